@@ -20,6 +20,7 @@ uint32_t check_possible_restore(PAR3_CTX *par3_ctx);
 
 
 // For repair
+int check_using_packet(PAR3_CTX *par3_ctx, uint64_t lost_count, uint64_t *unusable_count);
 int make_block_list(PAR3_CTX *par3_ctx, uint64_t lost_count, uint32_t lost_count_cohort);
 int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count);
 int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_count);
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "packet.h"
+#include "read.h"
+
 // Data Packets substitute for lost input blocks.
 int substitute_input_block(PAR3_CTX *par3_ctx)
 {
@@ -439,8 +442,12 @@ uint32_t check_possible_restore(PAR3_CTX *par3_ctx)
 
 	possible_count = 0;
 	for (file_index = 0; file_index < file_count; file_index++){
+		// This input file isn't selected to repair.
+		if (file_list[file_index].state & 0x800){
+			continue;
+
 		// This input file is misnamed.
-		if (file_list[file_index].state & 4){
+		} else if (file_list[file_index].state & 4){
 			// Misnamed file will be corrected later.
 			//printf("misnamed file[%u]\n", file_index);
 			possible_count++;
@@ -486,14 +493,310 @@ uint32_t check_possible_restore(PAR3_CTX *par3_ctx)
 	return possible_count;
 }
 
+// Compare position of Recovery Data Packets
+static int compare_packet_position(const void *a, const void *b)
+{
+	PAR3_PKT_CTX *packet_a, *packet_b;
+
+	packet_a = *((PAR3_PKT_CTX **)a);
+	packet_b = *((PAR3_PKT_CTX **)b);
+
+	// Names are stored in the list of PAR files, so they are sorted by pointer.
+	if (packet_a->name < packet_b->name)
+		return -1;
+	if (packet_a->name > packet_b->name)
+		return 1;
+	if (packet_a->offset < packet_b->offset)
+		return -1;
+	if (packet_a->offset > packet_b->offset)
+		return 1;
+	return 0;
+}
+
+// Select using recovery blocks, which are stored in less files and near positions.
+// Because any recovery blocks can be used, it prefers files with many blocks.
+// Selected blocks are sorted by file and offset, so that repair reads them in order.
+static int select_recovery_block(PAR3_CTX *par3_ctx, int *recv_id, uint64_t lost_count)
+{
+	uint8_t *packet_checksum, *flag_list;
+	uint64_t count, index, id, need;
+	uint64_t run_start, run_end, best_start, best_count, best_span;
+	uint64_t start, span;
+	PAR3_PKT_CTX **index_list, **list;
+
+	// Get checksum of using Matrix Packet
+	packet_checksum = par3_ctx->matrix_packet + par3_ctx->matrix_packet_offset + 8;
+
+	// List the first position of each recovery block in using Matrix Packet.
+	index_list = par3_ctx->recv_index_list;
+	list = malloc(sizeof(PAR3_PKT_CTX *) * par3_ctx->recv_index_count + par3_ctx->recv_index_count);
+	if (list == NULL){
+		perror("Failed to allocate memory for selecting recovery blocks");
+		return RET_MEMORY_ERROR;
+	}
+	flag_list = (uint8_t *)(list + par3_ctx->recv_index_count);
+	count = 0;
+	for (index = 0; index < par3_ctx->recv_index_count; index++){
+		if (memcmp(index_list[index]->matrix, packet_checksum, 16) != 0)
+			continue;
+		if ( (count > 0) && (list[count - 1]->index == index_list[index]->index) )
+			continue;	// Other copies are not used at first.
+		list[count++] = index_list[index];
+	}
+	qsort(list, (size_t)count, sizeof(PAR3_PKT_CTX *), compare_packet_position);
+	memset(flag_list, 0, (size_t)count);
+
+	need = lost_count;
+	if (need > count)
+		need = count;
+	while (need > 0){
+		// Search the file with the most unselected blocks.
+		best_count = 0;
+		best_start = 0;
+		for (run_start = 0; run_start < count; run_start = run_end){
+			run_end = run_start + 1;
+			while ( (run_end < count) && (list[run_end]->name == list[run_start]->name) )
+				run_end++;
+			if (flag_list[run_start] == 0){
+				if (run_end - run_start > best_count){
+					best_count = run_end - run_start;
+					best_start = run_start;
+				}
+			}
+		}
+
+		if (best_count <= need){	// Select all blocks in the file.
+			memset(flag_list + best_start, 1, (size_t)best_count);
+			need -= best_count;
+			continue;
+		}
+
+		// When the rest fits in one file, select contiguous blocks in a file with the least seeking.
+		best_span = UINT64_MAX;
+		for (run_start = 0; run_start < count; run_start = run_end){
+			run_end = run_start + 1;
+			while ( (run_end < count) && (list[run_end]->name == list[run_start]->name) )
+				run_end++;
+			if ( (flag_list[run_start] != 0) || (run_end - run_start < need) )
+				continue;
+			for (start = run_start; start + need <= run_end; start++){
+				span = list[start + need - 1]->offset - list[start]->offset;
+				if (span < best_span){
+					best_span = span;
+					best_start = start;
+				}
+			}
+		}
+		memset(flag_list + best_start, 1, (size_t)need);
+		need = 0;
+	}
+
+	// Set index of using recovery blocks in order of position
+	id = 0;
+	for (index = 0; index < count; index++){
+		if (flag_list[index] != 0){
+			recv_id[id] = (int)(list[index]->index);
+			//printf("recv_id[%"PRIu64"] = %d\n", id, recv_id[id]);
+			id++;
+		}
+	}
+	free(list);
+
+	return 0;
+}
+
+// Compare position of reading blocks
+static int compare_read_position(const void *a, const void *b)
+{
+	int ret;
+	PAR3_READ_CTX *read_a, *read_b;
+
+	read_a = (PAR3_READ_CTX *)a;
+	read_b = (PAR3_READ_CTX *)b;
+
+	// Lost blocks are put at the last.
+	if (read_a->name == NULL){
+		if (read_b->name != NULL)
+			return 1;
+	} else if (read_b->name == NULL){
+		return -1;
+	} else {
+		ret = strcmp(read_a->name, read_b->name);
+		if (ret != 0)
+			return ret;
+		if (read_a->offset < read_b->offset)
+			return -1;
+		if (read_a->offset > read_b->offset)
+			return 1;
+	}
+	if (read_a->index < read_b->index)
+		return -1;
+	if (read_a->index > read_b->index)
+		return 1;
+	return 0;
+}
+
+// Make order of reading available input blocks, sorted by found file and offset.
+static int make_read_order(PAR3_CTX *par3_ctx)
+{
+	int64_t slice_index;
+	uint64_t block_size, block_count, block_index;
+	uint64_t *read_order;
+	PAR3_BLOCK_CTX *block_list;
+	PAR3_SLICE_CTX *slice_list;
+	PAR3_READ_CTX *read_list;
+
+	block_size = par3_ctx->block_size;
+	block_count = par3_ctx->block_count;
+	block_list = par3_ctx->block_list;
+	slice_list = par3_ctx->slice_list;
+
+	read_list = malloc(sizeof(PAR3_READ_CTX) * block_count);
+	if (read_list == NULL){
+		perror("Failed to allocate memory for order of reading blocks");
+		return RET_MEMORY_ERROR;
+	}
+	for (block_index = 0; block_index < block_count; block_index++){
+		read_list[block_index].name = NULL;
+		read_list[block_index].offset = 0;
+		read_list[block_index].index = block_index;
+
+		// Position of the first reading slice
+		slice_index = -1;
+		if (block_list[block_index].state & 4){	// Full size data is available.
+			slice_index = block_list[block_index].slice;
+			while (slice_index != -1){
+				if (slice_list[slice_index].size == block_size)
+					break;
+				slice_index = slice_list[slice_index].next;
+			}
+		} else if (block_list[block_index].state & 16){	// All tail data is available.
+			slice_index = block_list[block_index].slice;
+			while (slice_index != -1){
+				if (slice_list[slice_index].tail_offset == 0)
+					break;
+				slice_index = slice_list[slice_index].next;
+			}
+		}
+		if (slice_index != -1){
+			read_list[block_index].name = slice_list[slice_index].find_name;
+			read_list[block_index].offset = slice_list[slice_index].find_offset;
+		}
+	}
+	qsort(read_list, (size_t)block_count, sizeof(PAR3_READ_CTX), compare_read_position);
+
+	read_order = malloc(sizeof(uint64_t) * block_count);
+	if (read_order == NULL){
+		perror("Failed to allocate memory for order of reading blocks");
+		free(read_list);
+		return RET_MEMORY_ERROR;
+	}
+	for (block_index = 0; block_index < block_count; block_index++)
+		read_order[block_index] = read_list[block_index].index;
+	free(read_list);
+
+	if (par3_ctx->read_order != NULL)
+		free(par3_ctx->read_order);
+	par3_ctx->read_order = read_order;
+
+	return 0;
+}
+
+// Verify a recovery block, which will be used to repair.
+// When the packet is damaged, it tries another copy of same packet.
+// return 0 = usable, 1 = not found, 2 = all copies are damaged, others = error
+static int check_recovery_block(PAR3_CTX *par3_ctx, uint64_t block_index)
+{
+	int ret;
+	uint32_t copy_index;
+	PAR3_PKT_CTX *packet_p;
+
+	for (copy_index = 0; ; copy_index++){
+		packet_p = find_recv_packet(par3_ctx, block_index, copy_index);
+		if (packet_p == NULL)
+			return (copy_index == 0) ? 1 : 2;
+		ret = check_recv_packet(par3_ctx, packet_p);
+		if (ret != 0)
+			return ret;
+		if (packet_p->checked > 0)
+			return 0;
+	}
+}
+
+// Verify checksum of Recovery Data Packets, which will be used to repair.
+// Other packets are not read, because they are useless.
+// Damaged packets are removed from the lists, and unusable_count is set to number of lost recovery blocks.
+// When it's not zero, recovery blocks must be aggregated and selected again.
+int check_using_packet(PAR3_CTX *par3_ctx, uint64_t lost_count, uint64_t *unusable_count)
+{
+	int *recv_id, ret;
+	uint32_t cohort_count, cohort_index, *lost_list, *recv_list, found_count;
+	uint64_t index, damaged_count, max_recovery_block2;
+
+	damaged_count = 0;
+	if (par3_ctx->interleave == 0){
+		// Verify the same blocks as make_block_list() selects.
+		recv_id = (int *) malloc(sizeof(int) * lost_count);
+		if (recv_id == NULL){
+			printf("Failed to make list for using blocks\n");
+			return RET_MEMORY_ERROR;
+		}
+		ret = select_recovery_block(par3_ctx, recv_id, lost_count);
+		if (ret != 0){
+			free(recv_id);
+			return ret;
+		}
+		for (index = 0; index < lost_count; index++){
+			ret = check_recovery_block(par3_ctx, recv_id[index]);
+			if (ret == 2){
+				damaged_count++;
+			} else if (ret != 0){
+				free(recv_id);
+				return ret;
+			}
+		}
+		free(recv_id);
+
+	} else {
+		// Verify the same blocks as recover_lost_block_cohort() reads.
+		// It uses recovery blocks in order of index, and skips unusable ones.
+		cohort_count = (uint32_t)(par3_ctx->interleave) + 1;
+		max_recovery_block2 = par3_ctx->max_recovery_block / cohort_count;
+		lost_list = par3_ctx->lost_list;
+		recv_list = lost_list + cohort_count;
+		for (cohort_index = 0; cohort_index < cohort_count; cohort_index++){
+			if ( (lost_list[cohort_index] == 0) || (lost_list[cohort_index] > recv_list[cohort_index]) )
+				continue;
+			found_count = 0;
+			for (index = 0; (index < max_recovery_block2) && (found_count < lost_list[cohort_index]); index++){
+				ret = check_recovery_block(par3_ctx, index * cohort_count + cohort_index);
+				if (ret == 0){
+					found_count++;
+				} else if (ret == 2){
+					damaged_count++;
+				} else if (ret != 1){
+					return ret;
+				}
+			}
+		}
+	}
+
+	*unusable_count = damaged_count;
+	if (par3_ctx->noise_level >= 0){
+		if (damaged_count > 0)
+			printf("%"PRIu64" recovery blocks are damaged.\n", damaged_count);
+	}
+
+	// Remove damaged packets, even when another copy is usable.
+	return remove_damaged_packet(par3_ctx);
+}
+
 // Make list of index for lost input blocks and using recovery blocks.
 int make_block_list(PAR3_CTX *par3_ctx, uint64_t lost_count, uint32_t lost_count_cohort)
 {
-	uint8_t *packet_checksum;
-	int *recv_id;
+	int *recv_id, ret;
 	uint64_t count, index, id;
 	PAR3_BLOCK_CTX *block_list;
-	PAR3_PKT_CTX *packet_list;
 
 	if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Codes
 		// Make list of index (lost input blocks and using recovery blocks)
@@ -520,27 +823,18 @@ int make_block_list(PAR3_CTX *par3_ctx, uint64_t lost_count, uint32_t lost_count
 	if (par3_ctx->interleave > 0)
 		return 0;
 
-	// Get checksum of using Matrix Packet
-	packet_checksum = par3_ctx->matrix_packet + par3_ctx->matrix_packet_offset + 8;
-
 	// Set index of using recovery blocks
-	packet_list = par3_ctx->recv_packet_list;
-	count = par3_ctx->recv_packet_count;
-	id = 0;
-	for (index = 0; index < count; index++){
-		// Search only Recovery Data Packets belong to using Matrix Packet
-		if (memcmp(packet_list[index].matrix, packet_checksum, 16) == 0){
-			recv_id[id] = (int)(packet_list[index].index);
-			//printf("recv_id[%"PRIu64"] = %d\n", id, recv_id[id]);
-			id++;
-
-			// If there are more blocks than required, just ignore them.
-			// Cauchy Matrix should be invertible always.
-			// Or, is it safe to keep more for full rank ?
-			if (id >= lost_count)
-				break;
-		}
-	}
+	// If there are more blocks than required, just ignore them.
+	// Cauchy Matrix should be invertible always.
+	// Or, is it safe to keep more for full rank ?
+	ret = select_recovery_block(par3_ctx, recv_id, lost_count);
+	if (ret != 0)
+		return ret;
+
+	// Input blocks are read in order of position also.
+	ret = make_read_order(par3_ctx);
+	if (ret != 0)
+		return ret;
 
 	if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Codes
 		int *lost_id = recv_id + lost_count;
@@ -582,6 +876,8 @@ uint64_t aggregate_block_cohort(PAR3_CTX *par3_ctx, uint32_t *lost_count_cohort,
 	cohort_count = par3_ctx->interleave + 1;
 
 	// Allocate memory and zero fill
+	if (par3_ctx->lost_list != NULL)	// When it aggregates again after removing damaged packets.
+		free(par3_ctx->lost_list);
 	lost_list = (uint32_t *) calloc(cohort_count * 2, sizeof(uint32_t));
 	recv_list = lost_list + cohort_count;
 	par3_ctx->lost_list = lost_list;	// Store here to refer and release later
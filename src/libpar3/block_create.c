@@ -1,23 +1,39 @@
 #include "libpar3.h"
 
+#include "../blake3/blake3.h"
 #include "../leopard/leopard.h"
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "galois.h"
 #include "hash.h"
+#include "io_batch.h"
+#include "packet.h"
 #include "reedsolomon.h"
+#include "write.h"
+
 
+// Max size of input blocks to read at once, while all recovery blocks are kept on memory.
+#define CREATE_READ_SIZE (16 * 1048576)
 
 // When it uses Reed-Solomon Erasure Codes, it tries to allocate memory for all recovery blocks.
 int allocate_recovery_block(PAR3_CTX *par3_ctx)
 {
 	size_t alloc_size, region_size;
 
+	// When it was allocated at mapping input blocks, no need to allocate again.
+	if (par3_ctx->galois_table != NULL)
+		return 0;
+
 	// Allocate tables before blocks.
 	if (par3_ctx->galois_poly == 0x1100B){	// 16-bit Galois Field (0x1100B).
 		par3_ctx->galois_table = gf16_create_table(par3_ctx->galois_poly);
@@ -61,12 +77,13 @@ int allocate_recovery_block(PAR3_CTX *par3_ctx)
 // GF tables and recovery blocks were allocated already.
 int create_recovery_block(PAR3_CTX *par3_ctx)
 {
-	uint8_t *work_buf;
+	uint8_t *work_buf, *buf_p;
 	uint8_t gf_size;
-	int galois_poly;
+	int galois_poly, ret, flag_add;
 	int block_count, block_index;
+	int batch_count, batch_start, batch_end;
 	int progress_old, progress_now;
-	uint32_t file_index, file_prev;
+	uint32_t file_index;
 	size_t block_size, region_size;
 	size_t data_size, read_size;
 	size_t tail_offset, tail_gap;
@@ -74,7 +91,7 @@ int create_recovery_block(PAR3_CTX *par3_ctx)
 	PAR3_FILE_CTX *file_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_BLOCK_CTX *block_list;
-	FILE *fp;
+	PAR3_IO_CTX io;
 	time_t time_old, time_now;
 	clock_t clock_now;
 
@@ -97,15 +114,37 @@ int create_recovery_block(PAR3_CTX *par3_ctx)
 	slice_list = par3_ctx->slice_list;
 	block_list = par3_ctx->block_list;
 
-	// Allocate memory to read one input block and parity.
+	// When some input blocks were multiplied at mapping, add values on them.
+	flag_add = 0;
+	for (block_index = 0; block_index < block_count; block_index++){
+		if (block_list[block_index].state & 0x200)
+			flag_add++;
+	}
+	// When all input blocks were multiplied already, there is nothing to read.
+	if (flag_add == block_count)
+		return 0;
+	if (flag_add > 0)
+		flag_add = 1;
+
+	// Allocate memory to read some input blocks and parity at once.
 	region_size = (block_size + 4 + 3) & ~3;
-	work_buf = malloc(region_size);
+	batch_count = (int)(CREATE_READ_SIZE / region_size);
+	if (batch_count < 1)
+		batch_count = 1;
+	if (batch_count > block_count)
+		batch_count = block_count;
+	work_buf = malloc(region_size * batch_count);
 	if (work_buf == NULL){
 		perror("Failed to allocate memory for input data");
 		return RET_MEMORY_ERROR;
 	}
 	par3_ctx->work_buf = work_buf;
 
+	// Reads of input blocks in a batch may be in flight at once.
+	ret = io_batch_open(par3_ctx, &io, work_buf, region_size * batch_count);
+	if (ret != 0)
+		return ret;
+
 	if (par3_ctx->noise_level >= 0){
 		printf("\nComputing recovery blocks:\n");
 		progress_old = 0;
@@ -114,156 +153,158 @@ int create_recovery_block(PAR3_CTX *par3_ctx)
 	}
 
 	// Reed-Solomon Erasure Codes
-	file_prev = 0xFFFFFFFF;
-	fp = NULL;
-	for (block_index = 0; block_index < block_count; block_index++){
-		// Read each input block from input files.
-		data_size = block_list[block_index].size;
-		if (block_list[block_index].state & 1){	// including full size data
-			slice_index = block_list[block_index].slice;
-			while (slice_index != -1){
-				if (slice_list[slice_index].size == block_size)
-					break;
-				slice_index = slice_list[slice_index].next;
-			}
-			if (slice_index == -1){	// When there is no valid slice.
-				printf("Mapping information for block[%d] is wrong.\n", block_index);
-				if (fp != NULL)
-					fclose(fp);
-				return RET_LOGIC_ERROR;
-			}
-
-			// Read one slice from a file.
-			file_index = slice_list[slice_index].file;
-			file_offset = slice_list[slice_index].offset;
-			read_size = data_size;
-			if (par3_ctx->noise_level >= 3){
-				printf("Reading %zu bytes of slice[%"PRId64"] for input block[%d]\n", read_size, slice_index, block_index);
-			}
-			if ( (fp == NULL) || (file_index != file_prev) ){
-				if (fp != NULL){	// Close previous input file.
-					fclose(fp);
-					fp = NULL;
-				}
-				fp = fopen(file_list[file_index].name, "rb");
-				if (fp == NULL){
-					perror("Failed to open Input File");
-					return RET_FILE_IO_ERROR;
-				}
-				file_prev = file_index;
-			}
-			if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-				perror("Failed to seek Input File");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-			if (fread(work_buf, 1, read_size, fp) != read_size){
-				perror("Failed to read slice on Input File");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
+	for (batch_start = 0; batch_start < block_count; batch_start = batch_end){
+		batch_end = batch_start + batch_count;
+		if (batch_end > block_count)
+			batch_end = block_count;
+
+		// Read input blocks of this batch from input files.
+		buf_p = work_buf;
+		for (block_index = batch_start; block_index < batch_end; block_index++){
+			// Skip input block, which was multiplied already.
+			if (block_list[block_index].state & 0x200){
+				buf_p += region_size;
+				continue;
 			}
 
-		} else {	// tail data only (one tail or packed tails)
-			if (par3_ctx->noise_level >= 3){
-				printf("Reading %"PRIu64" bytes for input block[%d]\n", data_size, block_index);
-			}
-			tail_offset = 0;
-			while (tail_offset < data_size){	// Read tails until data end.
+			data_size = block_list[block_index].size;
+			if (block_list[block_index].state & 1){	// including full size data
 				slice_index = block_list[block_index].slice;
 				while (slice_index != -1){
-					//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
-					// Even when chunk tails are overlaped, it will find tail slice of next position.
-					if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
-							&& (slice_list[slice_index].tail_offset <= tail_offset) ){
+					if (slice_list[slice_index].size == block_size)
 						break;
-					}
 					slice_index = slice_list[slice_index].next;
 				}
 				if (slice_index == -1){	// When there is no valid slice.
 					printf("Mapping information for block[%d] is wrong.\n", block_index);
-					if (fp != NULL)
-						fclose(fp);
+					io_batch_close(&io);
 					return RET_LOGIC_ERROR;
 				}
 
 				// Read one slice from a file.
-				tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
-				//printf("tail_gap for slice[%"PRId64"] = %zu.\n", slice_index, tail_gap);
 				file_index = slice_list[slice_index].file;
-				file_offset = slice_list[slice_index].offset + tail_gap;
-				read_size = slice_list[slice_index].size - tail_gap;
-				if ( (fp == NULL) || (file_index != file_prev) ){
-					if (fp != NULL){	// Close previous input file.
-						fclose(fp);
-						fp = NULL;
-					}
-					fp = fopen(file_list[file_index].name, "rb");
-					if (fp == NULL){
-						perror("Failed to open Input File");
-						return RET_FILE_IO_ERROR;
-					}
-					file_prev = file_index;
+				file_offset = slice_list[slice_index].offset;
+				read_size = data_size;
+				if (par3_ctx->noise_level >= 3){
+					printf("Reading %zu bytes of slice[%"PRId64"] for input block[%d]\n", read_size, slice_index, block_index);
 				}
-				if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-					perror("Failed to seek Input File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
+				ret = io_batch_read(&io, file_list[file_index].name, file_offset, buf_p, read_size);
+				if (ret != 0){
+					io_batch_close(&io);
+					return ret;
 				}
-				if (fread(work_buf + tail_offset, 1, read_size, fp) != read_size){
-					perror("Failed to read tail slice on Input File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
+
+			} else {	// tail data only (one tail or packed tails)
+				if (par3_ctx->noise_level >= 3){
+					printf("Reading %"PRIu64" bytes for input block[%d]\n", data_size, block_index);
 				}
-				tail_offset += read_size;
-			}
-		}
-		// Zero fill rest bytes
-		memset(work_buf + data_size, 0, region_size - data_size);
+				tail_offset = 0;
+				while (tail_offset < data_size){	// Read tails until data end.
+					slice_index = block_list[block_index].slice;
+					while (slice_index != -1){
+						//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
+						// Even when chunk tails are overlaped, it will find tail slice of next position.
+						if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
+								&& (slice_list[slice_index].tail_offset <= tail_offset) ){
+							break;
+						}
+						slice_index = slice_list[slice_index].next;
+					}
+					if (slice_index == -1){	// When there is no valid slice.
+						printf("Mapping information for block[%d] is wrong.\n", block_index);
+						io_batch_close(&io);
+						return RET_LOGIC_ERROR;
+					}
 
-		// At creating time, CRC of a block was set, even when the block includes multiple chunk tails.
-		// It appends chunk tails as tail packing, and calculates their total CRC for the block.
-		// But, after verification, a block without full size data doesn't have valid CRC value.
-		if (block_list[block_index].state & 64){
-			// Calculate checksum of block to confirm that input file was not changed.
-			if (crc64(work_buf, data_size, 0) != block_list[block_index].crc){
-				printf("Checksum of block[%d] is different.\n", block_index);
-				fclose(fp);
-				return RET_LOGIC_ERROR;
+					// Read one slice from a file.
+					tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
+					//printf("tail_gap for slice[%"PRId64"] = %zu.\n", slice_index, tail_gap);
+					file_index = slice_list[slice_index].file;
+					file_offset = slice_list[slice_index].offset + tail_gap;
+					read_size = slice_list[slice_index].size - tail_gap;
+					ret = io_batch_read(&io, file_list[file_index].name, file_offset, buf_p + tail_offset, read_size);
+					if (ret != 0){
+						io_batch_close(&io);
+						return ret;
+					}
+					tail_offset += read_size;
+				}
 			}
+
+			buf_p += region_size;	// Goto next input block
 		}
 
-		// Calculate parity bytes in the region
-		if (gf_size == 2){
-			gf16_region_create_parity(galois_poly, work_buf, region_size);
-		} else if (gf_size == 1){
-			gf8_region_create_parity(galois_poly, work_buf, region_size);
-		} else {
-			region_create_parity(work_buf, region_size);
+		// Wait until all input blocks of this batch are read.
+		ret = io_batch_wait(&io);
+		if (ret != 0){
+			io_batch_close(&io);
+			return ret;
 		}
 
-		// Multipy one input block for all recovery blocks.
-		rs_create_one_all(par3_ctx, block_index);
+		buf_p = work_buf;
+		for (block_index = batch_start; block_index < batch_end; block_index++, buf_p += region_size){
+			// Skip input block, which was multiplied already.
+			if (block_list[block_index].state & 0x200)
+				continue;
 
-		// Print progress percent
-		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 1) ){
-			time_now = time(NULL);
-			if (time_now != time_old){
-				time_old = time_now;
-				// Because block_count is 16-bit value, "int" (32-bit signed integer) is enough.
-				progress_now = (block_index * 1000) / block_count;
-				if (progress_now != progress_old){
-					progress_old = progress_now;
-					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+			// Zero fill rest bytes
+			data_size = block_list[block_index].size;
+			memset(buf_p + data_size, 0, region_size - data_size);
+
+			// At creating time, CRC of a block was set, even when the block includes multiple chunk tails.
+			// It appends chunk tails as tail packing, and calculates their total CRC for the block.
+			// But, after verification, a block without full size data doesn't have valid CRC value.
+			if (block_list[block_index].state & 64){
+				// Calculate checksum of block to confirm that input file was not changed.
+				if (crc64(buf_p, data_size, 0) != block_list[block_index].crc){
+					printf("Checksum of block[%d] is different.\n", block_index);
+					io_batch_close(&io);
+					return RET_LOGIC_ERROR;
+				}
+			}
+
+			// Write the input block on Archive File, while it's read for recovery blocks.
+			if (par3_ctx->archive_stream != NULL){
+				ret = write_archive_block(par3_ctx, block_index, buf_p);
+				if (ret != 0){
+					io_batch_close(&io);
+					return ret;
+				}
+			}
+
+			// Calculate parity bytes in the region
+			if (gf_size == 2){
+				gf16_region_create_parity(galois_poly, buf_p, region_size);
+			} else if (gf_size == 1){
+				gf8_region_create_parity(galois_poly, buf_p, region_size);
+			} else {
+				region_create_parity(buf_p, region_size);
+			}
+
+			// Multipy one input block for all recovery blocks.
+			par3_ctx->work_buf = buf_p;	// Position of this input block
+			rs_create_one_all(par3_ctx, block_index, flag_add);
+			par3_ctx->work_buf = work_buf;
+			flag_add = 1;
+
+			// Print progress percent
+			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 1) ){
+				time_now = time(NULL);
+				if (time_now != time_old){
+					time_old = time_now;
+					// Because block_count is 16-bit value, "int" (32-bit signed integer) is enough.
+					progress_now = (block_index * 1000) / block_count;
+					if (progress_now != progress_old){
+						progress_old = progress_now;
+						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+					}
 				}
 			}
 		}
 	}
-	if (fp != NULL){
-		if (fclose(fp) != 0){
-			perror("Failed to close Input File");
-			return RET_FILE_IO_ERROR;
-		}
-	}
+	ret = io_batch_close(&io);
+	if (ret != 0)
+		return ret;
 
 	// Release allocated memory
 	free(work_buf);
@@ -278,66 +319,433 @@ int create_recovery_block(PAR3_CTX *par3_ctx)
 	return 0;
 }
 
-// This keeps all input blocks and recovery blocks partially by spliting every block.
-// GF tables and recovery blocks were allocated already.
-int create_recovery_block_split(PAR3_CTX *par3_ctx)
+// Size of BLAKE3 state to keep for each Recovery Data Packet.
+// Because a packet isn't so large, it stores only the used depth of the chaining value stack.
+static size_t packet_hash_size(uint64_t block_size)
+{
+	uint64_t chunk_count, stack_count;
+
+	chunk_count = (64 + block_size + BLAKE3_CHUNK_LEN - 1) / BLAKE3_CHUNK_LEN;
+	stack_count = 2;	// lazy merging may keep one more chaining value
+	while (((uint64_t)1 << (stack_count - 2)) < chunk_count)
+		stack_count++;
+
+	return (offsetof(blake3_hasher, cv_stack) + BLAKE3_OUT_LEN * stack_count + 7) & ~7;
+}
+
+// Start BLAKE3 state of every Recovery Data Packet from the packet header after checksum.
+static void init_packet_hash(PAR3_CTX *par3_ctx, uint8_t *hash_state, size_t state_size)
+{
+	uint8_t packet_header[88];
+	uint64_t block_index, recovery_index;
+	blake3_hasher hasher;
+
+	// Same items as write_recovery_packet()
+	memcpy(packet_header + 48, par3_ctx->root_packet + 8, 16);
+	memcpy(packet_header + 64, par3_ctx->matrix_packet + 8, 16);
+	for (block_index = 0; block_index < par3_ctx->recovery_block_count; block_index++){
+		make_packet_header(packet_header, 88 + par3_ctx->block_size, par3_ctx->set_id, (uint8_t *)"PAR REC\0", 0);
+		recovery_index = par3_ctx->first_recovery_block + block_index;
+		memcpy(packet_header + 80, &recovery_index, 8);
+
+		blake3_hasher_init(&hasher);
+		blake3_hasher_update(&hasher, packet_header + 24, 24 + 40);
+		memcpy(hash_state + state_size * block_index, &hasher, state_size);
+	}
+}
+
+// Add a part of recovery block to the BLAKE3 state.
+// At the last part, return checksum of the packet in "hash".
+static void update_packet_hash(uint8_t *state, size_t state_size, uint8_t *buf, size_t size, uint8_t *hash)
+{
+	blake3_hasher hasher;
+
+	memcpy(&hasher, state, state_size);
+	blake3_hasher_update(&hasher, buf, size);
+	if (hash != NULL){
+		blake3_hasher_finalize(&hasher, hash, 16);
+	} else {
+		memcpy(state, &hasher, state_size);
+	}
+}
+
+// Write checksum of Recovery Data Packet, after writing the last part of the packet.
+static int write_packet_hash(FILE *fp, int64_t packet_offset, uint8_t *hash)
+{
+	if (_fseeki64(fp, packet_offset + 8, SEEK_SET) != 0){
+		perror("Failed to seek Recovery File");
+		return RET_FILE_IO_ERROR;
+	}
+	if (fwrite(hash, 1, 16, fp) != 16){
+		perror("Failed to write checksum of Recovery Data Packet");
+		return RET_FILE_IO_ERROR;
+	}
+
+	return 0;
+}
+
+// Write a part of recovery blocks on recovery files.
+// Recovery blocks from "block_start" at every "block_step" are stored in "buf" in order.
+// This may run on another thread, while next part is computed.
+static int write_recovery_part(PAR3_CTX *par3_ctx, uint8_t *buf, uint64_t region_size,
+		uint64_t block_start, uint64_t block_step, uint64_t split_offset, uint64_t split_size,
+		uint8_t *hash_state, size_t state_size, FILE **fp_p, char **name_prev_p)
+{
+	char *file_name;
+	uint8_t gf_size, packet_hash[16];
+	int ret, galois_poly;
+	int64_t file_offset;
+	uint64_t block_index, block_size, part_size;
+	PAR3_POS_CTX *position_list;
+	FILE *fp;
+
+	block_size = par3_ctx->block_size;
+	gf_size = par3_ctx->gf_size;
+	galois_poly = par3_ctx->galois_poly;
+	position_list = par3_ctx->position_list;
+	fp = *fp_p;
+
+	part_size = block_size - split_offset;
+	if (part_size > split_size)
+		part_size = split_size;
+	ret = 0;
+	for (block_index = block_start; block_index < par3_ctx->recovery_block_count; block_index += block_step){
+		// Check parity of recovery block to confirm that calculation was correct.
+		if (par3_ctx->ecc_method & 8){
+			if (gf_size == 2){
+				ret = leo_region_check_parity(buf, region_size);
+			} else {
+				ret = region_check_parity(buf, region_size);
+			}
+		} else {
+			if (gf_size == 2){
+				ret = gf16_region_check_parity(galois_poly, buf, region_size);
+			} else if (gf_size == 1){
+				ret = gf8_region_check_parity(galois_poly, buf, region_size);
+			} else {
+				ret = region_check_parity(buf, region_size);
+			}
+		}
+		if (ret != 0){
+			printf("Parity of recovery block[%"PRIu64"] is different.\n", block_index);
+			ret = RET_LOGIC_ERROR;
+			break;
+		}
+
+		// Position of Recovery Data Packet in recovery file
+		file_name = position_list[block_index].name;
+		file_offset = position_list[block_index].offset + 88 + split_offset;
+
+		// Calculate checksum of packet data while writing.
+		if (split_offset + split_size >= block_size){	// At the last
+			update_packet_hash(hash_state + state_size * block_index, state_size, buf, part_size, packet_hash);
+		} else {
+			update_packet_hash(hash_state + state_size * block_index, state_size, buf, part_size, NULL);
+		}
+
+		// Write partial recovery block
+		if ( (fp == NULL) || (file_name != *name_prev_p) ){
+			if (fp != NULL){	// Close previous recovery file.
+				fclose(fp);
+				fp = NULL;
+			}
+			fp = fopen(file_name, "r+b");	// Over-write on existing file
+			if (fp == NULL){
+				perror("Failed to open Recovery File");
+				ret = RET_FILE_IO_ERROR;
+				break;
+			}
+			*name_prev_p = file_name;
+		}
+		if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
+			perror("Failed to seek Recovery File");
+			ret = RET_FILE_IO_ERROR;
+			break;
+		}
+		if (fwrite(buf, 1, part_size, fp) != part_size){
+			perror("Failed to write Recovery Block on Recovery File");
+			ret = RET_FILE_IO_ERROR;
+			break;
+		}
+		if (split_offset + split_size >= block_size){
+			ret = write_packet_hash(fp, position_list[block_index].offset, packet_hash);
+			if (ret != 0)
+				break;
+		}
+
+		buf += region_size;
+	}
+
+	*fp_p = fp;
+	return ret;
+}
+
+// Read a part of all input blocks, and create the part of all recovery blocks on memory.
+static int create_recovery_part(PAR3_CTX *par3_ctx, PAR3_IO_CTX *io_p, uint8_t *block_data,
+		uint64_t region_size, uint64_t split_offset, uint64_t split_size,
+		uint32_t work_count, const void **original_data, void **work_data,
+		uint64_t progress_total, uint64_t *progress_step_p)
 {
-	char *name_prev, *file_name;
-	uint8_t *block_data, *buf_p;
+	uint8_t *buf_p;
 	uint8_t gf_size;
 	int ret, galois_poly;
 	int progress_old, progress_now;
-	uint32_t split_count;
-	uint32_t file_index, file_prev;
+	uint32_t file_index;
 	size_t io_size;
 	int64_t slice_index, file_offset;
 	uint64_t crc, block_index;
 	uint64_t block_size, block_count;
-	uint64_t recovery_block_count, first_recovery_block, max_recovery_block;
-	uint64_t alloc_size, region_size, split_size;
-	uint64_t data_size, part_size, split_offset;
+	uint64_t recovery_block_count, max_recovery_block;
+	uint64_t data_size, part_size;
 	uint64_t tail_offset, tail_gap;
-	uint64_t progress_total, progress_step;
 	PAR3_FILE_CTX *file_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_BLOCK_CTX *block_list;
-	PAR3_POS_CTX *position_list;
-	FILE *fp;
 	time_t time_old, time_now;
-	clock_t clock_now;
-
-	// For Leopard-RS library
-	uint32_t work_count;
-	const void **original_data = NULL;
-	void **work_data = NULL;
 
 	block_size = par3_ctx->block_size;
 	block_count = par3_ctx->block_count;
 	recovery_block_count = par3_ctx->recovery_block_count;
-	first_recovery_block = par3_ctx->first_recovery_block;
 	max_recovery_block = par3_ctx->max_recovery_block;
 	gf_size = par3_ctx->gf_size;
 	galois_poly = par3_ctx->galois_poly;
 	file_list = par3_ctx->input_file_list;
 	slice_list = par3_ctx->slice_list;
 	block_list = par3_ctx->block_list;
-	position_list = par3_ctx->position_list;
 
-	if (recovery_block_count == 0)
-		return RET_LOGIC_ERROR;
+	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+		progress_old = 0;
+		time_old = time(NULL);
+	}
 
-	// Set required memory size at first
-	if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
-		ret = leo_init();	// Initialize Leopard-RS library.
-		if (ret != 0){
-			printf("Failed to initialize Leopard-RS library (%d)\n", ret);
-			return RET_LOGIC_ERROR;
-		}
-		work_count = leo_encode_work_count((uint32_t)block_count, (uint32_t)max_recovery_block);
-		// max_recovery_block is equal or larger than (first_recovery_block + recovery_block_count).
-		//printf("Leopard-RS: work_count = %u\n", work_count);
-		// Leopard-RS requires multiple of 64 bytes for SIMD.
-		region_size = (block_size + 4 + 63) & ~63;
+	buf_p = block_data;	// Starting position of input blocks
+
+	// Read all input blocks on memory
+	for (block_index = 0; block_index < block_count; block_index++){
+		// Read each input block from input files.
+		data_size = block_list[block_index].size;
+		part_size = data_size - split_offset;
+		if (part_size > split_size)
+			part_size = split_size;
+
+		if (block_list[block_index].state & 1){	// including full size data
+			slice_index = block_list[block_index].slice;
+			while (slice_index != -1){
+				if (slice_list[slice_index].size == block_size)
+					break;
+				slice_index = slice_list[slice_index].next;
+			}
+			if (slice_index == -1){	// When there is no valid slice.
+				printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
+				return RET_LOGIC_ERROR;
+			}
+
+			// Read a part of slice from a file.
+			file_index = slice_list[slice_index].file;
+			file_offset = slice_list[slice_index].offset + split_offset;
+			io_size = part_size;
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
+			}
+			ret = io_batch_read(io_p, file_list[file_index].name, file_offset, buf_p, io_size);
+			if (ret != 0){
+				return ret;
+			}
+
+		} else if (data_size > split_offset){	// tail data only (one tail or packed tails)
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
+			}
+			tail_offset = split_offset;
+			while (tail_offset < split_offset + part_size){	// Read tails until data end.
+				slice_index = block_list[block_index].slice;
+				while (slice_index != -1){
+					//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
+					// Even when chunk tails are overlaped, it will find tail slice of next position.
+					if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
+							&& (slice_list[slice_index].tail_offset <= tail_offset) ){
+						break;
+					}
+					slice_index = slice_list[slice_index].next;
+				}
+				if (slice_index == -1){	// When there is no valid slice.
+					printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
+					return RET_LOGIC_ERROR;
+				}
+
+				// Read one slice from a file.
+				tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
+				file_index = slice_list[slice_index].file;
+				file_offset = slice_list[slice_index].offset + tail_gap;
+				io_size = slice_list[slice_index].size - tail_gap;
+				if (io_size > part_size)
+					io_size = part_size;
+				//printf("tail_gap for slice[%"PRId64"] = %zu, io_size = %zu\n", slice_index, tail_gap, io_size);
+				ret = io_batch_read(io_p, file_list[file_index].name, file_offset, buf_p + tail_offset - split_offset, io_size);
+				if (ret != 0){
+					return ret;
+				}
+				tail_offset += io_size;
+			}
+		}
+
+		buf_p += region_size;	// Goto next partial block
+	}
+
+	// Wait until all input blocks are read.
+	ret = io_batch_wait(io_p);
+	if (ret != 0){
+		return ret;
+	}
+
+	// Check and prepare all input blocks on memory
+	buf_p = block_data;
+	for (block_index = 0; block_index < block_count; block_index++){
+		data_size = block_list[block_index].size;
+		part_size = data_size - split_offset;
+		if (part_size > split_size)
+			part_size = split_size;
+
+		if ( ((block_list[block_index].state & 1) == 0) && (data_size <= split_offset) ){
+			// Zero fill partial input block
+			memset(buf_p, 0, region_size);
+		}
+
+		// Calculate checksum of block to confirm that input file was not changed.
+		if (split_offset == 0){
+			crc = 0;
+		} else {
+			memcpy(&crc, block_list[block_index].hash, 8);	// Use previous CRC value
+		}
+		if (data_size > split_offset){	// When there is slice data to process.
+			memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
+			crc = crc64(buf_p, part_size, crc);
+
+			// When whole input block is on memory, write it on Archive File before parity changes the layout.
+			if ( (par3_ctx->archive_stream != NULL) && (split_size >= block_size) ){
+				if ( (block_list[block_index].state & 64) && (crc != block_list[block_index].crc) ){
+					printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
+					return RET_LOGIC_ERROR;
+				}
+				ret = write_archive_block(par3_ctx, block_index, buf_p);
+				if (ret != 0)
+					return ret;
+			}
+
+			// Calculate parity bytes in the region
+			if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+				if (gf_size == 2){
+					leo_region_create_parity(buf_p, region_size);
+				} else {
+					region_create_parity(buf_p, region_size);
+				}
+			} else {
+				if (gf_size == 2){
+					gf16_region_create_parity(galois_poly, buf_p, region_size);
+				} else if (gf_size == 1){
+					gf8_region_create_parity(galois_poly, buf_p, region_size);
+				} else {
+					region_create_parity(buf_p, region_size);
+				}
+			}
+		}
+		// Intermediate CRC value is stored in "block_list[block_index].hash".
+		if (block_list[block_index].state & 64){
+			if (split_offset + split_size >= block_size){	// At the last
+				if (crc != block_list[block_index].crc){
+					printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
+					return RET_LOGIC_ERROR;
+				}
+			} else {
+				memcpy(block_list[block_index].hash, &crc, 8);	// Save this CRC value
+			}
+		}
+
+		// Print progress percent
+		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+			(*progress_step_p)++;
+			time_now = time(NULL);
+			if (time_now != time_old){
+				time_old = time_now;
+				progress_now = (int)((*progress_step_p * 1000) / progress_total);
+				if (progress_now != progress_old){
+					progress_old = progress_now;
+					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+				}
+			}
+		}
+
+		buf_p += region_size;	// Goto next partial block
+	}
+
+	// Create all recovery blocks on memory
+	if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Codes
+		rs_create_all(par3_ctx, region_size, progress_total, *progress_step_p);
+
+	} else if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+		ret = leo_encode(region_size, (uint32_t)block_count, (uint32_t)max_recovery_block, work_count, original_data, work_data);
+		if (ret != 0){
+			printf("Failed to call Leopard-RS library (%d)\n", ret);
+			return RET_LOGIC_ERROR;
+		}
+
+	}
+	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+		*progress_step_p += block_count * recovery_block_count;
+	}
+
+	return 0;
+}
+
+// This keeps all input blocks and recovery blocks partially by spliting every block.
+// GF tables and recovery blocks were allocated already.
+int create_recovery_block_split(PAR3_CTX *par3_ctx)
+{
+	char *name_prev;
+	uint8_t *block_data, *buf_p, *recv_p, *write_buf, *hash_state;
+	uint8_t gf_size;
+	int ret, write_ret, max_level;
+	uint32_t split_count;
+	size_t state_size;
+	uint64_t block_index;
+	uint64_t block_size, block_count;
+	uint64_t recovery_block_count, first_recovery_block, max_recovery_block;
+	uint64_t alloc_size, region_size, split_size;
+	uint64_t split_offset, write_offset;
+	uint64_t progress_total, progress_step;
+	PAR3_POS_CTX *position_list;
+	FILE *fp;
+	PAR3_IO_CTX io;
+	clock_t clock_now;
+
+	// For Leopard-RS library
+	uint32_t work_count;
+	const void **original_data = NULL;
+	void **work_data = NULL;
+
+	block_size = par3_ctx->block_size;
+	block_count = par3_ctx->block_count;
+	recovery_block_count = par3_ctx->recovery_block_count;
+	first_recovery_block = par3_ctx->first_recovery_block;
+	max_recovery_block = par3_ctx->max_recovery_block;
+	gf_size = par3_ctx->gf_size;
+	position_list = par3_ctx->position_list;
+
+	if (recovery_block_count == 0)
+		return RET_LOGIC_ERROR;
+
+	// Set required memory size at first
+	if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+		ret = leo_init();	// Initialize Leopard-RS library.
+		if (ret != 0){
+			printf("Failed to initialize Leopard-RS library (%d)\n", ret);
+			return RET_LOGIC_ERROR;
+		}
+		work_count = leo_encode_work_count((uint32_t)block_count, (uint32_t)max_recovery_block);
+		// max_recovery_block is equal or larger than (first_recovery_block + recovery_block_count).
+		//printf("Leopard-RS: work_count = %u\n", work_count);
+		// Leopard-RS requires multiple of 64 bytes for SIMD.
+		region_size = (block_size + 4 + 63) & ~63;
 		alloc_size = region_size * (block_count + work_count);
 
 	} else {	// Reed-Solomon Erasure Codes
@@ -352,12 +760,18 @@ int create_recovery_block_split(PAR3_CTX *par3_ctx)
 
 	// Limited memory usage
 	if ( (par3_ctx->memory_limit > 0) && (alloc_size > par3_ctx->memory_limit) ){
+		// Another buffer keeps recovery blocks of previous part, while they are written.
+		alloc_size += region_size * recovery_block_count;
 		split_count = (uint32_t)((alloc_size + par3_ctx->memory_limit - 1) / par3_ctx->memory_limit);
 		split_size = (block_size + split_count - 1) / split_count;	// This is splitted block size to fit in limited memory.
 		if (gf_size == 2){
 			// aligned to 2 bytes for 16-bit Galois Field
 			split_size = (split_size + 1) & ~1;
 		}
+		if (split_size > BLAKE3_CHUNK_LEN){
+			// aligned to chunk size of BLAKE3, so that each split continues checksum at same position in a chunk
+			split_size &= ~((uint64_t)BLAKE3_CHUNK_LEN - 1);
+		}
 		if (split_size > block_size)
 			split_size = block_size;
 		split_count = (uint32_t)((block_size + split_size - 1) / split_size);
@@ -394,6 +808,16 @@ int create_recovery_block_split(PAR3_CTX *par3_ctx)
 	}
 	par3_ctx->block_data = block_data;
 
+	// Keep BLAKE3 state of every Recovery Data Packet to calculate checksum while writing.
+	state_size = packet_hash_size(block_size);
+	hash_state = malloc(state_size * recovery_block_count);
+	if (hash_state == NULL){
+		perror("Failed to allocate memory for checksum of Recovery Data Packet");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->work_buf = hash_state;
+	init_packet_hash(par3_ctx, hash_state, state_size);
+
 	if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 		// List of pointer
 		original_data = malloc(sizeof(void*) * (block_count + work_count));
@@ -423,35 +847,261 @@ int create_recovery_block_split(PAR3_CTX *par3_ctx)
 		par3_ctx->matrix = original_data;	// Release this later
 	}
 
+	// When block is split, recovery blocks of previous part are written while next part is computed.
+	// If memory isn't enough for the buffer, each part is written after computation.
+	write_buf = NULL;
+	if (split_count > 1)
+		write_buf = malloc(region_size * recovery_block_count);
+	if ( (write_buf != NULL) && (par3_ctx->noise_level >= 2) ){
+		printf("Buffer to write recovery blocks = %"PRIu64" * %"PRIu64"\n", region_size, recovery_block_count);
+	}
+
 	if (par3_ctx->noise_level >= 0){
 		printf("\nComputing recovery blocks:\n");
 		progress_total = (block_count * recovery_block_count + block_count + recovery_block_count) * split_count;
 		progress_step = 0;
-		progress_old = 0;
-		time_old = time(NULL);
 		clock_now = clock();
 	}
 
 	// This file access style would support all Error Correction Codes.
+	// Input blocks are read in batch, and multiple reads may be in flight.
+	ret = io_batch_open(par3_ctx, &io, block_data, region_size * block_count);
+	if (ret != 0){
+		free(write_buf);
+		return ret;
+	}
 	name_prev = NULL;
 	fp = NULL;
+	recv_p = block_data + region_size * block_count;	// Starting position of recovery blocks
+	write_offset = block_size;	// No part is waiting to be written.
 	for (split_offset = 0; split_offset < block_size; split_offset += split_size){
-		buf_p = block_data;	// Starting position of input blocks
-		file_prev = 0xFFFFFFFF;
+		if (write_offset < block_size){
+			// Previous part is written on another thread, while this part is computed.
+#if _OPENMP >= 200805
+			max_level = omp_get_max_active_levels();
+			if (max_level < 2)
+				omp_set_max_active_levels(2);	// Leopard-RS library uses threads inside.
+#elif defined(_OPENMP)
+			max_level = omp_get_nested();
+			omp_set_nested(1);
+#endif
+			write_ret = 0;
+			#pragma omp parallel sections num_threads(2)
+			{
+				#pragma omp section
+				ret = create_recovery_part(par3_ctx, &io, block_data, region_size, split_offset, split_size,
+						work_count, original_data, work_data, progress_total, &progress_step);
+				#pragma omp section
+				write_ret = write_recovery_part(par3_ctx, write_buf, region_size, 0, 1, write_offset, split_size,
+						hash_state, state_size, &fp, &name_prev);
+			}
+#if _OPENMP >= 200805
+			omp_set_max_active_levels(max_level);
+#elif defined(_OPENMP)
+			omp_set_nested(max_level);
+#endif
+			if (ret == 0)
+				ret = write_ret;
+			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) )
+				progress_step += recovery_block_count;
+			write_offset = block_size;
+		} else {
+			ret = create_recovery_part(par3_ctx, &io, block_data, region_size, split_offset, split_size,
+					work_count, original_data, work_data, progress_total, &progress_step);
+		}
+		if (ret != 0){
+			if (fp != NULL)
+				fclose(fp);
+			io_batch_close(&io);
+			free(write_buf);
+			return ret;
+		}
 
-		// Read all input blocks on memory
-		for (block_index = 0; block_index < block_count; block_index++){
-			// Read each input block from input files.
-			data_size = block_list[block_index].size;
-			part_size = data_size - split_offset;
-			if (part_size > split_size)
-				part_size = split_size;
+		if ( (write_buf != NULL) && (split_offset + split_size < block_size) ){
+			// Keep this part to write while next part is computed.
+			memcpy(write_buf, recv_p, region_size * recovery_block_count);
+			write_offset = split_offset;
+		} else {
+			// Write all recovery blocks on recovery files
+			ret = write_recovery_part(par3_ctx, recv_p, region_size, 0, 1, split_offset, split_size,
+					hash_state, state_size, &fp, &name_prev);
+			if (ret != 0){
+				if (fp != NULL)
+					fclose(fp);
+				io_batch_close(&io);
+				free(write_buf);
+				return ret;
+			}
+			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) )
+				progress_step += recovery_block_count;
+		}
+	}
+	free(write_buf);
+	ret = io_batch_close(&io);
+	if (ret != 0){
+		if (fp != NULL)
+			fclose(fp);
+		return ret;
+	}
 
-			if (block_list[block_index].state & 1){	// including full size data
+/*
+{	// for debug
+FILE *fp2;
+buf_p = block_data + region_size * block_count;	// Starting position of recovery blocks
+
+fp2 = fopen("test.bin", "wb");
+fwrite(buf_p, 1, region_size * recovery_block_count, fp2);
+fclose(fp2);
+}
+*/
+
+	free(block_data);
+	par3_ctx->block_data = NULL;
+
+	// Checksum of every Recovery Data Packet was written already.
+	if (fp != NULL){
+		if (fclose(fp) != 0){
+			perror("Failed to close Recovery File");
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	if (par3_ctx->noise_level >= 0){
+		if (par3_ctx->noise_level <= 2){
+			if (progress_step < progress_total)
+				printf("Didn't finish progress. %"PRIu64" / %"PRIu64"\n", progress_step, progress_total);
+		}
+		clock_now = clock() - clock_now;
+		printf("done in %.1f seconds.\n", (double)clock_now / CLOCKS_PER_SEC);
+		printf("\n");
+	}
+
+	// Release some allocated memory
+	free(hash_state);
+	par3_ctx->work_buf = NULL;
+	free(position_list);
+	par3_ctx->position_list = NULL;
+	if (par3_ctx->matrix){
+		free(par3_ctx->matrix);
+		par3_ctx->matrix = NULL;
+	}
+
+	return 0;
+}
+
+// Read a part of input blocks in the cohort, and create the part of recovery blocks in the cohort on memory.
+static int create_cohort_part(PAR3_CTX *par3_ctx, uint8_t *block_data, uint64_t region_size,
+		uint32_t cohort_index, uint64_t split_offset, uint64_t split_size,
+		uint32_t work_count, const void **original_data, void **work_data,
+		uint64_t progress_total, uint64_t *progress_step_p)
+{
+	uint8_t *buf_p;
+	uint8_t gf_size;
+	int ret;
+	int progress_old, progress_now;
+	uint32_t file_index, file_prev;
+	uint32_t cohort_count;
+	size_t io_size;
+	int64_t slice_index, file_offset;
+	uint64_t crc, block_index;
+	uint64_t block_size, block_count;
+	uint64_t block_count2, recovery_block_count2, max_recovery_block2;
+	uint64_t data_size, part_size;
+	uint64_t tail_offset, tail_gap;
+	PAR3_FILE_CTX *file_list;
+	PAR3_SLICE_CTX *slice_list;
+	PAR3_BLOCK_CTX *block_list;
+	FILE *fp;
+	time_t time_old, time_now;
+
+	block_size = par3_ctx->block_size;
+	block_count = par3_ctx->block_count;
+	gf_size = par3_ctx->gf_size;
+	file_list = par3_ctx->input_file_list;
+	slice_list = par3_ctx->slice_list;
+	block_list = par3_ctx->block_list;
+
+	// Set count for each cohort
+	cohort_count = (uint32_t)(par3_ctx->interleave) + 1;
+	block_count2 = (block_count + cohort_count - 1) / cohort_count;	// round up
+	recovery_block_count2 = par3_ctx->recovery_block_count / cohort_count;
+	max_recovery_block2 = par3_ctx->max_recovery_block / cohort_count;
+
+	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+		progress_old = 0;
+		time_old = time(NULL);
+	}
+
+	fp = NULL;
+	buf_p = block_data;	// Starting position of input blocks
+	file_prev = 0xFFFFFFFF;
+
+	// Read all input blocks belong to the cohort on memory
+	for (block_index = cohort_index; block_index < block_count; block_index += cohort_count){
+		// Read each input block from input files.
+		data_size = block_list[block_index].size;
+		part_size = data_size - split_offset;
+		if (part_size > split_size)
+			part_size = split_size;
+
+		if (block_list[block_index].state & 1){	// including full size data
+			slice_index = block_list[block_index].slice;
+			while (slice_index != -1){
+				if (slice_list[slice_index].size == block_size)
+					break;
+				slice_index = slice_list[slice_index].next;
+			}
+			if (slice_index == -1){	// When there is no valid slice.
+				printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
+				if (fp != NULL)
+					fclose(fp);
+				return RET_LOGIC_ERROR;
+			}
+
+			// Read a part of slice from a file.
+			file_index = slice_list[slice_index].file;
+			file_offset = slice_list[slice_index].offset + split_offset;
+			io_size = part_size;
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
+			}
+			if ( (fp == NULL) || (file_index != file_prev) ){
+				if (fp != NULL){	// Close previous input file.
+					fclose(fp);
+					fp = NULL;
+				}
+				fp = fopen(file_list[file_index].name, "rb");
+				if (fp == NULL){
+					perror("Failed to open Input File");
+					return RET_FILE_IO_ERROR;
+				}
+				file_prev = file_index;
+			}
+			if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
+				perror("Failed to seek Input File");
+				fclose(fp);
+				return RET_FILE_IO_ERROR;
+			}
+			if (fread(buf_p, 1, io_size, fp) != io_size){
+				perror("Failed to read slice on Input File");
+				fclose(fp);
+				return RET_FILE_IO_ERROR;
+			}
+
+		} else if (data_size > split_offset){	// tail data only (one tail or packed tails)
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
+			}
+			tail_offset = split_offset;
+			while (tail_offset < split_offset + part_size){	// Read tails until data end.
 				slice_index = block_list[block_index].slice;
 				while (slice_index != -1){
-					if (slice_list[slice_index].size == block_size)
+					//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
+					// Even when chunk tails are overlaped, it will find tail slice of next position.
+					if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
+							&& (slice_list[slice_index].tail_offset <= tail_offset) ){
 						break;
+					}
 					slice_index = slice_list[slice_index].next;
 				}
 				if (slice_index == -1){	// When there is no valid slice.
@@ -461,13 +1111,14 @@ int create_recovery_block_split(PAR3_CTX *par3_ctx)
 					return RET_LOGIC_ERROR;
 				}
 
-				// Read a part of slice from a file.
+				// Read one slice from a file.
+				tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
 				file_index = slice_list[slice_index].file;
-				file_offset = slice_list[slice_index].offset + split_offset;
-				io_size = part_size;
-				if (par3_ctx->noise_level >= 3){
-					printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
-				}
+				file_offset = slice_list[slice_index].offset + tail_gap;
+				io_size = slice_list[slice_index].size - tail_gap;
+				if (io_size > part_size)
+					io_size = part_size;
+				//printf("tail_gap for slice[%"PRId64"] = %zu, io_size = %zu\n", slice_index, tail_gap, io_size);
 				if ( (fp == NULL) || (file_index != file_prev) ){
 					if (fp != NULL){	// Close previous input file.
 						fclose(fp);
@@ -485,332 +1136,86 @@ int create_recovery_block_split(PAR3_CTX *par3_ctx)
 					fclose(fp);
 					return RET_FILE_IO_ERROR;
 				}
-				if (fread(buf_p, 1, io_size, fp) != io_size){
-					perror("Failed to read slice on Input File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
-				}
-
-			} else if (data_size > split_offset){	// tail data only (one tail or packed tails)
-				if (par3_ctx->noise_level >= 3){
-					printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
-				}
-				tail_offset = split_offset;
-				while (tail_offset < split_offset + part_size){	// Read tails until data end.
-					slice_index = block_list[block_index].slice;
-					while (slice_index != -1){
-						//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
-						// Even when chunk tails are overlaped, it will find tail slice of next position.
-						if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
-								&& (slice_list[slice_index].tail_offset <= tail_offset) ){
-							break;
-						}
-						slice_index = slice_list[slice_index].next;
-					}
-					if (slice_index == -1){	// When there is no valid slice.
-						printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-						if (fp != NULL)
-							fclose(fp);
-						return RET_LOGIC_ERROR;
-					}
-
-					// Read one slice from a file.
-					tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
-					file_index = slice_list[slice_index].file;
-					file_offset = slice_list[slice_index].offset + tail_gap;
-					io_size = slice_list[slice_index].size - tail_gap;
-					if (io_size > part_size)
-						io_size = part_size;
-					//printf("tail_gap for slice[%"PRId64"] = %zu, io_size = %zu\n", slice_index, tail_gap, io_size);
-					if ( (fp == NULL) || (file_index != file_prev) ){
-						if (fp != NULL){	// Close previous input file.
-							fclose(fp);
-							fp = NULL;
-						}
-						fp = fopen(file_list[file_index].name, "rb");
-						if (fp == NULL){
-							perror("Failed to open Input File");
-							return RET_FILE_IO_ERROR;
-						}
-						file_prev = file_index;
-					}
-					if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-						perror("Failed to seek Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-					if (fread(buf_p + tail_offset - split_offset, 1, io_size, fp) != io_size){
-						perror("Failed to read tail slice on Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-					tail_offset += io_size;
-				}
-
-			} else {	// Zero fill partial input block
-				memset(buf_p, 0, region_size);
-			}
-
-			// Calculate checksum of block to confirm that input file was not changed.
-			if (split_offset == 0){
-				crc = 0;
-			} else {
-				memcpy(&crc, block_list[block_index].hash, 8);	// Use previous CRC value
-			}
-			if (data_size > split_offset){	// When there is slice data to process.
-				memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
-				crc = crc64(buf_p, part_size, crc);
-
-				// Calculate parity bytes in the region
-				if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
-					if (gf_size == 2){
-						leo_region_create_parity(buf_p, region_size);
-					} else {
-						region_create_parity(buf_p, region_size);
-					}
-				} else {
-					if (gf_size == 2){
-						gf16_region_create_parity(galois_poly, buf_p, region_size);
-					} else if (gf_size == 1){
-						gf8_region_create_parity(galois_poly, buf_p, region_size);
-					} else {
-						region_create_parity(buf_p, region_size);
-					}
-				}
-			}
-			// Intermediate CRC value is stored in "block_list[block_index].hash".
-			if (block_list[block_index].state & 64){
-				if (split_offset + split_size >= block_size){	// At the last
-					if (crc != block_list[block_index].crc){
-						printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
-						fclose(fp);
-						return RET_LOGIC_ERROR;
-					}
-				} else {
-					memcpy(block_list[block_index].hash, &crc, 8);	// Save this CRC value
-				}
-			}
-
-			// Print progress percent
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step++;
-				time_now = time(NULL);
-				if (time_now != time_old){
-					time_old = time_now;
-					progress_now = (int)((progress_step * 1000) / progress_total);
-					if (progress_now != progress_old){
-						progress_old = progress_now;
-						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-					}
-				}
-			}
-
-			buf_p += region_size;	// Goto next partial block
-		}
-		if (fp != NULL){
-			if (fclose(fp) != 0){
-				perror("Failed to close Input File");
-				return RET_FILE_IO_ERROR;
-			}
-			fp = NULL;
-		}
-
-		// Create all recovery blocks on memory
-		if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Codes
-			rs_create_all(par3_ctx, region_size, progress_total, progress_step);
-
-		} else if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
-			ret = leo_encode(region_size, (uint32_t)block_count, (uint32_t)max_recovery_block, work_count, original_data, work_data);
-			if (ret != 0){
-				printf("Failed to call Leopard-RS library (%d)\n", ret);
-				return RET_LOGIC_ERROR;
-			}
-
-		}
-		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-			progress_step += block_count * recovery_block_count;
-			time_old = time(NULL);
-		}
-
-		// Write all recovery blocks on recovery files
-		part_size = block_size - split_offset;
-		if (part_size > split_size)
-			part_size = split_size;
-		io_size = part_size;
-		buf_p = block_data + region_size * block_count;	// Starting position of recovery blocks
-		for (block_index = 0; block_index < recovery_block_count; block_index++){
-			// Check parity of recovery block to confirm that calculation was correct.
-			if (par3_ctx->ecc_method & 8){
-				if (gf_size == 2){
-					ret = leo_region_check_parity(buf_p, region_size);
-				} else {
-					ret = region_check_parity(buf_p, region_size);
-				}
-			} else {
-				if (gf_size == 2){
-					ret = gf16_region_check_parity(galois_poly, buf_p, region_size);
-				} else if (gf_size == 1){
-					ret = gf8_region_check_parity(galois_poly, buf_p, region_size);
-				} else {
-					ret = region_check_parity(buf_p, region_size);
-				}
-			}
-			if (ret != 0){
-				printf("Parity of recovery block[%"PRIu64"] is different.\n", block_index);
-				if (fp != NULL)
-					fclose(fp);
-				return RET_LOGIC_ERROR;
-			}
-
-			// Position of Recovery Data Packet in recovery file
-			file_name = position_list[block_index].name;
-			file_offset = position_list[block_index].offset + 88 + split_offset;
-
-			// Calculate CRC of packet data to check error later.
-			position_list[block_index].crc = crc64(buf_p, part_size, position_list[block_index].crc);
-
-			// Write partial recovery block
-			if ( (fp == NULL) || (file_name != name_prev) ){
-				if (fp != NULL){	// Close previous recovery file.
-					fclose(fp);
-					fp = NULL;
-				}
-				fp = fopen(file_name, "r+b");	// Over-write on existing file
-				if (fp == NULL){
-					perror("Failed to open Recovery File");
-					return RET_FILE_IO_ERROR;
-				}
-				name_prev = file_name;
-			}
-			if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-				perror("Failed to seek Recovery File");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-			if (fwrite(buf_p, 1, part_size, fp) != part_size){
-				perror("Failed to write Recovery Block on Recovery File");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-
-			// Print progress percent
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step++;
-				time_now = time(NULL);
-				if (time_now != time_old){
-					time_old = time_now;
-					progress_now = (int)((progress_step * 1000) / progress_total);
-					if (progress_now != progress_old){
-						progress_old = progress_now;
-						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-					}
+				if (fread(buf_p + tail_offset - split_offset, 1, io_size, fp) != io_size){
+					perror("Failed to read tail slice on Input File");
+					fclose(fp);
+					return RET_FILE_IO_ERROR;
 				}
+				tail_offset += io_size;
 			}
 
-			buf_p += region_size;
+		} else {	// Zero fill partial input block
+			memset(buf_p, 0, region_size);
 		}
-	}
-
-/*
-{	// for debug
-FILE *fp2;
-buf_p = block_data + region_size * block_count;	// Starting position of recovery blocks
-
-fp2 = fopen("test.bin", "wb");
-fwrite(buf_p, 1, region_size * recovery_block_count, fp2);
-fclose(fp2);
-}
-*/
-
-	free(block_data);
-	par3_ctx->block_data = NULL;
 
-	// Allocate memory to read one Recovery Data Packet.
-	alloc_size = 80 + block_size;
-	buf_p = malloc(alloc_size);
-	if (buf_p == NULL){
-		perror("Failed to allocate memory for Recovery Data Packet");
-		return RET_MEMORY_ERROR;
-	}
-	par3_ctx->work_buf = buf_p;
-
-	// Calculate checksum of every Recovery Data Packet
-	io_size = 64 + block_size;	// packet header after checksum and packet body
-	for (block_index = 0; block_index < recovery_block_count; block_index++){
-		// Position of Recovery Data Packet in recovery file
-		file_name = position_list[block_index].name;
-		file_offset = position_list[block_index].offset + 8;	// Offset of checksum
+		// Calculate checksum of block to confirm that input file was not changed.
+		if (split_offset == 0){
+			crc = 0;
+		} else {
+			memcpy(&crc, block_list[block_index].hash, 8);	// Use previous CRC value
+		}
+		if (data_size > split_offset){	// When there is slice data to process.
+			memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
+			crc = crc64(buf_p, part_size, crc);
 
-		// Read packet data and write checksum
-		if ( (fp == NULL) || (file_name != name_prev) ){
-			if (fp != NULL){	// Close previous recovery file.
-				fclose(fp);
-				fp = NULL;
-			}
-			fp = fopen(file_name, "r+b");	// Over-write on existing file
-			if (fp == NULL){
-				perror("Failed to open Recovery File");
-				return RET_FILE_IO_ERROR;
+			// Calculate parity bytes in the region
+			if (gf_size == 2){
+				leo_region_create_parity(buf_p, region_size);
+			} else {
+				region_create_parity(buf_p, region_size);
 			}
-			name_prev = file_name;
-		}
-		if (_fseeki64(fp, file_offset + 16, SEEK_SET) != 0){
-			perror("Failed to seek Recovery File");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
 		}
-		if (fread(buf_p + 16, 1, io_size, fp) != io_size){
-			perror("Failed to read Recovery Data Packet");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
+		if (block_list[block_index].state & 64){
+			if (split_offset + split_size >= block_size){	// At the last
+				if (crc != block_list[block_index].crc){
+					printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
+					fclose(fp);
+					return RET_LOGIC_ERROR;
+				}
+			} else {
+				memcpy(block_list[block_index].hash, &crc, 8);	// Save this CRC value
+			}
 		}
 
-		// Compare CRC of written packet data to confirm integrity.
-		crc = crc64(buf_p + 16, io_size, 0);
-		if (crc != position_list[block_index].crc){
-			printf("Packet data of recovery block[%"PRIu64"] is different.\n", block_index);
-			fclose(fp);
-			return RET_LOGIC_ERROR;
+		// Print progress percent
+		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+			(*progress_step_p)++;
+			time_now = time(NULL);
+			if (time_now != time_old){
+				time_old = time_now;
+				progress_now = (int)((*progress_step_p * 1000) / progress_total);
+				if (progress_now != progress_old){
+					progress_old = progress_now;
+					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+				}
+			}
 		}
 
-		// Calculate checksum of this packet
-		blake3(buf_p + 16, io_size, buf_p);
-
-		// Write checksum
-		if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-			perror("Failed to seek Recovery File");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
-		}
-		if (fwrite(buf_p, 1, 16, fp) != 16){
-			perror("Failed to write checksum of Recovery Data Packet");
-			fclose(fp);
+		buf_p += region_size;	// Goto next partial block
+	}
+	if (fp != NULL){
+		if (fclose(fp) != 0){
+			perror("Failed to close Input File");
 			return RET_FILE_IO_ERROR;
 		}
+		fp = NULL;
 	}
-	if (fclose(fp) != 0){
-		perror("Failed to close Recovery File");
-		return RET_FILE_IO_ERROR;
+
+	// When the last input block doesn't exist in this cohort, zero fill it.
+	if (block_index < block_count2 * cohort_count){
+		//printf("zero fill %"PRIu64", block_count2 * cohort_count = %"PRIu64"\n", block_index, block_count2 * cohort_count);
+		memset(buf_p, 0, region_size);
 	}
 
-	if (par3_ctx->noise_level >= 0){
-		if (par3_ctx->noise_level <= 2){
-			if (progress_step < progress_total)
-				printf("Didn't finish progress. %"PRIu64" / %"PRIu64"\n", progress_step, progress_total);
-		}
-		clock_now = clock() - clock_now;
-		printf("done in %.1f seconds.\n", (double)clock_now / CLOCKS_PER_SEC);
-		printf("\n");
+	// Create all recovery blocks on memory
+	ret = leo_encode(region_size, (uint32_t)block_count2, (uint32_t)max_recovery_block2, work_count, original_data, work_data);
+	if (ret != 0){
+		printf("Failed to call Leopard-RS library (%d)\n", ret);
+		return RET_LOGIC_ERROR;
 	}
 
-	// Release some allocated memory
-	free(buf_p);
-	par3_ctx->work_buf = NULL;
-	free(position_list);
-	par3_ctx->position_list = NULL;
-	if (par3_ctx->matrix){
-		free(par3_ctx->matrix);
-		par3_ctx->matrix = NULL;
+	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+		*progress_step_p += block_count2 * recovery_block_count2;
 	}
 
 	return 0;
@@ -822,29 +1227,21 @@ fclose(fp2);
 // GF tables and recovery blocks were allocated already.
 int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 {
-	char *name_prev, *file_name;
-	uint8_t *block_data, *buf_p;
+	char *name_prev;
+	uint8_t *block_data, *buf_p, *recv_p, *write_buf, *hash_state;
 	uint8_t gf_size;
-	int ret, galois_poly;
-	int progress_old, progress_now;
+	int ret, write_ret, max_level;
 	uint32_t split_count;
-	uint32_t file_index, file_prev;
-	uint32_t cohort_count, cohort_index;
-	size_t io_size;
-	int64_t slice_index, file_offset;
-	uint64_t crc, block_index;
+	uint32_t cohort_count, cohort_index, write_cohort;
+	size_t state_size;
+	uint64_t block_index;
 	uint64_t block_size, block_count, recovery_block_count;
 	uint64_t block_count2, recovery_block_count2, first_recovery_block2, max_recovery_block2;
 	uint64_t alloc_size, region_size, split_size;
-	uint64_t data_size, part_size, split_offset;
-	uint64_t tail_offset, tail_gap;
+	uint64_t split_offset, write_offset;
 	uint64_t progress_total, progress_step;
-	PAR3_FILE_CTX *file_list;
-	PAR3_SLICE_CTX *slice_list;
-	PAR3_BLOCK_CTX *block_list;
 	PAR3_POS_CTX *position_list;
 	FILE *fp;
-	time_t time_old, time_now;
 	clock_t clock_now;
 
 	// For Leopard-RS library
@@ -856,10 +1253,6 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 	block_count = par3_ctx->block_count;
 	recovery_block_count = par3_ctx->recovery_block_count;
 	gf_size = par3_ctx->gf_size;
-	galois_poly = par3_ctx->galois_poly;
-	file_list = par3_ctx->input_file_list;
-	slice_list = par3_ctx->slice_list;
-	block_list = par3_ctx->block_list;
 	position_list = par3_ctx->position_list;
 
 	if (recovery_block_count == 0)
@@ -887,6 +1280,7 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 	// Leopard-RS requires multiple of 64 bytes for SIMD.
 	region_size = (block_size + 4 + 63) & ~63;
 	alloc_size = region_size * (block_count2 + work_count);
+	alloc_size += region_size * recovery_block_count2;	// Buffer to write recovery blocks of previous part
 
 	// for test split
 	//par3_ctx->memory_limit = (alloc_size + 1) / 2;
@@ -900,6 +1294,10 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 			// aligned to 2 bytes for 16-bit Galois Field
 			split_size = (split_size + 1) & ~1;
 		}
+		if (split_size > BLAKE3_CHUNK_LEN){
+			// aligned to chunk size of BLAKE3, so that each split continues checksum at same position in a chunk
+			split_size &= ~((uint64_t)BLAKE3_CHUNK_LEN - 1);
+		}
 		if (split_size > block_size)
 			split_size = block_size;
 		split_count = (uint32_t)((block_size + split_size - 1) / split_size);
@@ -927,6 +1325,16 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 	}
 	par3_ctx->block_data = block_data;
 
+	// Keep BLAKE3 state of every Recovery Data Packet to calculate checksum while writing.
+	state_size = packet_hash_size(block_size);
+	hash_state = malloc(state_size * recovery_block_count);
+	if (hash_state == NULL){
+		perror("Failed to allocate memory for checksum of Recovery Data Packet");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->work_buf = hash_state;
+	init_packet_hash(par3_ctx, hash_state, state_size);
+
 	// List of pointer
 	original_data = malloc(sizeof(void*) * (block_count2 + work_count));
 	if (original_data == NULL){
@@ -954,17 +1362,25 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 	}
 	par3_ctx->matrix = original_data;	// Release this later
 
+	// Recovery blocks of previous part are written while next part is computed.
+	// If memory isn't enough for the buffer, each part is written after computation.
+	write_buf = malloc(region_size * recovery_block_count2);
+	if ( (write_buf != NULL) && (par3_ctx->noise_level >= 2) ){
+		printf("Buffer to write recovery blocks = %"PRIu64" * %"PRIu64"\n", region_size, recovery_block_count2);
+	}
+
 	if (par3_ctx->noise_level >= 0){
 		printf("\nComputing recovery blocks:\n");
 		progress_total = (block_count2 * recovery_block_count + block_count + recovery_block_count) * split_count;
 		progress_step = 0;
-		progress_old = 0;
-		time_old = time(NULL);
 		clock_now = clock();
 	}
 
 	name_prev = NULL;
 	fp = NULL;
+	recv_p = block_data + region_size * block_count2;	// Starting position of recovery blocks
+	write_offset = block_size;	// No part is waiting to be written.
+	write_cohort = 0;
 	// Process each cohort
 	for (cohort_index = 0; cohort_index < cohort_count; cohort_index++){
 		if ( (cohort_count < 10) && (par3_ctx->noise_level >= 1) ){
@@ -976,261 +1392,68 @@ int create_recovery_block_cohort(PAR3_CTX *par3_ctx)
 		}
 		for (split_offset = 0; split_offset < block_size; split_offset += split_size){
 			//printf("cohort_index = %u, split_offset = %"PRIu64"\n", cohort_index, split_offset);
-			buf_p = block_data;	// Starting position of input blocks
-			file_prev = 0xFFFFFFFF;
-
-			// Read all input blocks belong to the cohort on memory
-			for (block_index = cohort_index; block_index < block_count; block_index += cohort_count){
-				// Read each input block from input files.
-				data_size = block_list[block_index].size;
-				part_size = data_size - split_offset;
-				if (part_size > split_size)
-					part_size = split_size;
-
-				if (block_list[block_index].state & 1){	// including full size data
-					slice_index = block_list[block_index].slice;
-					while (slice_index != -1){
-						if (slice_list[slice_index].size == block_size)
-							break;
-						slice_index = slice_list[slice_index].next;
-					}
-					if (slice_index == -1){	// When there is no valid slice.
-						printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-						if (fp != NULL)
-							fclose(fp);
-						return RET_LOGIC_ERROR;
-					}
-
-					// Read a part of slice from a file.
-					file_index = slice_list[slice_index].file;
-					file_offset = slice_list[slice_index].offset + split_offset;
-					io_size = part_size;
-					if (par3_ctx->noise_level >= 3){
-						printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
-					}
-					if ( (fp == NULL) || (file_index != file_prev) ){
-						if (fp != NULL){	// Close previous input file.
-							fclose(fp);
-							fp = NULL;
-						}
-						fp = fopen(file_list[file_index].name, "rb");
-						if (fp == NULL){
-							perror("Failed to open Input File");
-							return RET_FILE_IO_ERROR;
-						}
-						file_prev = file_index;
-					}
-					if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-						perror("Failed to seek Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-					if (fread(buf_p, 1, io_size, fp) != io_size){
-						perror("Failed to read slice on Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-
-				} else if (data_size > split_offset){	// tail data only (one tail or packed tails)
-					if (par3_ctx->noise_level >= 3){
-						printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
-					}
-					tail_offset = split_offset;
-					while (tail_offset < split_offset + part_size){	// Read tails until data end.
-						slice_index = block_list[block_index].slice;
-						while (slice_index != -1){
-							//printf("block = %"PRIu64", size = %zu, offset = %zu, slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
-							// Even when chunk tails are overlaped, it will find tail slice of next position.
-							if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
-									&& (slice_list[slice_index].tail_offset <= tail_offset) ){
-								break;
-							}
-							slice_index = slice_list[slice_index].next;
-						}
-						if (slice_index == -1){	// When there is no valid slice.
-							printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-							if (fp != NULL)
-								fclose(fp);
-							return RET_LOGIC_ERROR;
-						}
-
-						// Read one slice from a file.
-						tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
-						file_index = slice_list[slice_index].file;
-						file_offset = slice_list[slice_index].offset + tail_gap;
-						io_size = slice_list[slice_index].size - tail_gap;
-						if (io_size > part_size)
-							io_size = part_size;
-						//printf("tail_gap for slice[%"PRId64"] = %zu, io_size = %zu\n", slice_index, tail_gap, io_size);
-						if ( (fp == NULL) || (file_index != file_prev) ){
-							if (fp != NULL){	// Close previous input file.
-								fclose(fp);
-								fp = NULL;
-							}
-							fp = fopen(file_list[file_index].name, "rb");
-							if (fp == NULL){
-								perror("Failed to open Input File");
-								return RET_FILE_IO_ERROR;
-							}
-							file_prev = file_index;
-						}
-						if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek Input File");
-							fclose(fp);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fread(buf_p + tail_offset - split_offset, 1, io_size, fp) != io_size){
-							perror("Failed to read tail slice on Input File");
-							fclose(fp);
-							return RET_FILE_IO_ERROR;
-						}
-						tail_offset += io_size;
-					}
-
-				} else {	// Zero fill partial input block
-					memset(buf_p, 0, region_size);
+			if (write_offset < block_size){
+				// Previous part is written on another thread, while this part is computed.
+#if _OPENMP >= 200805
+				max_level = omp_get_max_active_levels();
+				if (max_level < 2)
+					omp_set_max_active_levels(2);	// Leopard-RS library uses threads inside.
+#elif defined(_OPENMP)
+				max_level = omp_get_nested();
+				omp_set_nested(1);
+#endif
+				write_ret = 0;
+				#pragma omp parallel sections num_threads(2)
+				{
+					#pragma omp section
+					ret = create_cohort_part(par3_ctx, block_data, region_size, cohort_index, split_offset, split_size,
+							work_count, original_data, work_data, progress_total, &progress_step);
+					#pragma omp section
+					write_ret = write_recovery_part(par3_ctx, write_buf, region_size, write_cohort, cohort_count, write_offset, split_size,
+							hash_state, state_size, &fp, &name_prev);
 				}
-
-				// Calculate checksum of block to confirm that input file was not changed.
-				if (split_offset == 0){
-					crc = 0;
-				} else {
-					memcpy(&crc, block_list[block_index].hash, 8);	// Use previous CRC value
-				}
-				if (data_size > split_offset){	// When there is slice data to process.
-					memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
-					crc = crc64(buf_p, part_size, crc);
-
-					// Calculate parity bytes in the region
-					if (gf_size == 2){
-						leo_region_create_parity(buf_p, region_size);
-					} else {
-						region_create_parity(buf_p, region_size);
-					}
-				}
-				if (block_list[block_index].state & 64){
-					if (split_offset + split_size >= block_size){	// At the last
-						if (crc != block_list[block_index].crc){
-							printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
-							fclose(fp);
-							return RET_LOGIC_ERROR;
-						}
-					} else {
-						memcpy(block_list[block_index].hash, &crc, 8);	// Save this CRC value
-					}
-				}
-
-				// Print progress percent
-				if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-					progress_step++;
-					time_now = time(NULL);
-					if (time_now != time_old){
-						time_old = time_now;
-						progress_now = (int)((progress_step * 1000) / progress_total);
-						if (progress_now != progress_old){
-							progress_old = progress_now;
-							printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-						}
-					}
-				}
-
-				buf_p += region_size;	// Goto next partial block
-			}
-			if (fp != NULL){
-				if (fclose(fp) != 0){
-					perror("Failed to close Input File");
-					return RET_FILE_IO_ERROR;
-				}
-				fp = NULL;
-			}
-
-			// When the last input block doesn't exist in this cohort, zero fill it.
-			if (block_index < block_count2 * cohort_count){
-				//printf("zero fill %"PRIu64", block_count2 * cohort_count = %"PRIu64"\n", block_index, block_count2 * cohort_count);
-				memset(buf_p, 0, region_size);
+#if _OPENMP >= 200805
+				omp_set_max_active_levels(max_level);
+#elif defined(_OPENMP)
+				omp_set_nested(max_level);
+#endif
+				if (ret == 0)
+					ret = write_ret;
+				if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) )
+					progress_step += recovery_block_count2;
+				write_offset = block_size;
+			} else {
+				ret = create_cohort_part(par3_ctx, block_data, region_size, cohort_index, split_offset, split_size,
+						work_count, original_data, work_data, progress_total, &progress_step);
 			}
-
-			// Create all recovery blocks on memory
-			ret = leo_encode(region_size, (uint32_t)block_count2, (uint32_t)max_recovery_block2, work_count, original_data, work_data);
 			if (ret != 0){
-				printf("Failed to call Leopard-RS library (%d)\n", ret);
-				return RET_LOGIC_ERROR;
-			}
-
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step += block_count2 * recovery_block_count2;
-				time_old = time(NULL);
+				if (fp != NULL)
+					fclose(fp);
+				free(write_buf);
+				return ret;
 			}
 
-			// Write all recovery blocks on recovery files
-			part_size = block_size - split_offset;
-			if (part_size > split_size)
-				part_size = split_size;
-			io_size = part_size;
-			buf_p = block_data + region_size * block_count2;	// Starting position of recovery blocks
-			for (block_index = cohort_index; block_index < recovery_block_count; block_index += cohort_count){
-				// Check parity of recovery block to confirm that calculation was correct.
-				if (gf_size == 2){
-					ret = leo_region_check_parity(buf_p, region_size);
-				} else {
-					ret = region_check_parity(buf_p, region_size);
-				}
+			if ( (write_buf != NULL) && ( (cohort_index + 1 < cohort_count) || (split_offset + split_size < block_size) ) ){
+				// Keep this part to write while next part is computed.
+				memcpy(write_buf, recv_p, region_size * recovery_block_count2);
+				write_cohort = cohort_index;
+				write_offset = split_offset;
+			} else {
+				// Write all recovery blocks on recovery files
+				ret = write_recovery_part(par3_ctx, recv_p, region_size, cohort_index, cohort_count, split_offset, split_size,
+						hash_state, state_size, &fp, &name_prev);
 				if (ret != 0){
-					printf("Parity of recovery block[%"PRIu64"] is different.\n", block_index);
 					if (fp != NULL)
 						fclose(fp);
-					return RET_LOGIC_ERROR;
-				}
-
-				// Position of Recovery Data Packet in recovery file
-				file_name = position_list[block_index].name;
-				file_offset = position_list[block_index].offset + 88 + split_offset;
-
-				// Calculate CRC of packet data to check error later.
-				position_list[block_index].crc = crc64(buf_p, part_size, position_list[block_index].crc);
-
-				// Write partial recovery block
-				if ( (fp == NULL) || (file_name != name_prev) ){
-					if (fp != NULL){	// Close previous recovery file.
-						fclose(fp);
-						fp = NULL;
-					}
-					fp = fopen(file_name, "r+b");	// Over-write on existing file
-					if (fp == NULL){
-						perror("Failed to open Recovery File");
-						return RET_FILE_IO_ERROR;
-					}
-					name_prev = file_name;
-				}
-				if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-					perror("Failed to seek Recovery File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
+					free(write_buf);
+					return ret;
 				}
-				if (fwrite(buf_p, 1, part_size, fp) != part_size){
-					perror("Failed to write Recovery Block on Recovery File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
-				}
-
-				// Print progress percent
-				if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-					progress_step++;
-					time_now = time(NULL);
-					if (time_now != time_old){
-						time_old = time_now;
-						progress_now = (int)((progress_step * 1000) / progress_total);
-						if (progress_now != progress_old){
-							progress_old = progress_now;
-							printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-						}
-					}
-				}
-
-				buf_p += region_size;
+				if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) )
+					progress_step += recovery_block_count2;
 			}
 		}
 	}
+	free(write_buf);
 /*
 {	// for debug
 FILE *fp2;
@@ -1245,73 +1468,13 @@ fclose(fp2);
 	free(block_data);
 	par3_ctx->block_data = NULL;
 
-	// Allocate memory to read one Recovery Data Packet.
-	alloc_size = 80 + block_size;
-	buf_p = malloc(alloc_size);
-	if (buf_p == NULL){
-		perror("Failed to allocate memory for Recovery Data Packet");
-		return RET_MEMORY_ERROR;
-	}
-	par3_ctx->work_buf = buf_p;
-
-	// Calculate checksum of every Recovery Data Packet
-	io_size = 64 + block_size;	// packet header after checksum and packet body
-	for (block_index = 0; block_index < recovery_block_count; block_index++){
-		// Position of Recovery Data Packet in recovery file
-		file_name = position_list[block_index].name;
-		file_offset = position_list[block_index].offset + 8;	// Offset of checksum
-
-		// Read packet data and write checksum
-		if ( (fp == NULL) || (file_name != name_prev) ){
-			if (fp != NULL){	// Close previous recovery file.
-				fclose(fp);
-				fp = NULL;
-			}
-			fp = fopen(file_name, "r+b");	// Over-write on existing file
-			if (fp == NULL){
-				perror("Failed to open Recovery File");
-				return RET_FILE_IO_ERROR;
-			}
-			name_prev = file_name;
-		}
-		if (_fseeki64(fp, file_offset + 16, SEEK_SET) != 0){
-			perror("Failed to seek Recovery File");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
-		}
-		if (fread(buf_p + 16, 1, io_size, fp) != io_size){
-			perror("Failed to read Recovery Data Packet");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
-		}
-
-		// Compare CRC of written packet data to confirm integrity.
-		crc = crc64(buf_p + 16, io_size, 0);
-		if (crc != position_list[block_index].crc){
-			printf("Packet data of recovery block[%"PRIu64"] is different.\n", block_index);
-			fclose(fp);
-			return RET_LOGIC_ERROR;
-		}
-
-		// Calculate checksum of this packet
-		blake3(buf_p + 16, io_size, buf_p);
-
-		// Write checksum
-		if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-			perror("Failed to seek Recovery File");
-			fclose(fp);
-			return RET_FILE_IO_ERROR;
-		}
-		if (fwrite(buf_p, 1, 16, fp) != 16){
-			perror("Failed to write checksum of Recovery Data Packet");
-			fclose(fp);
+	// Checksum of every Recovery Data Packet was written already.
+	if (fp != NULL){
+		if (fclose(fp) != 0){
+			perror("Failed to close Recovery File");
 			return RET_FILE_IO_ERROR;
 		}
 	}
-	if (fclose(fp) != 0){
-		perror("Failed to close Recovery File");
-		return RET_FILE_IO_ERROR;
-	}
 
 	if (par3_ctx->noise_level >= 0){
 		if (par3_ctx->noise_level <= 2){
@@ -1324,7 +1487,7 @@ fclose(fp2);
 	}
 
 	// Release some allocated memory
-	free(buf_p);
+	free(hash_state);
 	par3_ctx->work_buf = NULL;
 	free(position_list);
 	par3_ctx->position_list = NULL;
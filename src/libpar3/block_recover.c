@@ -8,9 +8,75 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "galois.h"
 #include "hash.h"
+#include "io_batch.h"
+#include "packet.h"
+#include "read.h"
 #include "reedsolomon.h"
+#include "repair.h"
+
+
+// Read recovery data of a recovery block from Recovery Data Packet.
+// When it cannot read the packet, it tries another copy of same packet.
+static int read_recovery_data(PAR3_CTX *par3_ctx, FILE **fp_p, char **name_p,
+		uint64_t block_index, uint8_t *buf, size_t size)
+{
+	uint32_t copy_index;
+	int64_t file_offset;
+	PAR3_PKT_CTX *packet_p;
+
+	for (copy_index = 0; ; copy_index++){
+		packet_p = find_recv_packet(par3_ctx, block_index, copy_index);
+		if (packet_p == NULL){
+			if (copy_index == 0){
+				printf("Packet information for block[%"PRIu64"] is wrong.\n", block_index);
+				return RET_LOGIC_ERROR;
+			}
+			return RET_FILE_IO_ERROR;	// There is no other copy.
+		}
+		// Another copy may not be verified yet.
+		if (check_recv_packet(par3_ctx, packet_p) != 0)
+			return RET_MEMORY_ERROR;
+		if (packet_p->checked < 0)
+			continue;
+		if ( (copy_index > 0) && (par3_ctx->noise_level >= 1) ){
+			printf("Reading another copy of Recovery Data for recovery block[%"PRIu64"]\n", block_index);
+		}
+
+		// Read one Recovery Data Packet from a recovery file.
+		file_offset = packet_p->offset + 48 + 40;	// offset of the recovery block data
+		if (par3_ctx->noise_level >= 3){
+			printf("Reading Recovery Data for recovery block[%"PRIu64"] in \"%s\"\n", block_index, packet_p->name);
+		}
+		if ( (*fp_p == NULL) || (packet_p->name != *name_p) ){
+			if (*fp_p != NULL){	// Close previous file.
+				fclose(*fp_p);
+				*fp_p = NULL;
+			}
+			*fp_p = fopen(packet_p->name, "rb");
+			if (*fp_p == NULL){
+				perror("Failed to open recovery file");
+				continue;
+			}
+			*name_p = packet_p->name;
+		}
+		if (_fseeki64(*fp_p, file_offset, SEEK_SET) != 0){
+			perror("Failed to seek recovery file");
+			continue;
+		}
+		if (fread(buf, 1, size, *fp_p) != size){
+			perror("Failed to read recovery data on recovery file");
+			continue;
+		}
+
+		return 0;
+	}
+}
 
 
 /*
@@ -37,7 +103,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	uint8_t *block_data;
 	uint8_t gf_size;
 	int galois_poly, *lost_id, *recv_id;
-	int block_count, block_index;
+	int block_count, block_index, read_index;
 	int lost_index, ret;
 	int progress_old, progress_now, progress_step;
 	uint32_t file_count, file_index, file_prev;
@@ -46,13 +112,11 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	int64_t slice_index, file_offset;
 	uint64_t block_size, region_size, data_size;
 	uint64_t tail_offset, tail_gap;
-	uint64_t packet_count, packet_index;
 	uint64_t file_size, chunk_size;
 	PAR3_BLOCK_CTX *block_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_FILE_CTX *file_list;
-	PAR3_PKT_CTX *packet_list;
 	FILE *fp_read, *fp_write;
 	time_t time_old, time_now;
 	clock_t clock_now;
@@ -73,8 +137,6 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	slice_list = par3_ctx->slice_list;
 	chunk_list = par3_ctx->chunk_list;
 	file_list = par3_ctx->input_file_list;
-	packet_list = par3_ctx->recv_packet_list;
-	packet_count = par3_ctx->recv_packet_count;
 
 	region_size = (block_size + 4 + 3) & ~3;
 
@@ -107,7 +169,13 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	file_prev = 0xFFFFFFFF;
 	fp_read = NULL;
 	fp_write = NULL;
-	for (block_index = 0; block_index < block_count; block_index++){
+	for (read_index = 0; read_index < block_count; read_index++){
+		// Input blocks are read in order of position in files.
+		if (par3_ctx->read_order != NULL){
+			block_index = (int)(par3_ctx->read_order[read_index]);
+		} else {
+			block_index = read_index;
+		}
 		data_size = block_list[block_index].size;
 
 		// Read block data from found file.
@@ -237,7 +305,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 			while (slice_index != -1){
 				file_index = slice_list[slice_index].file;
 				// If belong file is missing or damaged.
-				if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+				if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 					// Write one lost slice on temporary file.
 					slice_size = slice_list[slice_index].size;
 					file_offset = slice_list[slice_index].offset;
@@ -250,8 +318,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 							fclose(fp_write);
 							fp_write = NULL;
 						}
-						sprintf(temp_path + 22, "%u.tmp", file_index);
-						fp_write = fopen(temp_path, "r+b");
+						fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 						if (fp_write == NULL){
 							perror("Failed to open temporary file");
 							if (fp_read != NULL)
@@ -260,19 +327,12 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 						}
 						file_prev = file_index;
 					}
-					if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-						perror("Failed to seek temporary file");
-						if (fp_read != NULL)
-							fclose(fp_read);
-						fclose(fp_write);
-						return RET_FILE_IO_ERROR;
-					}
-					if (fwrite(work_buf + tail_offset, 1, slice_size, fp_write) != slice_size){
-						perror("Failed to write slice on temporary file");
+					ret = write_repair_file(par3_ctx, fp_write, file_index, slice_index, file_offset, work_buf + tail_offset, slice_size);
+					if (ret != 0){
 						if (fp_read != NULL)
 							fclose(fp_read);
 						fclose(fp_write);
-						return RET_FILE_IO_ERROR;
+						return ret;
 					}
 				}
 
@@ -314,54 +374,14 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	for (lost_index = 0; lost_index < lost_count; lost_index++){
 		block_index = recv_id[lost_index];
 
-		// Search packet for the recovery block
-		for (packet_index = 0; packet_index < packet_count; packet_index++){
-			if (packet_list[packet_index].index == block_index)
-				break;
-		}
-		if (packet_index >= packet_count){
-			printf("Packet information for block[%d] is wrong.\n", block_index);
-			if (fp_read != NULL)
-				fclose(fp_read);
-			if (fp_write != NULL)
-				fclose(fp_write);
-			return RET_LOGIC_ERROR;
-		}
-
 		// Read one Recovery Data Packet from a recovery file.
-		slice_size = block_size;
-		file_name = packet_list[packet_index].name;
-		file_offset = packet_list[packet_index].offset + 48 + 40;	// offset of the recovery block data
-		if (par3_ctx->noise_level >= 3){
-			printf("Reading Recovery Data[%"PRIu64"] for recovery block[%d]\n", packet_index, block_index);
-		}
-		if ( (fp_read == NULL) || (file_name != name_prev) ){
-			if (fp_read != NULL){	// Close previous recovery file.
+		ret = read_recovery_data(par3_ctx, &fp_read, &name_prev, block_index, work_buf, block_size);
+		if (ret != 0){
+			if (fp_read != NULL)
 				fclose(fp_read);
-				fp_read = NULL;
-			}
-			fp_read = fopen(file_name, "rb");
-			if (fp_read == NULL){
-				perror("Failed to open recovery file");
-				if (fp_write != NULL)
-					fclose(fp_write);
-				return RET_FILE_IO_ERROR;
-			}
-			name_prev = file_name;
-		}
-		if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
-			perror("Failed to seek recovery file");
-			fclose(fp_read);
 			if (fp_write != NULL)
 				fclose(fp_write);
-			return RET_FILE_IO_ERROR;
-		}
-		if (fread(work_buf, 1, slice_size, fp_read) != slice_size){
-			perror("Failed to read recovery data on recovery file");
-			fclose(fp_read);
-			if (fp_write != NULL)
-				fclose(fp_write);
-			return RET_FILE_IO_ERROR;
+			return ret;
 		}
 		// Zero fill rest bytes
 		memset(work_buf + block_size, 0, region_size - block_size);
@@ -412,7 +432,9 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 		work_buf = block_data + region_size * lost_index;
 
 		// Check parity of recovered block to confirm that calculation was correct.
-		if (gf_size == 2){
+		if (block_list[block_index].state & 0x100){
+			ret = 0;	// This block wasn't recovered, because selected files don't use it.
+		} else if (gf_size == 2){
 			ret = gf16_region_check_parity(galois_poly, work_buf, region_size);
 		} else if (gf_size == 1){
 			ret = gf8_region_check_parity(galois_poly, work_buf, region_size);
@@ -430,7 +452,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 		while (slice_index != -1){
 			file_index = slice_list[slice_index].file;
 			// If belong file is missing or damaged.
-			if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+			if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 				// Write one lost slice on temporary file.
 				slice_size = slice_list[slice_index].size;
 				file_offset = slice_list[slice_index].offset;
@@ -443,23 +465,17 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 						fclose(fp_write);
 						fp_write = NULL;
 					}
-					sprintf(temp_path + 22, "%u.tmp", file_index);
-					fp_write = fopen(temp_path, "r+b");
+					fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 					if (fp_write == NULL){
 						perror("Failed to open temporary file");
 						return RET_FILE_IO_ERROR;
 					}
 					file_prev = file_index;
 				}
-				if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-					perror("Failed to seek temporary file");
-					fclose(fp_write);
-					return RET_FILE_IO_ERROR;
-				}
-				if (fwrite(work_buf + tail_offset, 1, slice_size, fp_write) != slice_size){
-					perror("Failed to write slice on temporary file");
+				ret = write_repair_file(par3_ctx, fp_write, file_index, slice_index, file_offset, work_buf + tail_offset, slice_size);
+				if (ret != 0){
 					fclose(fp_write);
-					return RET_FILE_IO_ERROR;
+					return ret;
 				}
 			}
 
@@ -471,7 +487,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	// Write chunk tails on input files
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 			file_size = 0;
 			chunk_index = file_list[file_index].chunk;		// index of the first chunk
 			chunk_num = file_list[file_index].chunk_num;	// number of chunk descriptions
@@ -492,8 +508,7 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 								fclose(fp_write);
 								fp_write = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp_write = fopen(temp_path, "r+b");
+							fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp_write == NULL){
 								perror("Failed to open temporary file");
 								return RET_FILE_IO_ERROR;
@@ -541,23 +556,17 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 								fclose(fp_write);
 								fp_write = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp_write = fopen(temp_path, "r+b");
+							fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp_write == NULL){
 								perror("Failed to open temporary file");
 								return RET_FILE_IO_ERROR;
 							}
 							file_prev = file_index;
 						}
-						if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek temporary file");
+						ret = write_repair_file(par3_ctx, fp_write, file_index, -1, file_offset, buf_tail, slice_size);
+						if (ret != 0){
 							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fwrite(buf_tail, 1, slice_size, fp_write) != slice_size){
-							perror("Failed to write tiny slice on temporary file");
-							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
+							return ret;
 						}
 					}
 				}
@@ -597,36 +606,138 @@ int recover_lost_block(PAR3_CTX *par3_ctx, char *temp_path, int lost_count)
 	return 0;
 }
 
+// Read available input blocks on memory.
+// Each block is stored at region_size interval in block_data.
+static int read_input_split(PAR3_CTX *par3_ctx, PAR3_IO_CTX *io_p, uint8_t *block_data,
+		uint64_t region_size, uint64_t split_offset, uint64_t split_size)
+{
+	char *file_name;
+	uint8_t *buf_p;
+	int ret;
+	size_t io_size;
+	int64_t slice_index, file_offset;
+	uint64_t block_index, read_index;
+	uint64_t block_size, block_count;
+	uint64_t data_size, part_size;
+	uint64_t tail_offset, tail_gap;
+	PAR3_BLOCK_CTX *block_list;
+	PAR3_SLICE_CTX *slice_list;
+
+	block_size = par3_ctx->block_size;
+	block_count = par3_ctx->block_count;
+	block_list = par3_ctx->block_list;
+	slice_list = par3_ctx->slice_list;
+
+	for (read_index = 0; read_index < block_count; read_index++){
+		// Input blocks are read in order of position in files.
+		if (par3_ctx->read_order != NULL){
+			block_index = par3_ctx->read_order[read_index];
+		} else {
+			block_index = read_index;
+		}
+		buf_p = block_data + region_size * block_index;	// Position of the input block
+		data_size = block_list[block_index].size;
+		part_size = data_size - split_offset;
+		if (part_size > split_size)
+			part_size = split_size;
+
+		// Read block data from found file.
+		if (block_list[block_index].state & 4){	// Full size data is available.
+			slice_index = block_list[block_index].slice;
+			while (slice_index != -1){
+				if (slice_list[slice_index].size == block_size)
+					break;
+				slice_index = slice_list[slice_index].next;
+			}
+			if (slice_index == -1){	// When there is no valid slice.
+				printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
+				return RET_LOGIC_ERROR;
+			}
+
+			// Read a part of slice from a file.
+			file_name = slice_list[slice_index].find_name;
+			file_offset = slice_list[slice_index].find_offset + split_offset;
+			io_size = part_size;
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
+			}
+			ret = io_batch_read(io_p, file_name, file_offset, buf_p, io_size);
+			if (ret != 0)
+				return ret;
+
+		// All tail data is available. (one tail or packed tails)
+		} else if ( (data_size > split_offset) && (block_list[block_index].state & 16) ){
+			if (par3_ctx->noise_level >= 3){
+				printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
+			}
+			tail_offset = split_offset;
+			while (tail_offset < split_offset + part_size){	// Read tails until data end.
+				slice_index = block_list[block_index].slice;
+				while (slice_index != -1){
+					//printf("block = %d, size = %"PRIu64", offset = %"PRIu64", slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
+					// Even when chunk tails are overlaped, it will find tail slice of next position.
+					if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
+							&& (slice_list[slice_index].tail_offset <= tail_offset) ){
+						break;
+					}
+					slice_index = slice_list[slice_index].next;
+				}
+				if (slice_index == -1){	// When there is no valid slice.
+					printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
+					return RET_LOGIC_ERROR;
+				}
+
+				// Read one slice from a file.
+				tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
+				file_name = slice_list[slice_index].find_name;
+				file_offset = slice_list[slice_index].find_offset + tail_gap;
+				io_size = slice_list[slice_index].size - tail_gap;
+				if (io_size > split_offset + part_size - tail_offset)
+					io_size = split_offset + part_size - tail_offset;	// Don't read over the end of this split.
+				ret = io_batch_read(io_p, file_name, file_offset, buf_p + tail_offset - split_offset, io_size);
+				if (ret != 0)
+					return ret;
+				tail_offset += io_size;
+			}
+		}
+	}
+
+	return 0;
+}
+
 // This keeps all input blocks and recovery blocks partially by spliting every block.
 int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_count)
 {
 	void *gf_table, *matrix;
-	char *name_prev, *file_name;
 	uint8_t buf_tail[40];
-	uint8_t *block_data, *buf_p;
+	uint8_t *block_data, *buf_p, *map_p, **recv_data;
 	uint8_t gf_size;
 	int galois_poly, *recv_id;
-	int ret;
+	int ret, matrix_ret;
 	int progress_old, progress_now;
+#ifdef _OPENMP
+	int max_level;
+#endif
 	uint32_t split_count;
 	uint32_t file_count, file_index, file_prev;
 	uint32_t chunk_index, chunk_num;
-	size_t io_size;
+	size_t io_size, map_align;
 	int64_t slice_index, file_offset;
 	uint64_t block_index, lost_index;
 	uint64_t block_size, block_count, max_recovery_block;
 	uint64_t alloc_size, region_size, split_size;
 	uint64_t data_size, part_size, split_offset;
 	uint64_t tail_offset, tail_gap;
-	uint64_t packet_count, packet_index;
+	uint32_t copy_index;
 	uint64_t file_size, chunk_size;
 	uint64_t progress_total, progress_step;
 	PAR3_BLOCK_CTX *block_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_FILE_CTX *file_list;
-	PAR3_PKT_CTX *packet_list;
+	PAR3_PKT_CTX *packet_p;
 	FILE *fp;
+	PAR3_IO_CTX io;
 	time_t time_old, time_now;
 	clock_t clock_now;
 
@@ -649,8 +760,6 @@ int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_
 	slice_list = par3_ctx->slice_list;
 	chunk_list = par3_ctx->chunk_list;
 	file_list = par3_ctx->input_file_list;
-	packet_list = par3_ctx->recv_packet_list;
-	packet_count = par3_ctx->recv_packet_count;
 
 	// Set required memory size at first
 	if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
@@ -754,6 +863,30 @@ int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_
 		par3_ctx->matrix = original_data;	// Release this later
 	}
 
+	// List of address of using recovery blocks
+	// recv_data[lost_index] = buffer to read the recovery block
+	// recv_data[lost_count + lost_index] = address of the recovery block at current split
+	recv_data = malloc(sizeof(uint8_t *) * lost_count * 2);
+	if (recv_data == NULL){
+		perror("Failed to allocate memory for recovery blocks");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->work_buf = (uint8_t *)recv_data;
+	for (lost_index = 0; lost_index < lost_count; lost_index++){
+		if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+			recv_data[lost_index] = (uint8_t *)recovery_data[ recv_id[lost_index] ];
+		} else {	// Recovery blocks are stored after input blocks.
+			recv_data[lost_index] = block_data + region_size * (block_count + lost_index);
+		}
+	}
+	// When Recovery Data is mapped at aligned address, it's used without copying.
+	// The mapped view is private, so zero fill and parity bytes after the data don't change the file.
+	if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+		map_align = 64;
+	} else {
+		map_align = 4;
+	}
+
 	// Base name of temporary file
 	sprintf(temp_path, "par3_%02X%02X%02X%02X%02X%02X%02X%02X_",
 			par3_ctx->set_id[0], par3_ctx->set_id[1], par3_ctx->set_id[2], par3_ctx->set_id[3],
@@ -773,120 +906,125 @@ int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_
 	}
 
 	// This file access style would support all Error Correction Codes.
+	// Input blocks and recovery blocks are read in batch, and multiple reads may be in flight.
+	ret = io_batch_open(par3_ctx, &io, block_data, alloc_size);
+	if (ret != 0)
+		return ret;
 	file_prev = 0xFFFFFFFF;
 	fp = NULL;
 	for (split_offset = 0; split_offset < block_size; split_offset += split_size){
-		buf_p = block_data;	// Starting position of input blocks
-		name_prev = NULL;
+		// Read available input blocks on memory
+		if ( (par3_ctx->ecc_method & 1) && (par3_ctx->matrix == NULL) ){
+			// At the first split, the matrix is solved on another thread while input blocks are read.
+#if _OPENMP >= 200805
+			max_level = omp_get_max_active_levels();
+			if (max_level < 2)
+				omp_set_max_active_levels(2);	// Solving matrix uses threads inside.
+#elif defined(_OPENMP)
+			max_level = omp_get_nested();	// OpenMP 2.0 (Visual Studio) has no active levels.
+			omp_set_nested(1);
+#endif
+			matrix_ret = 0;
+			#pragma omp parallel sections num_threads(2)
+			{
+				#pragma omp section
+				matrix_ret = rs_invert_matrix(par3_ctx, lost_count);
+				#pragma omp section
+				ret = read_input_split(par3_ctx, &io, block_data, region_size, split_offset, split_size);
+			}
+#if _OPENMP >= 200805
+			omp_set_max_active_levels(max_level);
+#elif defined(_OPENMP)
+			omp_set_nested(max_level);
+#endif
+			if (ret == 0)
+				ret = matrix_ret;
+		} else {
+			ret = read_input_split(par3_ctx, &io, block_data, region_size, split_offset, split_size);
+		}
+		if (ret != 0){
+			if (fp != NULL)
+				fclose(fp);
+			io_batch_close(&io);
+			return ret;
+		}
 
-		// Store available input blocks on memory
-		for (block_index = 0; block_index < block_count; block_index++){
-			data_size = block_list[block_index].size;
-			part_size = data_size - split_offset;
-			if (part_size > split_size)
-				part_size = split_size;
+		// Read using recovery blocks
+		part_size = block_size - split_offset;
+		if (part_size > split_size)
+			part_size = split_size;
+		io_size = part_size;
+		for (lost_index = 0; lost_index < lost_count; lost_index++){
+			block_index = recv_id[lost_index];	// Index of the recovery block
+			buf_p = recv_data[lost_index];
 
-			// Read block data from found file.
-			if (block_list[block_index].state & 4){	// Full size data is available.
-				slice_index = block_list[block_index].slice;
-				while (slice_index != -1){
-					if (slice_list[slice_index].size == block_size)
-						break;
-					slice_index = slice_list[slice_index].next;
+			// Read one Recovery Data Packet from a recovery file.
+			// When reading fails at submitting, try another copy of same packet.
+			copy_index = 0;
+			do {
+				packet_p = find_recv_packet(par3_ctx, block_index, copy_index);
+				if (packet_p == NULL){
+					if (copy_index == 0){
+						printf("Packet information for block[%"PRIu64"] is wrong.\n", block_index);
+						ret = RET_LOGIC_ERROR;
+					}
+					break;
 				}
-				if (slice_index == -1){	// When there is no valid slice.
-					printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-					if (fp != NULL)
-						fclose(fp);
-					return RET_LOGIC_ERROR;
+				// Another copy may not be verified yet.
+				ret = check_recv_packet(par3_ctx, packet_p);
+				if (ret != 0)
+					break;
+				if (packet_p->checked < 0){
+					copy_index++;
+					ret = RET_FILE_IO_ERROR;
+					continue;
 				}
-
-				// Read a part of slice from a file.
-				file_name = slice_list[slice_index].find_name;
-				file_offset = slice_list[slice_index].find_offset + split_offset;
-				io_size = part_size;
+				file_offset = packet_p->offset + 48 + 40 + split_offset;	// offset of the recovery block data
 				if (par3_ctx->noise_level >= 3){
-					printf("Reading %zu bytes of slice[%"PRId64"] for input block[%"PRIu64"]\n", io_size, slice_index, block_index);
-				}
-				if ( (fp == NULL) || (file_name != name_prev) ){
-					if (fp != NULL){	// Close previous input file.
-						fclose(fp);
-						fp = NULL;
-					}
-					fp = fopen(file_name, "rb");
-					if (fp == NULL){
-						perror("Failed to open Input File");
-						return RET_FILE_IO_ERROR;
-					}
-					name_prev = file_name;
+					printf("Reading Recovery Data for recovery block[%"PRIu64"] in \"%s\"\n", block_index, packet_p->name);
 				}
-				if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-					perror("Failed to seek Input File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
+				// Map region size, because rest bytes are modified later.
+				map_p = io_batch_map(&io, packet_p->name, file_offset, region_size, map_align);
+				if (map_p != NULL){
+					recv_data[lost_count + lost_index] = map_p;
+					ret = 0;
+				} else {
+					recv_data[lost_count + lost_index] = buf_p;
+					ret = io_batch_read(&io, packet_p->name, file_offset, buf_p, io_size);
 				}
-				if (fread(buf_p, 1, io_size, fp) != io_size){
-					perror("Failed to read slice on Input File");
+				copy_index++;
+			} while (ret != 0);
+			if (ret != 0){
+				if (fp != NULL)
 					fclose(fp);
-					return RET_FILE_IO_ERROR;
-				}
+				io_batch_close(&io);
+				return ret;
+			}
+			if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
+				recovery_data[block_index] = recv_data[lost_count + lost_index];
+			}
+		}
 
-			// All tail data is available. (one tail or packed tails)
-			} else if ( (data_size > split_offset) && (block_list[block_index].state & 16) ){
-				if (par3_ctx->noise_level >= 3){
-					printf("Reading %"PRIu64" bytes for input block[%"PRIu64"]\n", part_size, block_index);
-				}
-				tail_offset = split_offset;
-				while (tail_offset < split_offset + part_size){	// Read tails until data end.
-					slice_index = block_list[block_index].slice;
-					while (slice_index != -1){
-						//printf("block = %d, size = %"PRIu64", offset = %"PRIu64", slice = %"PRId64"\n", block_index, data_size, tail_offset, slice_index);
-						// Even when chunk tails are overlaped, it will find tail slice of next position.
-						if ( (slice_list[slice_index].tail_offset + slice_list[slice_index].size > tail_offset)
-								&& (slice_list[slice_index].tail_offset <= tail_offset) ){
-							break;
-						}
-						slice_index = slice_list[slice_index].next;
-					}
-					if (slice_index == -1){	// When there is no valid slice.
-						printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-						if (fp != NULL)
-							fclose(fp);
-						return RET_LOGIC_ERROR;
-					}
+		// Wait until all blocks are read.
+		ret = io_batch_wait(&io);
+		if (ret != 0){
+			if (fp != NULL)
+				fclose(fp);
+			io_batch_close(&io);
+			return ret;
+		}
 
-					// Read one slice from a file.
-					tail_gap = tail_offset - slice_list[slice_index].tail_offset;	// This tail slice may start before tail_offset.
-					file_name = slice_list[slice_index].find_name;
-					file_offset = slice_list[slice_index].find_offset + tail_gap;
-					io_size = slice_list[slice_index].size - tail_gap;
-					if (io_size > part_size)
-						io_size = part_size;
-					if ( (fp == NULL) || (file_name != name_prev) ){
-						if (fp != NULL){	// Close previous input file.
-							fclose(fp);
-							fp = NULL;
-						}
-						fp = fopen(file_name, "rb");
-						if (fp == NULL){
-							perror("Failed to open Input File");
-							return RET_FILE_IO_ERROR;
-						}
-						name_prev = file_name;
-					}
-					if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-						perror("Failed to seek Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-					if (fread(buf_p + tail_offset - split_offset, 1, io_size, fp) != io_size){
-						perror("Failed to read tail slice on Input File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-					tail_offset += io_size;
-				}
+		// Prepare input blocks on memory
+		buf_p = block_data;
+		for (block_index = 0; block_index < block_count; block_index++){
+			data_size = block_list[block_index].size;
+			part_size = data_size - split_offset;
+			if (part_size > split_size)
+				part_size = split_size;
 
+			if ( (block_list[block_index].state & 4)
+					|| ( (data_size > split_offset) && (block_list[block_index].state & 16) ) ){
+				// Input block was read.
 			} else {	// The input block was lost, or empty space in tail block.
 				if (block_list[block_index].state & 16){
 					// Zero fill partial input block
@@ -937,57 +1075,12 @@ int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_
 			buf_p += region_size;	// Goto next partial block
 		}
 
-		// Read using recovery blocks
+		// Prepare recovery blocks on memory
 		part_size = block_size - split_offset;
 		if (part_size > split_size)
 			part_size = split_size;
-		io_size = part_size;
 		for (lost_index = 0; lost_index < lost_count; lost_index++){
-			block_index = recv_id[lost_index];	// Index of the recovery block
-			if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
-				buf_p = (uint8_t *)recovery_data[block_index];	// Address of the recovery block
-			}
-
-			// Search packet for the recovery block
-			for (packet_index = 0; packet_index < packet_count; packet_index++){
-				if (packet_list[packet_index].index == block_index)
-					break;
-			}
-			if (packet_index >= packet_count){
-				printf("Packet information for block[%"PRIu64"] is wrong.\n", block_index);
-				if (fp != NULL)
-					fclose(fp);
-				return RET_LOGIC_ERROR;
-			}
-
-			// Read one Recovery Data Packet from a recovery file.
-			file_name = packet_list[packet_index].name;
-			file_offset = packet_list[packet_index].offset + 48 + 40 + split_offset;	// offset of the recovery block data
-			if (par3_ctx->noise_level >= 3){
-				printf("Reading Recovery Data[%"PRIu64"] for recovery block[%"PRIu64"]\n", packet_index, block_index);
-			}
-			if ( (fp == NULL) || (file_name != name_prev) ){
-				if (fp != NULL){	// Close previous recovery file.
-					fclose(fp);
-					fp = NULL;
-				}
-				fp = fopen(file_name, "rb");
-				if (fp == NULL){
-					perror("Failed to open recovery file");
-					return RET_FILE_IO_ERROR;
-				}
-				name_prev = file_name;
-			}
-			if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-				perror("Failed to seek recovery file");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-			if (fread(buf_p, 1, io_size, fp) != io_size){
-				perror("Failed to read recovery data on recovery file");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
+			buf_p = recv_data[lost_count + lost_index];	// Address of the recovery block
 			memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
 
 			if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
@@ -1021,18 +1114,9 @@ int recover_lost_block_split(PAR3_CTX *par3_ctx, char *temp_path, uint64_t lost_
 					}
 				}
 			}
-
-			buf_p += region_size;	// Goto next partial block
 		}
 
-		// Close recovery file, because next reading will be Input File.
-		if (fp != NULL){
-			if (fclose(fp) != 0){
-				perror("Failed to close recovery file");
-				return RET_FILE_IO_ERROR;
-			}
-			fp = NULL;
-		}
+
 
 /*
 if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
@@ -1048,7 +1132,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 
 		// Recover lost input blocks
 		if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Codes
-			rs_recover_all(par3_ctx, region_size, (int)lost_count, progress_total, progress_step);
+			rs_recover_all(par3_ctx, region_size, (int)lost_count, recv_data + lost_count, progress_total, progress_step);
 
 		} else if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 			ret = leo_decode(region_size,
@@ -1056,6 +1140,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 							original_data, recovery_data, work_data);
 			if (ret != 0){
 				printf("Failed to call Leopard-RS library (%d)\n", ret);
+				io_batch_close(&io);
 				return RET_LOGIC_ERROR;
 			}
 
@@ -1069,6 +1154,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 			}
 
 		}
+		io_batch_unmap(&io);	// Mapped recovery data isn't used anymore.
 		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
 			progress_step += block_count * lost_count;
 			time_old = time(NULL);
@@ -1086,7 +1172,9 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 						ret = region_check_parity(buf_p, region_size);
 					}
 				} else {
-					if (gf_size == 2){
+					if (block_list[block_index].state & 0x100){
+						ret = 0;	// This block wasn't recovered, because selected files don't use it.
+					} else if (gf_size == 2){
 						ret = gf16_region_check_parity(galois_poly, buf_p, region_size);
 					} else if (gf_size == 1){
 						ret = gf8_region_check_parity(galois_poly, buf_p, region_size);
@@ -1096,6 +1184,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 				}
 				if (ret != 0){
 					printf("Parity of recovered block[%"PRIu64"] is different.\n", block_index);
+					io_batch_close(&io);
 					return RET_LOGIC_ERROR;
 				}
 			} else if ( (par3_ctx->ecc_method & 8) && (gf_size == 2) ){
@@ -1106,7 +1195,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 			while (slice_index != -1){
 				file_index = slice_list[slice_index].file;
 				// If belong file is missing or damaged.
-				if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+				if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 					data_size = slice_list[slice_index].size;
 					file_offset = slice_list[slice_index].offset;
 					tail_offset = slice_list[slice_index].tail_offset;
@@ -1133,23 +1222,19 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 								fclose(fp);
 								fp = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp = fopen(temp_path, "r+b");
+							fp = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp == NULL){
 								perror("Failed to open temporary file");
+								io_batch_close(&io);
 								return RET_FILE_IO_ERROR;
 							}
 							file_prev = file_index;
 						}
-						if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek temporary file");
-							fclose(fp);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fwrite(buf_p + tail_gap, 1, io_size, fp) != io_size){
-							perror("Failed to write slice on temporary file");
+						ret = write_repair_file(par3_ctx, fp, file_index, slice_index, file_offset, buf_p + tail_gap, io_size);
+						if (ret != 0){
 							fclose(fp);
-							return RET_FILE_IO_ERROR;
+							io_batch_close(&io);
+							return ret;
 						}
 					}
 				}
@@ -1179,7 +1264,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 	// Write chunk tails on input files
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 			file_size = 0;
 			chunk_index = file_list[file_index].chunk;		// index of the first chunk
 			chunk_num = file_list[file_index].chunk_num;	// number of chunk descriptions
@@ -1200,10 +1285,10 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 								fclose(fp);
 								fp = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp = fopen(temp_path, "r+b");
+							fp = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp == NULL){
 								perror("Failed to open temporary file");
+								io_batch_close(&io);
 								return RET_FILE_IO_ERROR;
 							}
 							file_prev = file_index;
@@ -1212,11 +1297,13 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 						if (file_no < 0){
 							perror("Failed to seek temporary file");
 							fclose(fp);
+							io_batch_close(&io);
 							return RET_FILE_IO_ERROR;
 						} else {
 							if (_chsize_s(file_no, file_size) != 0){
 								perror("Failed to resize temporary file");
 								fclose(fp);
+								io_batch_close(&io);
 								return RET_FILE_IO_ERROR;
 							}
 						}
@@ -1249,23 +1336,19 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 								fclose(fp);
 								fp = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp = fopen(temp_path, "r+b");
+							fp = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp == NULL){
 								perror("Failed to open temporary file");
+								io_batch_close(&io);
 								return RET_FILE_IO_ERROR;
 							}
 							file_prev = file_index;
 						}
-						if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek temporary file");
+						ret = write_repair_file(par3_ctx, fp, file_index, -1, file_offset, buf_tail, io_size);
+						if (ret != 0){
 							fclose(fp);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fwrite(buf_tail, 1, io_size, fp) != io_size){
-							perror("Failed to write tiny slice on temporary file");
-							fclose(fp);
-							return RET_FILE_IO_ERROR;
+							io_batch_close(&io);
+							return ret;
 						}
 					}
 				}
@@ -1276,6 +1359,7 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 
 			if (file_size != file_list[file_index].size){
 				printf("file size is bad. %s\n", temp_path);
+				io_batch_close(&io);
 				return RET_LOGIC_ERROR;
 			} else {
 				file_list[file_index].state |= 0x100;
@@ -1283,6 +1367,14 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 		}
 	}
 
+	// Close reading files
+	ret = io_batch_close(&io);
+	if (ret != 0){
+		if (fp != NULL)
+			fclose(fp);
+		return ret;
+	}
+
 	// Close writing file
 	if (fp != NULL){
 		if (fclose(fp) != 0){
@@ -1301,6 +1393,8 @@ if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
 	}
 
 	// Release some allocated memory
+	free(recv_data);
+	par3_ctx->work_buf = NULL;
 	free(par3_ctx->recv_id_list);
 	par3_ctx->recv_id_list = NULL;
 	if (par3_ctx->matrix){
@@ -1319,13 +1413,12 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 	void *gf_table, *matrix;
 	char *name_prev, *file_name;
 	uint8_t buf_tail[40];
-	uint8_t *block_data, *buf_p;
+	uint8_t *block_data, *buf_p, *map_p;
 	uint8_t gf_size;
-	uint8_t *packet_checksum;
 	int galois_poly;
 	int ret;
 	int progress_old, progress_now;
-	uint32_t split_count;
+	uint32_t split_count, copy_index;
 	uint32_t file_count, file_index, file_prev;
 	uint32_t chunk_index, chunk_num;
 	uint32_t cohort_count, cohort_index;
@@ -1339,14 +1432,14 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 	uint64_t alloc_size, region_size, split_size;
 	uint64_t data_size, part_size, split_offset;
 	uint64_t tail_offset, tail_gap;
-	uint64_t packet_count, packet_index;
+	uint64_t recv_index;
 	uint64_t file_size, chunk_size;
 	uint64_t progress_total, progress_step;
 	PAR3_BLOCK_CTX *block_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_FILE_CTX *file_list;
-	PAR3_PKT_CTX *packet_list;
+	PAR3_PKT_CTX *packet_p;
 	FILE *fp_read, *fp_write;
 	time_t time_old, time_now;
 	clock_t clock_now;
@@ -1369,9 +1462,6 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 	slice_list = par3_ctx->slice_list;
 	chunk_list = par3_ctx->chunk_list;
 	file_list = par3_ctx->input_file_list;
-	packet_list = par3_ctx->recv_packet_list;
-	packet_count = par3_ctx->recv_packet_count;
-	packet_checksum = par3_ctx->matrix_packet + par3_ctx->matrix_packet_offset + 8;
 
 	// Set count for each cohort
 	cohort_count = (uint32_t)(par3_ctx->interleave) + 1;	// Minimum value is 2.
@@ -1507,7 +1597,7 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 				while (slice_index != -1){
 					file_index = slice_list[slice_index].file;
 					// If belong file is missing or damaged.
-					if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+					if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 						// Read slice data from another file.
 						file_name = slice_list[slice_index].find_name;
 						file_offset = slice_list[slice_index].find_offset;
@@ -1554,8 +1644,7 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 								fclose(fp_write);
 								fp_write = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp_write = fopen(temp_path, "r+b");
+							fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp_write == NULL){
 								perror("Failed to open temporary file");
 								fclose(fp_read);
@@ -1563,17 +1652,11 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 							}
 							file_prev = file_index;
 						}
-						if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek temporary file");
+						ret = write_repair_file(par3_ctx, fp_write, file_index, slice_index, file_offset, buf_p, io_size);
+						if (ret != 0){
 							fclose(fp_read);
 							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fwrite(buf_p, 1, io_size, fp_write) != io_size){
-							perror("Failed to write slice on temporary file");
-							fclose(fp_read);
-							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
+							return ret;
 						}
 					}
 
@@ -1705,8 +1788,8 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 						file_name = slice_list[slice_index].find_name;
 						file_offset = slice_list[slice_index].find_offset + tail_gap;
 						io_size = slice_list[slice_index].size - tail_gap;
-						if (io_size > part_size)
-							io_size = part_size;
+						if (io_size > split_offset + part_size - tail_offset)
+							io_size = split_offset + part_size - tail_offset;	// Don't read over the end of this split.
 						if ( (fp_read == NULL) || (file_name != name_prev) ){
 							if (fp_read != NULL){	// Close previous input file.
 								fclose(fp_read);
@@ -1795,49 +1878,70 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 			if (part_size > split_size)
 				part_size = split_size;
 			io_size = part_size;
-			// Search packet for the recovery block
-			for (packet_index = 0; packet_index < packet_count; packet_index++){
-				if (memcmp(packet_list[packet_index].matrix, packet_checksum, 16) != 0)
-					continue;	// Search only Recovery Data Packets belong to using Matrix Packet
-
-				block_index = packet_list[packet_index].index;	// Index of the recovery block
-				if (block_index % cohort_count != cohort_index)
-					continue;	// Ignore useless recovery block in other cohorts.
-
-				//printf("lost_index = %u, recovery block = %"PRIu64" \n", lost_index, block_index);
+			// Search packet for the recovery block in this cohort.
+			// When reading fails, it tries another copy of same packet, or next recovery block.
+			for (recv_index = 0; recv_index < max_recovery_block2; recv_index++){
+				block_index = recv_index * cohort_count + cohort_index;	// Index of the recovery block
 				buf_p = block_data + region_size * lost_id[lost_index];	// Address of the recovery block
-				// Set position of lost input block = address of using recovery block
-				recovery_data[block_index / cohort_count] = buf_p;
-				lost_index++;
+				map_p = NULL;
+				for (copy_index = 0; ; copy_index++){
+					packet_p = find_recv_packet(par3_ctx, block_index, copy_index);
+					if (packet_p == NULL)
+						break;	// There is no other copy.
+					// Another copy may not be verified yet.
+					if (check_recv_packet(par3_ctx, packet_p) != 0){
+						if (fp_read != NULL)
+							fclose(fp_read);
+						return RET_MEMORY_ERROR;
+					}
+					if (packet_p->checked < 0)
+						continue;
+					if ( (copy_index > 0) && (par3_ctx->noise_level >= 1) ){
+						printf("Reading another copy of Recovery Data for recovery block[%"PRIu64"]\n", block_index);
+					}
 
-				// Read one Recovery Data Packet from a recovery file.
-				file_name = packet_list[packet_index].name;
-				file_offset = packet_list[packet_index].offset + 48 + 40 + split_offset;	// offset of the recovery block data
-				if (par3_ctx->noise_level >= 3){
-					printf("Reading Recovery Data[%"PRIu64"] for recovery block[%"PRIu64"]\n", packet_index, block_index);
-				}
-				if ( (fp_read == NULL) || (file_name != name_prev) ){
-					if (fp_read != NULL){	// Close previous recovery file.
-						fclose(fp_read);
-						fp_read = NULL;
+					// Read one Recovery Data Packet from a recovery file.
+					file_name = packet_p->name;
+					file_offset = packet_p->offset + 48 + 40 + split_offset;	// offset of the recovery block data
+					if (par3_ctx->noise_level >= 3){
+						printf("Reading Recovery Data for recovery block[%"PRIu64"] in \"%s\"\n", block_index, file_name);
 					}
-					fp_read = fopen(file_name, "rb");
-					if (fp_read == NULL){
-						perror("Failed to open recovery file");
-						return RET_FILE_IO_ERROR;
+					if ( (fp_read == NULL) || (file_name != name_prev) ){
+						if (fp_read != NULL){	// Close previous recovery file.
+							fclose(fp_read);
+							fp_read = NULL;
+						}
+						fp_read = fopen(file_name, "rb");
+						if (fp_read == NULL){
+							perror("Failed to open recovery file");
+							continue;
+						}
+						name_prev = file_name;
 					}
-					name_prev = file_name;
-				}
-				if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
-					perror("Failed to seek recovery file");
-					fclose(fp_read);
-					return RET_FILE_IO_ERROR;
-				}
-				if (fread(buf_p, 1, io_size, fp_read) != io_size){
-					perror("Failed to read recovery data on recovery file");
-					fclose(fp_read);
-					return RET_FILE_IO_ERROR;
+					// When Recovery Data is mapped at aligned address, it's used without copying.
+					if (file_offset % 64 == 0)
+						map_p = file_map(_fileno(fp_read), file_offset, region_size);
+					if (map_p != NULL)
+						break;
+					if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
+						perror("Failed to seek recovery file");
+						continue;
+					}
+					if (fread(buf_p, 1, io_size, fp_read) != io_size){
+						perror("Failed to read recovery data on recovery file");
+						continue;
+					}
+					break;
 				}
+				if (packet_p == NULL)
+					continue;	// This recovery block isn't available.
+				if (map_p != NULL)
+					buf_p = map_p;
+				//printf("lost_index = %u, recovery block = %"PRIu64" \n", lost_index, block_index);
+				lost_index++;
+
+				// Set position of lost input block = address of using recovery block
+				recovery_data[block_index / cohort_count] = buf_p;
 				memset(buf_p + part_size, 0, region_size - part_size);	// Zero fill rest bytes
 
 				if (gf_size == 2){
@@ -1864,6 +1968,12 @@ int recover_lost_block_cohort(PAR3_CTX *par3_ctx, char *temp_path)
 				if (lost_index == lost_list[cohort_index])
 					break;
 			}
+			if (lost_index < lost_list[cohort_index]){
+				printf("Failed to read enough recovery blocks for cohort[%u]\n", cohort_index);
+				if (fp_read != NULL)
+					fclose(fp_read);
+				return RET_FILE_IO_ERROR;
+			}
 
 			// Close recovery file, because next reading will be Input File.
 			if (fp_read != NULL){
@@ -1899,6 +2009,13 @@ fclose(fp2);
 			ret = leo_decode(region_size,
 							(uint32_t)block_count2, (uint32_t)max_recovery_block2, work_count,
 							original_data, recovery_data, work_data);
+
+			// Release mapped recovery data, which is outside of block data.
+			for (block_index = 0; block_index < max_recovery_block2; block_index++){
+				buf_p = (uint8_t *)recovery_data[block_index];
+				if ( (buf_p != NULL) && ( (buf_p < block_data) || (buf_p >= block_data + alloc_size) ) )
+					file_unmap(buf_p, region_size);
+			}
 			if (ret != 0){
 				printf("Failed to call Leopard-RS library (%d)\n", ret);
 				return RET_LOGIC_ERROR;
@@ -1951,7 +2068,7 @@ printf("\n recover ok, progress = %"PRIu64" / %"PRIu64"\n", progress_step, progr
 				while (slice_index != -1){
 					file_index = slice_list[slice_index].file;
 					// If belong file is missing or damaged.
-					if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+					if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 						data_size = slice_list[slice_index].size;
 						file_offset = slice_list[slice_index].offset;
 						tail_offset = slice_list[slice_index].tail_offset;
@@ -1978,23 +2095,17 @@ printf("\n recover ok, progress = %"PRIu64" / %"PRIu64"\n", progress_step, progr
 									fclose(fp_write);
 									fp_write = NULL;
 								}
-								sprintf(temp_path + 22, "%u.tmp", file_index);
-								fp_write = fopen(temp_path, "r+b");
+								fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 								if (fp_write == NULL){
 									perror("Failed to open temporary file");
 									return RET_FILE_IO_ERROR;
 								}
 								file_prev = file_index;
 							}
-							if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-								perror("Failed to seek temporary file");
-								fclose(fp_write);
-								return RET_FILE_IO_ERROR;
-							}
-							if (fwrite(buf_p + tail_gap, 1, io_size, fp_write) != io_size){
-								perror("Failed to write slice on temporary file");
+							ret = write_repair_file(par3_ctx, fp_write, file_index, slice_index, file_offset, buf_p + tail_gap, io_size);
+							if (ret != 0){
 								fclose(fp_write);
-								return RET_FILE_IO_ERROR;
+								return ret;
 							}
 						}
 					}
@@ -2043,7 +2154,7 @@ printf("\n recover ok, progress = %"PRIu64" / %"PRIu64"\n", progress_step, progr
 	// Write chunk tails on input files
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
 			file_size = 0;
 			chunk_index = file_list[file_index].chunk;		// index of the first chunk
 			chunk_num = file_list[file_index].chunk_num;	// number of chunk descriptions
@@ -2065,8 +2176,7 @@ printf("\n recover ok, progress = %"PRIu64" / %"PRIu64"\n", progress_step, progr
 								fclose(fp_write);
 								fp_write = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp_write = fopen(temp_path, "r+b");
+							fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp_write == NULL){
 								perror("Failed to open temporary file");
 								return RET_FILE_IO_ERROR;
@@ -2114,23 +2224,17 @@ printf("\n recover ok, progress = %"PRIu64" / %"PRIu64"\n", progress_step, progr
 								fclose(fp_write);
 								fp_write = NULL;
 							}
-							sprintf(temp_path + 22, "%u.tmp", file_index);
-							fp_write = fopen(temp_path, "r+b");
+							fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 							if (fp_write == NULL){
 								perror("Failed to open temporary file");
 								return RET_FILE_IO_ERROR;
 							}
 							file_prev = file_index;
 						}
-						if (_fseeki64(fp_write, file_offset, SEEK_SET) != 0){
-							perror("Failed to seek temporary file");
+						ret = write_repair_file(par3_ctx, fp_write, file_index, -1, file_offset, buf_tail, io_size);
+						if (ret != 0){
 							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
-						}
-						if (fwrite(buf_tail, 1, io_size, fp_write) != io_size){
-							perror("Failed to write tiny slice on temporary file");
-							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
+							return ret;
 						}
 					}
 				}
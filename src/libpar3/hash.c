@@ -117,6 +117,14 @@ uint64_t crc64_zero(size_t size, uint64_t crc)
 	return ~crc;	// bit flipping again
 }
 
+// Combine CRC-64 of two data without reading them.
+// crc1 = CRC-64 of former data, crc2 = CRC-64 of latter data (size2 bytes).
+// Return value is same as crc64(latter data, size2, crc1).
+uint64_t crc64_combine(uint64_t crc1, uint64_t crc2, size_t size2)
+{
+	return crc2 ^ crc64_update_zero(size2, crc1);
+}
+
 // This return window_mask.
 static uint64_t init_slide_window(uint64_t window_size, uint64_t window_table[256])
 {
@@ -251,6 +259,45 @@ void crc_list_add(PAR3_CTX *par3_ctx, uint64_t crc, uint64_t index)
 	par3_ctx->crc_count = count;
 }
 
+// Set bit of CRC-64 in filter.
+// Because CRC-64 is random enough, lower bits are used as index.
+static void crc_filter_set(PAR3_CTX *par3_ctx, uint64_t crc)
+{
+	if (par3_ctx->crc_filter == NULL)
+		return;
+
+	crc &= par3_ctx->crc_filter_mask;
+	par3_ctx->crc_filter[crc >> 3] |= 1 << (crc & 7);
+}
+
+// Make bit filter of CRC-64 for slide window search.
+// Most offsets can be skipped without binary search of the lists.
+static int crc_filter_make(PAR3_CTX *par3_ctx, uint64_t full_count, uint64_t tail_count)
+{
+	uint64_t index, bit_count;
+
+	// 16 bits per item makes false positive less than 1 / 16.
+	bit_count = 1 << 16;	// 8 KB at least
+	while ( (bit_count < (full_count + tail_count) * 16) && (bit_count < ((uint64_t)1 << 30)) )
+		bit_count <<= 1;
+
+	if (par3_ctx->crc_filter != NULL)
+		free(par3_ctx->crc_filter);
+	par3_ctx->crc_filter = calloc((size_t)(bit_count >> 3), 1);
+	if (par3_ctx->crc_filter == NULL){
+		perror("Failed to allocate memory for filter of CRC-64");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->crc_filter_mask = bit_count - 1;
+
+	for (index = 0; index < full_count; index++)
+		crc_filter_set(par3_ctx, par3_ctx->crc_list[index].crc);
+	for (index = 0; index < tail_count; index++)
+		crc_filter_set(par3_ctx, par3_ctx->tail_list[index].crc);
+
+	return 0;
+}
+
 // Make list of crc for seaching full size blocks and chunk tails.
 int crc_list_make(PAR3_CTX *par3_ctx)
 {
@@ -358,7 +405,7 @@ int crc_list_make(PAR3_CTX *par3_ctx)
 	par3_ctx->crc_count = full_count;
 	par3_ctx->tail_count = tail_count;
 
-	return 0;
+	return crc_filter_make(par3_ctx, full_count, tail_count);
 }
 
 // Replace crc of a block, and sort again.
@@ -377,6 +424,7 @@ void crc_list_replace(PAR3_CTX *par3_ctx, uint64_t crc, uint64_t index)
 	for (i = 0; i < count; i++){
 		if (crc_list[i].index == index){
 			crc_list[i].crc = crc;
+			crc_filter_set(par3_ctx, crc);	// Old bit remains, but it's harmless.
 			i = -1;
 			break;
 		}
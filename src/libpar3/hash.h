@@ -2,6 +2,7 @@
 // CRC-64-ISO
 uint64_t crc64(const uint8_t *buf, size_t size, uint64_t crc);
 uint64_t crc64_zero(size_t size, uint64_t crc);
+uint64_t crc64_combine(uint64_t crc1, uint64_t crc2, size_t size2);
 
 // table setup for slide window search
 void init_crc_slide_table(PAR3_CTX *par3_ctx, int flag_usage);
@@ -0,0 +1,470 @@
+#include "libpar3.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+#include "hash_cache.h"
+
+
+/*
+Hash cache keeps checksums of input files between creations.
+When an input file was not changed, it can skip reading the file.
+
+File format:
+ 8 bytes : "PAR3HS2\0"
+ 8 bytes : CRC-64 of all records after this header
+ records (each starts at multiple of 8 bytes)
+
+Time stamps keep sub-second part, when the file system provides it.
+So, a file rewritten in the same second with the same size is read again.
+
+Record format:
+ 0 : record size (8 bytes)
+ 8 : file size (8 bytes)
+16 : mtime in nanoseconds (8 bytes)
+24 : inode (8 bytes)
+32 : block size (8 bytes)
+40 : CRC-64 of the first 16 KB (8 bytes)
+48 : BLAKE3 hash of the file (16 bytes)
+64 : tail information (40 bytes)
+     When tail size is 40 bytes or more;
+     CRC-64 of the first 40 bytes, BLAKE3 hash of the tail, and CRC-64 of the tail
+     When tail size is 1 ~ 39 bytes, it's raw data of the tail.
+104: length of file name including null terminator (8 bytes)
+112: ctime in nanoseconds (8 bytes)
+120: file name (padded to multiple of 8 bytes)
+ ? : CRC-64 and BLAKE3 hash of each full size block (24 bytes each)
+*/
+
+#define CACHE_HEADER_SIZE 16
+
+static int compare_record_name(const void *a, const void *b)
+{
+	const uint8_t *record1, *record2;
+
+	record1 = *(const uint8_t **)a;
+	record2 = *(const uint8_t **)b;
+
+	return strcmp((const char *)record1 + CACHE_RECORD_SIZE, (const char *)record2 + CACHE_RECORD_SIZE);
+}
+
+static int compare_record_key(const void *key, const void *item)
+{
+	const uint8_t *record;
+
+	record = *(const uint8_t **)item;
+
+	return strcmp((const char *)key, (const char *)record + CACHE_RECORD_SIZE);
+}
+
+// Return time stamps of a file in nanoseconds.
+static int64_t get_mtime_ns(struct _stat64 *stat_buf)
+{
+	return (int64_t)(stat_buf->st_mtime) * 1000000000 + ST_MTIME_NSEC(stat_buf);
+}
+static int64_t get_ctime_ns(struct _stat64 *stat_buf)
+{
+	return (int64_t)(stat_buf->st_ctime) * 1000000000 + ST_CTIME_NSEC(stat_buf);
+}
+
+// Simple pseudo random number generator (xorshift64) for spot check.
+// It doesn't touch rand() of the application.
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x;
+
+	x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+// Calculate total size of a record.
+static size_t calculate_record_size(uint64_t file_size, uint64_t block_size, size_t name_len)
+{
+	return CACHE_RECORD_SIZE + ((name_len + 7) & ~7) + (size_t)(file_size / block_size) * 24;
+}
+
+// Read hash cache file, and make list of records.
+// When the file doesn't exist or is broken, cache becomes empty.
+int hash_cache_load(PAR3_CTX *par3_ctx)
+{
+	uint8_t *buf, **list;
+	uint32_t count;
+	size_t buf_size, offset, record_size, name_len;
+	uint64_t crc, file_size, block_size;
+	int64_t file_length;
+	FILE *fp;
+
+	fp = fopen(par3_ctx->hash_cache_path, "rb");
+	if (fp == NULL){
+		if (par3_ctx->noise_level >= 1){
+			printf("Hash cache is empty.\n");
+		}
+		return 0;
+	}
+	file_length = _filelengthi64(_fileno(fp));
+	if (file_length < CACHE_HEADER_SIZE){
+		fclose(fp);
+		return 0;
+	}
+	if ( (par3_ctx->memory_limit > 0) && ((uint64_t)file_length > par3_ctx->memory_limit) ){
+		if (par3_ctx->noise_level >= 0){
+			printf("Hash cache is too large to load.\n");
+		}
+		fclose(fp);
+		return 0;
+	}
+	buf_size = (size_t)file_length;
+	buf = malloc(buf_size);
+	if (buf == NULL){
+		perror("Failed to allocate memory for hash cache");
+		fclose(fp);
+		return RET_MEMORY_ERROR;
+	}
+	if (fread(buf, 1, buf_size, fp) != buf_size){
+		perror("Failed to read hash cache");
+		free(buf);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	// Check header and integrity of records.
+	memcpy(&crc, buf + 8, 8);
+	if ( (memcmp(buf, "PAR3HS2\0", 8) != 0) || (crc != crc64(buf + CACHE_HEADER_SIZE, buf_size - CACHE_HEADER_SIZE, 0)) ){
+		if (par3_ctx->noise_level >= 0){
+			printf("Hash cache is broken and will be overwritten.\n");
+		}
+		free(buf);
+		return 0;
+	}
+
+	// Count records and check their sizes.
+	count = 0;
+	offset = CACHE_HEADER_SIZE;
+	while (offset + CACHE_RECORD_SIZE <= buf_size){
+		memcpy(&record_size, buf + offset, 8);
+		memcpy(&file_size, buf + offset + 8, 8);
+		memcpy(&block_size, buf + offset + 32, 8);
+		memcpy(&name_len, buf + offset + 104, 8);
+		if ( (block_size == 0) || (name_len == 0) || (name_len > _MAX_PATH)
+				|| (record_size != calculate_record_size(file_size, block_size, name_len))
+				|| (record_size > buf_size - offset)
+				|| (buf[offset + CACHE_RECORD_SIZE + name_len - 1] != 0) )
+			break;
+		count++;
+		offset += record_size;
+	}
+	if (offset != buf_size){
+		if (par3_ctx->noise_level >= 0){
+			printf("Hash cache is broken and will be overwritten.\n");
+		}
+		free(buf);
+		return 0;
+	}
+	if (count == 0){
+		free(buf);
+		return 0;
+	}
+
+	list = malloc(sizeof(uint8_t *) * count);
+	if (list == NULL){
+		perror("Failed to allocate memory for hash cache");
+		free(buf);
+		return RET_MEMORY_ERROR;
+	}
+	count = 0;
+	offset = CACHE_HEADER_SIZE;
+	while (offset < buf_size){
+		list[count] = buf + offset;
+		memcpy(&record_size, buf + offset, 8);
+		count++;
+		offset += record_size;
+	}
+	qsort( (void *)list, (size_t)count, sizeof(uint8_t *), compare_record_name );
+
+	par3_ctx->hash_cache_buf = buf;
+	par3_ctx->hash_cache_size = buf_size;
+	par3_ctx->hash_cache_list = list;
+	par3_ctx->hash_cache_count = count;
+	if (par3_ctx->noise_level >= 1){
+		printf("Number of files in hash cache = %u\n", count);
+	}
+
+	return 0;
+}
+
+// Return pointer of a record, when file was not changed.
+// When there is no matching record, return NULL.
+uint8_t * hash_cache_search(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, void *stat_p)
+{
+	uint8_t **list_p, *record;
+	uint64_t value8;
+	int64_t file_time;
+	struct _stat64 *stat_buf;
+
+	if (par3_ctx->hash_cache_count == 0)
+		return NULL;
+
+	// Binary search by file name
+	list_p = bsearch( file_p->name, par3_ctx->hash_cache_list, (size_t)(par3_ctx->hash_cache_count), sizeof(uint8_t *), compare_record_key );
+	if (list_p == NULL)
+		return NULL;
+	record = *list_p;
+
+	stat_buf = stat_p;
+	memcpy(&value8, record + 8, 8);
+	if (value8 != file_p->size)
+		return NULL;
+	memcpy(&file_time, record + 16, 8);
+	if (file_time != get_mtime_ns(stat_buf))
+		return NULL;
+	memcpy(&file_time, record + 112, 8);
+	if (file_time != get_ctime_ns(stat_buf))
+		return NULL;
+	memcpy(&value8, record + 24, 8);
+	if (value8 != (uint64_t)(stat_buf->st_ino))
+		return NULL;
+	memcpy(&value8, record + 32, 8);
+	if (value8 != par3_ctx->block_size)
+		return NULL;
+
+	return record;
+}
+
+// Read some blocks of a cached file at random, and compare their checksums.
+// Return 0 when all checksums are same, 1 when different, or error code.
+int hash_cache_spot_check(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, uint8_t *record, uint8_t *work_buf)
+{
+	uint8_t hash[16], *block_p;
+	uint32_t num;
+	uint64_t block_size, full_count, block_index, crc, crc_cache;
+	uint64_t random_state;
+	size_t name_len, io_size;
+	FILE *fp;
+
+	block_size = par3_ctx->block_size;
+	full_count = file_p->size / block_size;
+	memcpy(&name_len, record + 104, 8);
+	block_p = record + CACHE_RECORD_SIZE + ((name_len + 7) & ~7);
+
+	// Seed differs for each time and file. It must not be zero.
+	memcpy(&crc_cache, record + 40, 8);
+	random_state = ((uint64_t)time(NULL) << 20) ^ crc_cache ^ file_p->size;
+	if (random_state == 0)
+		random_state = 1;
+
+	fp = fopen(file_p->name, "rb");
+	if (fp == NULL){
+		perror("Failed to open input file");
+		return RET_FILE_IO_ERROR;
+	}
+
+	for (num = 0; num < par3_ctx->hash_cache_check; num++){
+		// The last block may be a tail.
+		if (file_p->size % block_size >= 40){
+			block_index = next_random(&random_state) % (full_count + 1);
+		} else if (full_count > 0){
+			block_index = next_random(&random_state) % full_count;
+		} else {	// Compare raw data of small tail.
+			io_size = (size_t)(file_p->size);
+			if (fread(work_buf, 1, io_size, fp) != io_size){
+				perror("Failed to read input file");
+				fclose(fp);
+				return RET_FILE_IO_ERROR;
+			}
+			if (memcmp(work_buf, record + 64, io_size) != 0)
+				num = 0xFFFFFFFF;
+			break;
+		}
+		if (_fseeki64(fp, block_index * block_size, SEEK_SET) != 0){
+			perror("Failed to seek input file");
+			fclose(fp);
+			return RET_FILE_IO_ERROR;
+		}
+
+		if (block_index < full_count){
+			io_size = (size_t)block_size;
+		} else {
+			io_size = (size_t)(file_p->size - block_index * block_size);
+		}
+		if (fread(work_buf, 1, io_size, fp) != io_size){
+			perror("Failed to read input file");
+			fclose(fp);
+			return RET_FILE_IO_ERROR;
+		}
+
+		if (block_index < full_count){
+			crc = crc64(work_buf, io_size, 0);
+			blake3(work_buf, io_size, hash);
+			memcpy(&crc_cache, block_p + block_index * 24, 8);
+			if ( (crc != crc_cache) || (memcmp(hash, block_p + block_index * 24 + 8, 16) != 0) )
+				num = 0xFFFFFFFF;
+		} else {	// chunk tail
+			crc = crc64(work_buf, 40, 0);
+			blake3(work_buf, io_size, hash);
+			memcpy(&crc_cache, record + 64, 8);
+			if ( (crc != crc_cache) || (memcmp(hash, record + 72, 16) != 0) )
+				num = 0xFFFFFFFF;
+		}
+		if (num == 0xFFFFFFFF)
+			break;
+	}
+	fclose(fp);
+
+	if (num == 0xFFFFFFFF){
+		if (par3_ctx->noise_level >= 1){
+			printf("Cached checksum is different: \"%s\"\n", file_p->name);
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+// Add a record of mapped file to save later.
+// block_p points the first full size block of the file.
+int hash_cache_add(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, void *stat_p,
+		PAR3_BLOCK_CTX *block_p, uint8_t tail_info[40])
+{
+	uint8_t *buf;
+	uint64_t value8, index, full_count;
+	int64_t file_time;
+	size_t name_len, record_size, alloc_size;
+	struct _stat64 *stat_buf;
+
+	name_len = strlen(file_p->name) + 1;
+	record_size = calculate_record_size(file_p->size, par3_ctx->block_size, name_len);
+
+	// Allocate more memory, when there isn't enough space.
+	if (par3_ctx->hash_cache_new_size + record_size > par3_ctx->hash_cache_new_max){
+		alloc_size = par3_ctx->hash_cache_new_max * 2;
+		if (alloc_size < CACHE_HEADER_SIZE + 4096)
+			alloc_size = CACHE_HEADER_SIZE + 4096;
+		while (alloc_size < par3_ctx->hash_cache_new_size + record_size)
+			alloc_size *= 2;
+		buf = realloc(par3_ctx->hash_cache_new, alloc_size);
+		if (buf == NULL){
+			perror("Failed to re-allocate memory for hash cache");
+			return RET_MEMORY_ERROR;
+		}
+		par3_ctx->hash_cache_new = buf;
+		par3_ctx->hash_cache_new_max = alloc_size;
+		if (par3_ctx->hash_cache_new_size == 0)
+			par3_ctx->hash_cache_new_size = CACHE_HEADER_SIZE;	// Space for header
+	}
+	buf = par3_ctx->hash_cache_new + par3_ctx->hash_cache_new_size;
+	memset(buf, 0, CACHE_RECORD_SIZE + ((name_len + 7) & ~7));
+
+	stat_buf = stat_p;
+	memcpy(buf, &record_size, 8);
+	memcpy(buf + 8, &(file_p->size), 8);
+	file_time = get_mtime_ns(stat_buf);
+	memcpy(buf + 16, &file_time, 8);
+	value8 = stat_buf->st_ino;
+	memcpy(buf + 24, &value8, 8);
+	memcpy(buf + 32, &(par3_ctx->block_size), 8);
+	memcpy(buf + 40, &(file_p->crc), 8);
+	memcpy(buf + 48, file_p->hash, 16);
+	memcpy(buf + 64, tail_info, 40);
+	memcpy(buf + 104, &name_len, 8);
+	file_time = get_ctime_ns(stat_buf);
+	memcpy(buf + 112, &file_time, 8);
+	memcpy(buf + CACHE_RECORD_SIZE, file_p->name, name_len);
+
+	// Checksums of full size blocks
+	buf += CACHE_RECORD_SIZE + ((name_len + 7) & ~7);
+	full_count = file_p->size / par3_ctx->block_size;
+	for (index = 0; index < full_count; index++){
+		memcpy(buf, &(block_p[index].crc), 8);
+		memcpy(buf + 8, block_p[index].hash, 16);
+		buf += 24;
+	}
+
+	par3_ctx->hash_cache_new_size += record_size;
+	return 0;
+}
+
+// Write new records on hash cache file.
+// It writes a temporary file and replaces the old file,
+// so that the old cache remains when writing is interrupted.
+int hash_cache_save(PAR3_CTX *par3_ctx)
+{
+	char temp_path[_MAX_PATH + 8];
+	uint8_t *buf;
+	uint64_t crc;
+	size_t buf_size;
+	FILE *fp;
+
+	buf = par3_ctx->hash_cache_new;
+	buf_size = par3_ctx->hash_cache_new_size;
+	if (buf == NULL)
+		return 0;
+
+	memcpy(buf, "PAR3HS2\0", 8);
+	crc = crc64(buf + CACHE_HEADER_SIZE, buf_size - CACHE_HEADER_SIZE, 0);
+	memcpy(buf + 8, &crc, 8);
+
+	sprintf(temp_path, "%s.tmp", par3_ctx->hash_cache_path);
+	fp = fopen(temp_path, "wb");
+	if (fp == NULL){
+		perror("Failed to open hash cache");
+		return RET_FILE_IO_ERROR;
+	}
+	if (fwrite(buf, 1, buf_size, fp) != buf_size){
+		perror("Failed to write hash cache");
+		fclose(fp);
+		remove(temp_path);
+		return RET_FILE_IO_ERROR;
+	}
+	if ( (fflush(fp) != 0) || (_commit(_fileno(fp)) != 0) ){
+		perror("Failed to flush hash cache");
+		fclose(fp);
+		remove(temp_path);
+		return RET_FILE_IO_ERROR;
+	}
+	if (fclose(fp) != 0){
+		perror("Failed to close hash cache");
+		remove(temp_path);
+		return RET_FILE_IO_ERROR;
+	}
+
+	if (rename(temp_path, par3_ctx->hash_cache_path) != 0){
+		// On Windows, rename() fails when the destination exists.
+		remove(par3_ctx->hash_cache_path);
+		if (rename(temp_path, par3_ctx->hash_cache_path) != 0){
+			perror("Failed to rename hash cache");
+			remove(temp_path);
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	return 0;
+}
+
+void hash_cache_release(PAR3_CTX *par3_ctx)
+{
+	if (par3_ctx->hash_cache_buf){
+		free(par3_ctx->hash_cache_buf);
+		par3_ctx->hash_cache_buf = NULL;
+		par3_ctx->hash_cache_size = 0;
+	}
+	if (par3_ctx->hash_cache_list){
+		free(par3_ctx->hash_cache_list);
+		par3_ctx->hash_cache_list = NULL;
+		par3_ctx->hash_cache_count = 0;
+	}
+	if (par3_ctx->hash_cache_new){
+		free(par3_ctx->hash_cache_new);
+		par3_ctx->hash_cache_new = NULL;
+		par3_ctx->hash_cache_new_size = 0;
+		par3_ctx->hash_cache_new_max = 0;
+	}
+}
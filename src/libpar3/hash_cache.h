@@ -0,0 +1,13 @@
+// Persistent cache of checksums of input files
+
+// Size of fixed part in a record of hash cache.
+// File name and checksums of full size blocks follow it.
+#define CACHE_RECORD_SIZE 120
+
+int hash_cache_load(PAR3_CTX *par3_ctx);
+uint8_t * hash_cache_search(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, void *stat_p);
+int hash_cache_spot_check(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, uint8_t *record, uint8_t *work_buf);
+int hash_cache_add(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, void *stat_p,
+		PAR3_BLOCK_CTX *block_p, uint8_t tail_info[40]);
+int hash_cache_save(PAR3_CTX *par3_ctx);
+void hash_cache_release(PAR3_CTX *par3_ctx);
@@ -0,0 +1,238 @@
+#include "libpar3.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_batch.h"
+
+
+// Max number of files to keep open while reading asynchronously
+#define IO_BATCH_FILE_MAX 64
+
+// Default number of reads in flight
+#define IO_BATCH_DEPTH 32
+
+// Prepare to read file data.
+// "buf" is the region, where most data will be read into.
+int io_batch_open(PAR3_CTX *par3_ctx, PAR3_IO_CTX *io_p, uint8_t *buf, size_t buf_size)
+{
+	uint32_t queue_depth;
+
+	memset(io_p, 0, sizeof(PAR3_IO_CTX));
+
+	queue_depth = par3_ctx->io_depth;
+	if (queue_depth == 0)
+		queue_depth = IO_BATCH_DEPTH;
+	if (queue_depth > 1)
+		io_p->async_p = async_read_init(queue_depth, buf, buf_size);
+
+	// Stdio keeps only one file open.
+	if (io_p->async_p != NULL){
+		io_p->file_max = IO_BATCH_FILE_MAX;
+	} else {
+		io_p->file_max = 1;
+	}
+	if (par3_ctx->noise_level >= 2){
+		if (io_p->async_p != NULL){
+			printf("Asynchronous read: queue depth = %u\n", queue_depth);
+		} else {
+			printf("Asynchronous read: not used\n");
+		}
+	}
+
+	io_p->name_list = malloc(sizeof(char *) * io_p->file_max);
+	io_p->fp_list = malloc(sizeof(FILE *) * io_p->file_max);
+	if ( (io_p->name_list == NULL) || (io_p->fp_list == NULL) ){
+		perror("Failed to allocate memory for reading files");
+		io_batch_close(io_p);
+		return RET_MEMORY_ERROR;
+	}
+
+	return 0;
+}
+
+// Close all opened files.
+static int close_all_file(PAR3_IO_CTX *io_p)
+{
+	int ret = 0;
+
+	while (io_p->file_count > 0){
+		io_p->file_count--;
+		if (fclose(io_p->fp_list[io_p->file_count]) != 0){
+			perror("Failed to close file");
+			ret = RET_FILE_IO_ERROR;
+		}
+	}
+
+	return ret;
+}
+
+// Return opened file of the name.
+static FILE * open_file(PAR3_IO_CTX *io_p, char *file_name)
+{
+	int ret;
+	uint32_t i;
+	FILE *fp;
+
+	// Search from recently opened file.
+	i = io_p->file_count;
+	while (i > 0){
+		i--;
+		if (io_p->name_list[i] == file_name)
+			return io_p->fp_list[i];
+	}
+
+	if (io_p->file_count == io_p->file_max){
+		// Files must be open until reading finishes.
+		if (io_p->async_p != NULL){
+			if (async_read_wait(io_p->async_p) != 0){
+				perror("Failed to read file");
+				return NULL;
+			}
+		}
+		ret = close_all_file(io_p);
+		if (ret != 0)
+			return NULL;
+	}
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL){
+		perror("Failed to open file");
+		return NULL;
+	}
+	io_p->name_list[io_p->file_count] = file_name;
+	io_p->fp_list[io_p->file_count] = fp;
+	io_p->file_count++;
+
+	return fp;
+}
+
+// Read file data into buffer.
+// When asynchronous I/O is used, data is available after io_batch_wait().
+int io_batch_read(PAR3_IO_CTX *io_p, char *file_name, int64_t offset, uint8_t *buf, size_t size)
+{
+	FILE *fp;
+
+	fp = open_file(io_p, file_name);
+	if (fp == NULL)
+		return RET_FILE_IO_ERROR;
+
+	if (io_p->async_p != NULL){
+		if (async_read_submit(io_p->async_p, _fileno(fp), offset, buf, size) != 0){
+			perror("Failed to read file");
+			return RET_FILE_IO_ERROR;
+		}
+		return 0;
+	}
+
+	if (_fseeki64(fp, offset, SEEK_SET) != 0){
+		perror("Failed to seek file");
+		return RET_FILE_IO_ERROR;
+	}
+	if (fread(buf, 1, size, fp) != size){
+		perror("Failed to read file");
+		return RET_FILE_IO_ERROR;
+	}
+
+	return 0;
+}
+
+// Wait for all reads to finish.
+int io_batch_wait(PAR3_IO_CTX *io_p)
+{
+	if (io_p->async_p != NULL){
+		if (async_read_wait(io_p->async_p) != 0){
+			perror("Failed to read file");
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	return 0;
+}
+
+// Map file data into memory, instead of reading it into buffer.
+// Return address of the data, or NULL when it cannot be mapped at "align" bytes boundary.
+// The mapped data may be modified, but the file isn't changed.
+// It's available until io_batch_unmap().
+uint8_t * io_batch_map(PAR3_IO_CTX *io_p, char *file_name, int64_t offset, size_t size, size_t align)
+{
+	FILE *fp;
+	uint8_t *view;
+
+	if ( (align > 1) && (offset % align != 0) )
+		return NULL;	// The address would be misaligned.
+
+	if (io_p->map_count == io_p->map_max){
+		uint8_t **new_list;
+		size_t *new_size;
+		uint32_t new_max;
+
+		new_max = (io_p->map_max == 0) ? 64 : io_p->map_max * 2;
+		new_list = realloc(io_p->map_list, sizeof(uint8_t *) * new_max);
+		if (new_list == NULL)
+			return NULL;
+		io_p->map_list = new_list;
+		new_size = realloc(io_p->map_size, sizeof(size_t) * new_max);
+		if (new_size == NULL)
+			return NULL;
+		io_p->map_size = new_size;
+		io_p->map_max = new_max;
+	}
+
+	fp = open_file(io_p, file_name);
+	if (fp == NULL)
+		return NULL;
+	view = file_map(_fileno(fp), offset, size);
+	if (view == NULL)
+		return NULL;
+
+	io_p->map_list[io_p->map_count] = view;
+	io_p->map_size[io_p->map_count] = size;
+	io_p->map_count++;
+
+	return view;
+}
+
+// Release all mapped data.
+void io_batch_unmap(PAR3_IO_CTX *io_p)
+{
+	while (io_p->map_count > 0){
+		io_p->map_count--;
+		file_unmap(io_p->map_list[io_p->map_count], io_p->map_size[io_p->map_count]);
+	}
+}
+
+// Wait for reads, and close all files.
+int io_batch_close(PAR3_IO_CTX *io_p)
+{
+	int ret = 0;
+
+	io_batch_unmap(io_p);
+	free(io_p->map_list);
+	io_p->map_list = NULL;
+	free(io_p->map_size);
+	io_p->map_size = NULL;
+	io_p->map_max = 0;
+	if (io_p->async_p != NULL){
+		if (async_read_wait(io_p->async_p) != 0){
+			perror("Failed to read file");
+			ret = RET_FILE_IO_ERROR;
+		}
+		async_read_close(io_p->async_p);
+		io_p->async_p = NULL;
+	}
+	if (io_p->fp_list != NULL){
+		if (close_all_file(io_p) != 0)
+			ret = RET_FILE_IO_ERROR;
+		free(io_p->fp_list);
+		io_p->fp_list = NULL;
+	}
+	if (io_p->name_list != NULL){
+		free(io_p->name_list);
+		io_p->name_list = NULL;
+	}
+
+	return ret;
+}
@@ -0,0 +1,21 @@
+// Batch of reading file data.
+// When asynchronous I/O is available, multiple reads are in flight at once.
+// Otherwise, each read is done by stdio at submitting time.
+typedef struct {
+	struct async_read *async_p;	// NULL = read by stdio
+	char **name_list;	// name of opened files (compared by pointer)
+	FILE **fp_list;		// opened files
+	uint32_t file_count;
+	uint32_t file_max;
+	uint8_t **map_list;	// mapped views of file data
+	size_t *map_size;
+	uint32_t map_count;
+	uint32_t map_max;
+} PAR3_IO_CTX;
+
+int io_batch_open(PAR3_CTX *par3_ctx, PAR3_IO_CTX *io_p, uint8_t *buf, size_t buf_size);
+int io_batch_read(PAR3_IO_CTX *io_p, char *file_name, int64_t offset, uint8_t *buf, size_t size);
+int io_batch_wait(PAR3_IO_CTX *io_p);
+uint8_t * io_batch_map(PAR3_IO_CTX *io_p, char *file_name, int64_t offset, size_t size, size_t align);
+void io_batch_unmap(PAR3_IO_CTX *io_p);
+int io_batch_close(PAR3_IO_CTX *io_p);
@@ -0,0 +1,219 @@
+#include "libpar3.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_gather.h"
+
+
+// Max number of buffers in one vectored write
+#define IO_GATHER_VEC_MAX 64
+
+// Size of buffer for copied small data
+#define IO_GATHER_COPY_SIZE 8192
+
+// Size of aligned buffer in direct mode
+#define IO_GATHER_ALIGN_SIZE (4 << 20)
+
+// Create a PAR file to write.
+// When "flag_direct" is set, it tries to write without page cache.
+// Return non-zero with errno, when failed.
+int io_gather_open(PAR3_GATHER_CTX *gp, char *file_name, int flag_direct)
+{
+	memset(gp, 0, sizeof(PAR3_GATHER_CTX));
+
+	gp->direct = (flag_direct != 0);
+	gp->fd = file_open_write(file_name, &(gp->direct));
+	if (gp->fd < 0)
+		return RET_FILE_IO_ERROR;
+
+	if (gp->direct){
+		gp->align_alloc = malloc(IO_GATHER_ALIGN_SIZE + FILE_DIRECT_ALIGN);
+		if (gp->align_alloc != NULL){
+			gp->align_buf = (uint8_t *)(((uintptr_t)gp->align_alloc + FILE_DIRECT_ALIGN - 1) & ~((uintptr_t)FILE_DIRECT_ALIGN - 1));
+		}
+	} else {
+		gp->vec_list = malloc(sizeof(struct file_vec) * IO_GATHER_VEC_MAX);
+		gp->copy_buf = malloc(IO_GATHER_COPY_SIZE);
+	}
+	if ( (gp->direct) ? (gp->align_buf == NULL) : ((gp->vec_list == NULL) || (gp->copy_buf == NULL)) ){
+		io_gather_close(gp);
+		errno = ENOMEM;
+		return RET_MEMORY_ERROR;
+	}
+
+	return 0;
+}
+
+// Write aligned data in the buffer.
+// At the end of file, the last partial data is written with zero padding.
+static int write_aligned(PAR3_GATHER_CTX *gp, int flag_tail)
+{
+	size_t write_size;
+	struct file_vec vec;
+
+	write_size = gp->align_size & ~((size_t)FILE_DIRECT_ALIGN - 1);
+	if ( (flag_tail) && (write_size < gp->align_size) ){
+		write_size += FILE_DIRECT_ALIGN;
+		memset(gp->align_buf + gp->align_size, 0, write_size - gp->align_size);
+		gp->align_size = write_size;
+	}
+	if (write_size == 0)
+		return 0;
+
+	vec.buf = gp->align_buf;
+	vec.size = write_size;
+	if (file_write_vector(gp->fd, gp->offset, &vec, 1) != 0)
+		return RET_FILE_IO_ERROR;
+	gp->offset += write_size;
+
+	// Keep the rest for next write.
+	gp->align_size -= write_size;
+	if (gp->align_size > 0)
+		memmove(gp->align_buf, gp->align_buf + write_size, gp->align_size);
+
+	return 0;
+}
+
+// Copy data into aligned buffer. When "buf" is NULL, zero bytes are put.
+static int put_aligned(PAR3_GATHER_CTX *gp, uint8_t *buf, uint64_t size)
+{
+	size_t copy_size;
+
+	while (size > 0){
+		copy_size = IO_GATHER_ALIGN_SIZE - gp->align_size;
+		if (copy_size > size)
+			copy_size = (size_t)size;
+		if (buf != NULL){
+			memcpy(gp->align_buf + gp->align_size, buf, copy_size);
+			buf += copy_size;
+		} else {
+			memset(gp->align_buf + gp->align_size, 0, copy_size);
+		}
+		gp->align_size += copy_size;
+		gp->size += copy_size;
+		size -= copy_size;
+
+		if (gp->align_size == IO_GATHER_ALIGN_SIZE){
+			if (write_aligned(gp, 0) != 0)
+				return RET_FILE_IO_ERROR;
+		}
+	}
+
+	return 0;
+}
+
+// Add data to write.
+// The buffer is referenced, so it must not be changed until io_gather_flush() or io_gather_close().
+int io_gather_add(PAR3_GATHER_CTX *gp, void *buf, size_t size)
+{
+	if (size == 0)
+		return 0;
+	if (gp->direct)
+		return put_aligned(gp, buf, size);
+
+	if (gp->vec_count == IO_GATHER_VEC_MAX){
+		if (io_gather_flush(gp) != 0)
+			return RET_FILE_IO_ERROR;
+	}
+	gp->vec_list[gp->vec_count].buf = buf;
+	gp->vec_list[gp->vec_count].size = size;
+	gp->vec_count++;
+	gp->size += size;
+
+	return 0;
+}
+
+// Add small data to write, such as packet header.
+// The data is copied, so the buffer may be changed after return.
+int io_gather_copy(PAR3_GATHER_CTX *gp, void *buf, size_t size)
+{
+	uint8_t *copy_p;
+
+	if (gp->direct)
+		return put_aligned(gp, buf, size);
+	if (size > IO_GATHER_COPY_SIZE){	// Too large to copy
+		if (io_gather_add(gp, buf, size) != 0)
+			return RET_FILE_IO_ERROR;
+		return io_gather_flush(gp);
+	}
+
+	// Flush before copying, because the copied data must be in the next write.
+	if ( (gp->copy_size + size > IO_GATHER_COPY_SIZE) || (gp->vec_count == IO_GATHER_VEC_MAX) ){
+		if (io_gather_flush(gp) != 0)
+			return RET_FILE_IO_ERROR;
+	}
+	copy_p = gp->copy_buf + gp->copy_size;
+	memcpy(copy_p, buf, size);
+	gp->copy_size += size;
+
+	return io_gather_add(gp, copy_p, size);
+}
+
+// Leave zero bytes in the file.
+// They are not written, when the file system supports sparse files.
+int io_gather_skip(PAR3_GATHER_CTX *gp, uint64_t size)
+{
+	if (gp->direct)
+		return put_aligned(gp, NULL, size);
+
+	if (io_gather_flush(gp) != 0)
+		return RET_FILE_IO_ERROR;
+	gp->size += size;
+	gp->offset = gp->size;
+
+	return 0;
+}
+
+// Write pending data on file.
+// In direct mode, the last unaligned data is kept in the buffer.
+int io_gather_flush(PAR3_GATHER_CTX *gp)
+{
+	int ret;
+
+	if (gp->direct)
+		return write_aligned(gp, 0);
+	if (gp->vec_count == 0)
+		return 0;
+
+	ret = file_write_vector(gp->fd, gp->offset, gp->vec_list, gp->vec_count);
+	gp->vec_count = 0;
+	gp->copy_size = 0;
+	if (ret != 0)
+		return RET_FILE_IO_ERROR;
+	gp->offset = gp->size;
+
+	return 0;
+}
+
+// Write rest data and close the file.
+// Even when it failed, the file is closed and resources are released.
+int io_gather_close(PAR3_GATHER_CTX *gp)
+{
+	int ret = 0;
+
+	if (gp->fd >= 0){
+		if (gp->direct){
+			if (gp->align_buf != NULL)
+				ret = write_aligned(gp, 1);
+		} else if (gp->vec_list != NULL){
+			ret = io_gather_flush(gp);
+		}
+		// Padding and skipped area are adjusted by the file size.
+		if (file_close_write(gp->fd, gp->size) != 0)
+			ret = RET_FILE_IO_ERROR;
+		gp->fd = -1;
+	}
+
+	free(gp->vec_list);
+	gp->vec_list = NULL;
+	free(gp->copy_buf);
+	gp->copy_buf = NULL;
+	free(gp->align_alloc);
+	gp->align_alloc = NULL;
+	gp->align_buf = NULL;
+
+	return ret;
+}
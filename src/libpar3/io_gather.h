@@ -0,0 +1,25 @@
+// Gathered writes of a PAR file.
+// Small data (packet headers) is copied, and large data (packets, blocks) is
+// referenced in place, until they are written by one vectored write.
+// In direct mode, all data is copied into an aligned buffer instead,
+// and the file is written without the page cache.
+typedef struct {
+	int fd;
+	int direct;			// 1 = written without page cache
+	int64_t offset;		// file offset of pending data
+	int64_t size;		// file size at the end of pending data
+	struct file_vec *vec_list;	// referenced buffers
+	int vec_count;
+	uint8_t *copy_buf;	// copied small data
+	size_t copy_size;
+	uint8_t *align_buf;	// aligned buffer in direct mode
+	uint8_t *align_alloc;
+	size_t align_size;
+} PAR3_GATHER_CTX;
+
+int io_gather_open(PAR3_GATHER_CTX *gp, char *file_name, int flag_direct);
+int io_gather_add(PAR3_GATHER_CTX *gp, void *buf, size_t size);
+int io_gather_copy(PAR3_GATHER_CTX *gp, void *buf, size_t size);
+int io_gather_skip(PAR3_GATHER_CTX *gp, uint64_t size);
+int io_gather_flush(PAR3_GATHER_CTX *gp);
+int io_gather_close(PAR3_GATHER_CTX *gp);
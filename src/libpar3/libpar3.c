@@ -7,6 +7,9 @@
 #include <math.h>
 
 #include "common.h"
+#include "hash_cache.h"
+#include "packet_index.h"
+#include "write.h"
 
 
 // recursive search into sub-directories
@@ -1083,6 +1086,12 @@ void par3_release(PAR3_CTX *par3_ctx)
 		par3_ctx->par_file_name_len = 0;
 		par3_ctx->par_file_name_max = 0;
 	}
+	if (par3_ctx->only_file_name){
+		free(par3_ctx->only_file_name);
+		par3_ctx->only_file_name = NULL;
+		par3_ctx->only_file_name_len = 0;
+		par3_ctx->only_file_name_max = 0;
+	}
 
 	if (par3_ctx->chunk_list){
 		free(par3_ctx->chunk_list);
@@ -1094,6 +1103,10 @@ void par3_release(PAR3_CTX *par3_ctx)
 		par3_ctx->slice_list = NULL;
 		par3_ctx->slice_count = 0;
 	}
+	if (par3_ctx->slice_check){
+		free(par3_ctx->slice_check);
+		par3_ctx->slice_check = NULL;
+	}
 	if (par3_ctx->block_list){
 		free(par3_ctx->block_list);
 		par3_ctx->block_list = NULL;
@@ -1107,10 +1120,18 @@ void par3_release(PAR3_CTX *par3_ctx)
 		free(par3_ctx->work_buf);
 		par3_ctx->work_buf = NULL;
 	}
+	if (par3_ctx->archive_stream)
+		release_archive_stream(par3_ctx);
 	if (par3_ctx->crc_list){
 		free(par3_ctx->crc_list);
 		par3_ctx->crc_list = NULL;
 	}
+	if (par3_ctx->crc_filter){
+		free(par3_ctx->crc_filter);
+		par3_ctx->crc_filter = NULL;
+	}
+	hash_cache_release(par3_ctx);
+	packet_index_release(par3_ctx);
 
 	if (par3_ctx->creator_packet){
 		free(par3_ctx->creator_packet);
@@ -1186,6 +1207,30 @@ void par3_release(PAR3_CTX *par3_ctx)
 		free(par3_ctx->recv_packet_list);
 		par3_ctx->recv_packet_list = NULL;
 		par3_ctx->recv_packet_count = 0;
+		par3_ctx->recv_packet_max = 0;
+	}
+	if (par3_ctx->recv_copy_list){
+		free(par3_ctx->recv_copy_list);
+		par3_ctx->recv_copy_list = NULL;
+		par3_ctx->recv_copy_count = 0;
+		par3_ctx->recv_copy_max = 0;
+	}
+	if (par3_ctx->recv_index_list){
+		free(par3_ctx->recv_index_list);
+		par3_ctx->recv_index_list = NULL;
+		par3_ctx->recv_index_count = 0;
+	}
+	if (par3_ctx->packet_key_set){
+		free(par3_ctx->packet_key_set);
+		par3_ctx->packet_key_set = NULL;
+		par3_ctx->packet_key_count = 0;
+		par3_ctx->packet_key_max = 0;
+	}
+	if (par3_ctx->recv_position_set){
+		free(par3_ctx->recv_position_set);
+		par3_ctx->recv_position_set = NULL;
+		par3_ctx->recv_position_count = 0;
+		par3_ctx->recv_position_max = 0;
 	}
 
 	if (par3_ctx->galois_table){
@@ -1200,6 +1245,10 @@ void par3_release(PAR3_CTX *par3_ctx)
 		free(par3_ctx->matrix);
 		par3_ctx->matrix = NULL;
 	}
+	if (par3_ctx->read_order){
+		free(par3_ctx->read_order);
+		par3_ctx->read_order = NULL;
+	}
 	if (par3_ctx->lost_list){
 		free(par3_ctx->lost_list);
 		par3_ctx->lost_list = NULL;
@@ -51,6 +51,7 @@ typedef struct {
 						// 1 = missing, 2 = damaged
 						// 4 = misnamed, higher bit is (extra_id << 3).
 						// 0x0100 = repaired, 0x0200 = repairable
+						// 0x0400 = repair in place, 0x0800 = not selected to repair
 						// 0x8000 = not file
 						// 0x10000 = different timestamp
 						// 0x20000 = different permissions
@@ -87,9 +88,11 @@ typedef struct {
 
 	uint32_t state;	// bit flag: 1 = including full size data, 2 = including tail data
 					// 64 = calculated CRC-64 of used area
+					// 0x200 = multiplied for recovery blocks at mapping
 					// Result of verification
 					// 4 = found full data, 8 = found tail data, 16 = found all tails
 					// 64 = found checksum on External Data Packet
+					// 0x100 = not used by files selected to repair
 } PAR3_BLOCK_CTX;
 
 typedef struct {
@@ -105,14 +108,69 @@ typedef struct {
 	uint64_t index;		// index of block
 	char *name;			// name of belong file
 	int64_t offset;		// offset bytes of packet
+	int checked;		// 1 = checksum was verified, 0 = not verified yet, -1 = damaged
 } PAR3_PKT_CTX;
 
 typedef struct {
-	uint64_t crc;		// CRC-64 of packet
 	char *name;			// name of belong file
 	int64_t offset;		// offset bytes of packet
 } PAR3_POS_CTX;
 
+typedef struct {
+	char *name;			// name of reading file
+	int64_t offset;		// offset bytes in the file
+	uint64_t index;		// index of block
+} PAR3_READ_CTX;
+
+typedef struct {
+	int64_t slice;		// index of found slice
+	int64_t offset;		// offset bytes of found slice
+	uint32_t flag;		// 4 = full size slice, 8 = chunk tail, 0x100 = overwrite
+} PAR3_FIND_CTX;
+
+typedef struct {
+	int ret;				// result of checking file data
+	int thread;				// index of worker thread (-1 = no need to check)
+	int flag_hash;			// 1 = calculate file hash
+	uint64_t current_size;	// current file size
+	uint64_t file_offset;	// file data is complete until here
+	uint64_t file_damage;	// size of damaged area
+	uint64_t find_start;	// range of found slices in the list of the worker
+	uint64_t find_end;
+	uint64_t crc;			// CRC-64 of the first 16 KB
+	uint8_t hash[16];		// file hash to find misnamed file
+} PAR3_CHECK_CTX;
+
+typedef struct {
+	int64_t offset;			// offset of packet in PAR file
+	int checked;			// 1 = checksum was verified, 0 = not verified yet
+} PAR3_SCAN_PKT;
+
+typedef struct {
+	int ret;				// result of scanning PAR file (-1 = failed to read, -2 = cannot map, -3 = cannot open)
+	char *name;				// file name in the list of PAR files
+	uint8_t *view;			// mapped file data
+	uint64_t file_size;
+	uint8_t *record;		// record in packet index (NULL = search packets in the file)
+	PAR3_SCAN_PKT *found_list;	// packets found by worker thread
+	uint64_t found_count;
+	uint64_t found_max;
+} PAR3_SCAN_CTX;
+
+typedef struct {
+	uint64_t start;			// first block number in the PAR file
+	uint64_t count;			// number of blocks in the PAR file
+	char *name;				// PAR filename
+	int ret;				// result of writing the file
+} PAR3_WRITE_CTX;
+
+typedef struct {
+	uint64_t size;		// file size
+	uint64_t crc;		// CRC-64 of the first 16 KB
+	uint32_t index;		// index of input file
+	uint32_t flag;		// 1 = CRC-64 is unknown
+} PAR3_MISNAME_CTX;
+
 typedef struct {
 	// Command-line options
 	int noise_level;
@@ -120,12 +178,20 @@ typedef struct {
 	char deduplication;
 	char data_packet;
 	char absolute_path;
+	char repair_inplace;	// Write repaired data on damaged files directly, with undo journal
+	char repair_reread;		// Read repaired files again to verify, instead of checking data at writing
+	char packet_index;		// Write packet index file of PAR files at creation
+	char write_direct;		// Write PAR files without page cache
 	uint32_t file_system;	// Bit flag to store/recover in File System Specific Packets
 							// UNIX Permissions Packet: 1 = mtime, 2 = i_mode
 							// FAT Permissions Packet: 0x10000 = LastWriteTimestamp
 	uint32_t search_limit;	// how long time to slide search (milli second)
 	uint64_t memory_limit;	// how much memory to use (byte)
 	int repetition_limit;	// max repetition of packets in each file
+	uint32_t thread_count;	// number of worker threads (0 = default)
+	uint32_t io_depth;		// number of reads in flight (0 = default, 1 = stdio only)
+	char hash_cache_path[_MAX_PATH];	// file to store checksums of input files
+	uint32_t hash_cache_check;	// number of blocks to spot-check in each cached file
 
 	// For CRC-64 as rolling hash
 	uint64_t window_table[256];		// slide window search for block size
@@ -134,10 +200,29 @@ typedef struct {
 	uint64_t window_mask40;
 
 	uint8_t *work_buf;		// Working buffer for temporary usage
+	void *archive_stream;	// State of writing Archive Files while creating recovery blocks
 	PAR3_CMP_CTX *crc_list;	// List of CRC-64 for slide window search
 	uint64_t crc_count;		// Number of CRC-64 in the list
 	PAR3_CMP_CTX *tail_list;
 	uint64_t tail_count;
+	uint8_t *crc_filter;	// Bit filter of CRC-64 in crc_list and tail_list
+	uint64_t crc_filter_mask;
+	PAR3_FIND_CTX *find_list;	// List of found slices on worker thread
+	uint64_t find_count;
+	uint64_t find_max;
+
+	uint8_t *hash_cache_buf;		// Loaded records of hash cache
+	size_t hash_cache_size;
+	uint8_t **hash_cache_list;		// Sorted list of records by file name
+	uint32_t hash_cache_count;
+	uint8_t *hash_cache_new;		// New records to save in hash cache
+	size_t hash_cache_new_size;		// current used size
+	size_t hash_cache_new_max;		// allocated size on memory
+
+	uint8_t *packet_index_buf;		// Loaded records of packet index
+	size_t packet_index_size;
+	uint8_t **packet_index_list;	// Sorted list of records by file name
+	uint32_t packet_index_count;
 
 	uint8_t set_id[8];	// InputSetID
 	uint8_t attribute;	// attributes in Root Packet
@@ -155,6 +240,7 @@ typedef struct {
 	uint32_t *lost_list;	// List for lost blocks and recovery blocks for every cohorts
 
 	int *recv_id_list;		// List for index of using recovery blocks
+	uint64_t *read_order;	// Index of input blocks in order of reading files
 	void *matrix;
 
 	uint64_t block_size;
@@ -196,10 +282,15 @@ typedef struct {
 	size_t extra_file_name_len;		// current used size
 	size_t extra_file_name_max;		// allocated size on memory
 
+	char *only_file_name;			// List of file names to repair (empty = all files)
+	size_t only_file_name_len;		// current used size
+	size_t only_file_name_max;		// allocated size on memory
+
 	uint32_t chunk_count;
 	PAR3_CHUNK_CTX *chunk_list;		// List of chunk description
 	uint64_t slice_count;
 	PAR3_SLICE_CTX *slice_list;		// List of input file slice
+	uint8_t *slice_check;			// Flags of slices, which were checked at writing repaired data
 
 	uint8_t *creator_packet;		// pointer to Creator Packet
 	size_t creator_packet_size;		// size of Creator Packet
@@ -243,6 +334,18 @@ typedef struct {
 	uint64_t data_packet_count;
 	PAR3_PKT_CTX *recv_packet_list;	// List of Recovery Data Packets
 	uint64_t recv_packet_count;
+	uint64_t recv_packet_max;		// Number of allocated items in the list
+	PAR3_PKT_CTX *recv_copy_list;	// List of same Recovery Data Packets at other positions
+	uint64_t recv_copy_count;
+	uint64_t recv_copy_max;
+	PAR3_PKT_CTX **recv_index_list;	// Recovery Data Packets and copies sorted by index of block
+	uint64_t recv_index_count;
+	uint8_t *packet_key_set;		// Hash set of checksums of loaded packets, only while reading PAR files
+	uint64_t packet_key_count;		// Number of checksums in the set
+	uint64_t packet_key_max;		// Number of slots in the set (power of 2)
+	PAR3_READ_CTX *recv_position_set;	// Hash set of positions of Recovery Data Packets, only while reading PAR files
+	uint64_t recv_position_count;
+	uint64_t recv_position_max;
 
 } PAR3_CTX;
 
@@ -7,6 +7,7 @@
 
 #include "map.h"
 #include "packet.h"
+#include "packet_index.h"
 #include "write.h"
 #include "block.h"
 
@@ -208,15 +209,28 @@ int par3_trial(PAR3_CTX *par3_ctx, char *temp_path)
 
 int par3_create(PAR3_CTX *par3_ctx, char *temp_path)
 {
-	int ret;
+	int ret, flag_encode;
+
+	// Hash cache is available only for mapping without deduplication.
+	if ( (par3_ctx->hash_cache_path[0] != 0) && (par3_ctx->noise_level >= 0) ){
+		if ( (par3_ctx->deduplication == '1') || (par3_ctx->deduplication == '2') )
+			printf("Hash cache is not used with deduplication.\n");
+	}
 
 	// Map input file slices into input blocks.
+	flag_encode = 0;
 	if (par3_ctx->block_count == 0){
 		ret = map_chunk_tail(par3_ctx);
 	} else if (par3_ctx->deduplication == '1'){	// Simple deduplication
 		ret = map_input_block(par3_ctx);
 	} else if (par3_ctx->deduplication == '2'){	// Deduplication with slide search
 		ret = map_input_block_slide(par3_ctx);
+	} else if ( (par3_ctx->hash_cache_path[0] == 0) && (par3_ctx->data_packet == 0) && ((par3_ctx->ecc_method & 8) == 0)
+			&& ( (par3_ctx->recovery_block_count > 0) || (par3_ctx->redundancy_size > 0) ) ){
+		// Without deduplication, mapping depends on file size only.
+		// Input files are read after number of recovery blocks is known.
+		ret = map_input_block_trial(par3_ctx);
+		flag_encode = 1;
 	} else {
 		ret = map_input_block_simple(par3_ctx);
 	}
@@ -228,6 +242,13 @@ int par3_create(PAR3_CTX *par3_ctx, char *temp_path)
 	if (ret != 0)
 		return ret;
 
+	// Calculate checksums of input blocks, and multiply them for recovery blocks at the same time.
+	if (flag_encode){
+		ret = map_input_block_encode(par3_ctx);
+		if (ret != 0)
+			return ret;
+	}
+
 	// Creator Packet, Comment Packet, Start Packet
 	ret = make_start_packet(par3_ctx, 0);
 	if (ret != 0)
@@ -268,9 +289,14 @@ int par3_create(PAR3_CTX *par3_ctx, char *temp_path)
 				return ret;
 		}
 
-		// Write PAR3 files with input blocks
+		// Write PAR3 files with input blocks.
+		// When recovery blocks are created, they are written while reading input blocks.
 		if (par3_ctx->data_packet != 0){
-			ret = write_archive_file(par3_ctx, temp_path);
+			if (par3_ctx->recovery_block_count > 0){
+				ret = open_archive_stream(par3_ctx, temp_path);
+			} else {
+				ret = write_archive_file(par3_ctx, temp_path);
+			}
 			if (ret != 0)
 				return ret;
 		}
@@ -308,6 +334,18 @@ int par3_create(PAR3_CTX *par3_ctx, char *temp_path)
 				return ret;
 			}
 		}
+
+		// Finish Archive Files, or write them at here when input blocks were not given.
+		ret = close_archive_stream(par3_ctx);
+		if (ret != 0)
+			return ret;
+	}
+
+	// Write positions of packets in the created PAR files.
+	if (par3_ctx->packet_index != 0){
+		ret = packet_index_save(par3_ctx);
+		if (ret != 0)
+			return ret;
 	}
 
 	return 0;
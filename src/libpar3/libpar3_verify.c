@@ -166,6 +166,7 @@ int par3_verify(PAR3_CTX *par3_ctx)
 	}
 
 	// Aggregate recovery blocks of each Matrix Packet
+	// Checksum of Recovery Data Packets isn't verified here, because their data isn't used.
 	recovery_block_available = aggregate_recovery_block(par3_ctx);
 	if (par3_ctx->interleave == 0){
 		if (block_available + recovery_block_available >= block_count){
@@ -213,11 +214,13 @@ int par3_verify(PAR3_CTX *par3_ctx)
 int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 {
 	int ret;
+	uint32_t file_index;
 	uint32_t missing_dir_count, bad_dir_count;
 	uint32_t missing_file_count, damaged_file_count, misnamed_file_count, bad_file_count;
 	uint32_t possible_count, lost_count_cohort, lack_count_cohort;
+	uint32_t left_file_count;
 	uint64_t block_count, block_available;
-	uint64_t recovery_block_available, recovery_block_lack;
+	uint64_t recovery_block_available, recovery_block_lack, unusable_count;
 
 	ret = read_packet(par3_ctx);
 	if (ret != 0)
@@ -252,6 +255,17 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 			return ret;
 	}
 
+	// When files to repair are specified, other files are ignored at repair.
+	if (par3_ctx->only_file_name_len > 0){
+		if (set_only_file(par3_ctx) == 0)
+			return RET_INVALID_COMMAND;
+	}
+
+	// When previous in-place repair was interrupted, restore original data at first.
+	ret = undo_inplace_repair(par3_ctx, NULL);
+	if (ret != 0)
+		return ret;
+
 	// Check input file and directory.
 	missing_dir_count = 0;
 	bad_dir_count = 0;
@@ -302,6 +316,23 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 		return 0;
 	}
 
+	// When selected files are complete, others are left as they are.
+	if (par3_ctx->only_file_name_len > 0){
+		for (file_index = 0; file_index < par3_ctx->input_file_count; file_index++){
+			if ( ((par3_ctx->input_file_list[file_index].state & 7) != 0)
+					&& ((par3_ctx->input_file_list[file_index].state & 0x800) == 0) ){
+				break;
+			}
+		}
+		if (file_index == par3_ctx->input_file_count){
+			if (par3_ctx->noise_level >= -1){
+				printf("\n");
+				printf("Selected files are correct, repair is not required.\n");
+			}
+			return 0;
+		}
+	}
+
 	// There are damaged or missing files.
 	if (par3_ctx->noise_level >= -1){
 		printf("\nRepair is required.\n");
@@ -336,18 +367,29 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 		}
 	}
 
-	// Aggregate recovery blocks of each Matrix Packet
-	recovery_block_available = aggregate_recovery_block(par3_ctx);
-	if (par3_ctx->interleave == 0){
-		if (block_available + recovery_block_available >= block_count){
-			recovery_block_lack = 0;
+	do {
+		// Aggregate recovery blocks of each Matrix Packet
+		recovery_block_available = aggregate_recovery_block(par3_ctx);
+		if (par3_ctx->interleave == 0){
+			if (block_available + recovery_block_available >= block_count){
+				recovery_block_lack = 0;
+			} else {
+				recovery_block_lack = block_count - block_available - recovery_block_available;
+			}
+			lost_count_cohort = (uint32_t)(block_count - block_available);
 		} else {
-			recovery_block_lack = block_count - block_available - recovery_block_available;
+			recovery_block_lack = aggregate_block_cohort(par3_ctx, &lost_count_cohort, &lack_count_cohort);
 		}
-		lost_count_cohort = (uint32_t)(block_count - block_available);
-	} else {
-		recovery_block_lack = aggregate_block_cohort(par3_ctx, &lost_count_cohort, &lack_count_cohort);
-	}
+
+		// Verify only Recovery Data Packets, which will be used to repair.
+		// When some of them are damaged, recovery blocks are aggregated and selected again.
+		unusable_count = 0;
+		if ( (recovery_block_lack == 0) && (block_available < block_count) ){
+			ret = check_using_packet(par3_ctx, block_count - block_available, &unusable_count);
+			if (ret != 0)
+				return ret;
+		}
+	} while (unusable_count > 0);
 	if (recovery_block_lack == 0){
 		if (par3_ctx->noise_level >= -1){
 			printf("Repair is possible.\n");
@@ -399,11 +441,19 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 		// When input blocks are enough, restore missing and damaged file.
 		if (block_available >= block_count){
 
+			// Select damaged files to repair in place.
+			if (par3_ctx->repair_inplace)
+				set_inplace_file(par3_ctx);
+
 			// Create temporary files for lost input files
 			ret = create_temp_file(par3_ctx, temp_path);
 			if (ret != 0)
 				return ret;
 
+			// Decode matrix of previous repair isn't required.
+			if (par3_ctx->ecc_method & 1)
+				rs_delete_matrix_cache(par3_ctx);
+
 			// Restore content of input files
 			ret = restore_input_file(par3_ctx, temp_path);
 			if (ret != 0)
@@ -420,10 +470,16 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 			if (par3_ctx->ecc_method & 1){	// Cauchy Reed-Solomon Erasure Codes
 				// Construct matrix for Reed-Solomon Codes, and solve linear equation.
 				ret = rs_compute_matrix(par3_ctx, block_count - block_available);
-				if (ret != 0)
+				if (ret != 0){
+					rs_delete_matrix_cache(par3_ctx);
 					return ret;
+				}
 			}
 
+			// Select damaged files to repair in place.
+			if (par3_ctx->repair_inplace)
+				set_inplace_file(par3_ctx);
+
 			// Create temporary files for lost input files
 			ret = create_temp_file(par3_ctx, temp_path);
 			if (ret != 0)
@@ -433,8 +489,6 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 			if (par3_ctx->ecc_method & 0x8000){
 				// Recover lost input blocks at reading each input block.
 				ret = recover_lost_block(par3_ctx, temp_path, (int)(block_count - block_available));
-				if (ret != 0)
-					return ret;
 
 			} else {
 				// Recover lost input blocks by spliting every block.
@@ -444,12 +498,26 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 				} else {
 					ret = recover_lost_block_split(par3_ctx, temp_path, block_count - block_available);
 				}
-				if (ret != 0)
-					return ret;
 			}
 
+			if (par3_ctx->ecc_method & 1){
+				if (ret == RET_FILE_IO_ERROR){
+					// Keep decode matrix, when repair may be retried after fixing the I/O error.
+					rs_save_matrix_cache(par3_ctx, block_count - block_available);
+				} else {
+					// Lost blocks were recovered, or the matrix is useless.
+					rs_delete_matrix_cache(par3_ctx);
+				}
+			}
+			if (ret != 0)
+				return ret;
+
 		// Even when blocks are not enough, this tries to repair as possible as it can.
 		} else {
+			// Decode matrix of previous repair isn't required.
+			if (par3_ctx->ecc_method & 1)
+				rs_delete_matrix_cache(par3_ctx);
+
 			// Try to restore content of input files
 			ret = try_restore_input_file(par3_ctx, temp_path);
 			if (ret != 0)
@@ -469,13 +537,27 @@ int par3_repair(PAR3_CTX *par3_ctx, char *temp_path)
 		// If all directories become ok, return zero.
 	}
 
-	if (missing_dir_count + bad_dir_count + missing_file_count + damaged_file_count + misnamed_file_count + bad_file_count == 0){
+	// Files, which were not selected to repair, are damaged or missing still.
+	left_file_count = 0;
+	if (par3_ctx->only_file_name_len > 0){
+		for (file_index = 0; file_index < par3_ctx->input_file_count; file_index++){
+			if ( ((par3_ctx->input_file_list[file_index].state & 7) != 0)
+					&& ((par3_ctx->input_file_list[file_index].state & 0x800) != 0) ){
+				left_file_count++;
+			}
+		}
+	}
+
+	if (missing_dir_count + bad_dir_count + missing_file_count + damaged_file_count + misnamed_file_count + bad_file_count + left_file_count == 0){
 		// When it repaired all input set
 		printf("\nRepair complete.\n");
 		return 0;
 
-	} else if (missing_dir_count + bad_dir_count + missing_file_count + damaged_file_count + misnamed_file_count + bad_file_count < possible_count){
+	} else if (missing_dir_count + bad_dir_count + missing_file_count + damaged_file_count + misnamed_file_count + bad_file_count + left_file_count < possible_count){
 		// Though it repaired some files, others are damaged or missing still.
+		if ( (left_file_count > 0) && (par3_ctx->noise_level >= 0) ){
+			printf("\n%u files were not selected to repair.\n", left_file_count);
+		}
 		printf("\nRepair partially.\n");
 		return RET_REPAIR_FAILED;
 
@@ -8,26 +8,175 @@
 #include <string.h>
 #include <time.h>
 
+#include "block.h"
+#include "galois.h"
 #include "hash.h"
+#include "hash_cache.h"
+#include "packet.h"
+#include "reedsolomon.h"
+
+
+// Read an input file, and calculate checksums of the file, its full size blocks, and chunk tail.
+// Full size blocks of the file must be mapped in order from chunk_p->block.
+// When cache_p isn't NULL, checksums are copied from hash cache without reading the file.
+// When encode_func isn't NULL, it's called for each full size block in work_buf.
+// At return, buf_tail keeps checksums of chunk tail, or data of tiny chunk tail (1 ~ 39 bytes).
+static int hash_input_file(PAR3_CTX *par3_ctx, PAR3_FILE_CTX *file_p, PAR3_CHUNK_CTX *chunk_p,
+		uint8_t *cache_p, uint8_t *work_buf, uint8_t *buf_tail, uint64_t *tail_crc,
+		void (*encode_func)(PAR3_CTX *, uint64_t, uint8_t *),
+		uint64_t progress_total, uint64_t *progress_step_p)
+{
+	uint8_t *data_p;
+	int progress_old, progress_now;
+	size_t name_len;
+	uint64_t block_size, read_size, file_offset;
+	PAR3_BLOCK_CTX *block_p;
+	FILE *fp;
+	blake3_hasher hasher;
+	time_t time_old, time_now;
+
+	block_size = par3_ctx->block_size;
+	block_p = par3_ctx->block_list + chunk_p->block;
 
+	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+		progress_old = 0;
+		time_old = time(NULL);
+	}
+
+	fp = NULL;
+	if (cache_p != NULL){
+		memcpy(&(file_p->crc), cache_p + 40, 8);
+		memcpy(file_p->hash, cache_p + 48, 16);
+		memcpy(buf_tail, cache_p + 64, 40);
+		memcpy(&name_len, cache_p + 104, 8);
+		cache_p += CACHE_RECORD_SIZE + ((name_len + 7) & ~7);	// Checksums of full size blocks
+	} else {
+		fp = fopen(file_p->name, "rb");
+		if (fp == NULL){
+			perror("Failed to open input file");
+			return RET_FILE_IO_ERROR;
+		}
+		file_p->crc = 0;
+		blake3_hasher_init(&hasher);
+	}
+
+	// Read full size blocks, and chunk tail at the last.
+	file_offset = 0;
+	while (file_offset < file_p->size){
+		read_size = file_p->size - file_offset;
+		if (read_size > block_size)
+			read_size = block_size;
+		data_p = (read_size >= 40) ? work_buf : buf_tail;
+
+		if (fp != NULL){
+			if (fread(data_p, 1, (size_t)read_size, fp) != (size_t)read_size){
+				if (read_size == block_size){
+					perror("Failed to read full size chunk on input file");
+				} else {
+					perror("Failed to read tail chunk on input file");
+				}
+				fclose(fp);
+				return RET_FILE_IO_ERROR;
+			}
+
+			// calculate CRC-64 of the first 16 KB
+			if (file_offset + read_size < 16384){
+				file_p->crc = crc64(data_p, (size_t)read_size, file_p->crc);
+			} else if (file_offset < 16384){
+				file_p->crc = crc64(data_p, (size_t)(16384 - file_offset), file_p->crc);
+			}
+			blake3_hasher_update(&hasher, data_p, (size_t)read_size);
+		}
+
+		// Print progress percent
+		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
+			*progress_step_p += read_size;
+			time_now = time(NULL);
+			if (time_now != time_old){
+				time_old = time_now;
+				progress_now = (int)((*progress_step_p * 1000) / progress_total);
+				if (progress_now != progress_old){
+					progress_old = progress_now;
+					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+				}
+			}
+		}
+
+		if (read_size == block_size){	// full size block
+			if (fp == NULL){
+				memcpy(&(block_p->crc), cache_p, 8);
+				memcpy(block_p->hash, cache_p + 8, 16);
+				cache_p += 24;
+			} else {
+				block_p->crc = crc64(work_buf, (size_t)block_size, 0);
+				blake3(work_buf, (size_t)block_size, block_p->hash);
+			}
+			block_p->state = 1 | 64;
+
+			if ( (fp != NULL) && (encode_func != NULL) )
+				encode_func(par3_ctx, (uint64_t)(block_p - par3_ctx->block_list), work_buf);
+			block_p++;
+
+		} else if (read_size >= 40){	// chunk tail
+			if (fp == NULL){
+				memcpy(&(chunk_p->tail_crc), buf_tail, 8);
+				memcpy(chunk_p->tail_hash, buf_tail + 8, 16);
+				memcpy(tail_crc, buf_tail + 24, 8);
+			} else {
+				// calculate checksum of chunk tail
+				chunk_p->tail_crc = crc64(work_buf, 40, 0);
+				blake3(work_buf, (size_t)read_size, chunk_p->tail_hash);
+				*tail_crc = crc64(work_buf, (size_t)read_size, 0);
+
+				// save checksums of tail for hash cache
+				memcpy(buf_tail, &(chunk_p->tail_crc), 8);
+				memcpy(buf_tail + 8, chunk_p->tail_hash, 16);
+				memcpy(buf_tail + 24, tail_crc, 8);
+				memset(buf_tail + 32, 0, 8);
+			}
+
+		} else {	// When tail size is 1~39 bytes, it's saved in File Packet.
+			// buf_tail was copied from hash cache already.
+			if (fp != NULL)
+				memset(buf_tail + read_size, 0, 40 - read_size);	// zero fill the rest bytes
+
+			// copy 1 ~ 39 bytes
+			memcpy(&(chunk_p->tail_crc), buf_tail, 8);
+			memcpy(chunk_p->tail_hash, buf_tail + 8, 16);
+			memcpy(&(chunk_p->tail_block), buf_tail + 24, 8);
+			memcpy(&(chunk_p->tail_offset), buf_tail + 32, 8);
+		}
+
+		file_offset += read_size;
+	}
+
+	if (fp != NULL){
+		blake3_hasher_finalize(&hasher, file_p->hash, 16);
+		if (fclose(fp) != 0){
+			perror("Failed to close input file");
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	return 0;
+}
 
 // map input file slices into input blocks without deduplication
 int map_input_block_simple(PAR3_CTX *par3_ctx)
 {
-	uint8_t *work_buf, buf_tail[40];
-	int progress_old, progress_now;
-	uint32_t num, num_pack;
+	uint8_t *work_buf, buf_tail[40], *cache_p;
+	int ret;
+	uint32_t num, num_pack, cache_hit;
 	uint32_t input_file_count, chunk_index;
 	uint64_t block_size, tail_size, file_offset, tail_offset;
+	uint64_t tail_crc = 0;
 	uint64_t block_count, block_index, slice_index, index;
 	uint64_t progress_total, progress_step;
 	PAR3_FILE_CTX *file_p;
 	PAR3_CHUNK_CTX *chunk_p;
 	PAR3_SLICE_CTX *slice_p, *slice_list;
 	PAR3_BLOCK_CTX *block_p, *block_list;
-	FILE *fp;
-	blake3_hasher hasher;
-	time_t time_old, time_now;
+	struct _stat64 stat_buf;
 	clock_t clock_now;
 
 	// Copy variables from context to local.
@@ -72,25 +221,30 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 	}
 	par3_ctx->work_buf = work_buf;
 
+	// Load checksums of unchanged files.
+	if (par3_ctx->hash_cache_path[0] != 0){
+		ret = hash_cache_load(par3_ctx);
+		if (ret != 0)
+			return ret;
+	}
+
+	progress_total = par3_ctx->total_file_size;
+	progress_step = 0;
 	if (par3_ctx->noise_level >= 0){
 		printf("\nComputing hash:\n");
-		progress_total = par3_ctx->total_file_size;
-		progress_step = 0;
-		progress_old = 0;
-		time_old = time(NULL);
 		clock_now = clock();
 	}
 
 	// Read data of input files on memory
 	num_pack = 0;
+	cache_hit = 0;
 	chunk_index = 0;
 	block_index = 0;
 	slice_index = 0;
 	file_p = par3_ctx->input_file_list;
 	for (num = 0; num < input_file_count; num++){
-		blake3_hasher_init(&hasher);
 		if (file_p->size == 0){	// Skip empty files.
-			blake3_hasher_finalize(&hasher, file_p->hash, 16);
+			blake3(NULL, 0, file_p->hash);
 			file_p++;
 			continue;
 		}
@@ -98,10 +252,28 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 			printf("file size = %"PRIu64" \"%s\"\n", file_p->size, file_p->name);
 		}
 
-		fp = fopen(file_p->name, "rb");
-		if (fp == NULL){
-			perror("Failed to open input file");
-			return RET_FILE_IO_ERROR;
+		// When the file was not changed, use checksums in hash cache.
+		cache_p = NULL;
+		if (par3_ctx->hash_cache_path[0] != 0){
+			if (_stat64(file_p->name, &stat_buf) != 0){
+				perror("Failed to get status of input file");
+				return RET_FILE_IO_ERROR;
+			}
+			cache_p = hash_cache_search(par3_ctx, file_p, &stat_buf);
+			if ( (cache_p != NULL) && (par3_ctx->hash_cache_check > 0) ){
+				ret = hash_cache_spot_check(par3_ctx, file_p, cache_p, work_buf);
+				if (ret == 1){	// Read the file again.
+					cache_p = NULL;
+				} else if (ret != 0){
+					return ret;
+				}
+			}
+			if (cache_p != NULL){
+				if (par3_ctx->noise_level >= 3){
+					printf("Use hash cache for \"%s\"\n", file_p->name);
+				}
+				cache_hit++;
+			}
 		}
 
 		// When no deduplication, chunk's index is same as file's index.
@@ -110,44 +282,18 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 		chunk_p->size = file_p->size;	// file size = chunk size
 		chunk_p->block = block_index;
 
-		// Read full size blocks
+		// Calculate checksums of full size blocks and chunk tail.
+		ret = hash_input_file(par3_ctx, file_p, chunk_p, cache_p, work_buf, buf_tail, &tail_crc,
+				NULL, progress_total, &progress_step);
+		if (ret != 0)
+			return ret;
+
+		// Map full size blocks
 		file_offset = 0;
 		while (file_offset + block_size <= file_p->size){
-			// read full block from input file
-			if (fread(work_buf, 1, (size_t)block_size, fp) != (size_t)block_size){
-				perror("Failed to read full size chunk on input file");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-
-			// Print progress percent
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step += block_size;
-				time_now = time(NULL);
-				if (time_now != time_old){
-					time_old = time_now;
-					progress_now = (int)((progress_step * 1000) / progress_total);
-					if (progress_now != progress_old){
-						progress_old = progress_now;
-						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-					}
-				}
-			}
-
-			// calculate CRC-64 of the first 16 KB
-			if (file_offset + block_size < 16384){
-				file_p->crc = crc64(work_buf, (size_t)block_size, file_p->crc);
-			} else if (file_offset < 16384){
-				file_p->crc = crc64(work_buf, (size_t)(16384 - file_offset), file_p->crc);
-			}
-			blake3_hasher_update(&hasher, work_buf, (size_t)block_size);
-
 			// set block info
 			block_p->slice = slice_index;
 			block_p->size = block_size;
-			block_p->crc = crc64(work_buf, (size_t)block_size, 0);
-			blake3(work_buf, (size_t)block_size, block_p->hash);
-			block_p->state = 1 | 64;
 
 			// set slice info
 			slice_p->chunk = chunk_index;
@@ -169,35 +315,10 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 			block_index++;
 		}
 
-		// Calculate size of chunk tail, and read it.
+		// Calculate size of chunk tail, and map it.
 		tail_size = file_p->size - file_offset;
 		//printf("tail_size = %"PRIu64", file size = %"PRIu64", offset %"PRIu64"\n", tail_size, file_p->size, file_offset);
 		if (tail_size >= 40){
-			// read chunk tail from input file
-			if (fread(work_buf, 1, (size_t)tail_size, fp) != (size_t)tail_size){
-				perror("Failed to read tail chunk on input file");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-
-			// Print progress percent
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step += tail_size;
-				time_now = time(NULL);
-				if (time_now != time_old){
-					time_old = time_now;
-					progress_now = (int)((progress_step * 1000) / progress_total);
-					if (progress_now != progress_old){
-						progress_old = progress_now;
-						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-					}
-				}
-			}
-
-			// calculate checksum of chunk tail
-			chunk_p->tail_crc = crc64(work_buf, 40, 0);
-			blake3(work_buf, (size_t)tail_size, chunk_p->tail_hash);
-
 			// search existing tails to check available space
 			tail_offset = 0;
 			for (index = 0; index < slice_index; index++){
@@ -228,7 +349,7 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 				// set block info (block for tails don't store checksum)
 				block_p->slice = slice_index;
 				block_p->size = tail_size;
-				block_p->crc = crc64(work_buf, (size_t)tail_size, 0);
+				block_p->crc = tail_crc;
 				block_p->state = 2 | 64;
 				block_p++;
 				block_index++;
@@ -251,16 +372,8 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 
 				// update block info
 				block_list[slice_p->block].size = tail_offset + tail_size;
-				block_list[slice_p->block].crc = crc64(work_buf, (size_t)tail_size, block_list[slice_p->block].crc);
-			}
-
-			// calculate CRC-64 of the first 16 KB
-			if (file_offset + tail_size < 16384){
-				file_p->crc = crc64(work_buf, (size_t)tail_size, file_p->crc);
-			} else if (file_offset < 16384){
-				file_p->crc = crc64(work_buf, (size_t)(16384 - file_offset), file_p->crc);
+				block_list[slice_p->block].crc = crc64_combine(block_list[slice_p->block].crc, tail_crc, (size_t)tail_size);
 			}
-			blake3_hasher_update(&hasher, work_buf, (size_t)tail_size);
 
 			// set common slice info
 			slice_p->file = num;
@@ -272,51 +385,21 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 			slice_index++;
 
 		} else if (tail_size > 0){
-			// When tail size is 1~39 bytes, it's saved in File Packet.
-			if (fread(buf_tail, 1, (size_t)tail_size, fp) != (size_t)tail_size){
-				perror("Failed to read tail chunk on input file");
-				fclose(fp);
-				return RET_FILE_IO_ERROR;
-			}
-			memset(buf_tail + tail_size, 0, 40 - tail_size);	// zero fill the rest bytes
+			// Tiny chunk tail was copied in chunk description already.
 			if (par3_ctx->noise_level >= 3){
 				printf("    block no  : slice no  chunk[%2u] file %d, offset %"PRIu64", tail size %"PRIu64"\n",
 						chunk_index, num, file_offset, tail_size);
 			}
-
-			// Print progress percent
-			if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 2) ){
-				progress_step += tail_size;
-				time_now = time(NULL);
-				if (time_now != time_old){
-					time_old = time_now;
-					progress_now = (int)((progress_step * 1000) / progress_total);
-					if (progress_now != progress_old){
-						progress_old = progress_now;
-						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
-					}
-				}
-			}
-
-			// calculate CRC-64 of the first 16 KB
-			if (file_offset + tail_size < 16384){
-				file_p->crc = crc64(buf_tail, (size_t)tail_size, file_p->crc);
-			} else if (file_offset < 16384){
-				file_p->crc = crc64(buf_tail, (size_t)(16384 - file_offset), file_p->crc);
-			}
-			blake3_hasher_update(&hasher, buf_tail, (size_t)tail_size);
-
-			// copy 1 ~ 39 bytes
-			memcpy(&(chunk_p->tail_crc), buf_tail, 8);
-			memcpy(chunk_p->tail_hash, buf_tail + 8, 16);
-			memcpy(&(chunk_p->tail_block), buf_tail + 24, 8);
-			memcpy(&(chunk_p->tail_offset), buf_tail + 32, 8);
 		}
 
-		blake3_hasher_finalize(&hasher, file_p->hash, 16);
-		if (fclose(fp) != 0){
-			perror("Failed to close input file");
-			return RET_FILE_IO_ERROR;
+		// Store checksums of this file in hash cache.
+		if (par3_ctx->hash_cache_path[0] != 0){
+			if (tail_size == 0){
+				memset(buf_tail, 0, 40);
+			}
+			ret = hash_cache_add(par3_ctx, file_p, &stat_buf, block_list + chunk_p->block, buf_tail);
+			if (ret != 0)
+				return ret;
 		}
 
 		file_p++;
@@ -328,6 +411,19 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 	free(work_buf);
 	par3_ctx->work_buf = NULL;
 
+	// Save hash cache for next time.
+	if (par3_ctx->hash_cache_path[0] != 0){
+		if (par3_ctx->noise_level >= 1){
+			printf("Number of files in hash cache = %u (hit %u)\n", par3_ctx->input_file_count, cache_hit);
+		}
+		ret = hash_cache_save(par3_ctx);
+		hash_cache_release(par3_ctx);
+		// Like loading, failure of saving isn't fatal, because hash cache is optional.
+		if ( (ret != 0) && (par3_ctx->noise_level >= -1) ){
+			printf("Warning, hash cache was not saved.\n");
+		}
+	}
+
 	if (par3_ctx->noise_level >= 0){
 		if (par3_ctx->noise_level <= 2){
 			if (progress_step < progress_total)
@@ -385,6 +481,147 @@ int map_input_block_simple(PAR3_CTX *par3_ctx)
 }
 
 
+// Multiply one full size block for all recovery blocks, while reading input files.
+static void encode_input_block(PAR3_CTX *par3_ctx, uint64_t block_index, uint8_t *work_buf)
+{
+	size_t region_size;
+
+	// Zero fill rest bytes, and calculate parity bytes in the region
+	region_size = (par3_ctx->block_size + 4 + 3) & ~3;
+	memset(work_buf + par3_ctx->block_size, 0, region_size - par3_ctx->block_size);
+	if (par3_ctx->gf_size == 2){
+		gf16_region_create_parity(par3_ctx->galois_poly, work_buf, region_size);
+	} else if (par3_ctx->gf_size == 1){
+		gf8_region_create_parity(par3_ctx->galois_poly, work_buf, region_size);
+	} else {
+		region_create_parity(work_buf, region_size);
+	}
+
+	// Multipy one input block for all recovery blocks.
+	// Recovery blocks were cleared already, so values are always added.
+	rs_create_one_all(par3_ctx, (int)block_index, 1);
+	par3_ctx->block_list[block_index].state |= 0x200;
+}
+
+// read input files after mapping by map_input_block_trial(), and calculate checksums.
+// When all recovery blocks can be kept on memory, full size blocks are multiplied at the same time.
+int map_input_block_encode(PAR3_CTX *par3_ctx)
+{
+	uint8_t *work_buf, buf_tail[40];
+	int ret, flag_encode;
+	uint32_t num, input_file_count;
+	uint64_t block_size, tail_size, tail_crc;
+	uint64_t block_index, encode_count;
+	uint64_t progress_total, progress_step;
+	size_t region_size;
+	PAR3_FILE_CTX *file_p;
+	PAR3_CHUNK_CTX *chunk_p;
+	PAR3_BLOCK_CTX *block_p, *block_list;
+	clock_t clock_now;
+
+	// Copy variables from context to local.
+	input_file_count = par3_ctx->input_file_count;
+	block_size = par3_ctx->block_size;
+	block_list = par3_ctx->block_list;
+	if ( (input_file_count == 0) || (block_size == 0) || (block_list == NULL) )
+		return RET_LOGIC_ERROR;
+
+	// Size of one input block with parity bytes
+	region_size = (block_size + 4 + 3) & ~3;
+
+	// Recovery blocks are calculated only when they are kept on memory.
+	flag_encode = 0;
+	if ( (par3_ctx->recovery_block_count > 0) && (par3_ctx->ecc_method & 1) ){
+		select_galois_field(par3_ctx);
+		ret = allocate_recovery_block(par3_ctx);
+		if (ret != 0)
+			return ret;
+		if (par3_ctx->ecc_method & 0x8000){
+			flag_encode = 1;
+			// Input blocks are added on recovery blocks in order of reading files.
+			memset(par3_ctx->block_data, 0, region_size * par3_ctx->recovery_block_count);
+		}
+	}
+
+	// Allocate memory to read one input block and parity.
+	work_buf = malloc(region_size);
+	if (work_buf == NULL){
+		perror("Failed to allocate memory for input data");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->work_buf = work_buf;
+
+	progress_total = par3_ctx->total_file_size;
+	progress_step = 0;
+	if (par3_ctx->noise_level >= 0){
+		if (flag_encode){
+			printf("\nComputing hash and recovery blocks:\n");
+		} else {
+			printf("\nComputing hash:\n");
+		}
+		clock_now = clock();
+	}
+
+	// Read data of input files in order of mapped slices
+	file_p = par3_ctx->input_file_list;
+	for (num = 0; num < input_file_count; num++){
+		if (file_p->size == 0){	// Skip empty files.
+			blake3(NULL, 0, file_p->hash);
+			file_p++;
+			continue;
+		}
+		if (par3_ctx->noise_level >= 2){
+			printf("file size = %"PRIu64" \"%s\"\n", file_p->size, file_p->name);
+		}
+
+		// When no deduplication, each file contains single chunk.
+		chunk_p = par3_ctx->chunk_list + file_p->chunk;
+		ret = hash_input_file(par3_ctx, file_p, chunk_p, NULL, work_buf, buf_tail, &tail_crc,
+				flag_encode ? encode_input_block : NULL, progress_total, &progress_step);
+		if (ret != 0)
+			return ret;
+
+		// Because tails are packed in order of files, CRC of the block is combined here.
+		// The block of tails will be read again to create recovery blocks.
+		tail_size = file_p->size % block_size;
+		if (tail_size >= 40){
+			block_p = block_list + chunk_p->tail_block;
+			if (chunk_p->tail_offset == 0){
+				block_p->crc = tail_crc;
+			} else {
+				block_p->crc = crc64_combine(block_p->crc, tail_crc, (size_t)tail_size);
+			}
+		}
+
+		file_p++;
+	}
+
+	// Release temporary buffer.
+	free(work_buf);
+	par3_ctx->work_buf = NULL;
+
+	if (par3_ctx->noise_level >= 0){
+		if (par3_ctx->noise_level <= 2){
+			if (progress_step < progress_total)
+				printf("Didn't finish progress. %"PRIu64" / %"PRIu64"\n", progress_step, progress_total);
+		}
+		clock_now = clock() - clock_now;
+		printf("done in %.1f seconds.\n", (double)clock_now / CLOCKS_PER_SEC);
+		if ( (flag_encode) && (par3_ctx->noise_level >= 1) ){
+			encode_count = 0;
+			for (block_index = 0; block_index < par3_ctx->block_count; block_index++){
+				if (block_list[block_index].state & 0x200)
+					encode_count++;
+			}
+			printf("Multiplied input blocks = %"PRIu64" / %"PRIu64"\n", encode_count, par3_ctx->block_count);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
+
+
 // map chunk tails, when there are no input blocks.
 int map_chunk_tail(PAR3_CTX *par3_ctx)
 {
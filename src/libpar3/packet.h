@@ -3,6 +3,7 @@
 
 void make_packet_header(uint8_t *buf, uint64_t packet_size, uint8_t *set_id, uint8_t *packet_type, int flag_hash);
 
+void select_galois_field(PAR3_CTX *par3_ctx);
 int make_start_packet(PAR3_CTX *par3_ctx, int flag_trial);
 int make_matrix_packet(PAR3_CTX *par3_ctx);
 int make_file_packet(PAR3_CTX *par3_ctx);
@@ -14,9 +15,14 @@ int duplicate_common_packet(PAR3_CTX *par3_ctx);
 // for verification
 
 int check_packet_exist(uint8_t *buf, size_t buf_size, uint8_t *packet, uint64_t packet_size);
+int find_packet_key(PAR3_CTX *par3_ctx, uint8_t *packet);
+int add_packet_key(PAR3_CTX *par3_ctx, uint8_t *packet);
+void release_packet_key(PAR3_CTX *par3_ctx);
 int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet);
-int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64_t offset);
+int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64_t offset, int checked);
 int check_packet_set(PAR3_CTX *par3_ctx);
+int make_recv_index(PAR3_CTX *par3_ctx);
+PAR3_PKT_CTX * find_recv_packet(PAR3_CTX *par3_ctx, uint64_t block_index, uint32_t copy_index);
 
 int parse_vital_packet(PAR3_CTX *par3_ctx);
 int parse_external_data_packet(PAR3_CTX *par3_ctx);
@@ -29,18 +29,131 @@ int check_packet_exist(uint8_t *buf, size_t buf_size, uint8_t *packet, uint64_t
 	return 0;
 }
 
+// Key of a packet is its checksum. Because BLAKE3 hash is random, the first 8 bytes are used as hash value.
+// Zero checksum cannot be distinguished from empty slot, but valid packet won't have it.
+static int is_empty_key(uint8_t *key)
+{
+	uint64_t val1, val2;
+
+	memcpy(&val1, key, 8);
+	memcpy(&val2, key + 8, 8);
+
+	return (val1 | val2) == 0;
+}
+
+// Insert a key in the hash set, which has enough empty slots.
+static void insert_packet_key(uint8_t *key_set, uint64_t key_max, uint8_t *key)
+{
+	uint64_t slot;
+
+	memcpy(&slot, key, 8);
+	slot &= key_max - 1;
+	while (is_empty_key(key_set + slot * 16) == 0)
+		slot = (slot + 1) & (key_max - 1);	// linear probing
+	memcpy(key_set + slot * 16, key, 16);
+}
+
+// Search checksum of the packet in the hash set.
+// 0 = no packet yet, 1 = the packet exists already
+int find_packet_key(PAR3_CTX *par3_ctx, uint8_t *packet)
+{
+	uint8_t *key;
+	uint64_t slot;
+
+	key = packet + 8;
+	if ( (par3_ctx->packet_key_max == 0) || is_empty_key(key) )
+		return 0;
+
+	memcpy(&slot, key, 8);
+	slot &= par3_ctx->packet_key_max - 1;
+	while (is_empty_key(par3_ctx->packet_key_set + slot * 16) == 0){
+		if (memcmp(par3_ctx->packet_key_set + slot * 16, key, 16) == 0)
+			return 1;
+		slot = (slot + 1) & (par3_ctx->packet_key_max - 1);
+	}
+
+	return 0;
+}
+
+// Search checksum of the packet in the hash set, and add it when it's new.
+// Packet with zero checksum is always treated as new one.
+// 0 = added, 1 = the packet exists already, 2~ = error
+int add_packet_key(PAR3_CTX *par3_ctx, uint8_t *packet)
+{
+	uint8_t *key, *new_set;
+	uint64_t slot, new_max;
+
+	key = packet + 8;
+	if (is_empty_key(key))
+		return 0;
+	if (find_packet_key(par3_ctx, packet) == 1)
+		return 1;
+
+	// Keep more than half slots empty.
+	if ((par3_ctx->packet_key_count + 1) * 2 > par3_ctx->packet_key_max){
+		new_max = par3_ctx->packet_key_max * 2;
+		if (new_max == 0)
+			new_max = 1024;
+		new_set = calloc(new_max, 16);
+		if (new_set == NULL){
+			perror("Failed to allocate memory for checksums of packets");
+			return RET_MEMORY_ERROR;
+		}
+		for (slot = 0; slot < par3_ctx->packet_key_max; slot++){
+			if (is_empty_key(par3_ctx->packet_key_set + slot * 16) == 0)
+				insert_packet_key(new_set, new_max, par3_ctx->packet_key_set + slot * 16);
+		}
+		free(par3_ctx->packet_key_set);
+		par3_ctx->packet_key_set = new_set;
+		par3_ctx->packet_key_max = new_max;
+	}
+
+	insert_packet_key(par3_ctx->packet_key_set, par3_ctx->packet_key_max, key);
+	par3_ctx->packet_key_count++;
+
+	return 0;
+}
+
+// Checksums and positions of packets aren't used after reading PAR files.
+void release_packet_key(PAR3_CTX *par3_ctx)
+{
+	if (par3_ctx->packet_key_set){
+		free(par3_ctx->packet_key_set);
+		par3_ctx->packet_key_set = NULL;
+		par3_ctx->packet_key_count = 0;
+		par3_ctx->packet_key_max = 0;
+	}
+	if (par3_ctx->recv_position_set){
+		free(par3_ctx->recv_position_set);
+		par3_ctx->recv_position_set = NULL;
+		par3_ctx->recv_position_count = 0;
+		par3_ctx->recv_position_max = 0;
+	}
+}
+
 // It allocates memory for each packet type, and stores the packet.
 // -2 = unknown type, -1 = the packet exists already, 0 = added, 1~ = error
 int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 {
 	uint8_t *packet_type, *tmp_p;
+	int ret;
 	uint64_t packet_size;
 
 	// read packet size
 	memcpy(&packet_size, packet + 24, 8);
 
-	// allocate memory for the packet type
+	// Data Packet and Recovery Data Packet are checked in list_found_packet().
 	packet_type = packet + 40;
+	if ( (memcmp(packet_type, "PAR DAT\0", 8) != 0) && (memcmp(packet_type, "PAR REC\0", 8) != 0) ){
+		ret = add_packet_key(par3_ctx, packet);
+		if (ret == 1){	// If there is the packet already, just exit.
+			return -1;
+		} else if (ret != 0){
+			return ret;
+		}
+	}
+
+	// allocate memory for the packet type
 	if (memcmp(packet_type, "PAR CRE\0", 8) == 0){	// Creator Packet
 		if (par3_ctx->creator_packet == NULL){
 			par3_ctx->creator_packet = malloc(packet_size);
@@ -51,9 +164,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->creator_packet, packet, packet_size);
 			par3_ctx->creator_packet_size = packet_size;
 			par3_ctx->creator_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->creator_packet, par3_ctx->creator_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->creator_packet, par3_ctx->creator_packet_size + packet_size);
@@ -77,9 +187,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->comment_packet, packet, packet_size);
 			par3_ctx->comment_packet_size = packet_size;
 			par3_ctx->comment_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->comment_packet, par3_ctx->comment_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->comment_packet, par3_ctx->comment_packet_size + packet_size);
@@ -103,9 +210,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->start_packet, packet, packet_size);
 			par3_ctx->start_packet_size = packet_size;
 			par3_ctx->start_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->start_packet, par3_ctx->start_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->start_packet, par3_ctx->start_packet_size + packet_size);
@@ -129,9 +233,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->file_packet, packet, packet_size);
 			par3_ctx->file_packet_size = packet_size;
 			par3_ctx->file_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->file_packet, par3_ctx->file_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->file_packet, par3_ctx->file_packet_size + packet_size);
@@ -155,9 +256,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->dir_packet, packet, packet_size);
 			par3_ctx->dir_packet_size = packet_size;
 			par3_ctx->dir_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->dir_packet, par3_ctx->dir_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->dir_packet, par3_ctx->dir_packet_size + packet_size);
@@ -181,9 +279,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->root_packet, packet, packet_size);
 			par3_ctx->root_packet_size = packet_size;
 			par3_ctx->root_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->root_packet, par3_ctx->root_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->root_packet, par3_ctx->root_packet_size + packet_size);
@@ -207,9 +302,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->ext_data_packet, packet, packet_size);
 			par3_ctx->ext_data_packet_size = packet_size;
 			par3_ctx->ext_data_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->ext_data_packet, par3_ctx->ext_data_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->ext_data_packet, par3_ctx->ext_data_packet_size + packet_size);
@@ -233,9 +325,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->matrix_packet, packet, packet_size);
 			par3_ctx->matrix_packet_size = packet_size;
 			par3_ctx->matrix_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->matrix_packet, par3_ctx->matrix_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->matrix_packet, par3_ctx->matrix_packet_size + packet_size);
@@ -259,9 +348,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->matrix_packet, packet, packet_size);
 			par3_ctx->matrix_packet_size = packet_size;
 			par3_ctx->matrix_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->matrix_packet, par3_ctx->matrix_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->matrix_packet, par3_ctx->matrix_packet_size + packet_size);
@@ -287,9 +373,6 @@ int add_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet)
 			memcpy(par3_ctx->file_system_packet, packet, packet_size);
 			par3_ctx->file_system_packet_size = packet_size;
 			par3_ctx->file_system_packet_count = 1;
-		} else if (check_packet_exist(par3_ctx->file_system_packet, par3_ctx->file_system_packet_size, packet, packet_size) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			tmp_p = realloc(par3_ctx->file_system_packet, par3_ctx->file_system_packet_size + packet_size);
@@ -314,34 +397,133 @@ Data Packet and Recovery Data Packet will be too large to store on memory.
 	return 0;
 }
 
-// 0 = no packet yet, 1 = the packet exists already
-static int check_item_exist(PAR3_PKT_CTX *list, uint64_t item_count, uint64_t id, uint64_t index, uint8_t *cmp_buf)
+// Hash value of position of a packet.
+// Names are stored in the list of PAR files, so same name has same pointer.
+static uint64_t hash_position(uint64_t index, char *filename, int64_t offset)
+{
+	uint64_t hash;
+
+	hash = (uint64_t)(uintptr_t)filename ^ ((uint64_t)offset * 0x9E3779B97F4A7C15) ^ (index * 0xC2B2AE3D27D4EB4F);
+	return hash ^ (hash >> 32);
+}
+
+// Insert a position in the hash set, which has enough empty slots.
+static void insert_recv_position(PAR3_READ_CTX *position_set, uint64_t position_max, PAR3_READ_CTX *position)
 {
-	while (item_count != 0){
-		// compare InputSetID and index
-		if ( (list->id == id) && (list->index == index) ){
-			if (cmp_buf == NULL){	// Data Packet
+	uint64_t slot;
+
+	slot = hash_position(position->index, position->name, position->offset) & (position_max - 1);
+	while (position_set[slot].name != NULL)
+		slot = (slot + 1) & (position_max - 1);	// linear probing
+	memcpy(position_set + slot, position, sizeof(PAR3_READ_CTX));
+}
+
+// Search position of Recovery Data Packet in the hash set, and add it when it's new.
+// When same file was read again, the position exists already.
+// 0 = added, 1 = the position exists already, 2~ = error
+static int add_recv_position(PAR3_CTX *par3_ctx, uint64_t index, char *filename, int64_t offset)
+{
+	uint64_t slot, new_max;
+	PAR3_READ_CTX *position_set, *new_set, position;
+
+	position_set = par3_ctx->recv_position_set;
+	if (par3_ctx->recv_position_max > 0){
+		slot = hash_position(index, filename, offset) & (par3_ctx->recv_position_max - 1);
+		while (position_set[slot].name != NULL){
+			if ( (position_set[slot].index == index) && (position_set[slot].name == filename)
+					&& (position_set[slot].offset == offset) ){
 				return 1;
-			} else {	// Recovery Data Packet
-				// comprare other values
-				if ( (memcmp(list->root, cmp_buf, 16) == 0) && (memcmp(list->matrix, cmp_buf + 16, 16) == 0) ){
-					return 1;
-				}
 			}
+			slot = (slot + 1) & (par3_ctx->recv_position_max - 1);
 		}
+	}
 
-		list++;
-		item_count--;
+	// Keep more than half slots empty.
+	if ((par3_ctx->recv_position_count + 1) * 2 > par3_ctx->recv_position_max){
+		new_max = par3_ctx->recv_position_max * 2;
+		if (new_max == 0)
+			new_max = 1024;
+		new_set = calloc(new_max, sizeof(PAR3_READ_CTX));
+		if (new_set == NULL){
+			perror("Failed to allocate memory for positions of packets");
+			return RET_MEMORY_ERROR;
+		}
+		for (slot = 0; slot < par3_ctx->recv_position_max; slot++){
+			if (position_set[slot].name != NULL)
+				insert_recv_position(new_set, new_max, position_set + slot);
+		}
+		free(position_set);
+		par3_ctx->recv_position_set = new_set;
+		par3_ctx->recv_position_max = new_max;
 	}
 
+	position.name = filename;
+	position.offset = offset;
+	position.index = index;
+	insert_recv_position(par3_ctx->recv_position_set, par3_ctx->recv_position_max, &position);
+	par3_ctx->recv_position_count++;
+
+	return 0;
+}
+
+// Make space to add an item at the end of list.
+// The list grows geometrically, because many Recovery Data Packets are added one by one.
+static PAR3_PKT_CTX * grow_packet_list(PAR3_PKT_CTX *list, uint64_t count, uint64_t *max_p)
+{
+	uint64_t new_max;
+
+	if (count < *max_p)
+		return list;
+	new_max = *max_p * 2;
+	if (new_max < 256)
+		new_max = 256;
+	list = realloc(list, sizeof(PAR3_PKT_CTX) * new_max);
+	if (list != NULL)
+		*max_p = new_max;
+	return list;
+}
+
+// Keep position of same Recovery Data Packet, which may be used when the first one cannot be read.
+// return 0 = added or listed already, 1~ = error
+static int add_recv_copy(PAR3_CTX *par3_ctx, uint64_t id, uint8_t *cmp_buf, uint64_t index, char *filename, int64_t offset, int checked)
+{
+	int ret;
+	uint64_t count;
+	PAR3_PKT_CTX *list;
+
+	ret = add_recv_position(par3_ctx, index, filename, offset);
+	if (ret == 1){
+		return 0;
+	} else if (ret != 0){
+		return ret;
+	}
+
+	count = par3_ctx->recv_copy_count;
+	list = grow_packet_list(par3_ctx->recv_copy_list, count, &(par3_ctx->recv_copy_max));
+	if (list == NULL){
+		perror("Failed to re-allocate memory for Recovery Data Packet");
+		return RET_MEMORY_ERROR;
+	}
+	par3_ctx->recv_copy_list = list;
+	list[count].id = id;
+	memcpy(list[count].root, cmp_buf, 16);
+	memcpy(list[count].matrix, cmp_buf + 16, 16);
+	list[count].index = index;
+	list[count].name = filename;
+	list[count].offset = offset;
+	list[count].checked = checked;
+	par3_ctx->recv_copy_count += 1;
+
 	return 0;
 }
 
 // It allocates memory for each packet type, and lists the packet.
+// checked: 1 = checksum was verified, 0 = checksum of Recovery Data Packet will be verified later
 // -2 = unknown type, -1 = the packet exists already, 0 = added, 1~ = error
-int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64_t offset)
+int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64_t offset, int checked)
 {
 	uint8_t *packet_type, cmp_buf[32];
+	int ret;
 	uint64_t set_id, index, count;
 	PAR3_PKT_CTX *list;
 
@@ -350,6 +532,12 @@ int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64
 	if (memcmp(packet_type, "PAR DAT\0", 8) == 0){	// Data Packet
 		memcpy(&set_id, packet + 32, 8);	// InputSetID
 		memcpy(&index, packet + 48, 8);		// Index of input block
+		ret = add_packet_key(par3_ctx, packet);
+		if (ret == 1){	// If there is the packet already, just exit.
+			return -1;
+		} else if (ret != 0){
+			return ret;
+		}
 		if (par3_ctx->data_packet_list == NULL){
 			list = malloc(sizeof(PAR3_PKT_CTX));
 			if (list == NULL){
@@ -363,10 +551,8 @@ int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64
 			list[0].index = index;
 			list[0].name = filename;
 			list[0].offset = offset;
+			list[0].checked = checked;
 			par3_ctx->data_packet_count = 1;
-		} else if (check_item_exist(par3_ctx->data_packet_list, par3_ctx->data_packet_count, set_id, index, NULL) == 1){
-			// If there is the packet already, just exit.
-			return -1;
 		} else {
 			// Add this packet after other packets.
 			count = par3_ctx->data_packet_count;
@@ -382,6 +568,7 @@ int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64
 			list[count].index = index;
 			list[count].name = filename;
 			list[count].offset = offset;
+			list[count].checked = checked;
 			par3_ctx->data_packet_count += 1;
 		}
 
@@ -390,40 +577,36 @@ int list_found_packet(PAR3_CTX *par3_ctx, uint8_t *packet, char *filename, int64
 		memcpy(cmp_buf, packet + 48, 16);		// checksum from Root packet
 		memcpy(cmp_buf + 16, packet + 64, 16);	// checksum from Matrix packet
 		memcpy(&index, packet + 80, 8);			// Index of recovery block
-		if (par3_ctx->recv_packet_list == NULL){
-			list = malloc(sizeof(PAR3_PKT_CTX));
-			if (list == NULL){
-				perror("Failed to allocate memory for Recovery Data Packet");
+		ret = add_packet_key(par3_ctx, packet);
+		if (ret == 1){
+			// If there is the packet already, keep the position for alternative reading.
+			if (add_recv_copy(par3_ctx, set_id, cmp_buf, index, filename, offset, checked) != 0)
 				return RET_MEMORY_ERROR;
-			}
-			par3_ctx->recv_packet_list = list;
-			list[0].id = set_id;
-			memcpy(list[0].root, cmp_buf, 16);
-			memcpy(list[0].matrix, cmp_buf + 16, 16);
-			list[0].index = index;
-			list[0].name = filename;
-			list[0].offset = offset;
-			par3_ctx->recv_packet_count = 1;
-		} else if (check_item_exist(par3_ctx->recv_packet_list, par3_ctx->recv_packet_count, set_id, index, cmp_buf) == 1){
-			// If there is the packet already, just exit.
 			return -1;
-		} else {
-			// Add this packet after other packets.
-			count = par3_ctx->recv_packet_count;
-			list = realloc(par3_ctx->recv_packet_list, sizeof(PAR3_PKT_CTX) * (count + 1));
-			if (list == NULL){
-				perror("Failed to re-allocate memory for Recovery Data Packet");
-				return RET_MEMORY_ERROR;
-			}
-			par3_ctx->recv_packet_list = list;
-			list[count].id = set_id;
-			memcpy(list[count].root, cmp_buf, 16);
-			memcpy(list[count].matrix, cmp_buf + 16, 16);
-			list[count].index = index;
-			list[count].name = filename;
-			list[count].offset = offset;
-			par3_ctx->recv_packet_count += 1;
+		} else if (ret != 0){
+			return ret;
 		}
+		// Position of the first packet is searched, when a copy is found later.
+		ret = add_recv_position(par3_ctx, index, filename, offset);
+		if (ret > 1)
+			return ret;
+
+		// Add this packet after other packets.
+		count = par3_ctx->recv_packet_count;
+		list = grow_packet_list(par3_ctx->recv_packet_list, count, &(par3_ctx->recv_packet_max));
+		if (list == NULL){
+			perror("Failed to re-allocate memory for Recovery Data Packet");
+			return RET_MEMORY_ERROR;
+		}
+		par3_ctx->recv_packet_list = list;
+		list[count].id = set_id;
+		memcpy(list[count].root, cmp_buf, 16);
+		memcpy(list[count].matrix, cmp_buf + 16, 16);
+		list[count].index = index;
+		list[count].name = filename;
+		list[count].offset = offset;
+		list[count].checked = checked;
+		par3_ctx->recv_packet_count += 1;
 
 	} else {
 		return -2;
@@ -700,6 +883,7 @@ static int remove_other_packet(PAR3_CTX *par3_ctx, uint64_t *id_list, int id_cou
 			free(par3_ctx->recv_packet_list);
 			par3_ctx->recv_packet_list = NULL;
 			par3_ctx->recv_packet_count = 0;
+			par3_ctx->recv_packet_max = 0;
 		} else if (item_count < par3_ctx->recv_packet_count){
 			list = realloc(par3_ctx->recv_packet_list, sizeof(PAR3_PKT_CTX) * item_count);
 			if (list == NULL){
@@ -708,12 +892,137 @@ static int remove_other_packet(PAR3_CTX *par3_ctx, uint64_t *id_list, int id_cou
 			}
 			par3_ctx->recv_packet_list = list;
 			par3_ctx->recv_packet_count = item_count;
+			par3_ctx->recv_packet_max = item_count;
 		}
 	}
+	if (par3_ctx->recv_copy_count > 0){
+		if (par3_ctx->root_packet != NULL){
+			tmp_p = par3_ctx->root_packet + 8;	// checksum from Root Packet
+		} else {
+			tmp_p = NULL;
+		}
+		item_count = adjust_packet_list(par3_ctx->recv_copy_list, par3_ctx->recv_copy_count, id_list, id_count, tmp_p);
+		if (item_count == 0){
+			free(par3_ctx->recv_copy_list);
+			par3_ctx->recv_copy_list = NULL;
+			par3_ctx->recv_copy_count = 0;
+			par3_ctx->recv_copy_max = 0;
+		} else if (item_count < par3_ctx->recv_copy_count){
+			list = realloc(par3_ctx->recv_copy_list, sizeof(PAR3_PKT_CTX) * item_count);
+			if (list == NULL){
+				perror("Failed to re-allocate memory for Recovery Data Packet");
+				return RET_MEMORY_ERROR;
+			}
+			par3_ctx->recv_copy_list = list;
+			par3_ctx->recv_copy_count = item_count;
+			par3_ctx->recv_copy_max = item_count;
+		}
+	}
+
+	return 0;
+}
+
+// Compare index of block, checksum of Matrix Packet, and position
+static int compare_recv_packet(const void *a, const void *b)
+{
+	int ret;
+	PAR3_PKT_CTX *packet_a, *packet_b;
+
+	packet_a = *((PAR3_PKT_CTX **)a);
+	packet_b = *((PAR3_PKT_CTX **)b);
+
+	if (packet_a->index < packet_b->index)
+		return -1;
+	if (packet_a->index > packet_b->index)
+		return 1;
+	ret = memcmp(packet_a->matrix, packet_b->matrix, 16);
+	if (ret != 0)
+		return ret;
+	// Names are stored in the list of PAR files, so the first found position comes first.
+	if (packet_a->name < packet_b->name)
+		return -1;
+	if (packet_a->name > packet_b->name)
+		return 1;
+	if (packet_a->offset < packet_b->offset)
+		return -1;
+	if (packet_a->offset > packet_b->offset)
+		return 1;
+	return 0;
+}
+
+// Make sorted list of Recovery Data Packets to search by index of block.
+// Because the list points items in recv_packet_list and recv_copy_list,
+// it must be made again after these lists are changed.
+int make_recv_index(PAR3_CTX *par3_ctx)
+{
+	uint64_t count, item_index;
+	PAR3_PKT_CTX **index_list;
+
+	if (par3_ctx->recv_index_list != NULL){
+		free(par3_ctx->recv_index_list);
+		par3_ctx->recv_index_list = NULL;
+		par3_ctx->recv_index_count = 0;
+	}
+	count = par3_ctx->recv_packet_count + par3_ctx->recv_copy_count;
+	if (count == 0)
+		return 0;
+
+	index_list = malloc(sizeof(PAR3_PKT_CTX *) * count);
+	if (index_list == NULL){
+		perror("Failed to allocate memory for index of Recovery Data Packet");
+		return RET_MEMORY_ERROR;
+	}
+	count = 0;
+	for (item_index = 0; item_index < par3_ctx->recv_packet_count; item_index++)
+		index_list[count++] = par3_ctx->recv_packet_list + item_index;
+	for (item_index = 0; item_index < par3_ctx->recv_copy_count; item_index++)
+		index_list[count++] = par3_ctx->recv_copy_list + item_index;
+	qsort(index_list, (size_t)count, sizeof(PAR3_PKT_CTX *), compare_recv_packet);
+
+	par3_ctx->recv_index_list = index_list;
+	par3_ctx->recv_index_count = count;
 
 	return 0;
 }
 
+// Search Recovery Data Packet of the block in using Matrix Packet.
+// copy_index: 0 = the first position, 1~ = other positions of same packet
+// return NULL = not found
+PAR3_PKT_CTX * find_recv_packet(PAR3_CTX *par3_ctx, uint64_t block_index, uint32_t copy_index)
+{
+	uint8_t *packet_checksum;
+	uint64_t min, mid, max;
+	PAR3_PKT_CTX **index_list;
+
+	if ( (par3_ctx->recv_index_list == NULL) || (par3_ctx->matrix_packet == NULL) )
+		return NULL;
+
+	// Get checksum of using Matrix Packet
+	packet_checksum = par3_ctx->matrix_packet + par3_ctx->matrix_packet_offset + 8;
+	index_list = par3_ctx->recv_index_list;
+
+	// Binary search for the first item
+	min = 0;
+	max = par3_ctx->recv_index_count;
+	while (min < max){
+		mid = (min + max) / 2;
+		if ( (index_list[mid]->index < block_index) || ( (index_list[mid]->index == block_index)
+				&& (memcmp(index_list[mid]->matrix, packet_checksum, 16) < 0) ) ){
+			min = mid + 1;
+		} else {
+			max = mid;
+		}
+	}
+
+	min += copy_index;
+	if (min >= par3_ctx->recv_index_count)
+		return NULL;
+	if ( (index_list[min]->index != block_index) || (memcmp(index_list[min]->matrix, packet_checksum, 16) != 0) )
+		return NULL;
+
+	return index_list[min];
+}
+
 // check InputSetID of packets
 int check_packet_set(PAR3_CTX *par3_ctx)
 {
@@ -855,6 +1164,10 @@ int check_packet_set(PAR3_CTX *par3_ctx)
 			printf("Number of Recovery Data Packet =%3"PRIu64"\n", par3_ctx->recv_packet_count);
 	}
 
+	// Index of Recovery Data Packets is used to read recovery blocks at repair.
+	if (make_recv_index(par3_ctx) != 0)
+		return RET_MEMORY_ERROR;
+
 	return 0;
 }
 
@@ -0,0 +1,499 @@
+#include "libpar3.h"
+
+#include "common.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "packet.h"
+#include "packet_index.h"
+#include "read.h"
+
+
+/*
+Packet index keeps positions of packets in PAR files.
+When a PAR file was not changed, packets are loaded without searching the file.
+
+File format:
+ 8 bytes : "PAR3IDX\0"
+ 8 bytes : CRC-64 of all records after this header
+ records (each starts at multiple of 8 bytes)
+
+Record format:
+ 0 : record size (8 bytes)
+ 8 : file size (8 bytes)
+16 : mtime (8 bytes)
+24 : number of packets (8 bytes)
+32 : length of file name including null terminator (8 bytes)
+40 : file name without directory (padded to multiple of 8 bytes)
+ ? : offset of packet and the first 88 bytes of packet (96 bytes each)
+     The first 88 bytes include packet header, and index of block in Data Packet or Recovery Data Packet.
+     When packet is smaller than 88 bytes, the rest is zero.
+*/
+
+#define INDEX_HEADER_SIZE 16
+#define INDEX_RECORD_SIZE 40
+#define INDEX_ENTRY_SIZE 96
+
+static int compare_record_name(const void *a, const void *b)
+{
+	const uint8_t *record1, *record2;
+
+	record1 = *(const uint8_t **)a;
+	record2 = *(const uint8_t **)b;
+
+	return strcmp((const char *)record1 + INDEX_RECORD_SIZE, (const char *)record2 + INDEX_RECORD_SIZE);
+}
+
+static int compare_record_key(const void *key, const void *item)
+{
+	const uint8_t *record;
+
+	record = *(const uint8_t **)item;
+
+	return strcmp((const char *)key, (const char *)record + INDEX_RECORD_SIZE);
+}
+
+// Calculate total size of a record.
+static size_t calculate_record_size(uint64_t packet_count, size_t name_len)
+{
+	return INDEX_RECORD_SIZE + ((name_len + 7) & ~7) + (size_t)packet_count * INDEX_ENTRY_SIZE;
+}
+
+// Remove ".par3" and ".vol#+#" or ".part#+#" from PAR filename, and return length of base name.
+// "something.vol1+2.par3" -> "something"
+static size_t get_base_name(char *base_name, char *par_name)
+{
+	size_t len;
+
+	strcpy(base_name, par_name);
+	len = strlen(base_name);
+	if ( (len > 5) && (_stricmp(base_name + len - 5, ".par3") == 0) ){
+		len -= 5;
+		base_name[len] = 0;
+	}
+	while (len > 0){
+		if (base_name[len] == '.'){
+			if ( (_strnicmp(base_name + len, ".vol", 4) == 0) || (_strnicmp(base_name + len, ".part", 5) == 0) )
+				base_name[len] = 0;
+			break;
+		}
+		len--;
+	}
+
+	return strlen(base_name);
+}
+
+// Search PAR files of the set, and write positions of their packets.
+// The PAR files must be complete, because their packets are checked here.
+int packet_index_save(PAR3_CTX *par3_ctx)
+{
+	char find_path[_MAX_PATH];
+	uint8_t *buf, *tmp_p, *entry;
+	uint32_t file_count;
+	int64_t mtime;
+	size_t len, dir_len, name_len, record_size;
+	size_t buf_size, buf_max;
+	uint64_t num, packet_size, crc;
+	FILE *fp;
+	PAR3_SCAN_CTX scan_ctx;
+
+	// MSVC
+	struct _finddatai64_t c_file;
+	struct _stat64 stat_buf;
+	intptr_t handle;
+
+	// something.par3 -> something.*par3
+	len = get_base_name(find_path, par3_ctx->par_filename);
+	if (len + 10 >= _MAX_PATH)	// .*par3 or .par3idx
+		return 0;
+	strcpy(find_path + len, ".*par3");
+	dir_len = offset_file_name(find_path) - find_path;
+
+	buf_size = INDEX_HEADER_SIZE;
+	buf_max = INDEX_HEADER_SIZE + 4096;
+	buf = malloc(buf_max);
+	if (buf == NULL){
+		perror("Failed to allocate memory for packet index");
+		return RET_MEMORY_ERROR;
+	}
+	memset(&scan_ctx, 0, sizeof(PAR3_SCAN_CTX));
+
+	file_count = 0;
+	handle = _findfirst64(find_path, &c_file);
+	if (handle != (intptr_t) -1){
+		do {
+			// ignore hidden or system files or directory
+			if ( ((c_file.attrib & _A_HIDDEN) != 0) || ((c_file.attrib & _A_SYSTEM) != 0) || ((c_file.attrib & _A_SUBDIR) != 0) )
+				continue;
+			if (dir_len + strlen(c_file.name) >= _MAX_PATH)
+				continue;
+			strcpy(find_path + dir_len, c_file.name);
+			if (_stat64(find_path, &stat_buf) != 0)
+				continue;
+
+			// Search packets in the PAR file.
+			scan_ctx.name = find_path;
+			scan_ctx.found_count = 0;
+			scan_par_file(&scan_ctx);
+			if (scan_ctx.ret != 0){
+				if (scan_ctx.view != NULL)
+					file_unmap(scan_ctx.view, (size_t)(scan_ctx.file_size));
+				if (scan_ctx.ret > 0){
+					_findclose(handle);
+					free(scan_ctx.found_list);
+					free(buf);
+					return scan_ctx.ret;
+				}
+				// When the file cannot be mapped, it will be searched at reading.
+				if (par3_ctx->noise_level >= 1){
+					printf("Packet index doesn't include \"%s\".\n", c_file.name);
+				}
+				continue;
+			}
+
+			// Allocate more memory, when there isn't enough space.
+			name_len = strlen(c_file.name) + 1;
+			record_size = calculate_record_size(scan_ctx.found_count, name_len);
+			if (buf_size + record_size > buf_max){
+				buf_max *= 2;
+				while (buf_max < buf_size + record_size)
+					buf_max *= 2;
+				tmp_p = realloc(buf, buf_max);
+				if (tmp_p == NULL){
+					perror("Failed to re-allocate memory for packet index");
+					file_unmap(scan_ctx.view, (size_t)(scan_ctx.file_size));
+					_findclose(handle);
+					free(scan_ctx.found_list);
+					free(buf);
+					return RET_MEMORY_ERROR;
+				}
+				buf = tmp_p;
+			}
+
+			tmp_p = buf + buf_size;
+			memset(tmp_p, 0, record_size);
+			memcpy(tmp_p, &record_size, 8);
+			memcpy(tmp_p + 8, &(scan_ctx.file_size), 8);
+			mtime = stat_buf.st_mtime;
+			memcpy(tmp_p + 16, &mtime, 8);
+			memcpy(tmp_p + 24, &(scan_ctx.found_count), 8);
+			memcpy(tmp_p + 32, &name_len, 8);
+			memcpy(tmp_p + INDEX_RECORD_SIZE, c_file.name, name_len);
+			entry = tmp_p + INDEX_RECORD_SIZE + ((name_len + 7) & ~7);
+			for (num = 0; num < scan_ctx.found_count; num++){
+				memcpy(entry, &(scan_ctx.found_list[num].offset), 8);
+				memcpy(&packet_size, scan_ctx.view + scan_ctx.found_list[num].offset + 24, 8);
+				if (packet_size > 88)
+					packet_size = 88;
+				memcpy(entry + 8, scan_ctx.view + scan_ctx.found_list[num].offset, (size_t)packet_size);
+				entry += INDEX_ENTRY_SIZE;
+			}
+			file_unmap(scan_ctx.view, (size_t)(scan_ctx.file_size));
+			buf_size += record_size;
+			file_count++;
+
+		} while( _findnext64( handle, &c_file ) == 0 );
+
+		_findclose(handle);
+	}
+	free(scan_ctx.found_list);
+
+	memcpy(buf, "PAR3IDX\0", 8);
+	crc = crc64(buf + INDEX_HEADER_SIZE, buf_size - INDEX_HEADER_SIZE, 0);
+	memcpy(buf + 8, &crc, 8);
+
+	// something.par3 -> something.par3idx
+	len = get_base_name(find_path, par3_ctx->par_filename);
+	strcpy(find_path + len, ".par3idx");
+	fp = fopen(find_path, "wb");
+	if (fp == NULL){
+		perror("Failed to open packet index");
+		free(buf);
+		return RET_FILE_IO_ERROR;
+	}
+	if (fwrite(buf, 1, buf_size, fp) != buf_size){
+		perror("Failed to write packet index");
+		fclose(fp);
+		free(buf);
+		return RET_FILE_IO_ERROR;
+	}
+	free(buf);
+	if (fclose(fp) != 0){
+		perror("Failed to close packet index");
+		return RET_FILE_IO_ERROR;
+	}
+	if (par3_ctx->noise_level >= -1)
+		printf("Wrote packet index of %u files, %s\n", file_count, offset_file_name(find_path));
+
+	return 0;
+}
+
+// Read packet index file, and make list of records.
+// When the file doesn't exist or is broken, PAR files are searched as usual.
+int packet_index_load(PAR3_CTX *par3_ctx)
+{
+	char index_path[_MAX_PATH];
+	uint8_t *buf, **list;
+	uint32_t count;
+	size_t len, buf_size, offset, record_size, name_len;
+	uint64_t crc, packet_count;
+	int64_t file_length;
+	FILE *fp;
+
+	len = get_base_name(index_path, par3_ctx->par_filename);
+	if (len + 10 >= _MAX_PATH)
+		return 0;
+	strcpy(index_path + len, ".par3idx");
+	fp = fopen(index_path, "rb");
+	if (fp == NULL)
+		return 0;
+	file_length = _filelengthi64(_fileno(fp));
+	if (file_length < INDEX_HEADER_SIZE){
+		fclose(fp);
+		return 0;
+	}
+	if ( (par3_ctx->memory_limit > 0) && ((uint64_t)file_length > par3_ctx->memory_limit) ){
+		if (par3_ctx->noise_level >= 0){
+			printf("Packet index is too large to load.\n");
+		}
+		fclose(fp);
+		return 0;
+	}
+	buf_size = (size_t)file_length;
+	buf = malloc(buf_size);
+	if (buf == NULL){
+		perror("Failed to allocate memory for packet index");
+		fclose(fp);
+		return RET_MEMORY_ERROR;
+	}
+	if (fread(buf, 1, buf_size, fp) != buf_size){
+		perror("Failed to read packet index");
+		free(buf);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	// Check header and integrity of records.
+	memcpy(&crc, buf + 8, 8);
+	if ( (memcmp(buf, "PAR3IDX\0", 8) != 0) || (crc != crc64(buf + INDEX_HEADER_SIZE, buf_size - INDEX_HEADER_SIZE, 0)) ){
+		if (par3_ctx->noise_level >= 0){
+			printf("Packet index is broken and isn't used.\n");
+		}
+		free(buf);
+		return 0;
+	}
+
+	// Count records and check their sizes.
+	count = 0;
+	offset = INDEX_HEADER_SIZE;
+	while (offset + INDEX_RECORD_SIZE <= buf_size){
+		memcpy(&record_size, buf + offset, 8);
+		memcpy(&packet_count, buf + offset + 24, 8);
+		memcpy(&name_len, buf + offset + 32, 8);
+		if ( (name_len == 0) || (name_len > _MAX_PATH) || (packet_count > buf_size / INDEX_ENTRY_SIZE)
+				|| (record_size != calculate_record_size(packet_count, name_len))
+				|| (record_size > buf_size - offset)
+				|| (buf[offset + INDEX_RECORD_SIZE + name_len - 1] != 0) )
+			break;
+		count++;
+		offset += record_size;
+	}
+	if (offset != buf_size){
+		if (par3_ctx->noise_level >= 0){
+			printf("Packet index is broken and isn't used.\n");
+		}
+		free(buf);
+		return 0;
+	}
+	if (count == 0){
+		free(buf);
+		return 0;
+	}
+
+	list = malloc(sizeof(uint8_t *) * count);
+	if (list == NULL){
+		perror("Failed to allocate memory for packet index");
+		free(buf);
+		return RET_MEMORY_ERROR;
+	}
+	count = 0;
+	offset = INDEX_HEADER_SIZE;
+	while (offset < buf_size){
+		list[count] = buf + offset;
+		memcpy(&record_size, buf + offset, 8);
+		count++;
+		offset += record_size;
+	}
+	qsort( (void *)list, (size_t)count, sizeof(uint8_t *), compare_record_name );
+
+	par3_ctx->packet_index_buf = buf;
+	par3_ctx->packet_index_size = buf_size;
+	par3_ctx->packet_index_list = list;
+	par3_ctx->packet_index_count = count;
+	if (par3_ctx->noise_level >= 1){
+		printf("Number of files in packet index = %u\n", count);
+	}
+
+	return 0;
+}
+
+// Return pointer of a record, when PAR file was not changed.
+// When there is no matching record, return NULL.
+// This may run on worker thread.
+uint8_t * packet_index_search(PAR3_CTX *par3_ctx, char *file_name)
+{
+	uint8_t **list_p, *record;
+	uint64_t file_size;
+	int64_t mtime;
+	struct _stat64 stat_buf;
+
+	if (par3_ctx->packet_index_count == 0)
+		return NULL;
+
+	// Binary search by file name
+	list_p = bsearch( offset_file_name(file_name), par3_ctx->packet_index_list, (size_t)(par3_ctx->packet_index_count), sizeof(uint8_t *), compare_record_key );
+	if (list_p == NULL)
+		return NULL;
+	record = *list_p;
+
+	if (_stat64(file_name, &stat_buf) != 0)
+		return NULL;
+	memcpy(&file_size, record + 8, 8);
+	if (file_size != (uint64_t)(stat_buf.st_size))
+		return NULL;
+	memcpy(&mtime, record + 16, 8);
+	if (mtime != (int64_t)(stat_buf.st_mtime))
+		return NULL;
+
+	return record;
+}
+
+// Store packets in a PAR file by using a record of packet index.
+// Recovery Data Packets are listed without reading, and their checksums are verified later at using.
+// Other packets are read and verified, only when they weren't loaded yet.
+// return -1 = record is different from the file, 0 = done, 1~ = error
+int packet_index_merge(PAR3_CTX *par3_ctx, uint8_t *record, char *file_name,
+		uint64_t *packet_count, uint64_t *new_packet_count)
+{
+	char packet_type[9];
+	uint8_t *entry, *header, *buf, *tmp_p, buf_hash[16];
+	int ret;
+	size_t name_len, buf_size;
+	int64_t offset;
+	uint64_t num, count, file_size, packet_size;
+	FILE *fp;
+
+	packet_type[8] = 0;	// Set null string.
+
+	memcpy(&file_size, record + 8, 8);
+	memcpy(&count, record + 24, 8);
+	memcpy(&name_len, record + 32, 8);
+	entry = record + INDEX_RECORD_SIZE + ((name_len + 7) & ~7);
+
+	buf = NULL;
+	buf_size = 0;
+	fp = NULL;
+	ret = 0;
+	for (num = 0; num < count; num++){
+		memcpy(&offset, entry, 8);
+		header = entry + 8;
+		entry += INDEX_ENTRY_SIZE;
+		memcpy(&packet_size, header + 24, 8);
+		if ( (memcmp(header, "PAR3\0PKT", 8) != 0) || (packet_size <= 48)
+				|| (offset < 0) || ((uint64_t)offset > file_size) || (packet_size > file_size - offset) ){
+			ret = -1;
+			break;
+		}
+		(*packet_count)++;
+
+		// read packet type
+		memcpy(packet_type, header + 40, 8);
+		if (par3_ctx->noise_level >= 3){
+			printf("offset =%6"PRId64", size =%5"PRIu64", type = %s\n", offset, packet_size, packet_type);
+		}
+
+		if (memcmp(packet_type, "PAR REC\0", 8) == 0){	// Recovery Data Packet
+			if (packet_size <= 88){
+				ret = -1;
+				break;
+			}
+			// Header in the index is enough to list the packet.
+			ret = list_found_packet(par3_ctx, header, file_name, offset, 0);
+
+		} else if (find_packet_key(par3_ctx, header) == 1){
+			// When same packet was loaded already, no need to read it.
+			continue;
+
+		} else {
+			if (packet_size > SIZE_MAX){
+				ret = -1;
+				break;
+			}
+			if (packet_size > buf_size){
+				tmp_p = realloc(buf, (size_t)packet_size);
+				if (tmp_p == NULL){
+					perror("Failed to allocate memory for packet");
+					ret = RET_MEMORY_ERROR;
+					break;
+				}
+				buf = tmp_p;
+				buf_size = (size_t)packet_size;
+			}
+			if (fp == NULL){
+				fp = fopen(file_name, "rb");
+				if (fp == NULL){
+					ret = -1;
+					break;
+				}
+			}
+			if ( (_fseeki64(fp, offset, SEEK_SET) != 0) || (fread(buf, 1, (size_t)packet_size, fp) != packet_size) ){
+				ret = -1;
+				break;
+			}
+
+			// check fingerprint hash of the packet
+			blake3(buf + 24, (size_t)(packet_size - 24), buf_hash);
+			if ( (memcmp(buf, header, 48) != 0) || (memcmp(buf + 8, buf_hash, 16) != 0) ){
+				ret = -1;
+				break;
+			}
+
+			// store the found packet
+			ret = add_found_packet(par3_ctx, buf);
+			if (ret == -2){
+				ret = list_found_packet(par3_ctx, buf, file_name, offset, 1);
+			}
+		}
+		if (ret > 0){
+			break;
+		} else if (ret == 0){
+			(*new_packet_count)++;
+		}
+		ret = 0;
+	}
+	if (fp != NULL)
+		fclose(fp);
+	if (buf != NULL)
+		free(buf);
+
+	return ret;
+}
+
+void packet_index_release(PAR3_CTX *par3_ctx)
+{
+	if (par3_ctx->packet_index_buf){
+		free(par3_ctx->packet_index_buf);
+		par3_ctx->packet_index_buf = NULL;
+		par3_ctx->packet_index_size = 0;
+	}
+	if (par3_ctx->packet_index_list){
+		free(par3_ctx->packet_index_list);
+		par3_ctx->packet_index_list = NULL;
+		par3_ctx->packet_index_count = 0;
+	}
+}
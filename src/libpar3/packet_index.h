@@ -0,0 +1,7 @@
+// Packet index of PAR files, to load packets without searching whole files
+int packet_index_save(PAR3_CTX *par3_ctx);
+int packet_index_load(PAR3_CTX *par3_ctx);
+uint8_t * packet_index_search(PAR3_CTX *par3_ctx, char *file_name);
+int packet_index_merge(PAR3_CTX *par3_ctx, uint8_t *record, char *file_name,
+		uint64_t *packet_count, uint64_t *new_packet_count);
+void packet_index_release(PAR3_CTX *par3_ctx);
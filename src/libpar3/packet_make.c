@@ -162,33 +162,10 @@ static void generate_set_id(PAR3_CTX *par3_ctx, uint8_t *buf, size_t body_size)
 }
 
 
-// Start Packet, Creator Packet, Comment Packet
-int make_start_packet(PAR3_CTX *par3_ctx, int flag_trial)
+// Select Galois Field for Error Correction Codes.
+// This is called before creating Start Packet, or before calculating recovery blocks.
+void select_galois_field(PAR3_CTX *par3_ctx)
 {
-	uint8_t *tmp_p;
-	size_t packet_size;
-
-	// When there is packet already, just exit.
-	if (par3_ctx->start_packet_size > 0)
-		return 0;
-
-	// Packet size depends on galois field size.
-	packet_size = 48 + 8 + 16 + 8 + 1;	// 81 + additional bytes
-	if (par3_ctx->start_packet == NULL){
-		par3_ctx->start_packet = malloc(packet_size + 4);	// Upto 32-bit Galois Field
-		if (par3_ctx->start_packet == NULL){
-			perror("Failed to allocate memory for Start Packet");
-			return RET_MEMORY_ERROR;
-		}
-	}
-
-	// Set initial value temporary.
-	tmp_p = par3_ctx->start_packet + 48;
-	// At this time, "incremental backup" feature isn't made.
-	memset(tmp_p, 0, 24);	// When there is no parent, fill zeros.
-	tmp_p += 24;
-	memcpy(tmp_p, &(par3_ctx->block_size), 8);	// Block size
-	tmp_p += 8;
 	// Galois Field is varied by using Error Correction Codes.
 	if (par3_ctx->ecc_method & 1){	// Reed-Solomon Erasure Codes with Cauchy Matrix
 		if ( ( (par3_ctx->block_count > 128) && (par3_ctx->max_recovery_block == 0) )
@@ -197,15 +174,10 @@ int make_start_packet(PAR3_CTX *par3_ctx, int flag_trial)
 			// When there are 129 or more input blocks, use 16-bit Galois Field (0x1100B).
 			par3_ctx->galois_poly = 0x1100B;
 			par3_ctx->gf_size = 2;
-			tmp_p[0] = 2;
-			tmp_p[1] = 0x0B;
-			tmp_p[2] = 0x10;
 		} else if (par3_ctx->block_count > 0){
 			// When there are 128 or less input blocks, use 8-bit Galois Field (0x11D).
 			par3_ctx->galois_poly = 0x11D;
 			par3_ctx->gf_size = 1;
-			tmp_p[0] = 1;
-			tmp_p[1] = 0x1D;
 		}
 
 	} else if (par3_ctx->ecc_method & 8){	// FFT based Reed-Solomon Codes
@@ -231,21 +203,48 @@ int make_start_packet(PAR3_CTX *par3_ctx, int flag_trial)
 			if (n <= 256){	// LEO_HAS_FF8
 				par3_ctx->galois_poly = 0x11D;
 				par3_ctx->gf_size = 1;
-				tmp_p[0] = 1;
-				tmp_p[1] = 0x1D;
 			} else {	// LEO_HAS_FF16
 				par3_ctx->galois_poly = 0x1002D;
 				par3_ctx->gf_size = 2;
-				tmp_p[0] = 2;
-				tmp_p[1] = 0x2D;
-				tmp_p[2] = 0x00;
 			}
 		}
 	}
-	if (par3_ctx->gf_size == 0){	// When there is no input blocks, no need to set Galois Field.
+	if (par3_ctx->gf_size == 0)	// When there is no input blocks, no need to set Galois Field.
 		par3_ctx->galois_poly = 0;
-		tmp_p[0] = 0;
-	} else {
+}
+
+// Start Packet, Creator Packet, Comment Packet
+int make_start_packet(PAR3_CTX *par3_ctx, int flag_trial)
+{
+	uint8_t *tmp_p;
+	size_t packet_size;
+
+	// When there is packet already, just exit.
+	if (par3_ctx->start_packet_size > 0)
+		return 0;
+
+	// Packet size depends on galois field size.
+	packet_size = 48 + 8 + 16 + 8 + 1;	// 81 + additional bytes
+	if (par3_ctx->start_packet == NULL){
+		par3_ctx->start_packet = malloc(packet_size + 4);	// Upto 32-bit Galois Field
+		if (par3_ctx->start_packet == NULL){
+			perror("Failed to allocate memory for Start Packet");
+			return RET_MEMORY_ERROR;
+		}
+	}
+
+	// Set initial value temporary.
+	tmp_p = par3_ctx->start_packet + 48;
+	// At this time, "incremental backup" feature isn't made.
+	memset(tmp_p, 0, 24);	// When there is no parent, fill zeros.
+	tmp_p += 24;
+	memcpy(tmp_p, &(par3_ctx->block_size), 8);	// Block size
+	tmp_p += 8;
+	// Galois Field size and lower bytes of the generator polynomial.
+	select_galois_field(par3_ctx);
+	tmp_p[0] = par3_ctx->gf_size;
+	memcpy(tmp_p + 1, &(par3_ctx->galois_poly), par3_ctx->gf_size);	// little endian
+	if (par3_ctx->gf_size > 0){
 		if (par3_ctx->noise_level >= 1){
 			printf("\nGalois field size = %u\n", par3_ctx->gf_size);
 			printf("Galois field generator = 0x%X\n", par3_ctx->galois_poly);
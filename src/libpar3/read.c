@@ -7,190 +7,469 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "file.h"
 #include "hash.h"
 #include "packet.h"
+#include "packet_index.h"
+#include "read.h"
 
 
-int read_packet(PAR3_CTX *par3_ctx)
+// Search packets in a PAR file, which is mapped on memory.
+// Checksum of Recovery Data Packet is verified later at using, so its data isn't read here.
+// Instead, it confirms that next packet or end of file follows the packet.
+// This may run on worker thread, so found packets are only listed in scan_p.
+static int scan_mapped_file(PAR3_SCAN_CTX *scan_p)
+{
+	uint8_t *view, *find_p, buf_hash[16];
+	int checked;
+	uint64_t file_size, offset, next_offset, packet_size;
+	PAR3_SCAN_PKT *tmp_p;
+
+	view = scan_p->view;
+	file_size = scan_p->file_size;
+
+	offset = 0;
+	while (offset + 48 < file_size){
+		// Search the first byte of Magic sequence. memchr() is vectorized in C runtime.
+		find_p = memchr(view + offset, 'P', (size_t)(file_size - 48 - offset));
+		if (find_p == NULL)
+			break;
+		offset = find_p - view;
+		if (memcmp(view + offset, "PAR3\0PKT", 8) != 0){	// check Magic sequence
+			offset++;
+			continue;
+		}
+
+		// read packet size
+		memcpy(&packet_size, view + (offset + 24), 8);
+		if ( (packet_size <= 48) || (packet_size > file_size - offset) ){
+			// If packet is too small or not enough data, ignore it.
+			offset += 8;
+			continue;
+		}
+
+		checked = 1;
+		if (memcmp(view + (offset + 40), "PAR REC\0", 8) == 0){	// Recovery Data Packet
+			next_offset = offset + packet_size;
+			if ( (next_offset == file_size) || ( (next_offset + 8 <= file_size)
+					&& (memcmp(view + next_offset, "PAR3\0PKT", 8) == 0) ) ){
+				checked = 0;	// Checksum will be verified later.
+			}
+		}
+		if (checked != 0){
+			// check fingerprint hash of the packet
+			blake3(view + (offset + 24), (size_t)(packet_size - 24), buf_hash);
+			if (memcmp(view + (offset + 8), buf_hash, 16) != 0){
+				// If checksum is different, ignore the packet.
+				offset += 8;
+				continue;
+			}
+		}
+
+		// add the found packet to list
+		if (scan_p->found_count >= scan_p->found_max){
+			scan_p->found_max += 256;
+			tmp_p = realloc(scan_p->found_list, sizeof(PAR3_SCAN_PKT) * scan_p->found_max);
+			if (tmp_p == NULL)
+				return RET_MEMORY_ERROR;
+			scan_p->found_list = tmp_p;
+		}
+		scan_p->found_list[scan_p->found_count].offset = offset;
+		scan_p->found_list[scan_p->found_count].checked = checked;
+		scan_p->found_count++;
+
+		offset += packet_size;
+	}
+
+	return 0;
+}
+
+// Open and map a PAR file, then search packets in it.
+// This may run on worker thread, so it doesn't show anything.
+void scan_par_file(PAR3_SCAN_CTX *scan_p)
 {
-	char *namez, packet_type[9];
-	uint8_t *buf, buf_hash[16];
+	FILE *fp;
+
+	fp = fopen(scan_p->name, "rb");
+	if (fp == NULL){
+		scan_p->ret = -3;
+		return;
+	}
+
+	// get file size
+	scan_p->file_size = _filelengthi64(_fileno(fp));
+
+	// Map whole file on memory to search packets without reading all data.
+	scan_p->view = NULL;
+	if ( (scan_p->file_size > 48) && (scan_p->file_size <= SIZE_MAX) )
+		scan_p->view = file_map(_fileno(fp), 0, (size_t)(scan_p->file_size));
+	fclose(fp);	// The view stays valid after the file is closed.
+	if (scan_p->view == NULL){
+		scan_p->ret = -2;	// It will be read by buffer.
+		return;
+	}
+
+	scan_p->ret = scan_mapped_file(scan_p);
+}
+
+// Store packets, which were found in a mapped PAR file.
+static int merge_found_packet(PAR3_CTX *par3_ctx, PAR3_SCAN_CTX *scan_p,
+		uint64_t *packet_count, uint64_t *new_packet_count)
+{
+	char packet_type[9];
+	uint8_t *packet;
 	int ret;
+	uint64_t num, packet_size;
+
+	packet_type[8] = 0;	// Set null string.
+
+	for (num = 0; num < scan_p->found_count; num++){
+		packet = scan_p->view + scan_p->found_list[num].offset;
+		(*packet_count)++;
+
+		// read packet type
+		if (par3_ctx->noise_level >= 3){
+			memcpy(&packet_size, packet + 24, 8);
+			memcpy(packet_type, packet + 40, 8);
+			printf("offset =%6"PRId64", size =%5"PRIu64", type = %s\n", scan_p->found_list[num].offset, packet_size, packet_type);
+		}
+
+		// store the found packet
+		ret = add_found_packet(par3_ctx, packet);
+		if (ret == -2){
+			ret = list_found_packet(par3_ctx, packet, scan_p->name, scan_p->found_list[num].offset, scan_p->found_list[num].checked);
+		}
+		if (ret > 0){
+			return ret;
+		} else if (ret == 0){
+			(*new_packet_count)++;
+		}
+	}
+
+	return 0;
+}
+
+// Search packets in a PAR file, while reading file data into buffer.
+// return -1 = failed to read, 0 = done, 1~ = error
+static int scan_read_file(PAR3_CTX *par3_ctx, FILE *fp, uint64_t file_size, uint8_t *buf, size_t buf_size, char *file_name,
+		uint64_t *packet_count, uint64_t *new_packet_count)
+{
+	char packet_type[9];
+	uint8_t buf_hash[16];
+	int ret;
+	size_t read_size, max, offset;
+	uint64_t file_offset, packet_size;
+
+	packet_type[8] = 0;	// Set null string.
+
+	// Read file data at first.
+	read_size = buf_size;
+	if (file_size < buf_size)
+		read_size = file_size;
+	//printf("file data = %"PRIu64", read_size = %zu, remain = %zu\n", file_size, read_size, file_size - read_size);
+	if (fread(buf, 1, read_size, fp) != read_size)
+		return -1;
+	file_size -= read_size;
+	max = read_size;
+
+	file_offset = 0;
+	offset = 0;
+	while (offset + 48 < max){
+		if (memcmp(buf + offset, "PAR3\0PKT", 8) == 0){	// check Magic sequence
+			// read packet size
+			memcpy(&packet_size, buf + (offset + 24), 8);
+			if (packet_size <= 48){	// If packet is too small, just ignore it.
+				offset += 8;
+				continue;
+			}
+			if (offset + packet_size > buf_size + file_size){	// If not enough data, ignore the packet.
+				offset += 8;
+				continue;
+			}
+			if (packet_size > buf_size){	// If packet is larger than buffer, show error and continue.
+				if (par3_ctx->noise_level >= 1){
+					memcpy(packet_type, buf + (offset + 40), 8);
+					printf("Warning, packet is too large. size = %"PRIu64", type = %s\n", packet_size, packet_type);
+				}
+				offset += 8;
+				continue;
+			}
+			// If packet exceeds buffer, read more bytes.
+			if (offset + packet_size > buf_size){
+				read_size = offset;
+				if (read_size > file_size)
+					read_size = file_size;
+
+				// slide data to top
+				memmove(buf, buf + offset, buf_size - offset);
+				//printf("file data = %"PRIu64", offset = %zu, read_size = %zu, ", file_size, offset, read_size);
+				if (fread(buf + buf_size - offset, 1, read_size, fp) != read_size)
+					return -1;
+				file_size -= read_size;
+				max = buf_size - offset + read_size;
+				//printf("remain = %"PRIu64", max = %zu\n", file_size, max);
+				file_offset += offset;
+				offset = 0;
+			}
+
+			// check fingerprint hash of the packet
+			blake3(buf + (offset + 24), packet_size - 24, buf_hash);
+			if (memcmp(buf + (offset + 8), buf_hash, 16) != 0){
+				// If checksum is different, ignore the packet.
+				offset += 8;
+				continue;
+			}
+			(*packet_count)++;
+
+			// read packet type
+			memcpy(packet_type, buf + (offset + 40), 8);
+			if (par3_ctx->noise_level >= 3){
+				printf("offset =%6"PRIu64", size =%5"PRIu64", type = %s\n", file_offset + offset, packet_size, packet_type);
+			}
+
+			// store the found packet
+			ret = add_found_packet(par3_ctx, buf + offset);
+			if (ret == -2){
+				ret = list_found_packet(par3_ctx, buf + offset, file_name, file_offset + offset, 1);
+			}
+			if (ret > 0){
+				return ret;
+			} else if (ret == 0){
+				(*new_packet_count)++;
+			}
+
+			offset += packet_size;
+		} else {
+			offset++;
+		}
+
+		if ( (file_size > 0) && (offset + 48 >= max) ){	// read more bytes
+			read_size = offset;
+			if (read_size > file_size)
+				read_size = file_size;
+
+			// slide data to top
+			memmove(buf, buf + offset, buf_size - offset);
+			//printf("file_size = %"PRIu64", offset = %zu, read_size = %zu, ", file_size, offset, read_size);
+			if (fread(buf + buf_size - offset, 1, read_size, fp) != read_size)
+				return -1;
+			file_size -= read_size;
+			max = buf_size - offset + read_size;
+			//printf("remain = %"PRIu64", max = %zu\n", file_size, max);
+			file_offset += offset;
+			offset = 0;
+		}
+	}
+
+	return 0;
+}
+
+// Return number of worker threads to scan PAR files.
+static int get_scan_worker_count(PAR3_CTX *par3_ctx, int file_count)
+{
+	int worker_count;
+
+	if (par3_ctx->thread_count > 0){
+		worker_count = par3_ctx->thread_count;
+	} else {
+#ifdef _OPENMP
+		worker_count = omp_get_max_threads();
+#else
+		worker_count = 1;
+#endif
+	}
+#ifndef _OPENMP
+	worker_count = 1;	// Without OpenMP, files are scanned one by one.
+#endif
+	if (worker_count > file_count)
+		worker_count = file_count;
+	if (worker_count <= 1)
+		return 1;
+
+	return worker_count;
+}
+
+int read_packet(PAR3_CTX *par3_ctx)
+{
+	char *namez;
+	uint8_t *buf;
+	int ret, worker_count, file_count, scan_max, scan_count, num;
 	size_t namez_len, namez_off;
-	size_t buf_size, read_size, max, offset;
-	uint64_t file_size, file_offset, packet_size;
+	size_t buf_size;
 	uint64_t packet_count, new_packet_count;
 	FILE *fp;
+	PAR3_SCAN_CTX *scan_list, *scan_p;
 
 	//for debug
 	//par3_ctx->memory_limit = 1024;
 
-	packet_type[8] = 0;	// Set null string.
-
-	// Allocate buffer to keep PAR file.
+	// Buffer to keep PAR file is allocated, only when the file cannot be mapped.
 	buf_size = par3_ctx->max_file_size;
 	if ( (par3_ctx->memory_limit != 0) && (buf_size > par3_ctx->memory_limit) ){
 		buf_size = par3_ctx->memory_limit;	// multiple of MB
 		// When buffer size is 1 MB, readable minimum packet size becomes 1 MB, too.
 		// So, a user should not set small limit.
 	}
-	if (par3_ctx->noise_level >= 2){
-		printf("buffer size for PAR files = %"PRIu64"\n", buf_size);
+	buf = NULL;
+
+	namez = par3_ctx->par_file_name;
+	namez_len = par3_ctx->par_file_name_len;
+	file_count = namez_count(namez, namez_len);
+	if (file_count <= 0)
+		return check_packet_set(par3_ctx);
+
+	// When packet index exists, packets in unchanged PAR files are loaded without searching.
+	ret = packet_index_load(par3_ctx);
+	if (ret != 0)
+		return ret;
+
+	// PAR files are scanned on worker threads by each group.
+	// Because packets are stored in order of files, the result is same as single thread.
+	worker_count = get_scan_worker_count(par3_ctx, file_count);
+	scan_max = 1;
+	if (worker_count > 1){
+		scan_max = worker_count * 4;	// Number of mapped files at once is limited.
+		if (scan_max > file_count)
+			scan_max = file_count;
+		if (par3_ctx->noise_level >= 2){
+			printf("Number of worker threads to scan PAR files = %d\n", worker_count);
+		}
 	}
-	buf = malloc(buf_size);
-	if (buf == NULL){
-		perror("Failed to allocate memory for PAR files");
+	scan_list = calloc(scan_max, sizeof(PAR3_SCAN_CTX));
+	if (scan_list == NULL){
+		perror("Failed to allocate memory for scanning PAR files");
 		return RET_MEMORY_ERROR;
 	}
-	par3_ctx->work_buf = buf;
 
-	namez = par3_ctx->par_file_name;
-	namez_len = par3_ctx->par_file_name_len;
+	ret = 0;
 	namez_off = 0;
 	while (namez_off < namez_len){
-		if (par3_ctx->noise_level >= -1){
-			printf("Loading \"%s\".\n", namez + namez_off);
+		// Set names of files in this group.
+		scan_count = 0;
+		while ( (namez_off < namez_len) && (scan_count < scan_max) ){
+			scan_p = scan_list + scan_count;
+			scan_p->name = namez + namez_off;
+			scan_p->view = NULL;
+			scan_p->file_size = 0;
+			scan_p->record = NULL;
+			scan_p->found_count = 0;
+			namez_off += strlen(namez + namez_off) + 1;
+			scan_count++;
 		}
 
-		fp = fopen(namez + namez_off, "rb");
-		if (fp == NULL){
-			printf("Failed to open \"%s\", skip to next file.\n", namez + namez_off);
-			namez_off += strlen(namez + namez_off) + 1;
-			continue;
+		// Map and search packets in each file.
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+#endif
+		for (int i = 0; i < scan_count; i++){
+			scan_list[i].record = packet_index_search(par3_ctx, scan_list[i].name);
+			if (scan_list[i].record == NULL)
+				scan_par_file(scan_list + i);
 		}
 
-		// get file size
-		file_size = _filelengthi64(_fileno(fp));
+		// Merge results in order of PAR files.
+		for (num = 0; num < scan_count; num++){
+			scan_p = scan_list + num;
+			if (ret > 0){	// After error, just release mapped files.
+				if (scan_p->view != NULL)
+					file_unmap(scan_p->view, (size_t)(scan_p->file_size));
+				continue;
+			}
 
-		// Read file data at first.
-		read_size = buf_size;
-		if (file_size < buf_size)
-			read_size = file_size;
-		//printf("file data = %"PRIu64", read_size = %zu, remain = %zu\n", file_size, read_size, file_size - read_size);
-		if (fread(buf, 1, read_size, fp) != read_size){
-			printf("Failed to read \"%s\", skip to next file.\n", namez + namez_off);
-			namez_off += strlen(namez + namez_off) + 1;
-			fclose(fp);
-			continue;
-		}
-		file_size -= read_size;
-		max = read_size;
-
-		file_offset = 0;
-		packet_count = 0;
-		new_packet_count = 0;
-		offset = 0;
-		while (offset + 48 < max){
-			if (memcmp(buf + offset, "PAR3\0PKT", 8) == 0){	// check Magic sequence
-				// read packet size
-				memcpy(&packet_size, buf + (offset + 24), 8);
-				if (packet_size <= 48){	// If packet is too small, just ignore it.
-					offset += 8;
-					continue;
-				}
-				if (offset + packet_size > buf_size + file_size){	// If not enough data, ignore the packet.
-					offset += 8;
+			if (par3_ctx->noise_level >= -1){
+				printf("Loading \"%s\".\n", scan_p->name);
+			}
+			packet_count = 0;
+			new_packet_count = 0;
+
+			if (scan_p->record != NULL){	// Use packet index instead of searching the file.
+				ret = packet_index_merge(par3_ctx, scan_p->record, scan_p->name, &packet_count, &new_packet_count);
+				if (ret > 0)
 					continue;
-				}
-				if (packet_size > buf_size){	// If packet is larger than buffer, show error and continue.
+				if (ret < 0){	// When the file is different from the index, search packets in it.
 					if (par3_ctx->noise_level >= 1){
-						memcpy(packet_type, buf + (offset + 40), 8);
-						printf("Warning, packet is too large. size = %"PRIu64", type = %s\n", packet_size, packet_type);
+						printf("Packet index is different from the file.\n");
 					}
-					offset += 8;
+					ret = 0;
+					packet_count = 0;
+					new_packet_count = 0;
+					scan_p->record = NULL;
+					scan_par_file(scan_p);
+				}
+			}
+
+			if (scan_p->record != NULL){
+				// Packets were loaded already.
+
+			} else if (scan_p->ret == -3){
+				printf("Failed to open \"%s\", skip to next file.\n", scan_p->name);
+				continue;
+
+			} else if (scan_p->ret == -2){	// Read file data into buffer.
+				fp = fopen(scan_p->name, "rb");
+				if (fp == NULL){
+					printf("Failed to open \"%s\", skip to next file.\n", scan_p->name);
 					continue;
 				}
-				// If packet exceeds buffer, read more bytes.
-				if (offset + packet_size > buf_size){
-					read_size = offset;
-					if (read_size > file_size)
-						read_size = file_size;
-
-					// slide data to top
-					memmove(buf, buf + offset, buf_size - offset);
-					//printf("file data = %"PRIu64", offset = %zu, read_size = %zu, ", file_size, offset, read_size);
-					if (fread(buf + buf_size - offset, 1, read_size, fp) != read_size){
-						printf("Failed to read \"%s\", skip to next file.\n", namez + namez_off);
-						namez_off += strlen(namez + namez_off) + 1;
+				if (buf == NULL){
+					if (par3_ctx->noise_level >= 2){
+						printf("buffer size for PAR files = %zu\n", buf_size);
+					}
+					buf = malloc(buf_size);
+					if (buf == NULL){
+						perror("Failed to allocate memory for PAR files");
 						fclose(fp);
+						ret = RET_MEMORY_ERROR;
 						continue;
 					}
-					file_size -= read_size;
-					max = buf_size - offset + read_size;
-					//printf("remain = %"PRIu64", max = %zu\n", file_size, max);
-					file_offset += offset;
-					offset = 0;
-				}
-
-				// check fingerprint hash of the packet
-				blake3(buf + (offset + 24), packet_size - 24, buf_hash);
-				if (memcmp(buf + (offset + 8), buf_hash, 16) != 0){
-					// If checksum is different, ignore the packet.
-					offset += 8;
-					continue;
-				}
-				packet_count++;
-
-				// read packet type
-				memcpy(packet_type, buf + (offset + 40), 8);
-				if (par3_ctx->noise_level >= 3){
-					printf("offset =%6"PRIu64", size =%5"PRIu64", type = %s\n", file_offset + offset, packet_size, packet_type);
-				}
-
-				// store the found packet
-				ret = add_found_packet(par3_ctx, buf + offset);
-				if (ret == -2){
-					ret = list_found_packet(par3_ctx, buf + offset, namez + namez_off, file_offset + offset);
+					par3_ctx->work_buf = buf;
 				}
+				ret = scan_read_file(par3_ctx, fp, scan_p->file_size, buf, buf_size, scan_p->name, &packet_count, &new_packet_count);
 				if (ret > 0){
 					fclose(fp);
-					return ret;
-				} else if (ret == 0){
-					new_packet_count++;
+					continue;
+				} else if (ret < 0){
+					printf("Failed to read \"%s\", skip to next file.\n", scan_p->name);
+					fclose(fp);
+					ret = 0;
+					continue;
+				}
+				if (fclose(fp) != 0){
+					printf("Failed to close \"%s\", skip to next file.\n", scan_p->name);
+					continue;
 				}
 
-				offset += packet_size;
 			} else {
-				offset++;
-			}
-
-			if ( (file_size > 0) && (offset + 48 >= max) ){	// read more bytes
-				read_size = offset;
-				if (read_size > file_size)
-					read_size = file_size;
-
-				// slide data to top
-				memmove(buf, buf + offset, buf_size - offset);
-				//printf("file_size = %"PRIu64", offset = %zu, read_size = %zu, ", file_size, offset, read_size);
-				if (fread(buf + buf_size - offset, 1, read_size, fp) != read_size){
-					printf("Failed to read \"%s\", skip to next file.\n", namez + namez_off);
-					namez_off += strlen(namez + namez_off) + 1;
-					fclose(fp);
+				ret = scan_p->ret;
+				if (ret == 0)
+					ret = merge_found_packet(par3_ctx, scan_p, &packet_count, &new_packet_count);
+				file_unmap(scan_p->view, (size_t)(scan_p->file_size));
+				if (ret > 0)
 					continue;
-				}
-				file_size -= read_size;
-				max = buf_size - offset + read_size;
-				//printf("remain = %"PRIu64", max = %zu\n", file_size, max);
-				file_offset += offset;
-				offset = 0;
 			}
-		}
-
-		if (fclose(fp) != 0){
-			printf("Failed to close \"%s\", skip to next file.\n", namez + namez_off);
-			namez_off += strlen(namez + namez_off) + 1;
-			continue;
-		}
 
-		if (par3_ctx->noise_level >= 0){
-			printf("Loaded %"PRIu64" new packets (found %"PRIu64" packets)\n", new_packet_count, packet_count);
+			if (par3_ctx->noise_level >= 0){
+				printf("Loaded %"PRIu64" new packets (found %"PRIu64" packets)\n", new_packet_count, packet_count);
+			}
 		}
-
-		namez_off += strlen(namez + namez_off) + 1;
+		if (ret > 0)
+			break;
+	}
+	for (num = 0; num < scan_max; num++)
+		free(scan_list[num].found_list);
+	free(scan_list);
+	if (buf != NULL){
+		free(buf);
+		par3_ctx->work_buf = NULL;
 	}
-	free(buf);
-	par3_ctx->work_buf = NULL;
+	release_packet_key(par3_ctx);
+	packet_index_release(par3_ctx);
+	if (ret > 0)
+		return ret;
 
 	if (par3_ctx->noise_level >= 2){
 		printf("\nTotal packet:\n");
@@ -224,6 +503,109 @@ int read_packet(PAR3_CTX *par3_ctx)
 	return 0;
 }
 
+// Verify checksum of a Recovery Data Packet, which was listed without reading its data.
+// Result is set in packet_p->checked, so it's verified only once.
+int check_recv_packet(PAR3_CTX *par3_ctx, PAR3_PKT_CTX *packet_p)
+{
+	uint8_t *buf, *view, buf_hash[16];
+	int ret;
+	size_t packet_size;
+	FILE *fp;
+
+	if (packet_p->checked != 0)
+		return 0;
+
+	packet_size = 88 + par3_ctx->block_size;
+	fp = fopen(packet_p->name, "rb");
+	if (fp == NULL){	// When the file cannot be opened, the packet isn't usable.
+		packet_p->checked = -1;
+		return 0;
+	}
+
+	// check fingerprint hash of the packet
+	view = file_map(_fileno(fp), packet_p->offset, packet_size);
+	if (view != NULL){
+		blake3(view + 24, packet_size - 24, buf_hash);
+		ret = memcmp(view + 8, buf_hash, 16);
+		file_unmap(view, packet_size);
+	} else {	// Read packet data into buffer.
+		buf = malloc(packet_size);
+		if (buf == NULL){
+			perror("Failed to allocate memory for Recovery Data Packet");
+			fclose(fp);
+			return RET_MEMORY_ERROR;
+		}
+		ret = 1;
+		if ( (_fseeki64(fp, packet_p->offset, SEEK_SET) == 0) && (fread(buf, 1, packet_size, fp) == packet_size) ){
+			blake3(buf + 24, packet_size - 24, buf_hash);
+			ret = memcmp(buf + 8, buf_hash, 16);
+		}
+		free(buf);
+	}
+	fclose(fp);
+
+	if (ret == 0){
+		packet_p->checked = 1;
+	} else {
+		packet_p->checked = -1;
+		if (par3_ctx->noise_level >= 1){
+			printf("Recovery Data Packet for recovery block[%"PRIu64"] is damaged in \"%s\"\n", packet_p->index, packet_p->name);
+		}
+	}
+
+	return 0;
+}
+
+// Remove damaged Recovery Data Packets from the lists.
+// A valid copy takes the place of damaged one.
+int remove_damaged_packet(PAR3_CTX *par3_ctx)
+{
+	uint64_t item_index, copy_index, item_count;
+	PAR3_PKT_CTX *list, *copy_list, tmp_item;
+
+	// Replace damaged packet with valid copy of same packet.
+	list = par3_ctx->recv_packet_list;
+	copy_list = par3_ctx->recv_copy_list;
+	for (item_index = 0; item_index < par3_ctx->recv_packet_count; item_index++){
+		if (list[item_index].checked >= 0)
+			continue;
+		for (copy_index = 0; copy_index < par3_ctx->recv_copy_count; copy_index++){
+			if ( (copy_list[copy_index].checked >= 0) && (copy_list[copy_index].id == list[item_index].id)
+					&& (copy_list[copy_index].index == list[item_index].index)
+					&& (memcmp(copy_list[copy_index].root, list[item_index].root, 16) == 0)
+					&& (memcmp(copy_list[copy_index].matrix, list[item_index].matrix, 16) == 0) ){
+				memcpy(&tmp_item, list + item_index, sizeof(PAR3_PKT_CTX));
+				memcpy(list + item_index, copy_list + copy_index, sizeof(PAR3_PKT_CTX));
+				memcpy(copy_list + copy_index, &tmp_item, sizeof(PAR3_PKT_CTX));
+				break;
+			}
+		}
+	}
+
+	// Remove damaged packets from the lists.
+	item_count = 0;
+	for (item_index = 0; item_index < par3_ctx->recv_packet_count; item_index++){
+		if (list[item_index].checked >= 0){
+			if (item_count < item_index)
+				memcpy(list + item_count, list + item_index, sizeof(PAR3_PKT_CTX));
+			item_count++;
+		}
+	}
+	par3_ctx->recv_packet_count = item_count;
+	item_count = 0;
+	for (item_index = 0; item_index < par3_ctx->recv_copy_count; item_index++){
+		if (copy_list[item_index].checked >= 0){
+			if (item_count < item_index)
+				memcpy(copy_list + item_count, copy_list + item_index, sizeof(PAR3_PKT_CTX));
+			item_count++;
+		}
+	}
+	par3_ctx->recv_copy_count = item_count;
+
+	// Because the index points items in the lists, make it again.
+	return make_recv_index(par3_ctx);
+}
+
 void show_read_result(PAR3_CTX *par3_ctx, int flag_detail)
 {
 	uint32_t num;
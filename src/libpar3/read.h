@@ -1,5 +1,8 @@
 
+void scan_par_file(PAR3_SCAN_CTX *scan_p);
 int read_packet(PAR3_CTX *par3_ctx);
+int check_recv_packet(PAR3_CTX *par3_ctx, PAR3_PKT_CTX *packet_p);
+int remove_damaged_packet(PAR3_CTX *par3_ctx);
 
 void show_read_result(PAR3_CTX *par3_ctx, int flag_detail);
 void show_data_size(PAR3_CTX *par3_ctx);
@@ -6,13 +6,17 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "galois.h"
 #include "hash.h"
 #include "reedsolomon.h"
 
 
 // Create all recovery blocks from one input block.
-void rs_create_one_all(PAR3_CTX *par3_ctx, int x_index)
+void rs_create_one_all(PAR3_CTX *par3_ctx, int x_index, int flag_add)
 {
 	void *gf_table;
 	uint8_t *work_buf, *buf_p;
@@ -37,17 +41,17 @@ void rs_create_one_all(PAR3_CTX *par3_ctx, int x_index)
 			y_R = 65535 - (y_index + first_num);
 			element = gf16_reciprocal(gf_table, x_index ^ y_R);	// inv( x_index ^ y_R )
 
-			// If x_index == 0, just put values.
-			// If x_index > 0, add values on previous values.
-			gf16_region_multiply(gf_table, work_buf, element, region_size, buf_p, x_index);
+			// If flag_add == 0, just put values.
+			// If flag_add != 0, add values on previous values.
+			gf16_region_multiply(gf_table, work_buf, element, region_size, buf_p, flag_add);
 
 		} else {	// 8-bit Galois Field
 			y_R = 255 - (y_index + first_num);
 			element = gf8_reciprocal(gf_table, x_index ^ y_R);	// inv( x_index ^ y_R )
 
-			// If x_index == 0, just put values.
-			// If x_index > 0, add values on previous values.
-			gf8_region_multiply(gf_table, work_buf, element, region_size, buf_p, x_index);
+			// If flag_add == 0, just put values.
+			// If flag_add != 0, add values on previous values.
+			gf8_region_multiply(gf_table, work_buf, element, region_size, buf_p, flag_add);
 		}
 		//printf("x = %d, R = %d, y_R = %d, element = %d\n", x_index, y_index + first_num, y_R, element);
 
@@ -128,10 +132,214 @@ void rs_create_all(PAR3_CTX *par3_ctx, size_t region_size, uint64_t progress_tot
 }
 
 
+/*
+Matrix cache keeps decode matrix beside PAR files.
+It's written only when recovery failed by an I/O error after computing the matrix.
+When repair is retried, it can skip computation of matrix.
+The cache file is deleted, when repair doesn't need it anymore.
+
+File format:
+ 8 bytes : "PAR3MTX\0"
+ 8 bytes : CRC-64 of all data after this header
+16 bytes : checksum of using Matrix Packet
+ 8 bytes : number of input blocks
+ 4 bytes : number of lost blocks
+ 4 bytes : Galois Field size
+ ? bytes : index of using recovery blocks and lost input blocks (4 bytes each)
+ ? bytes : decode matrix
+*/
+
+#define MATRIX_CACHE_HEADER_SIZE 16
+#define MATRIX_CACHE_KEY_SIZE 32
+
+// Make path of matrix cache from PAR filename.
+static int matrix_cache_path(PAR3_CTX *par3_ctx, char *path)
+{
+	size_t len;
+
+	len = strlen(par3_ctx->par_filename);
+	if ( (len == 0) || (len + 8 > _MAX_PATH) )
+		return 1;
+	memcpy(path, par3_ctx->par_filename, len);
+	strcpy(path + len, ".matrix");
+
+	return 0;
+}
+
+// Make key data to identify the decode matrix.
+static void matrix_cache_key(PAR3_CTX *par3_ctx, int lost_count, uint8_t key[MATRIX_CACHE_KEY_SIZE])
+{
+	uint32_t value4;
+
+	memcpy(key, par3_ctx->matrix_packet + par3_ctx->matrix_packet_offset + 8, 16);
+	memcpy(key + 16, &(par3_ctx->block_count), 8);
+	value4 = lost_count;
+	memcpy(key + 24, &value4, 4);
+	value4 = par3_ctx->gf_size;
+	memcpy(key + 28, &value4, 4);
+}
+
+// Read decode matrix from cache file.
+// return 0 = loaded, 1 = not found or different
+static int matrix_cache_load(PAR3_CTX *par3_ctx, int lost_count)
+{
+	char path[_MAX_PATH];
+	uint8_t *buf, key[MATRIX_CACHE_KEY_SIZE];
+	size_t id_size, matrix_size, buf_size;
+	uint64_t crc;
+	FILE *fp;
+
+	if (matrix_cache_path(par3_ctx, path) != 0)
+		return 1;
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return 1;
+
+	id_size = sizeof(int) * lost_count * 2;
+	matrix_size = (size_t)(par3_ctx->gf_size) * par3_ctx->block_count * lost_count;
+	buf_size = MATRIX_CACHE_HEADER_SIZE + MATRIX_CACHE_KEY_SIZE + id_size + matrix_size;
+	if (_filelengthi64(_fileno(fp)) != (int64_t)buf_size){
+		fclose(fp);
+		return 1;
+	}
+	buf = malloc(buf_size);
+	if (buf == NULL){
+		fclose(fp);
+		return 1;
+	}
+	if (fread(buf, 1, buf_size, fp) != buf_size){
+		free(buf);
+		fclose(fp);
+		return 1;
+	}
+	fclose(fp);
+
+	// Check integrity and key of the matrix.
+	matrix_cache_key(par3_ctx, lost_count, key);
+	memcpy(&crc, buf + 8, 8);
+	if ( (memcmp(buf, "PAR3MTX\0", 8) != 0)
+			|| (crc != crc64(buf + MATRIX_CACHE_HEADER_SIZE, buf_size - MATRIX_CACHE_HEADER_SIZE, 0))
+			|| (memcmp(buf + MATRIX_CACHE_HEADER_SIZE, key, MATRIX_CACHE_KEY_SIZE) != 0)
+			|| (memcmp(buf + MATRIX_CACHE_HEADER_SIZE + MATRIX_CACHE_KEY_SIZE, par3_ctx->recv_id_list, id_size) != 0) ){
+		free(buf);
+		return 1;
+	}
+
+	// Move matrix to the top of buffer.
+	memmove(buf, buf + MATRIX_CACHE_HEADER_SIZE + MATRIX_CACHE_KEY_SIZE + id_size, matrix_size);
+	par3_ctx->matrix = buf;
+
+	if (par3_ctx->noise_level >= 0){
+		printf("\nLoaded Reed Solomon matrix from \"%s\"\n", path);
+	}
+
+	return 0;
+}
+
+// Write decode matrix to cache file.
+// Failure of writing is ignored, because it's not required for repair.
+void rs_save_matrix_cache(PAR3_CTX *par3_ctx, uint64_t lost_count)
+{
+	char path[_MAX_PATH], temp_path[_MAX_PATH + 8];
+	uint8_t header[MATRIX_CACHE_HEADER_SIZE], key[MATRIX_CACHE_KEY_SIZE];
+	size_t id_size, matrix_size;
+	uint64_t crc;
+	FILE *fp;
+
+	// Only 16-bit Reed-Solomon Codes use the cache, after the matrix was computed.
+	if ( (par3_ctx->gf_size != 2) || (par3_ctx->matrix == NULL) || (par3_ctx->recv_id_list == NULL) )
+		return;
+	if (matrix_cache_path(par3_ctx, path) != 0)
+		return;
+
+	id_size = sizeof(int) * lost_count * 2;
+	matrix_size = (size_t)(par3_ctx->gf_size) * par3_ctx->block_count * lost_count;
+	matrix_cache_key(par3_ctx, lost_count, key);
+	crc = crc64(key, MATRIX_CACHE_KEY_SIZE, 0);
+	crc = crc64((uint8_t *)(par3_ctx->recv_id_list), id_size, crc);
+	crc = crc64(par3_ctx->matrix, matrix_size, crc);
+	memcpy(header, "PAR3MTX\0", 8);
+	memcpy(header + 8, &crc, 8);
+
+	// Write a temporary file and replace, so that a broken cache isn't left.
+	sprintf(temp_path, "%s.tmp", path);
+	fp = fopen(temp_path, "wb");
+	if (fp == NULL)
+		return;
+	if ( (fwrite(header, 1, MATRIX_CACHE_HEADER_SIZE, fp) != MATRIX_CACHE_HEADER_SIZE)
+			|| (fwrite(key, 1, MATRIX_CACHE_KEY_SIZE, fp) != MATRIX_CACHE_KEY_SIZE)
+			|| (fwrite(par3_ctx->recv_id_list, 1, id_size, fp) != id_size)
+			|| (fwrite(par3_ctx->matrix, 1, matrix_size, fp) != matrix_size) ){
+		fclose(fp);
+		remove(temp_path);
+		return;
+	}
+	if (fclose(fp) != 0){
+		remove(temp_path);
+		return;
+	}
+	if (rename(temp_path, path) != 0){
+		// On Windows, rename() fails when the destination exists.
+		remove(path);
+		if (rename(temp_path, path) != 0){
+			remove(temp_path);
+			return;
+		}
+	}
+
+	if (par3_ctx->noise_level >= 0){
+		printf("Saved Reed Solomon matrix to \"%s\" for next repair.\n", path);
+	}
+}
+
+// Delete cache file of decode matrix.
+void rs_delete_matrix_cache(PAR3_CTX *par3_ctx)
+{
+	char path[_MAX_PATH];
+
+	if (matrix_cache_path(par3_ctx, path) != 0)
+		return;
+	remove(path);
+}
+
+// Solve linear equation of Cauchy Reed-Solomon.
+// This may run on a thread while input blocks are read, because it touches only the matrix.
+int rs_invert_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count)
+{
+	int ret;
+
+	if (par3_ctx->gf_size == 2){	// 16-bit Reed-Solomon Codes
+		// When the same matrix was computed by previous repair, use it.
+		if (matrix_cache_load(par3_ctx, (int)lost_count) != 0){
+			// Either functions should work.
+			// As blocks are more, Gaussian elimination become too slow.
+			//ret = rs16_gaussian_elimination(par3_ctx, (int)lost_count);
+			ret = rs16_invert_matrix_cauchy(par3_ctx, (int)lost_count);
+			if (ret != 0){
+				// Incomplete matrix must not be saved as cache.
+				free(par3_ctx->matrix);
+				par3_ctx->matrix = NULL;
+				return ret;
+			}
+		}
+
+	} else if (par3_ctx->gf_size == 1){	// 8-bit Reed-Solomon Codes
+		// Either functions should work.
+		// Gaussian elimination is enough fast for a few blocks.
+		ret = rs8_gaussian_elimination(par3_ctx, (int)lost_count);
+		//ret = rs8_invert_matrix_cauchy(par3_ctx, (int)lost_count);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 // Construct matrix for Cauchy Reed-Solomon, and solve linear equation.
+// When lost blocks don't fit in memory, recovery reads input blocks by spliting every block.
+// Then, the matrix is solved at reading the first split, instead of here.
 int rs_compute_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count)
 {
-	int ret;
 	size_t alloc_size, region_size;
 
 	// Only when it uses Reed-Solomon Erasure Codes.
@@ -153,24 +361,6 @@ int rs_compute_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count)
 		return RET_MEMORY_ERROR;
 	}
 
-	// Make matrix
-	if (par3_ctx->gf_size == 2){	// 16-bit Reed-Solomon Codes
-		// Either functions should work.
-		// As blocks are more, Gaussian elimination become too slow.
-		//ret = rs16_gaussian_elimination(par3_ctx, (int)lost_count);
-		ret = rs16_invert_matrix_cauchy(par3_ctx, (int)lost_count);
-		if (ret != 0)
-			return ret;
-
-	} else if (par3_ctx->gf_size == 1){	// 8-bit Reed-Solomon Codes
-		// Either functions should work.
-		// Gaussian elimination is enough fast for a few blocks.
-		ret = rs8_gaussian_elimination(par3_ctx, (int)lost_count);
-		//ret = rs8_invert_matrix_cauchy(par3_ctx, (int)lost_count);
-		if (ret != 0)
-			return ret;
-	}
-
 	// Set memory alignment of block data to be 4.
 	// Increase at least 1 byte as checksum.
 	region_size = (par3_ctx->block_size + 4 + 3) & ~3;
@@ -183,37 +373,79 @@ int rs_compute_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count)
 	// Allocate memory to keep lost blocks
 	par3_ctx->block_data = malloc(alloc_size);
 	//par3_ctx->block_data = NULL;	// For testing another method
-	if (par3_ctx->block_data != NULL){
-		par3_ctx->ecc_method |= 0x8000;	// Keep all lost blocks on memory
-		if (par3_ctx->noise_level >= 2){
-			printf("\nAligned size of block data = %zu\n", region_size);
-			printf("Keep all lost blocks on memory (%zu * %"PRIu64" = %zu)\n", region_size, lost_count, alloc_size);
-		}
+	if (par3_ctx->block_data == NULL)
+		return 0;
+	par3_ctx->ecc_method |= 0x8000;	// Keep all lost blocks on memory
+	if (par3_ctx->noise_level >= 2){
+		printf("\nAligned size of block data = %zu\n", region_size);
+		printf("Keep all lost blocks on memory (%zu * %"PRIu64" = %zu)\n", region_size, lost_count, alloc_size);
 	}
 
-	return 0;
+	// Lost blocks are recovered at reading each input block, so the matrix is required now.
+	return rs_invert_matrix(par3_ctx, lost_count);
+}
+
+// Return number of threads to recover lost blocks.
+// Each thread calculates different lost blocks, so it's limited by number of lost blocks.
+// When total data size is small, single thread is faster.
+static int get_recover_thread_count(PAR3_CTX *par3_ctx, size_t region_size, int lost_count)
+{
+	int thread_count;
+
+#ifdef _OPENMP
+	if (par3_ctx->thread_count > 0){
+		thread_count = par3_ctx->thread_count;
+	} else {
+		thread_count = omp_get_max_threads();
+	}
+#else
+	(void)par3_ctx;
+	thread_count = 1;
+#endif
+	if (thread_count > lost_count)
+		thread_count = lost_count;
+	if (region_size * lost_count < 65536)
+		thread_count = 1;
+	if (thread_count < 1)
+		thread_count = 1;
+
+	return thread_count;
 }
 
 // Recover all lost input blocks from one block.
+// The matrix and the source block are read only, so lost blocks are calculated on threads.
 void rs_recover_one_all(PAR3_CTX *par3_ctx, int x_index, int lost_count)
 {
 	void *gf_table, *matrix;
-	uint8_t *work_buf, *buf_p;
+	uint8_t *work_buf, *block_data;
 	uint8_t gf_size;
-	int y_index, factor;
-	int block_count;
+	int *lost_id;
+	int block_count, thread_count;
 	size_t region_size;
+	PAR3_BLOCK_CTX *block_list;
 
 	block_count = (int)(par3_ctx->block_count);
 	gf_size = par3_ctx->gf_size;
 	gf_table = par3_ctx->galois_table;
 	matrix = par3_ctx->matrix;
 	work_buf = par3_ctx->work_buf;
-	buf_p = par3_ctx->block_data;
+	block_data = par3_ctx->block_data;
+	lost_id = par3_ctx->recv_id_list + lost_count;
+	block_list = par3_ctx->block_list;
 
-	// For every lost block
 	region_size = (par3_ctx->block_size + 4 + 3) & ~3;
-	for (y_index = 0; y_index < lost_count; y_index++){
+	thread_count = get_recover_thread_count(par3_ctx, region_size, lost_count);
+
+	// For every lost block
+	#pragma omp parallel for schedule(static) num_threads(thread_count) if(thread_count > 1)
+	for (int y_index = 0; y_index < lost_count; y_index++){
+		uint8_t *buf_p = block_data + region_size * y_index;
+		int factor;
+
+		// Lost block, which isn't used by selected files, isn't recovered.
+		if (block_list[ lost_id[y_index] ].state & 0x100)
+			continue;
+
 		if (gf_size == 2){
 			factor = ((uint16_t *)matrix)[ block_count * y_index + x_index ];
 			gf16_region_multiply(gf_table, work_buf, factor, region_size, buf_p, 1);
@@ -222,45 +454,62 @@ void rs_recover_one_all(PAR3_CTX *par3_ctx, int x_index, int lost_count)
 			gf8_region_multiply(gf_table, work_buf, factor, region_size, buf_p, 1);
 		}
 		//printf("%d-th lost block += input block[%d] * %2x\n", y_index, x_index, factor);
-
-		buf_p += region_size;
 	}
 }
 
 // Recover all lost input blocks from all blocks.
-void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count, uint64_t progress_total, uint64_t progress_step)
+// Each thread calculates different lost blocks. Only the first thread prints progress.
+// Recovery blocks follow input blocks in block_data, or they are at addresses in recv_data.
+void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count, uint8_t **recv_data, uint64_t progress_total, uint64_t progress_step)
 {
 	void *gf_table, *matrix;
-	uint8_t *block_data, *buf_p, *input_p, *recv_p;
+	uint8_t *block_data, *recv_p;
 	uint8_t gf_size;
 	int *lost_id;
-	int x_index, y_index, lost_index, factor;
-	int block_count;
+	int block_count, thread_count, done_count;
 	int progress_old, progress_now;
 	time_t time_old, time_now;
+	PAR3_BLOCK_CTX *block_list;
 
 	block_count = (int)(par3_ctx->block_count);
 	gf_size = par3_ctx->gf_size;
 	gf_table = par3_ctx->galois_table;
 	matrix = par3_ctx->matrix;
 	lost_id = par3_ctx->recv_id_list + lost_count;
+	block_list = par3_ctx->block_list;
 	block_data = par3_ctx->block_data;
 	recv_p = block_data + region_size * block_count;
+	thread_count = get_recover_thread_count(par3_ctx, region_size, lost_count);
 
 	if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 1) ){
 		progress_old = 0;
 		time_old = time(NULL);
 	}
+	done_count = 0;
 
 	// For every lost block
-	for (y_index = 0; y_index < lost_count; y_index++){
+	#pragma omp parallel for schedule(dynamic) num_threads(thread_count) if(thread_count > 1)
+	for (int y_index = 0; y_index < lost_count; y_index++){
+		uint8_t *buf_p, *input_p;
+		int x_index, lost_index, factor;
+#ifdef _OPENMP
+		int thread_id = omp_get_thread_num();
+#else
+		int thread_id = 0;
+#endif
+
+		// Lost block, which isn't used by selected files, isn't recovered.
+		// Only a row of the matrix is used for each lost block.
+		if (block_list[ lost_id[y_index] ].state & 0x100)
+			continue;
+
 		buf_p = block_data + region_size * lost_id[y_index];
 		input_p = block_data;
 
 		// For every available input block
 		lost_index = 0;
 		for (x_index = 0; x_index < block_count; x_index++){
-			if (x_index == lost_id[lost_index]){
+			if ( (lost_index < lost_count) && (x_index == lost_id[lost_index]) ){
 				lost_index++;
 				input_p += region_size;
 				continue;
@@ -278,8 +527,11 @@ void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count, uint
 		}
 
 		// For every using recovery block
+		input_p = recv_p;
 		for (lost_index = 0; lost_index < lost_count; lost_index++){
 			x_index = lost_id[lost_index];
+			if (recv_data != NULL)
+				input_p = recv_data[lost_index];
 
 			if (gf_size == 2){
 				factor = ((uint16_t *)matrix)[ block_count * y_index + x_index ];
@@ -294,17 +546,20 @@ void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count, uint
 
 		// Print progress percent
 		if ( (par3_ctx->noise_level >= 0) && (par3_ctx->noise_level <= 1) ){
-			progress_step += block_count;
-			time_now = time(NULL);
-			if (time_now != time_old){
-				time_old = time_now;
-				progress_now = (int)((progress_step * 1000) / progress_total);
-				if (progress_now != progress_old){
-					progress_old = progress_now;
-					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+			// Count finished lost blocks, and add their steps to the given progress.
+			#pragma omp atomic
+			done_count++;
+			if (thread_id == 0){
+				time_now = time(NULL);
+				if (time_now != time_old){
+					time_old = time_now;
+					progress_now = (int)(((progress_step + (uint64_t)done_count * block_count) * 1000) / progress_total);
+					if (progress_now != progress_old){
+						progress_old = progress_now;
+						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+					}
 				}
 			}
 		}
 	}
 }
-
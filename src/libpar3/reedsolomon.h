@@ -1,6 +1,7 @@
 
 // Create all recovery blocks from one input block.
-void rs_create_one_all(PAR3_CTX *par3_ctx, int x_index);
+// When flag_add is 0, it overwrites previous values.
+void rs_create_one_all(PAR3_CTX *par3_ctx, int x_index, int flag_add);
 
 // Create all recovery blocks from all input blocks.
 void rs_create_all(PAR3_CTX *par3_ctx, size_t region_size,
@@ -8,7 +9,13 @@ void rs_create_all(PAR3_CTX *par3_ctx, size_t region_size,
 
 
 // Construct matrix for Reed-Solomon, and solve linear equation.
+// When lost blocks don't fit in memory, solving is left to rs_invert_matrix().
 int rs_compute_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count);
+int rs_invert_matrix(PAR3_CTX *par3_ctx, uint64_t lost_count);
+
+// Save or delete cache file of decode matrix.
+void rs_save_matrix_cache(PAR3_CTX *par3_ctx, uint64_t lost_count);
+void rs_delete_matrix_cache(PAR3_CTX *par3_ctx);
 
 
 // for 8-bit Cauchy Reed-Solomon
@@ -23,6 +30,7 @@ int rs16_invert_matrix_cauchy(PAR3_CTX *par3_ctx, int lost_count);
 void rs_recover_one_all(PAR3_CTX *par3_ctx, int x_index, int lost_count);
 
 // Recover all lost input blocks from all blocks.
-void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count,
+// When recv_data isn't NULL, it's list of address of using recovery blocks.
+void rs_recover_all(PAR3_CTX *par3_ctx, size_t region_size, int lost_count, uint8_t **recv_data,
 				uint64_t progress_total, uint64_t progress_step);
 
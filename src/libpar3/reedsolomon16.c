@@ -6,9 +6,35 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "galois.h"
 
 
+// Return number of threads to compute matrix.
+static int get_matrix_thread_count(PAR3_CTX *par3_ctx, int lost_count)
+{
+	int thread_count;
+
+#ifdef _OPENMP
+	if (par3_ctx->thread_count > 0){
+		thread_count = par3_ctx->thread_count;
+	} else {
+		thread_count = omp_get_max_threads();
+	}
+#else
+	(void)par3_ctx;
+	thread_count = 1;
+#endif
+	// Small matrix is faster on single thread.
+	if (lost_count < 64)
+		thread_count = 1;
+
+	return thread_count;
+}
+
 // Gaussian elimination of matrix for Cauchy Reed-Solomon
 int rs16_gaussian_elimination(PAR3_CTX *par3_ctx, int lost_count)
 {
@@ -16,7 +42,8 @@ int rs16_gaussian_elimination(PAR3_CTX *par3_ctx, int lost_count)
 	int x, y, y_R, y2;
 	int *lost_id, *recv_id;
 	int block_count;
-	int pivot, factor, factor2;
+	int pivot, factor;
+	int thread_count;
 	int progress_old, progress_now;
 	time_t time_old, time_now;
 	clock_t clock_now;
@@ -28,6 +55,7 @@ int rs16_gaussian_elimination(PAR3_CTX *par3_ctx, int lost_count)
 	gf_table = par3_ctx->galois_table;
 	recv_id = par3_ctx->recv_id_list;
 	lost_id = recv_id + lost_count;
+	thread_count = get_matrix_thread_count(par3_ctx, lost_count);
 
 	// Allocate matrix on memory
 	matrix = malloc(sizeof(uint16_t) * block_count * lost_count);
@@ -80,7 +108,11 @@ int rs16_gaussian_elimination(PAR3_CTX *par3_ctx, int lost_count)
 		gf16_region_multiply(gf_table, (uint8_t *)(matrix + block_count * y), factor, block_count * 2, NULL, 0);
 
 		// Erase values of same pivot on other rows.
+		// Each row is independent, so they are calculated on threads.
+		#pragma omp parallel for schedule(static) num_threads(thread_count) if(thread_count > 1)
 		for (y2 = 0; y2 < lost_count; y2++){
+			int factor2;
+
 			if (y2 == y)
 				continue;
 
@@ -149,7 +181,7 @@ int rs16_invert_matrix_cauchy(PAR3_CTX *par3_ctx, int lost_count)
 	int *x, *y, *a, *b, *c, *d;
 	int i, j, k;
 	int *lost_id, *recv_id;
-	int block_count;
+	int block_count, thread_count, done_count;
 	int progress_old, progress_now;
 	time_t time_old, time_now;
 	clock_t clock_now;
@@ -161,6 +193,7 @@ int rs16_invert_matrix_cauchy(PAR3_CTX *par3_ctx, int lost_count)
 	gf_table = par3_ctx->galois_table;
 	recv_id = par3_ctx->recv_id_list;
 	lost_id = recv_id + lost_count;
+	thread_count = get_matrix_thread_count(par3_ctx, lost_count);
 
 	// Allocate matrix on memory
 	matrix = malloc(sizeof(uint16_t) * block_count * lost_count);
@@ -213,33 +246,52 @@ int rs16_invert_matrix_cauchy(PAR3_CTX *par3_ctx, int lost_count)
 		x[i] = y[i];
 	}
 
+	// Each element of a, b, c and d is independent, so they are calculated on threads.
+	// Only the first thread prints progress.
+	done_count = 0;
+	#pragma omp parallel for schedule(static) num_threads(thread_count) if(thread_count > 1)
 	for (i = 0; i < block_count; i++){
-		a[i] = 1;
-		b[i] = 1;
-		c[i] = 1;
-		d[i] = 1;
-
-		for (j = 0; j < lost_count; j++){
-			if (i != j){
-				a[i] = gf16_multiply(gf_table, a[i], x[i] ^ x[j]);
-				b[i] = gf16_multiply(gf_table, b[i], y[i] ^ y[j]);
+		int j2, a_i, b_i, c_i, d_i;
+#ifdef _OPENMP
+		int thread_id = omp_get_thread_num();
+#else
+		int thread_id = 0;
+#endif
+
+		a_i = 1;
+		b_i = 1;
+		c_i = 1;
+		d_i = 1;
+		for (j2 = 0; j2 < lost_count; j2++){
+			if (i != j2){
+				a_i = gf16_multiply(gf_table, a_i, x[i] ^ x[j2]);
+				b_i = gf16_multiply(gf_table, b_i, y[i] ^ y[j2]);
 			}
 
-			c[i] = gf16_multiply(gf_table, c[i], x[i] ^ y[j]);
-			d[i] = gf16_multiply(gf_table, d[i], y[i] ^ x[j]);
+			c_i = gf16_multiply(gf_table, c_i, x[i] ^ y[j2]);
+			d_i = gf16_multiply(gf_table, d_i, y[i] ^ x[j2]);
 		}
+		a[i] = a_i;
+		b[i] = b_i;
+		c[i] = c_i;
+		d[i] = d_i;
 
 		// Print progress percent
 		if (par3_ctx->noise_level >= 0){
-			time_now = time(NULL);
-			if (time_now != time_old){
-				time_old = time_now;
-				// Complexity is "lost_count * block_count * 2".
-				// Because lost_count is 16-bit value, "int" (32-bit signed integer) is enough.
-				progress_now = (i * 1000) / (block_count + lost_count);
-				if (progress_now != progress_old){
-					progress_old = progress_now;
-					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+			// OpenMP 2.0 (Visual Studio) doesn't support "atomic capture".
+			#pragma omp atomic
+			done_count++;
+			if (thread_id == 0){
+				time_now = time(NULL);
+				if (time_now != time_old){
+					time_old = time_now;
+					// Complexity is "lost_count * block_count * 2".
+					// Because lost_count is 16-bit value, "int" (32-bit signed integer) is enough.
+					progress_now = (done_count * 1000) / (block_count + lost_count);
+					if (progress_now != progress_old){
+						progress_old = progress_now;
+						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+					}
 				}
 			}
 		}
@@ -281,25 +333,36 @@ int rs16_invert_matrix_cauchy(PAR3_CTX *par3_ctx, int lost_count)
 	}
 */
 
+	// Each row of matrix is independent, so they are calculated on threads.
+	#pragma omp parallel for schedule(static) num_threads(thread_count) if(thread_count > 1)
 	for (i = 0; i < lost_count; i++){
-		for (j = 0; j < block_count; j++){
-			k = gf16_multiply(gf_table, a[j], b[i]);
-			k = gf16_reciprocal(gf_table, gf16_multiply(gf_table, k, x[j] ^ y[i]));
-			k = gf16_multiply(gf_table, gf16_multiply(gf_table, c[j], d[i]), k);
-			matrix[ block_count * i + y[j] ] = k;
+		int j2, k2;
+#ifdef _OPENMP
+		int thread_id = omp_get_thread_num();
+#else
+		int thread_id = 0;
+#endif
+
+		for (j2 = 0; j2 < block_count; j2++){
+			k2 = gf16_multiply(gf_table, a[j2], b[i]);
+			k2 = gf16_reciprocal(gf_table, gf16_multiply(gf_table, k2, x[j2] ^ y[i]));
+			k2 = gf16_multiply(gf_table, gf16_multiply(gf_table, c[j2], d[i]), k2);
+			matrix[ block_count * i + y[j2] ] = (uint16_t)k2;
 		}
 
 		// Print progress percent
 		if (par3_ctx->noise_level >= 0){
-			time_now = time(NULL);
-			if (time_now != time_old){
-				time_old = time_now;
-				// Complexity is "lost_count * block_count * 2".
-				// Because lost_count is 16-bit value, "int" (32-bit signed integer) is enough.
-				progress_now = ((block_count + i) * 1000) / (block_count + lost_count);
-				if (progress_now != progress_old){
-					progress_old = progress_now;
-					printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+			#pragma omp atomic
+			done_count++;
+			if (thread_id == 0){
+				time_now = time(NULL);
+				if (time_now != time_old){
+					time_old = time_now;
+					progress_now = (done_count * 1000) / (block_count + lost_count);
+					if (progress_now != progress_old){
+						progress_old = progress_now;
+						printf("%d.%d%%\r", progress_now / 10, progress_now % 10);	// 0.0% ~ 100.0%
+					}
 				}
 			}
 		}
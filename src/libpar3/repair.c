@@ -8,7 +8,9 @@
 #include <string.h>
 
 #include "file.h"
+#include "hash.h"
 #include "inside.h"
+#include "repair.h"
 #include "verify.h"
 
 
@@ -77,6 +79,524 @@ uint32_t reconstruct_directory_tree(PAR3_CTX *par3_ctx)
 	return failed_dir_count;
 }
 
+/*
+In-place repair writes only damaged parts on the original file,
+instead of rebuilding whole file in temporary file.
+Before over-writing, the original bytes of damaged areas are saved in undo journal.
+Records of each file are flushed at once, before repair starts.
+When repair was interrupted, the next repair restores them at first.
+
+Journal format:
+ 8 bytes : "PAR3UND\0"
+ records
+
+Record format:
+ 0 : offset in the file (8 bytes)
+ 8 : size of data (8 bytes)
+16 : length of file name including null terminator (8 bytes)
+24 : file name (absolute path)
+ ? : original data
+ ? : CRC-64 of the record until here (8 bytes)
+*/
+
+#define JOURNAL_RECORD_SIZE 24
+
+// Name of undo journal is similar to temporary files.
+static void get_journal_path(PAR3_CTX *par3_ctx, char *path)
+{
+	sprintf(path, "par3_%02X%02X%02X%02X%02X%02X%02X%02X_undo.tmp",
+			par3_ctx->set_id[0], par3_ctx->set_id[1], par3_ctx->set_id[2], par3_ctx->set_id[3],
+			par3_ctx->set_id[4], par3_ctx->set_id[5], par3_ctx->set_id[6], par3_ctx->set_id[7]);
+}
+
+// Select files to repair by name. Other files are left as they are.
+// Lost blocks, which aren't used by selected files, don't need to be recovered.
+// Return number of selected files.
+uint32_t set_only_file(PAR3_CTX *par3_ctx)
+{
+	char *name_p, *name_end;
+	uint32_t file_count, file_index, select_count;
+	int64_t slice_index, slice_count;
+	uint64_t block_index, block_count;
+	PAR3_FILE_CTX *file_list;
+	PAR3_SLICE_CTX *slice_list;
+	PAR3_BLOCK_CTX *block_list;
+
+	file_count = par3_ctx->input_file_count;
+	file_list = par3_ctx->input_file_list;
+	slice_count = par3_ctx->slice_count;
+	slice_list = par3_ctx->slice_list;
+	block_count = par3_ctx->block_count;
+	block_list = par3_ctx->block_list;
+
+	// Every specified name must be an input file.
+	name_p = par3_ctx->only_file_name;
+	name_end = name_p + par3_ctx->only_file_name_len;
+	while (name_p < name_end){
+		for (file_index = 0; file_index < file_count; file_index++){
+			if (_stricmp(name_p, file_list[file_index].name) == 0)
+				break;
+		}
+		if (file_index == file_count){
+			printf("\"%s\" isn't an input file.\n", name_p);
+			return 0;
+		}
+		name_p += strlen(name_p) + 1;
+	}
+
+	select_count = 0;
+	for (file_index = 0; file_index < file_count; file_index++){
+		if (namez_search(par3_ctx->only_file_name, par3_ctx->only_file_name_len, file_list[file_index].name) == NULL){
+			file_list[file_index].state |= 0x800;
+		} else {
+			select_count++;
+			if (par3_ctx->noise_level >= 2)
+				printf("Target: \"%s\" - selected to repair.\n", file_list[file_index].name);
+		}
+	}
+
+	// Mark blocks, which don't include slices of selected files.
+	for (block_index = 0; block_index < block_count; block_index++)
+		block_list[block_index].state |= 0x100;
+	for (slice_index = 0; slice_index < slice_count; slice_index++){
+		file_index = slice_list[slice_index].file;
+		if ((file_list[file_index].state & 0x800) == 0)
+			block_list[ slice_list[slice_index].block ].state &= ~0x100;
+	}
+
+	return select_count;
+}
+
+// Save original bytes of damaged areas in undo journal.
+// Areas, which aren't complete slices at original position, may be over-written.
+// The journal is opened once, and records of each file are flushed at once.
+static int save_undo_journal(PAR3_CTX *par3_ctx)
+{
+	char journal_path[_MAX_PATH], file_path[_MAX_PATH], *file_name, *find_name;
+	uint8_t *buf, header[JOURNAL_RECORD_SIZE];
+	uint32_t file_count, file_index;
+	int64_t slice_index, slice_count;
+	size_t size, name_len;
+	uint64_t block_size, area_start, area_end, file_size, crc, value8;
+	PAR3_FILE_CTX *file_list;
+	PAR3_SLICE_CTX *slice_list;
+	FILE *fp, *fp_journal;
+
+	file_count = par3_ctx->input_file_count;
+	file_list = par3_ctx->input_file_list;
+	slice_count = par3_ctx->slice_count;
+	slice_list = par3_ctx->slice_list;
+	block_size = par3_ctx->block_size;
+
+	buf = malloc(block_size);
+	if (buf == NULL){
+		perror("Failed to allocate memory for undo journal");
+		return RET_MEMORY_ERROR;
+	}
+	get_journal_path(par3_ctx, journal_path);
+	fp_journal = fopen(journal_path, "wb");
+	if (fp_journal == NULL){
+		perror("Failed to open undo journal");
+		free(buf);
+		return RET_FILE_IO_ERROR;
+	}
+	if (fwrite("PAR3UND\0", 1, 8, fp_journal) != 8){
+		perror("Failed to write undo journal");
+		goto error_return;
+	}
+
+	fp = NULL;
+	for (file_index = 0; file_index < file_count; file_index++){
+		if ((file_list[file_index].state & 0x400) == 0)
+			continue;
+		file_name = file_list[file_index].name;
+		file_size = file_list[file_index].size;
+
+		// Absolute path is saved, so that another repair can restore it from anywhere.
+		if (get_absolute_path(file_path, file_name, _MAX_PATH) != 0){
+			printf("Failed to convert \"%s\" to absolute path\n", file_name);
+			goto error_return;
+		}
+		name_len = strlen(file_path) + 1;
+		fp = fopen(file_name, "rb");
+		if (fp == NULL){
+			perror("Failed to open damaged file");
+			goto error_return;
+		}
+
+		area_start = 0;
+		slice_index = file_list[file_index].slice;
+		while (area_start < file_size){
+			// Search the next complete slice, which won't be over-written.
+			area_end = file_size;
+			while ( (slice_index < slice_count) && (slice_list[slice_index].file == file_index) ){
+				find_name = slice_list[slice_index].find_name;
+				if ( (find_name != NULL) && (slice_list[slice_index].find_offset == slice_list[slice_index].offset)
+						&& (strcmp(find_name, file_name) == 0) ){
+					area_end = slice_list[slice_index].offset;
+					break;
+				}
+				slice_index++;
+			}
+
+			// Append records of the damaged area.
+			while (area_start < area_end){
+				size = (size_t)block_size;
+				if (size > area_end - area_start)
+					size = (size_t)(area_end - area_start);
+				if ( (_fseeki64(fp, area_start, SEEK_SET) != 0)
+						|| (fread(buf, 1, size, fp) != size) ){
+					perror("Failed to read damaged file");
+					goto error_return;
+				}
+				value8 = area_start;
+				memcpy(header, &value8, 8);
+				value8 = size;
+				memcpy(header + 8, &value8, 8);
+				value8 = name_len;
+				memcpy(header + 16, &value8, 8);
+				crc = crc64(header, JOURNAL_RECORD_SIZE, 0);
+				crc = crc64((uint8_t *)file_path, name_len, crc);
+				crc = crc64(buf, size, crc);
+				if ( (fwrite(header, 1, JOURNAL_RECORD_SIZE, fp_journal) != JOURNAL_RECORD_SIZE)
+						|| (fwrite(file_path, 1, name_len, fp_journal) != name_len)
+						|| (fwrite(buf, 1, size, fp_journal) != size)
+						|| (fwrite(&crc, 1, 8, fp_journal) != 8) ){
+					perror("Failed to write undo journal");
+					goto error_return;
+				}
+				area_start += size;
+			}
+
+			// Skip the complete slice.
+			if (area_end < file_size){
+				area_start = area_end + slice_list[slice_index].size;
+				slice_index++;
+			}
+		}
+		fclose(fp);
+		fp = NULL;
+
+		// Records of this file must be on disk, before over-writing the file.
+		if ( (fflush(fp_journal) != 0) || (_commit(_fileno(fp_journal)) != 0) ){
+			perror("Failed to flush undo journal");
+			goto error_return;
+		}
+	}
+
+	free(buf);
+	if (fclose(fp_journal) != 0){
+		perror("Failed to close undo journal");
+		remove(journal_path);
+		return RET_FILE_IO_ERROR;
+	}
+	return 0;
+
+error_return:
+	if (fp != NULL)
+		fclose(fp);
+	fclose(fp_journal);
+	remove(journal_path);
+	free(buf);
+	return RET_FILE_IO_ERROR;
+}
+
+// Select damaged files, which can be repaired in place.
+// Size of the file must be same, and its found slices must be at original position.
+// When data in the file is used at another position, it cannot be over-written.
+uint32_t set_inplace_file(PAR3_CTX *par3_ctx)
+{
+	char *find_name;
+	uint32_t file_count, file_index, inplace_count;
+	int64_t slice_index, slice_count;
+	struct _stat64 stat_buf;
+	PAR3_FILE_CTX *file_list;
+	PAR3_SLICE_CTX *slice_list;
+
+	file_count = par3_ctx->input_file_count;
+	file_list = par3_ctx->input_file_list;
+	slice_count = par3_ctx->slice_count;
+	slice_list = par3_ctx->slice_list;
+
+	inplace_count = 0;
+	for (file_index = 0; file_index < file_count; file_index++){
+		// Only damaged file of original name, without unprotected chunks.
+		if ((file_list[file_index].state & (1 | 2 | 4 | 0x800 | 0x8000 | 0x80000000)) != 2)
+			continue;
+		if ( (_stat64(file_list[file_index].name, &stat_buf) != 0) || ((uint64_t)(stat_buf.st_size) != file_list[file_index].size) )
+			continue;
+		file_list[file_index].state |= 0x400;
+		inplace_count++;
+	}
+	if (inplace_count == 0)
+		return 0;
+
+	for (slice_index = 0; slice_index < slice_count; slice_index++){
+		find_name = slice_list[slice_index].find_name;
+		if (find_name == NULL)
+			continue;
+		file_index = slice_list[slice_index].file;
+		if ( (slice_list[slice_index].find_offset == slice_list[slice_index].offset)
+				&& (strcmp(find_name, file_list[file_index].name) == 0) ){
+			continue;	// This slice is at original position.
+		}
+		for (file_index = 0; file_index < file_count; file_index++){
+			if ( (file_list[file_index].state & 0x400) && (strcmp(find_name, file_list[file_index].name) == 0) ){
+				file_list[file_index].state &= ~0x400;
+				inplace_count--;
+			}
+		}
+	}
+
+	if (par3_ctx->noise_level >= 2){
+		for (file_index = 0; file_index < file_count; file_index++){
+			if (file_list[file_index].state & 0x400)
+				printf("Target: \"%s\" - repair in place.\n", file_list[file_index].name);
+		}
+	}
+
+	// When original bytes cannot be saved, damaged files are repaired in temporary files.
+	if ( (inplace_count > 0) && (save_undo_journal(par3_ctx) != 0) ){
+		for (file_index = 0; file_index < file_count; file_index++)
+			file_list[file_index].state &= ~0x400;
+		inplace_count = 0;
+	}
+
+	return inplace_count;
+}
+
+// Open temporary file to write repaired data.
+// When the file is repaired in place, open the original file.
+FILE * open_repair_file(PAR3_CTX *par3_ctx, char *temp_path, uint32_t file_index)
+{
+	if (par3_ctx->input_file_list[file_index].state & 0x400)
+		return fopen(par3_ctx->input_file_list[file_index].name, "r+b");
+
+	sprintf(temp_path + 22, "%u.tmp", file_index);
+	return fopen(temp_path, "r+b");
+}
+
+// Set check flag of a slice on repaired file.
+// flag: 1 = written data is same as original, 0 = unknown
+static void set_slice_check(PAR3_CTX *par3_ctx, int64_t slice_index, uint8_t flag)
+{
+	if (par3_ctx->repair_reread)
+		return;	// Repaired files will be read again.
+
+	if (par3_ctx->slice_check == NULL){
+		par3_ctx->slice_check = calloc((size_t)(par3_ctx->slice_count), 1);
+		if (par3_ctx->slice_check == NULL)
+			return;	// Without the flags, repaired files will be read again.
+	}
+	par3_ctx->slice_check[slice_index] = flag;
+}
+
+// Compare checksums of slice data, which is written on repaired file.
+static void check_written_slice(PAR3_CTX *par3_ctx, int64_t slice_index,
+		int64_t file_offset, uint8_t *buf, size_t size)
+{
+	uint8_t hash[16], flag;
+	uint32_t chunk_index;
+	uint64_t block_index;
+	PAR3_SLICE_CTX *slice_p;
+
+	if ( (slice_index < 0) || (par3_ctx->repair_reread) )
+		return;	// Tiny chunk tail is copied from File Packet.
+	slice_p = par3_ctx->slice_list + slice_index;
+
+	flag = 0;
+	if ( (file_offset != slice_p->offset) || (size != slice_p->size) ){
+		// A part of slice cannot be checked by itself.
+
+	} else if (size == par3_ctx->block_size){	// full size slice
+		block_index = slice_p->block;
+		// Comparison is possible, only when checksum exists.
+		if ( (par3_ctx->block_list[block_index].state & 64)
+				&& (crc64(buf, size, 0) == par3_ctx->block_list[block_index].crc) ){
+			blake3(buf, size, hash);
+			if (memcmp(hash, par3_ctx->block_list[block_index].hash, 16) == 0)
+				flag = 1;
+		}
+
+	} else {	// chunk tail slice
+		chunk_index = slice_p->chunk;
+		if (crc64(buf, 40, 0) == par3_ctx->chunk_list[chunk_index].tail_crc){	// Check the first 40-bytes only.
+			blake3(buf, size, hash);
+			if (memcmp(hash, par3_ctx->chunk_list[chunk_index].tail_hash, 16) == 0)
+				flag = 1;
+		}
+	}
+
+	set_slice_check(par3_ctx, slice_index, flag);
+}
+
+// Write repaired data at the offset.
+// When the file is repaired in place, it skips slices at original position.
+// Original bytes of other areas were saved in undo journal already.
+// slice_index is -1 for tiny chunk tail.
+int write_repair_file(PAR3_CTX *par3_ctx, FILE *fp, uint32_t file_index, int64_t slice_index,
+		int64_t file_offset, uint8_t *buf, size_t size)
+{
+	char *file_name;
+
+	if (par3_ctx->input_file_list[file_index].state & 0x400){
+		file_name = par3_ctx->input_file_list[file_index].name;
+		if ( (slice_index >= 0) && (par3_ctx->slice_list[slice_index].find_name != NULL)
+				&& (par3_ctx->slice_list[slice_index].find_offset == par3_ctx->slice_list[slice_index].offset)
+				&& (strcmp(par3_ctx->slice_list[slice_index].find_name, file_name) == 0) ){
+			set_slice_check(par3_ctx, slice_index, 1);
+			return 0;	// This slice is complete already.
+		}
+	}
+
+	if (_fseeki64(fp, file_offset, SEEK_SET) != 0){
+		perror("Failed to seek temporary file");
+		return RET_FILE_IO_ERROR;
+	}
+	if (fwrite(buf, 1, size, fp) != size){
+		perror("Failed to write slice on temporary file");
+		return RET_FILE_IO_ERROR;
+	}
+
+	// Checksums are compared at writing, instead of reading repaired file again.
+	check_written_slice(par3_ctx, slice_index, file_offset, buf, size);
+
+	return 0;
+}
+
+// Restore original bytes from undo journal.
+// When file_name is NULL, it restores all files and deletes the journal.
+// return 0 = no journal or restored, others = error
+int undo_inplace_repair(PAR3_CTX *par3_ctx, char *file_name)
+{
+	char journal_path[_MAX_PATH], file_path[_MAX_PATH];
+	uint8_t *buf;
+	size_t buf_size, offset, record_size;
+	uint64_t crc, *record_list, record_count, data_size, name_len;
+	int64_t file_length, data_offset;
+	FILE *fp;
+
+	// Records have absolute path of files.
+	if ( (file_name != NULL) && (get_absolute_path(file_path, file_name, _MAX_PATH) != 0) ){
+		printf("Failed to convert \"%s\" to absolute path\n", file_name);
+		return RET_FILE_IO_ERROR;
+	}
+
+	get_journal_path(par3_ctx, journal_path);
+	fp = fopen(journal_path, "rb");
+	if (fp == NULL)
+		return 0;
+	file_length = _filelengthi64(_fileno(fp));
+	if (file_length <= 8){
+		fclose(fp);
+		if (file_name == NULL)
+			remove(journal_path);
+		return 0;
+	}
+	buf_size = (size_t)file_length;
+	buf = malloc(buf_size);
+	if (buf == NULL){
+		perror("Failed to allocate memory for undo journal");
+		fclose(fp);
+		return RET_MEMORY_ERROR;
+	}
+	if (fread(buf, 1, buf_size, fp) != buf_size){
+		perror("Failed to read undo journal");
+		free(buf);
+		fclose(fp);
+		return RET_FILE_IO_ERROR;
+	}
+	fclose(fp);
+	if (memcmp(buf, "PAR3UND\0", 8) != 0){
+		printf("Undo journal is broken. \"%s\"\n", journal_path);
+		free(buf);
+		return RET_FILE_IO_ERROR;
+	}
+
+	// Make list of valid records. An incomplete record at the end is ignored.
+	record_list = malloc(sizeof(uint64_t) * (buf_size / (JOURNAL_RECORD_SIZE + 8) + 1));
+	if (record_list == NULL){
+		perror("Failed to allocate memory for undo journal");
+		free(buf);
+		return RET_MEMORY_ERROR;
+	}
+	record_count = 0;
+	offset = 8;
+	while (offset + JOURNAL_RECORD_SIZE + 8 <= buf_size){
+		memcpy(&data_size, buf + offset + 8, 8);
+		memcpy(&name_len, buf + offset + 16, 8);
+		if ( (name_len > buf_size) || (data_size > buf_size) )
+			break;
+		record_size = JOURNAL_RECORD_SIZE + (size_t)name_len + (size_t)data_size;
+		if (offset + record_size + 8 > buf_size)
+			break;
+		memcpy(&crc, buf + offset + record_size, 8);
+		if (crc != crc64(buf + offset, record_size, 0))
+			break;
+		record_list[record_count++] = offset;
+		offset += record_size + 8;
+	}
+
+	if ( (par3_ctx->noise_level >= 0) && (record_count > 0) ){
+		printf("\nRestoring original data from undo journal:\n\n");
+	}
+
+	// Apply records in reverse order, because a range may be over-written twice.
+	while (record_count > 0){
+		record_count--;
+		offset = record_list[record_count];
+		memcpy(&data_offset, buf + offset, 8);
+		memcpy(&data_size, buf + offset + 8, 8);
+		memcpy(&name_len, buf + offset + 16, 8);
+		if ( (file_name != NULL) && (strcmp(file_path, (char *)buf + offset + JOURNAL_RECORD_SIZE) != 0) )
+			continue;
+		if (par3_ctx->noise_level >= 1){
+			printf("Target: \"%s\" - restored %"PRIu64" bytes at %"PRId64".\n", (char *)buf + offset + JOURNAL_RECORD_SIZE, data_size, data_offset);
+		}
+		fp = fopen((char *)buf + offset + JOURNAL_RECORD_SIZE, "r+b");
+		if (fp == NULL){
+			perror("Failed to open file in undo journal");
+			free(record_list);
+			free(buf);
+			return RET_FILE_IO_ERROR;
+		}
+		if ( (_fseeki64(fp, data_offset, SEEK_SET) != 0)
+				|| (fwrite(buf + offset + JOURNAL_RECORD_SIZE + name_len, 1, (size_t)data_size, fp) != data_size) ){
+			perror("Failed to restore file in undo journal");
+			fclose(fp);
+			free(record_list);
+			free(buf);
+			return RET_FILE_IO_ERROR;
+		}
+		if (fclose(fp) != 0){
+			perror("Failed to close file in undo journal");
+			free(record_list);
+			free(buf);
+			return RET_FILE_IO_ERROR;
+		}
+	}
+	free(record_list);
+	free(buf);
+
+	if (file_name == NULL){
+		if (remove(journal_path) != 0){
+			perror("Failed to delete undo journal");
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	return 0;
+}
+
+// Delete undo journal after repair.
+void delete_undo_journal(PAR3_CTX *par3_ctx)
+{
+	char journal_path[_MAX_PATH];
+
+	get_journal_path(par3_ctx, journal_path);
+	remove(journal_path);
+}
+
 // Create temporary files for lost input files
 int create_temp_file(PAR3_CTX *par3_ctx, char *temp_path)
 {
@@ -97,7 +617,9 @@ int create_temp_file(PAR3_CTX *par3_ctx, char *temp_path)
 
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
+			if (file_list[file_index].state & 0x400)
+				continue;	// The original file will be repaired in place.
 			sprintf(temp_path + 22, "%u.tmp", file_index);
 			//fp = fopen(temp_path, "wbx");	// Error at over writing temporary file
 			fp = fopen(temp_path, "wb");	// There is a risk of over writing existing file of same name.
@@ -124,16 +646,65 @@ int create_temp_file(PAR3_CTX *par3_ctx, char *temp_path)
 	return 0;
 }
 
+// Copy a run of slices, which are stored contiguously in another file, without reading them.
+// When it succeeded, return number of copied slices and set total size of them.
+// When it cannot copy so, return 0. Then, caller should copy each slice by buffer.
+static int64_t copy_slice_run(PAR3_CTX *par3_ctx, FILE *fp_read, FILE *fp_write,
+		int64_t slice_index, uint64_t chunk_size, uint64_t *run_size)
+{
+	char *find_name;
+	int64_t i, run_count, find_offset, write_offset;
+	uint64_t block_size, size;
+	PAR3_SLICE_CTX *slice_list;
+
+	block_size = par3_ctx->block_size;
+	slice_list = par3_ctx->slice_list;
+	find_name = slice_list[slice_index].find_name;
+	find_offset = slice_list[slice_index].find_offset;
+	write_offset = slice_list[slice_index].offset;
+
+	// Following slices in the chunk are joined, while they are found at next position in the same file.
+	size = 0;
+	run_count = 0;
+	while ( (chunk_size - size >= block_size) || (chunk_size - size >= 40) ){
+		if ( (slice_list[slice_index + run_count].find_name != find_name)
+				|| (slice_list[slice_index + run_count].find_offset != find_offset + (int64_t)size)
+				|| (slice_list[slice_index + run_count].offset != write_offset + (int64_t)size) )
+			break;
+		size += slice_list[slice_index + run_count].size;
+		run_count++;
+	}
+
+	// Because file system copies data by file descriptor, stdio buffer must be written at first.
+	if (fflush(fp_write) != 0)
+		return 0;
+	if (file_copy_range(_fileno(fp_read), find_offset, _fileno(fp_write), write_offset, size) != 0)
+		return 0;
+
+	// File position isn't moved by the copy, so set it after the copied data.
+	if (_fseeki64(fp_write, write_offset + size, SEEK_SET) != 0)
+		return 0;
+
+	// Source slices were checked at verification already.
+	for (i = 0; i < run_count; i++)
+		set_slice_check(par3_ctx, slice_index + i, 1);
+
+	*run_size = size;
+	return run_count;
+}
+
 // Restore content of input files
 int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 {
 	char *name_prev, *find_name;
 	uint8_t *work_buf, buf_tail[40];
+	int ret;
 	uint32_t file_count, file_index;
 	uint32_t chunk_index, chunk_num;
 	size_t slice_size;
-	int64_t slice_index, file_offset;
-	uint64_t block_size, chunk_size, file_size;
+	int flag_copy;
+	int64_t slice_index, file_offset, run_count;
+	uint64_t block_size, chunk_size, file_size, run_size;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_FILE_CTX *file_list;
@@ -169,13 +740,14 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 	fp_read = NULL;
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0) ){
-			sprintf(temp_path + 22, "%u.tmp", file_index);
-			fp_write = fopen(temp_path, "r+b");
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0) ){
+			fp_write = open_repair_file(par3_ctx, temp_path, file_index);
 			if (fp_write == NULL){
 				perror("Failed to open temporary file");
 				return RET_FILE_IO_ERROR;
 			}
+			// In-place repair must save original data in undo journal, before over-writing.
+			flag_copy = ((file_list[file_index].state & 0x400) == 0);
 
 			file_size = 0;
 			chunk_index = file_list[file_index].chunk;		// index of the first chunk
@@ -208,6 +780,15 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 							return RET_LOGIC_ERROR;
 						}
 
+						// When this slice is complete in the original file, no need to copy.
+						if ( (file_list[file_index].state & 0x400) && (file_offset == slice_list[slice_index].offset)
+								&& (strcmp(find_name, file_list[file_index].name) == 0) ){
+							set_slice_check(par3_ctx, slice_index, 1);
+							slice_index++;
+							chunk_size -= slice_size;
+							continue;
+						}
+
 						// Read input file slice from another file.
 						if ( (fp_read == NULL) || (find_name != name_prev) ){
 							if (fp_read != NULL){	// Close previous another file.
@@ -222,6 +803,18 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 							}
 							name_prev = find_name;
 						}
+
+						// Copy contiguous slices at once by file system, when it's possible.
+						if (flag_copy){
+							run_count = copy_slice_run(par3_ctx, fp_read, fp_write, slice_index, chunk_size, &run_size);
+							if (run_count > 0){
+								slice_index += run_count;
+								chunk_size -= run_size;
+								continue;
+							}
+							flag_copy = 0;	// Don't try again for this file.
+						}
+
 						if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
 							perror("Failed to seek another file");
 							fclose(fp_read);
@@ -236,11 +829,11 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 						}
 
 						// Write input file slice on temporary file.
-						if (fwrite(work_buf, 1, slice_size, fp_write) != slice_size){
-							perror("Failed to write slice on temporary file");
+						ret = write_repair_file(par3_ctx, fp_write, file_index, slice_index, slice_list[slice_index].offset, work_buf, slice_size);
+						if (ret != 0){
 							fclose(fp_read);
 							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
+							return ret;
 						}
 
 						slice_index++;
@@ -257,11 +850,12 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 						memcpy(buf_tail + 32, &(chunk_list[chunk_index].tail_offset), 8);
 
 						// Write input file slice on temporary file.
-						if (fwrite(buf_tail, 1, slice_size, fp_write) != slice_size){
-							perror("Failed to write tiny slice on temporary file");
-							fclose(fp_read);
+						ret = write_repair_file(par3_ctx, fp_write, file_index, -1, file_size - chunk_size, buf_tail, slice_size);
+						if (ret != 0){
+							if (fp_read != NULL)
+								fclose(fp_read);
 							fclose(fp_write);
-							return RET_FILE_IO_ERROR;
+							return ret;
 						}
 					}
 
@@ -286,7 +880,11 @@ int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 			} else {
 				file_list[file_index].state |= 0x100;
 				if (par3_ctx->noise_level >= 1){
-					printf("Target: \"%s\" - restored temporary.\n", temp_path);
+					if (file_list[file_index].state & 0x400){
+						printf("Target: \"%s\" - restored in place.\n", file_list[file_index].name);
+					} else {
+						printf("Target: \"%s\" - restored temporary.\n", temp_path);
+					}
 				}
 			}
 		}
@@ -309,8 +907,9 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 	uint32_t file_count, file_index;
 	uint32_t chunk_index, chunk_num;
 	size_t slice_size;
-	int64_t slice_index, file_offset;
-	uint64_t block_size, chunk_size, file_size;
+	int flag_copy;
+	int64_t slice_index, file_offset, run_count;
+	uint64_t block_size, chunk_size, file_size, run_size;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_FILE_CTX *file_list;
@@ -346,7 +945,7 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 	fp_read = NULL;
 	for (file_index = 0; file_index < file_count; file_index++){
 		// The input file is missing or damaged.
-		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & 4) == 0)
+		if ( ((file_list[file_index].state & 3) != 0) && ((file_list[file_index].state & (4 | 0x800)) == 0)
 				&& ((file_list[file_index].state & 0x200) != 0) ){	// Checked repairable already
 			sprintf(temp_path + 22, "%u.tmp", file_index);
 			fp_write = fopen(temp_path, "wb");	// There is a risk of over writing existing file of same name.
@@ -354,6 +953,7 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 				perror("Failed to open temporary file");
 				return RET_FILE_IO_ERROR;
 			}
+			flag_copy = 1;
 
 			file_size = 0;
 			chunk_index = file_list[file_index].chunk;		// index of the first chunk
@@ -401,6 +1001,18 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 							}
 							name_prev = find_name;
 						}
+
+						// Copy contiguous slices at once by file system, when it's possible.
+						if (flag_copy){
+							run_count = copy_slice_run(par3_ctx, fp_read, fp_write, slice_index, chunk_size, &run_size);
+							if (run_count > 0){
+								slice_index += run_count;
+								chunk_size -= run_size;
+								continue;
+							}
+							flag_copy = 0;	// Don't try again for this file.
+						}
+
 						if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
 							perror("Failed to seek another file");
 							fclose(fp_read);
@@ -421,6 +1033,7 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 							fclose(fp_write);
 							return RET_FILE_IO_ERROR;
 						}
+						check_written_slice(par3_ctx, slice_index, slice_list[slice_index].offset, work_buf, slice_size);
 
 						slice_index++;
 						chunk_size -= slice_size;
@@ -479,6 +1092,57 @@ int try_restore_input_file(PAR3_CTX *par3_ctx, char *temp_path)
 	return 0;
 }
 
+// Check repaired file by flags of written slices, without reading file data.
+// return 0 = complete, 1 = need to read the file
+static int check_written_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_index)
+{
+	int file_no;
+	uint32_t chunk_index, chunk_num;
+	int64_t slice_index;
+	uint64_t block_size, chunk_size, current_size;
+	PAR3_SLICE_CTX *slice_list;
+	PAR3_CHUNK_CTX *chunk_list;
+	PAR3_FILE_CTX *file_p;
+	FILE *fp;
+
+	if ( (par3_ctx->repair_reread) || (par3_ctx->slice_check == NULL) )
+		return 1;
+
+	block_size = par3_ctx->block_size;
+	slice_list = par3_ctx->slice_list;
+	chunk_list = par3_ctx->chunk_list;
+	file_p = par3_ctx->input_file_list + file_index;
+
+	// Every slice must have been checked at writing.
+	// Tiny chunk tails are copied from File Packet, and unprotected chunks aren't checked.
+	chunk_index = file_p->chunk;
+	chunk_num = file_p->chunk_num;
+	slice_index = file_p->slice;
+	while (chunk_num > 0){
+		chunk_size = chunk_list[chunk_index].size;
+		while ( (chunk_size >= block_size) || (chunk_size >= 40) ){
+			if (par3_ctx->slice_check[slice_index] == 0)
+				return 1;
+			chunk_size -= slice_list[slice_index].size;
+			slice_index++;
+		}
+		chunk_index++;
+		chunk_num--;
+	}
+
+	// File size must be same as original.
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return 1;
+	file_no = _fileno(fp);
+	current_size = (file_no >= 0) ? _filelengthi64(file_no) : 0;
+	fclose(fp);
+	if (current_size != file_p->size)
+		return 1;
+
+	return 0;
+}
+
 // Backup damaged file by adding number at the last
 static int backup_file(char *filename)
 {
@@ -538,7 +1202,7 @@ int verify_repaired_file(PAR3_CTX *par3_ctx, char *temp_path,
 	*bad_file_count = 0;
 	for (file_index = 0; file_index < file_count; file_index++){
 		// This input file is misnamed.
-		if (file_list[file_index].state & 4){
+		if ((file_list[file_index].state & (4 | 0x800)) == 4){
 			if (par3_ctx->noise_level >= 0){
 				if (flag_show == 0){
 					flag_show++;
@@ -597,8 +1261,46 @@ int verify_repaired_file(PAR3_CTX *par3_ctx, char *temp_path,
 				}
 			}
 
+			if (file_list[file_index].state & 0x400){	// This damaged file was repaired in place.
+				ret = check_written_file(par3_ctx, file_list[file_index].name, file_index);
+				if (ret != 0)	// Read file data to check.
+					ret = check_complete_file(par3_ctx, file_list[file_index].name, file_index, file_list[file_index].size, NULL);
+				if (ret > 0)
+					return ret;	// error
+				if (ret != 0){	// Repaired file is bad.
+					// Return to the damaged state
+					if (undo_inplace_repair(par3_ctx, file_list[file_index].name) != 0)
+						printf("Failed to restore original data of \"%s\"\n", file_list[file_index].name);
+					*damaged_file_count += 1;
+					if (par3_ctx->noise_level >= 0){
+						printf("Target: \"%s\" - failed.\n", file_list[file_index].name);
+					}
+
+				} else if (par3_ctx->file_system & 0x10003){	// test property
+					ret = test_file_system_option(par3_ctx, 1, file_list[file_index].offset, file_list[file_index].name);
+					if (ret == 0){
+						if (par3_ctx->noise_level >= 0){
+							printf("Target: \"%s\" - repaired in place.\n", file_list[file_index].name);
+						}
+					} else {
+						*bad_file_count += 1;	// Though file data was repaired, property is different.
+						if (par3_ctx->noise_level >= 0){
+							printf("Target: \"%s\" - failed.\n", file_list[file_index].name);
+						}
+					}
+
+				} else {
+					if (par3_ctx->noise_level >= 0){
+						printf("Target: \"%s\" - repaired in place.\n", file_list[file_index].name);
+					}
+				}
+				continue;
+			}
+
 			sprintf(temp_path + 22, "%u.tmp", file_index);
-			ret = check_complete_file(par3_ctx, temp_path, file_index, file_list[file_index].size, NULL);
+			ret = check_written_file(par3_ctx, temp_path, file_index);
+			if (ret != 0)	// Read file data to check.
+				ret = check_complete_file(par3_ctx, temp_path, file_index, file_list[file_index].size, NULL);
 			if (ret > 0)
 				return ret;	// error
 			if (ret == 0){
@@ -666,6 +1368,8 @@ int verify_repaired_file(PAR3_CTX *par3_ctx, char *temp_path,
 			}
 
 		// Not repaired files.
+		} else if (file_list[file_index].state & 0x800){
+			// This file wasn't selected to repair.
 		} else if (file_list[file_index].state & 4){
 			*misnamed_file_count += 1;
 		} else if (file_list[file_index].state & 2){
@@ -699,6 +1403,14 @@ int verify_repaired_file(PAR3_CTX *par3_ctx, char *temp_path,
 	free(par3_ctx->work_buf);
 	par3_ctx->work_buf = NULL;
 
+	// Original data of files repaired in place isn't required anymore.
+	delete_undo_journal(par3_ctx);
+
+	if (par3_ctx->slice_check != NULL){
+		free(par3_ctx->slice_check);
+		par3_ctx->slice_check = NULL;
+	}
+
 	return 0;
 }
 
@@ -1,6 +1,17 @@
 
 uint32_t reconstruct_directory_tree(PAR3_CTX *par3_ctx);
 
+// Partial repair of selected files
+uint32_t set_only_file(PAR3_CTX *par3_ctx);
+
+// In-place repair of damaged files with undo journal
+uint32_t set_inplace_file(PAR3_CTX *par3_ctx);
+FILE * open_repair_file(PAR3_CTX *par3_ctx, char *temp_path, uint32_t file_index);
+int write_repair_file(PAR3_CTX *par3_ctx, FILE *fp, uint32_t file_index, int64_t slice_index,
+		int64_t file_offset, uint8_t *buf, size_t size);
+int undo_inplace_repair(PAR3_CTX *par3_ctx, char *file_name);
+void delete_undo_journal(PAR3_CTX *par3_ctx);
+
 // When there are enough input blocks after verification, no need Recovery Codes.
 int create_temp_file(PAR3_CTX *par3_ctx, char *temp_path);
 int restore_input_file(PAR3_CTX *par3_ctx, char *temp_path);
@@ -7,6 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "hash.h"
 #include "file.h"
 #include "verify.h"
@@ -124,13 +128,165 @@ static int check_file(PAR3_CTX *par3_ctx, char *path, uint64_t *current_size, in
 }
 
 
+// Return number of worker threads to check files.
+static int get_worker_count(PAR3_CTX *par3_ctx, uint32_t file_count)
+{
+	int worker_count;
+	uint64_t index, mem_size;
+
+	// Because worker thread cannot show detail of each file, use single thread when verbose.
+	if (par3_ctx->noise_level >= 1)
+		return 1;
+
+	if (par3_ctx->thread_count > 0){
+		worker_count = par3_ctx->thread_count;
+	} else {
+#ifdef _OPENMP
+		worker_count = omp_get_max_threads();
+#else
+		worker_count = 1;
+#endif
+	}
+#ifndef _OPENMP
+	worker_count = 1;	// Without OpenMP, files are checked one by one.
+#endif
+	if ((uint32_t)worker_count > file_count)
+		worker_count = file_count;
+	if (worker_count <= 1)
+		return 1;
+
+	// Checksum of block may be set while checking complete file.
+	for (index = 0; index < par3_ctx->block_count; index++){
+		if ( (par3_ctx->block_list[index].state & 1) && ((par3_ctx->block_list[index].state & 64) == 0) )
+			return 1;
+	}
+
+	// Each worker requires buffer and local copy of CRC-list.
+	if (par3_ctx->memory_limit > 0){
+		mem_size = par3_ctx->block_size * 2 + sizeof(PAR3_CMP_CTX) * (par3_ctx->crc_count + par3_ctx->tail_count) * 2;
+		while ( (worker_count > 1) && (mem_size * worker_count > par3_ctx->memory_limit) )
+			worker_count--;
+	}
+
+	return worker_count;
+}
+
+static void release_worker_context(PAR3_CTX *ctx_list, int worker_count)
+{
+	int i;
+
+	for (i = 0; i < worker_count; i++){
+		if (ctx_list[i].work_buf != NULL)
+			free(ctx_list[i].work_buf);
+		if (ctx_list[i].crc_list != NULL)
+			free(ctx_list[i].crc_list);
+		if (ctx_list[i].tail_list != NULL)
+			free(ctx_list[i].tail_list);
+		if (ctx_list[i].find_list != NULL)
+			free(ctx_list[i].find_list);
+	}
+	free(ctx_list);
+}
+
+// Copy context for each worker thread.
+// Each worker has own buffer, local copy of CRC-list, and list of found slices.
+// Found slices are merged into PAR3_SLICE_CTX and PAR3_BLOCK_CTX later.
+static PAR3_CTX * create_worker_context(PAR3_CTX *par3_ctx, int worker_count)
+{
+	int i;
+	PAR3_CTX *ctx_list, *ctx_p;
+
+	ctx_list = malloc(sizeof(PAR3_CTX) * worker_count);
+	if (ctx_list == NULL){
+		perror("Failed to allocate memory for worker thread");
+		return NULL;
+	}
+	for (i = 0; i < worker_count; i++){
+		ctx_p = ctx_list + i;
+		memcpy(ctx_p, par3_ctx, sizeof(PAR3_CTX));
+		ctx_p->work_buf = NULL;
+		ctx_p->crc_list = NULL;
+		ctx_p->tail_list = NULL;
+		ctx_p->find_list = NULL;
+	}
+
+	for (i = 0; i < worker_count; i++){
+		ctx_p = ctx_list + i;
+		ctx_p->work_buf = malloc(par3_ctx->block_size * 2);
+		if (ctx_p->work_buf == NULL)
+			break;
+		if (par3_ctx->crc_count > 0){
+			ctx_p->crc_list = malloc(sizeof(PAR3_CMP_CTX) * par3_ctx->crc_count * 2);
+			if (ctx_p->crc_list == NULL)
+				break;
+			memcpy(ctx_p->crc_list, par3_ctx->crc_list, sizeof(PAR3_CMP_CTX) * par3_ctx->crc_count);
+		}
+		if (par3_ctx->tail_count > 0){
+			ctx_p->tail_list = malloc(sizeof(PAR3_CMP_CTX) * par3_ctx->tail_count * 2);
+			if (ctx_p->tail_list == NULL)
+				break;
+			memcpy(ctx_p->tail_list, par3_ctx->tail_list, sizeof(PAR3_CMP_CTX) * par3_ctx->tail_count);
+		}
+		ctx_p->find_max = 256;
+		ctx_p->find_count = 0;
+		ctx_p->find_list = malloc(sizeof(PAR3_FIND_CTX) * ctx_p->find_max);
+		if (ctx_p->find_list == NULL)
+			break;
+	}
+	if (i < worker_count){
+		perror("Failed to allocate memory for worker thread");
+		release_worker_context(ctx_list, worker_count);
+		return NULL;
+	}
+
+	return ctx_list;
+}
+
+// Set found slices in a file, which were checked by worker thread.
+static void merge_found_slice(PAR3_CTX *par3_ctx, PAR3_CTX *ctx_list, PAR3_CHECK_CTX *check_p, char *filename)
+{
+	uint64_t index;
+	PAR3_FIND_CTX *find_list;
+
+	find_list = ctx_list[check_p->thread].find_list;
+	for (index = check_p->find_start; index < check_p->find_end; index++){
+		apply_found_slice(par3_ctx, find_list[index].slice, find_list[index].flag, filename, find_list[index].offset);
+	}
+}
+
+// Check content of an input file.
+// Return 0 = complete, negative value = damaged, or error code.
+static int check_input_content(PAR3_CTX *par3_ctx, uint32_t file_id, PAR3_CHECK_CTX *check_p)
+{
+	int ret, ret2;
+	char *filename;
+
+	filename = par3_ctx->input_file_list[file_id].name;
+	check_p->file_offset = 0;
+	check_p->file_damage = 0;
+	ret = check_complete_file(par3_ctx, filename, file_id, check_p->current_size, &(check_p->file_offset));
+	//printf("ret = %d, size = %"PRIu64", offset = %"PRIu64"\n", ret, check_p->current_size, check_p->file_offset);
+	if (ret >= 0)
+		return ret;	// complete or error
+
+	// Start slide search after the last found block position.
+	ret2 = check_damaged_file(par3_ctx, filename, check_p->current_size, check_p->file_offset, &(check_p->file_damage), NULL);
+	//printf("ret = %d, size = %"PRIu64", offset = %"PRIu64", damage = %"PRIu64"\n",
+	//		ret2, check_p->current_size, check_p->file_offset, check_p->file_damage);
+	if (ret2 != 0)
+		return ret2;
+
+	return ret;
+}
+
 // Check existense and content of each input file.
 int verify_input_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t *damaged_file_count, uint32_t *bad_file_count)
 {
-	int ret;
+	int ret, worker_count;
 	uint32_t num;
-	uint64_t current_size, file_offset, file_damage;
 	PAR3_FILE_CTX *file_p;
+	PAR3_CHECK_CTX *check_list, *check_p;
+	PAR3_CTX *ctx_list;
 
 	if (par3_ctx->input_file_count == 0)
 		return 0;
@@ -210,20 +366,74 @@ int verify_input_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 		return RET_MEMORY_ERROR;
 	}
 
+	check_list = malloc(sizeof(PAR3_CHECK_CTX) * par3_ctx->input_file_count);
+	if (check_list == NULL){
+		perror("Failed to allocate memory for verification");
+		return RET_MEMORY_ERROR;
+	}
+
+	// Check existence and property of each input file at first.
 	file_p = par3_ctx->input_file_list;
+	check_p = check_list;
 	for (num = 0; num < par3_ctx->input_file_count; num++){
-		ret = check_file(par3_ctx, file_p->name, &current_size, file_p->offset);
-		//printf("check_file = 0x%x, size = %"PRIu64"\n", ret, current_size);
+		check_p->current_size = 0;
+		ret = check_file(par3_ctx, file_p->name, &(check_p->current_size), file_p->offset);
+		//printf("check_file = 0x%x, size = %"PRIu64"\n", ret, check_p->current_size);
 		file_p->state |= ret;
-		if ( ((ret & 0xFFFF) == 0) && ( (file_p->size > 0) || (current_size > 0) ) ){
+		check_p->ret = ret;
+		check_p->thread = -1;
+		if ( ((ret & 0xFFFF) == 0) && ( (file_p->size > 0) || (check_p->current_size > 0) ) )
+			check_p->thread = 0;	// Need to check content
+
+		file_p++;
+		check_p++;
+	}
+
+	// Check content of files on worker threads.
+	ctx_list = NULL;
+	worker_count = get_worker_count(par3_ctx, par3_ctx->input_file_count);
+	if (worker_count > 1){
+		ctx_list = create_worker_context(par3_ctx, worker_count);
+		if (ctx_list == NULL){
+			free(check_list);
+			return RET_MEMORY_ERROR;
+		}
+
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+		for (int i = 0; i < (int)(par3_ctx->input_file_count); i++){
+			PAR3_CTX *ctx_p = ctx_list + omp_get_thread_num();
+			PAR3_CHECK_CTX *check_i = check_list + i;
+
+			if (check_i->thread < 0)
+				continue;
+			check_i->thread = omp_get_thread_num();
+			check_i->find_start = ctx_p->find_count;
+			check_i->ret = check_input_content(ctx_p, i, check_i);
+			check_i->find_end = ctx_p->find_count;
+		}
+#endif
+	}
+
+	// Merge results in order of input files.
+	ret = 0;
+	file_p = par3_ctx->input_file_list;
+	check_p = check_list;
+	for (num = 0; num < par3_ctx->input_file_count; num++){
+		if (check_p->thread >= 0){
 			if (par3_ctx->noise_level >= 0){
 				printf("Opening: \"%s\"\n", file_p->name);
 			}
-			file_offset = 0;
-			ret = check_complete_file(par3_ctx, file_p->name, num, current_size, &file_offset);
-			//printf("ret = %d, size = %"PRIu64", offset = %"PRIu64"\n", ret, current_size, file_offset);
+			if (ctx_list != NULL){
+				ret = check_p->ret;
+				if (ret <= 0)
+					merge_found_slice(par3_ctx, ctx_list, check_p, file_p->name);
+			} else {
+				ret = check_input_content(par3_ctx, num, check_p);
+			}
 			if (ret > 0)
-				return ret;	// error
+				break;	// error
+
 			if (ret == 0){
 				if (file_p->state & 0x7FFF0000){
 					*bad_file_count += 1;
@@ -248,18 +458,12 @@ int verify_input_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 					}
 				}
 			} else {
+				ret = 0;
 				file_p->state |= 2;
 				*damaged_file_count += 1;
-
-				// Start slide search after the last found block position.
-				ret = check_damaged_file(par3_ctx, file_p->name, current_size, file_offset, &file_damage, NULL);
-				//printf("ret = %d, size = %"PRIu64", offset = %"PRIu64", damage = %"PRIu64"\n",
-				//		ret, current_size, file_offset, file_damage);
-				if (ret != 0)
-					return ret;
 				if (par3_ctx->noise_level >= -1){
 					printf("Target: \"%s\" - damaged. %"PRIu64" of %"PRIu64" bytes available.\n",
-							file_p->name, current_size - file_damage, current_size);
+							file_p->name, check_p->current_size - check_p->file_damage, check_p->current_size);
 				}
 			}
 
@@ -267,16 +471,16 @@ int verify_input_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 			if (par3_ctx->noise_level >= -1){
 				printf("Target: \"%s\"", file_p->name);
 			}
-			if (ret == 0){
+			if (check_p->ret == 0){
 				if (par3_ctx->noise_level >= -1){
 					printf(" - found.\n");
 				}
-			} else if (ret == 1){
+			} else if (check_p->ret == 1){
 				*missing_file_count += 1;
 				if (par3_ctx->noise_level >= -1){
 					printf(" - missing.\n");
 				}
-			} else if (ret == 0x8000){
+			} else if (check_p->ret == 0x8000){
 				*missing_file_count += 1;
 				if (par3_ctx->noise_level >= -1){
 					printf(" - not file.\n");
@@ -289,31 +493,324 @@ int verify_input_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 		}
 
 		file_p++;
+		check_p++;
+	}
+
+	if (ctx_list != NULL)
+		release_worker_context(ctx_list, worker_count);
+	free(check_list);
+
+	return ret;
+}
+
+// Compare file size
+static int compare_size( const void *arg1, const void *arg2 )
+{
+	PAR3_MISNAME_CTX *cmp1_p, *cmp2_p;
+
+	cmp1_p = ( PAR3_MISNAME_CTX * ) arg1;
+	cmp2_p = ( PAR3_MISNAME_CTX * ) arg2;
+
+	if (cmp1_p->size < cmp2_p->size)
+		return -1;
+	if (cmp1_p->size > cmp2_p->size)
+		return 1;
+
+	return 0;
+}
+
+// Compare file size and CRC-64 of the first 16 KB
+static int compare_misname( const void *arg1, const void *arg2 )
+{
+	PAR3_MISNAME_CTX *cmp1_p, *cmp2_p;
+
+	cmp1_p = ( PAR3_MISNAME_CTX * ) arg1;
+	cmp2_p = ( PAR3_MISNAME_CTX * ) arg2;
+
+	if (cmp1_p->size < cmp2_p->size)
+		return -1;
+	if (cmp1_p->size > cmp2_p->size)
+		return 1;
+	if (cmp1_p->flag < cmp2_p->flag)
+		return -1;
+	if (cmp1_p->flag > cmp2_p->flag)
+		return 1;
+	if (cmp1_p->crc < cmp2_p->crc)
+		return -1;
+	if (cmp1_p->crc > cmp2_p->crc)
+		return 1;
+
+	return 0;
+}
+
+// Make index of missing or damaged input files, which may be found as misnamed file.
+// Items are sorted by file size and CRC-64 of the first 16 KB.
+static PAR3_MISNAME_CTX * make_misname_list(PAR3_CTX *par3_ctx, uint32_t *misname_count)
+{
+	uint32_t num, count;
+	PAR3_FILE_CTX *file_p;
+	PAR3_MISNAME_CTX *misname_list;
+
+	*misname_count = 0;
+	misname_list = malloc(sizeof(PAR3_MISNAME_CTX) * (par3_ctx->input_file_count + 1));
+	if (misname_list == NULL){
+		perror("Failed to allocate memory for verification");
+		return NULL;
+	}
+
+	count = 0;
+	file_p = par3_ctx->input_file_list;
+	for (num = 0; num < par3_ctx->input_file_count; num++){
+		// No need to compare to compelete input files.
+		if ( (file_p->state & (1 | 2)) && (file_p->size > 0) ){	// missing or damaged
+			misname_list[count].size = file_p->size;
+			misname_list[count].index = num;
+			if (file_p->state & 0x80000000){	// CRC-64 isn't stored for Unprotected Chunk.
+				misname_list[count].crc = 0;
+				misname_list[count].flag = 1;
+			} else {
+				misname_list[count].crc = file_p->crc;
+				misname_list[count].flag = 0;
+			}
+			count++;
+		}
+
+		file_p++;
+	}
+
+	if (count > 1)
+		qsort( (void *)misname_list, (size_t)count, sizeof(PAR3_MISNAME_CTX), compare_misname );
+
+	*misname_count = count;
+	return misname_list;
+}
+
+// Return index of the first item, which has the same size and CRC-64.
+static int64_t misname_list_search(PAR3_MISNAME_CTX *key_p, PAR3_MISNAME_CTX *misname_list, uint32_t count)
+{
+	int64_t index;
+	PAR3_MISNAME_CTX *cmp_p;
+
+	if (count == 0)
+		return -1;
+
+	// Binary search
+	cmp_p = (PAR3_MISNAME_CTX *)bsearch( key_p, misname_list, (size_t)count, sizeof(PAR3_MISNAME_CTX), compare_misname );
+	if (cmp_p == NULL)
+		return -2;
+
+	// Search lower items of same size and CRC-64
+	index = cmp_p - misname_list;
+	while (index > 0){
+		cmp_p--;
+		if (compare_misname(key_p, cmp_p) != 0)
+			break;
+		index--;
+	}
+
+	return index;
+}
+
+// Calculate CRC-64 of the first 16 KB in a file.
+static int calculate_crc16k(char *filename, uint64_t file_size, uint64_t *crc)
+{
+	uint8_t buf[4096];
+	size_t read_size;
+	uint64_t size16k;
+	FILE *fp;
+
+	size16k = 16384;
+	if (size16k > file_size)
+		size16k = file_size;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL){
+		perror("Failed to open extra file");
+		return RET_FILE_IO_ERROR;
+	}
+
+	*crc = 0;
+	while (size16k > 0){
+		read_size = sizeof(buf);
+		if (read_size > size16k)
+			read_size = (size_t)size16k;
+		if (fread(buf, 1, read_size, fp) != read_size){
+			perror("Failed to read extra file");
+			fclose(fp);
+			return RET_FILE_IO_ERROR;
+		}
+		*crc = crc64(buf, read_size, *crc);
+		size16k -= read_size;
+	}
+
+	if (fclose(fp) != 0){
+		perror("Failed to close extra file");
+		return RET_FILE_IO_ERROR;
 	}
 
 	return 0;
 }
 
+// Check content of an extra file.
+// File hash is calculated, only when size and CRC-64 of the first 16 KB match a missing or damaged file.
+static int check_extra_content(PAR3_CTX *par3_ctx, char *filename, PAR3_CHECK_CTX *check_p,
+	PAR3_MISNAME_CTX *misname_list, uint32_t misname_count)
+{
+	int ret;
+	PAR3_MISNAME_CTX key;
+
+	if (check_p->flag_hash != 0){	// When size is same as a candidate.
+		ret = calculate_crc16k(filename, check_p->current_size, &(check_p->crc));
+		if (ret != 0)
+			return ret;
+		key.size = check_p->current_size;
+		key.crc = check_p->crc;
+		key.flag = 0;
+		if (misname_list_search(&key, misname_list, misname_count) < 0){
+			// Input file with unknown CRC-64 may be same.
+			key.crc = 0;
+			key.flag = 1;
+			if (misname_list_search(&key, misname_list, misname_count) < 0)
+				check_p->flag_hash = 0;
+		}
+	}
+
+	return check_damaged_file(par3_ctx, filename, check_p->current_size, 0,
+			&(check_p->file_damage), check_p->flag_hash ? check_p->hash : NULL);
+}
+
+// Compare file hash with candidates of same size and CRC-64.
+// Return index of input file, or -1 when no match.
+static int64_t find_misnamed_file(PAR3_CTX *par3_ctx, PAR3_CHECK_CTX *check_p,
+	PAR3_MISNAME_CTX *misname_list, uint32_t misname_count)
+{
+	int64_t index;
+	PAR3_FILE_CTX *file_p;
+	PAR3_MISNAME_CTX key;
+
+	key.size = check_p->current_size;
+	key.crc = check_p->crc;
+	key.flag = 0;
+	while (key.flag <= 1){
+		index = misname_list_search(&key, misname_list, misname_count);
+		while (index >= 0){
+			file_p = par3_ctx->input_file_list + misname_list[index].index;
+			// Ignore input file, which was found as misnamed file already.
+			if ( ((file_p->state & 4) == 0) && (memcmp(file_p->hash, check_p->hash, 16) == 0) )
+				return misname_list[index].index;
+
+			index++;
+			if (index == misname_count)
+				break;
+			if (compare_misname(&key, misname_list + index) != 0)
+				break;
+		}
+
+		// Input file with unknown CRC-64 may be same.
+		key.crc = 0;
+		key.flag++;
+	}
+
+	return -1;
+}
+
 // Check extra files and misnamed files.
 int verify_extra_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t *damaged_file_count, uint32_t *misnamed_file_count)
 {
-	int ret, flag_show = 0;
-	char *list_name;
+	int ret, worker_count, flag_show = 0;
+	char *list_name, **name_list;
 	size_t len, off, list_len;
-	uint8_t buf_hash[16], *tmp_p;
-	uint32_t num, extra_id;
-	uint64_t current_size, file_damage;
+	uint32_t extra_id, extra_count, misname_count;
+	int64_t file_index;
 	PAR3_FILE_CTX *file_p;
+	PAR3_CHECK_CTX *check_list, *check_p;
+	PAR3_MISNAME_CTX *misname_list, key;
+	PAR3_CTX *ctx_list;
 
 	if (par3_ctx->extra_file_name_len == 0)
 		return 0;
 
-	extra_id = 0;
 	list_name = par3_ctx->extra_file_name;
 	list_len = par3_ctx->extra_file_name_len;
+	extra_count = namez_count(list_name, list_len);
+	check_list = malloc(sizeof(PAR3_CHECK_CTX) * extra_count);
+	if (check_list == NULL){
+		perror("Failed to allocate memory for verification");
+		return RET_MEMORY_ERROR;
+	}
+	name_list = malloc(sizeof(char *) * extra_count);
+	if (name_list == NULL){
+		perror("Failed to allocate memory for verification");
+		free(check_list);
+		return RET_MEMORY_ERROR;
+	}
+	misname_list = make_misname_list(par3_ctx, &misname_count);
+	if (misname_list == NULL){
+		free(name_list);
+		free(check_list);
+		return RET_MEMORY_ERROR;
+	}
+
+	// Get size of each extra file at first.
+	extra_id = 0;
 	off = 0;
 	while (off < list_len){
 		len = strlen(list_name + off);
+		name_list[extra_id] = list_name + off;
+		check_p = check_list + extra_id;
+
+		check_p->current_size = 0;
+		check_p->ret = check_file(par3_ctx, list_name + off, &(check_p->current_size), -1);
+		check_p->thread = -1;
+		check_p->flag_hash = 0;
+		if ((check_p->ret & 0xFFFF) == 0){
+			check_p->thread = 0;	// Need to check content
+
+			// Check possibility of misnamed file by size.
+			// CRC-64 of the first 16 KB will be checked before calculating file hash.
+			if (misname_count > 0){
+				key.size = check_p->current_size;
+				if (bsearch( &key, misname_list, (size_t)misname_count, sizeof(PAR3_MISNAME_CTX), compare_size ) != NULL)
+					check_p->flag_hash = 1;
+			}
+		}
+
+		extra_id++;
+		off += len + 1;	// goto next filename
+	}
+
+	// Check content of files on worker threads.
+	ctx_list = NULL;
+	worker_count = get_worker_count(par3_ctx, extra_count);
+	if (worker_count > 1){
+		ctx_list = create_worker_context(par3_ctx, worker_count);
+		if (ctx_list == NULL){
+			free(misname_list);
+			free(name_list);
+			free(check_list);
+			return RET_MEMORY_ERROR;
+		}
+
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+		for (int i = 0; i < (int)extra_count; i++){
+			PAR3_CTX *ctx_p = ctx_list + omp_get_thread_num();
+			PAR3_CHECK_CTX *check_i = check_list + i;
+
+			if (check_i->thread < 0)
+				continue;
+			check_i->thread = omp_get_thread_num();
+			check_i->find_start = ctx_p->find_count;
+			check_i->ret = check_extra_content(ctx_p, name_list[i], check_i, misname_list, misname_count);
+			check_i->find_end = ctx_p->find_count;
+		}
+#endif
+	}
+
+	// Merge results in order of extra files.
+	ret = 0;
+	for (extra_id = 0; extra_id < extra_count; extra_id++){
+		check_p = check_list + extra_id;
 
 		if (par3_ctx->noise_level >= 0){
 			if (flag_show == 0){
@@ -321,95 +818,62 @@ int verify_extra_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 				printf("\nScanning extra files:\n\n");
 			}
 
-			printf("Opening: \"%s\"\n", list_name + off);
+			printf("Opening: \"%s\"\n", name_list[extra_id]);
 		}
 
-		// Get file size
-		ret = check_file(par3_ctx, list_name + off, &current_size, -1);
-		if ((ret & 0xFFFF) != 0){
+		if (check_p->thread < 0){
 			if (par3_ctx->noise_level >= -1){
-				printf("Target: \"%s\" - unknown.\n", list_name + off);
+				printf("Target: \"%s\" - unknown.\n", name_list[extra_id]);
 			}
-			extra_id++;
-			off += len + 1;	// goto next filename
-			break;
-		}
-
-		// Check possibility of misnamed file
-		tmp_p = NULL;
-		file_p = par3_ctx->input_file_list;
-		num = par3_ctx->input_file_count;
-		while (num > 0){
-			// No need to compare to compelete input files.
-			if (file_p->state & (1 | 2)){	// missing or damaged
-				if (file_p->size == current_size){
-					//printf("Calculate file hash to check misnamed file later.\n");
-					tmp_p = buf_hash;
-					break;
-				}
-			}
-
-			file_p++;
-			num--;
+			continue;
 		}
 
 		// Calculate file hash to find misnamed file later.
-		ret = check_damaged_file(par3_ctx, list_name + off, current_size, 0, &file_damage, tmp_p);
-		//printf("ret = %d, size = %"PRIu64", damage = %"PRIu64"\n", ret, current_size, file_damage);
+		if (ctx_list != NULL){
+			ret = check_p->ret;
+			if (ret == 0)
+				merge_found_slice(par3_ctx, ctx_list, check_p, name_list[extra_id]);
+		} else {
+			ret = check_extra_content(par3_ctx, name_list[extra_id], check_p, misname_list, misname_count);
+		}
+		//printf("ret = %d, size = %"PRIu64", damage = %"PRIu64"\n", ret, check_p->current_size, check_p->file_damage);
 		if (ret != 0)
-			return ret;
-
-		if (tmp_p != NULL){	// Check misnamed file here
-/*
-// for debug
-printf("%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x\n",
-	buf_hash[0], buf_hash[1], buf_hash[2], buf_hash[3],
-	buf_hash[4], buf_hash[5], buf_hash[6], buf_hash[7],
-	buf_hash[8], buf_hash[9], buf_hash[10], buf_hash[11],
-	buf_hash[12], buf_hash[13], buf_hash[14], buf_hash[15]);
-*/
+			break;
 
+		if (check_p->flag_hash != 0){	// Check misnamed file here
 			// Compare size and hash to find misnamed file.
-			file_p = par3_ctx->input_file_list;
-			num = par3_ctx->input_file_count;
-			while (num > 0){
-				// No need to compare to compelete input files.
-				if (file_p->state & (1 | 2)){	// missing or damaged
-					if (file_p->size == current_size){
-						if (memcmp(file_p->hash, buf_hash, 16) == 0){
-							*misnamed_file_count += 1;
-							if (file_p->state & 1){	// When this was missing file.
-								*missing_file_count -= 1;
-							} else if (file_p->state & 2){	// When this was damaged file.
-								*damaged_file_count -= 1;
-							}
-							file_p->state |= (extra_id << 3) | 4;
-
-							//printf("Extra file[%u] is misnamed file of \"%s\".\n", extra_id, file_p->name);
-							ret = 4;
-							break;
-						}
-					}
+			file_index = find_misnamed_file(par3_ctx, check_p, misname_list, misname_count);
+			if (file_index >= 0){
+				file_p = par3_ctx->input_file_list + file_index;
+				*misnamed_file_count += 1;
+				if (file_p->state & 1){	// When this was missing file.
+					*missing_file_count -= 1;
+				} else if (file_p->state & 2){	// When this was damaged file.
+					*damaged_file_count -= 1;
 				}
+				file_p->state |= (extra_id << 3) | 4;
 
-				file_p++;
-				num--;
+				//printf("Extra file[%u] is misnamed file of \"%s\".\n", extra_id, file_p->name);
+				ret = 4;
 			}
 		}
 
 		if (par3_ctx->noise_level >= -1){
 			if (ret & 4){
-				printf("Target: \"%s\" - is a match for \"%s\".\n", list_name + off, file_p->name);
+				printf("Target: \"%s\" - is a match for \"%s\".\n", name_list[extra_id], file_p->name);
 			} else {
 				printf("Target: \"%s\" - %"PRIu64" of %"PRIu64" bytes available.\n",
-						list_name + off, current_size - file_damage, current_size);
+						name_list[extra_id], check_p->current_size - check_p->file_damage, check_p->current_size);
 			}
 		}
-
-		extra_id++;
-		off += len + 1;	// goto next filename
+		ret = 0;
 	}
 
-	return 0;
-}
+	if (ctx_list != NULL)
+		release_worker_context(ctx_list, worker_count);
+	free(misname_list);
+	free(name_list);
+	free(check_list);
 
+	return ret;
+}
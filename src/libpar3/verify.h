@@ -7,6 +7,8 @@ int verify_extra_file(PAR3_CTX *par3_ctx, uint32_t *missing_file_count, uint32_t
 
 
 // Find available slices in an input file
+void apply_found_slice(PAR3_CTX *par3_ctx, int64_t slice_index, uint32_t flag, char *filename, int64_t offset);
+int set_found_slice(PAR3_CTX *par3_ctx, int64_t slice_index, uint32_t flag, char *filename, int64_t offset);
 int check_complete_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_id,
 	uint64_t current_size, uint64_t *offset_next);
 
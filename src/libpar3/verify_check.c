@@ -11,6 +11,64 @@
 #include <time.h>
 
 #include "hash.h"
+#include "verify.h"
+
+
+// Set position of found slice.
+// flag: 4 = full size slice, 8 = chunk tail, 0x100 = overwrite previous position
+void apply_found_slice(PAR3_CTX *par3_ctx, int64_t slice_index, uint32_t flag, char *filename, int64_t offset)
+{
+	uint64_t block_index;
+	PAR3_BLOCK_CTX *block_list;
+	PAR3_SLICE_CTX *slice_list;
+
+	block_list = par3_ctx->block_list;
+	slice_list = par3_ctx->slice_list;
+	block_index = slice_list[slice_index].block;
+
+	if ((flag & 0x100) == 0){
+		// Keep the first found position.
+		if (flag & 4){
+			if (block_list[block_index].state & 4)
+				return;
+		} else if (slice_list[slice_index].find_name != NULL){
+			return;
+		}
+	}
+
+	// Store filename & position of this slice for later reading.
+	slice_list[slice_index].find_name = filename;
+	slice_list[slice_index].find_offset = offset;
+	block_list[block_index].state |= flag & (4 | 8);
+}
+
+// When checking on worker thread, found slice is added in list to merge later.
+int set_found_slice(PAR3_CTX *par3_ctx, int64_t slice_index, uint32_t flag, char *filename, int64_t offset)
+{
+	PAR3_FIND_CTX *find_p;
+
+	if (par3_ctx->find_list == NULL){	// Set the result directly.
+		apply_found_slice(par3_ctx, slice_index, flag, filename, offset);
+		return 0;
+	}
+
+	if (par3_ctx->find_count == par3_ctx->find_max){
+		find_p = realloc(par3_ctx->find_list, sizeof(PAR3_FIND_CTX) * par3_ctx->find_max * 2);
+		if (find_p == NULL){
+			perror("Failed to re-allocate memory for found slices");
+			return RET_MEMORY_ERROR;
+		}
+		par3_ctx->find_list = find_p;
+		par3_ctx->find_max *= 2;
+	}
+	find_p = par3_ctx->find_list + par3_ctx->find_count;
+	find_p->slice = slice_index;
+	find_p->offset = offset;
+	find_p->flag = flag;
+	par3_ctx->find_count++;
+
+	return 0;
+}
 
 
 /*
@@ -81,6 +139,9 @@ int check_complete_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_id,
 	block_list = par3_ctx->block_list;
 	slice_list = par3_ctx->slice_list;
 
+	// This reads the file sequentially by stdio, instead of batch of reading.
+	// Because checking stops at the first different block, reading ahead may be wasted on damaged file.
+	// Sequential reading of one file is prefetched by OS already.
 	fp = fopen(filename, "rb");
 	if (fp == NULL){
 		perror("Failed to open input file");
@@ -203,9 +264,10 @@ int check_complete_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_id,
 								printf("full block[%2"PRId64"] : slice[%2"PRIu64"] chunk[%2u] file %d, offset = %"PRIu64"\n",
 										block_index, slice_index, chunk_index, file_id, file_offset);
 							}
-							slice_list[slice_index].find_name = file_p->name;
-							slice_list[slice_index].find_offset = file_offset;
-							block_list[block_index].state |= 4;
+							if (set_found_slice(par3_ctx, slice_index, 0x100 | 4, file_p->name, file_offset) != 0){
+								fclose(fp);
+								return RET_MEMORY_ERROR;
+							}
 						} else {	// BLAKE3 hash is different.
 							block_index = -1;
 						}
@@ -297,9 +359,10 @@ int check_complete_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_id,
 							printf("tail block[%2"PRId64"] : slice[%2"PRIu64"] chunk[%2u] file %d, offset = %"PRIu64", size = %"PRIu64"\n",
 									block_index, slice_index, chunk_index, file_id, file_offset, tail_size);
 						}
-						slice_list[slice_index].find_name = file_p->name;
-						slice_list[slice_index].find_offset = file_offset;
-						block_list[block_index].state |= 8;
+						if (set_found_slice(par3_ctx, slice_index, 0x100 | 8, file_p->name, file_offset) != 0){
+							fclose(fp);
+							return RET_MEMORY_ERROR;
+						}
 					} else {	// BLAKE3 hash is different.
 						block_index = -1;
 					}
@@ -471,31 +534,92 @@ int check_complete_file(PAR3_CTX *par3_ctx, char *filename, uint32_t file_id,
 	return 0;
 }
 
-#define CHECK_SLIDE_INTERVAL 8
-#define CHECK_SLIDE_RANGE 10
+// Number of mismatched candidates in a block range, before skipping the rest of slide search.
+#define CHECK_MISMATCH_LIMIT 64
+
+// Number of anchors (alignment of found slices) to check before sliding byte by byte.
+#define CHECK_ANCHOR_COUNT 8
+
+// Store alignment of a found slice in the file.
+// When data was inserted or deleted, following slices keep the same alignment.
+static void add_anchor(uint64_t *anchor_list, int *anchor_count, uint64_t anchor)
+{
+	int i;
+
+	for (i = 0; i < *anchor_count; i++){
+		if (anchor_list[i] == anchor)
+			return;
+	}
+	if (*anchor_count == CHECK_ANCHOR_COUNT){	// Remove the oldest one.
+		memmove(anchor_list, anchor_list + 1, sizeof(uint64_t) * (CHECK_ANCHOR_COUNT - 1));
+		(*anchor_count)--;
+	}
+	anchor_list[*anchor_count] = anchor;
+	(*anchor_count)++;
+}
+
+// Return the first offset from slide_offset in the block range, which is aligned to an anchor.
+// When there is no candidate, return block_size.
+static uint64_t next_anchor_offset(uint64_t *anchor_list, int anchor_count,
+	uint64_t block_size, uint64_t file_offset, uint64_t slide_offset)
+{
+	int i;
+	uint64_t offset, min_offset;
+
+	min_offset = block_size;
+	for (i = 0; i < anchor_count; i++){
+		offset = (anchor_list[i] + block_size - file_offset % block_size) % block_size;
+		if ( (offset >= slide_offset) && (offset < min_offset) )
+			min_offset = offset;
+	}
+
+	return min_offset;
+}
+
+// Return 1, when the next slice follows the slice in the same file without gap.
+// Then, the next slice may be found in orderly position, even over chunk boundary.
+static int is_following_slice(PAR3_SLICE_CTX *slice_list, int64_t slice_count, int64_t slice_index)
+{
+	if (slice_index + 1 >= slice_count)
+		return 0;
+
+	// Belong to same chunk
+	if (slice_list[slice_index + 1].chunk == slice_list[slice_index].chunk)
+		return 1;
+
+	// Next chunk starts at the end of this slice in same file.
+	if ( (slice_list[slice_index + 1].file == slice_list[slice_index].file)
+			&& (slice_list[slice_index + 1].offset == slice_list[slice_index].offset + slice_list[slice_index].size) )
+		return 1;
+
+	return 0;
+}
 
 // This checks available slices in the file.
 // This uses pointer of filename, instead of file ID.
 int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 	uint64_t file_size, uint64_t file_offset, uint64_t *file_damage, uint8_t *file_hash)
 {
-	uint8_t *work_buf, buf_hash[16], buf_hash2[16];
-	int flag_slide, hash_counter;
+	uint8_t *work_buf, *crc_filter, buf_hash[16], buf_hash2[16];
+	int flag_slide, flag_anchor, mismatch_counter, mismatch_limit, check_limit;
+	int anchor_count;
 	int64_t find_index, block_index, slice_index;
-	int64_t crc_count, tail_count;
+	int64_t crc_count, tail_count, find_count;
 	int64_t next_offset, next_slice, slice_count;
 	uint64_t block_size, read_size, slide_offset, slide_start;
-	uint64_t crc, crc40, tail_size, temp_crc;
-	uint64_t uniform_start, uniform_end, hash_offset;
+	uint64_t crc, crc40, tail_size, temp_crc, slide_crc;
+	uint64_t uniform_start, uniform_end;
+	uint64_t filter_mask;
 	uint64_t window_mask, *window_table, window_mask40, *window_table40;
 	uint64_t damage_size, find_last, find_min, find_max;
+	uint64_t anchor_list[CHECK_ANCHOR_COUNT];
 	PAR3_BLOCK_CTX *block_list;
 	PAR3_SLICE_CTX *slice_list;
 	PAR3_CHUNK_CTX *chunk_list;
 	PAR3_CMP_CTX *crc_list, *tail_list;
 	FILE *fp;
-	clock_t time_slide, time_limit;
 	blake3_hasher hasher;
+	clock_t time_slide, time_limit;
 
 	if (filename == NULL){
 		printf("File name is bad.\n");
@@ -522,18 +646,26 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 	slice_list = par3_ctx->slice_list;
 	chunk_list = par3_ctx->chunk_list;
 
-	// Set time limit for slide search
-	if (par3_ctx->search_limit != 0){
-		time_limit = par3_ctx->search_limit;
-	} else {
-		time_limit = 100;	// Time out is 100 ms by default.
-	}
+	// Set limit of mismatched candidates for slide search.
+	// Because it doesn't depend on time, result is same on any speed of computer.
+	// When time limit is set by user, it's used instead of the number of candidates.
+	mismatch_limit = CHECK_MISMATCH_LIMIT;
+	time_limit = (clock_t)((uint64_t)(par3_ctx->search_limit) * CLOCKS_PER_SEC / 1000);
+	if ( (par3_ctx->search_limit != 0) && (time_limit == 0) )
+		time_limit = 1;
+
+	// Found slices become anchors to check aligned offsets before sliding.
+	// The original position of slices in the file is the first anchor.
+	anchor_count = 0;
+	add_anchor(anchor_list, &anchor_count, file_offset % block_size);
 
 	// Prepare to search blocks.
 	window_mask = par3_ctx->window_mask;
 	window_table = par3_ctx->window_table;
 	window_mask40 = par3_ctx->window_mask40;
 	window_table40 = par3_ctx->window_table40;
+	crc_filter = par3_ctx->crc_filter;	// Bit filter of CRC-64 to skip most binary search
+	filter_mask = par3_ctx->crc_filter_mask;
 
 	// Copy CRC-list for local usage.
 	crc_count = par3_ctx->crc_count;
@@ -609,16 +741,16 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 							printf("p fu block[%2"PRId64"] : slice[%2"PRId64"] offset = %"PRIu64" + %"PRIu64"\n",
 									block_index, slice_index, file_offset, slide_offset);
 						}
-						if ((block_list[block_index].state & 4) == 0){	// When this block was not found yet.
-							// Store filename & position of this slice for later reading.
-							slice_list[slice_index].find_name = filename;
-							slice_list[slice_index].find_offset = file_offset + slide_offset;
-							block_list[block_index].state |= 4;
+						// When this block was not found yet, store filename & position of this slice for later reading.
+						if (set_found_slice(par3_ctx, slice_index, 4, filename, file_offset + slide_offset) != 0){
+							fclose(fp);
+							return RET_MEMORY_ERROR;
 						}
 						if (find_min > file_offset + slide_offset)
 							find_min = file_offset + slide_offset;
 						if (find_max < file_offset + slide_offset + block_size)
 							find_max = file_offset + slide_offset + block_size;
+						add_anchor(anchor_list, &anchor_count, (file_offset + slide_offset) % block_size);
 
 						// When CRC and BLAKE3 match, remove this item from crc_list.
 						find_index = cmp_list_search_index(temp_crc, block_index, crc_list, crc_count);
@@ -631,12 +763,10 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 
 						// When predicted slice was found, cancel slide search.
 						if (slice_list[slice_index].next == -1){	// There is only one slice for the found block.
-							if (slice_index + 1 < slice_count){	// There is next slice
-								if (slice_list[slice_index + 1].chunk == slice_list[slice_index].chunk){	// Belong to same chunk
-									next_offset = slide_offset;
-									next_slice = slice_index + 1;
-									flag_slide |= 7;	// Cancel slide and calculate CRC-64 after reading next block.
-								}
+							if (is_following_slice(slice_list, slice_count, slice_index)){	// There is next slice
+								next_offset = slide_offset;
+								next_slice = slice_index + 1;
+								flag_slide |= 7;	// Cancel slide and calculate CRC-64 after reading next block.
 							}
 						}
 					}
@@ -652,16 +782,17 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 							printf("p ta block[%2"PRId64"] : slice[%2"PRId64"] offset = %"PRIu64" + %"PRIu64", tail size = %"PRIu64", offset = %"PRIu64"\n",
 									block_index, slice_index, file_offset, slide_offset, tail_size, slice_list[slice_index].tail_offset);
 						}
-						if (slice_list[slice_index].find_name == NULL){	// When this slice was not found yet.
-							// Store filename & position of this slice for later reading.
-							slice_list[slice_index].find_name = filename;
-							slice_list[slice_index].find_offset = file_offset + slide_offset;
-							block_list[block_index].state |= 8;
+						// When this slice was not found yet, store filename & position of this slice for later reading.
+						if (set_found_slice(par3_ctx, slice_index, 8, filename, file_offset + slide_offset) != 0){
+							fclose(fp);
+							return RET_MEMORY_ERROR;
 						}
 						if (find_min > file_offset + slide_offset)
 							find_min = file_offset + slide_offset;
 						if (find_max < file_offset + slide_offset + tail_size)
 							find_max = file_offset + slide_offset + tail_size;
+						// Next chunk may start at the end of chunk tail.
+						add_anchor(anchor_list, &anchor_count, (file_offset + slide_offset + tail_size) % block_size);
 
 						// When CRC and BLAKE3 match, remove this item from tail_list.
 						find_index = cmp_list_search_index(temp_crc, slice_index, tail_list, tail_count);
@@ -697,25 +828,40 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 		// Compare current CRC-64 with full size blocks.
 		if ( ((flag_slide & 4) == 0) && (crc_count > 0) && (file_offset + slide_start + block_size <= file_size) ){
 			//printf("slide: offset = %"PRIu64" + %"PRIu64", block crc = 0x%016"PRIx64"\n", file_offset, slide_start, crc);
-			hash_counter = 0;
-			hash_offset = 0;
+			mismatch_counter = 0;
+			check_limit = (time_limit > 0) ? 1 : mismatch_limit;
 			time_slide = clock();	// Store starting time of slide search.
-			slide_offset = slide_start;
+			find_count = crc_count;
+			slide_crc = crc;	// CRC-64 at slide_start to slide byte by byte later
+
+			// At first, check only offsets which are aligned to anchors.
+			// When a block is found there, it's resynchronized without sliding byte by byte.
+			// So, search cost depends on the damaged area, instead of file size.
+			flag_anchor = 0;
+			slide_offset = next_anchor_offset(anchor_list, anchor_count, block_size, file_offset, slide_start);
+			if ( (slide_offset < block_size) && (file_offset + slide_offset + block_size <= file_size) ){
+				flag_anchor = 2;
+				crc = crc64(work_buf + slide_offset, block_size, 0);
+			} else {
+				slide_offset = slide_start;
+			}
 			while ( (slide_offset < block_size) && (file_offset + slide_offset + block_size <= file_size) ){
 				tail_size = 0;
 				// find_index is the first index of the matching CRC-64. There may be multiple items.
-				find_index = cmp_list_search(crc, crc_list, crc_count);
+				if (crc_filter[(crc & filter_mask) >> 3] & (1 << (crc & 7))){
+					find_index = cmp_list_search(crc, crc_list, crc_count);
+				} else {
+					find_index = -1;
+				}
 				while (find_index >= 0){	// When CRC-64 is same.
 					block_index = crc_list[find_index].index;	// index of block
 					if (tail_size == 0){	// When it didn't hash the block data yet.
 						tail_size++;
 						blake3(work_buf + slide_offset, block_size, buf_hash);
 
-						// Count number of hashing.
-						if (hash_counter == 0)
-							hash_offset = slide_offset;
-						hash_counter++;
-						//printf("block[%"PRIu64"], hashing = %d, offset = %"PRIu64" + %"PRIu64".\n", block_index, hash_counter, file_offset, slide_offset);
+						// Count number of hashing. It's canceled when a block is found at this offset.
+						mismatch_counter++;
+						//printf("block[%"PRIu64"], hashing = %d, offset = %"PRIu64" + %"PRIu64".\n", block_index, mismatch_counter, file_offset, slide_offset);
 					}
 					if (memcmp(buf_hash, block_list[block_index].hash, 16) == 0){
 						slice_index = block_list[block_index].slice;
@@ -723,16 +869,22 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 							printf("full block[%2"PRId64"] : slice[%2"PRId64"] offset = %"PRIu64" + %"PRIu64"\n",
 									block_index, slice_index, file_offset, slide_offset);
 						}
-						if ((block_list[block_index].state & 4) == 0){	// When this block was not found yet.
-							// Store filename & position of this slice for later reading.
-							slice_list[slice_index].find_name = filename;
-							slice_list[slice_index].find_offset = file_offset + slide_offset;
-							block_list[block_index].state |= 4;
+						// When this block was not found yet, store filename & position of this slice for later reading.
+						if (set_found_slice(par3_ctx, slice_index, 4, filename, file_offset + slide_offset) != 0){
+							fclose(fp);
+							return RET_MEMORY_ERROR;
 						}
 						if (find_min > file_offset + slide_offset)
 							find_min = file_offset + slide_offset;
 						if (find_max < file_offset + slide_offset + block_size)
 							find_max = file_offset + slide_offset + block_size;
+						add_anchor(anchor_list, &anchor_count, (file_offset + slide_offset) % block_size);
+
+						// Cancel the count only once, even when same data is found as multiple blocks.
+						if (tail_size == 1){
+							tail_size++;
+							mismatch_counter--;
+						}
 
 						// Store offset of found block to check at first in next loop.
 						if (next_offset == -1){
@@ -761,26 +913,46 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 						break;
 				}
 
-				temp_crc = crc;	// Save previous CRC-64 to compare later
-				crc = window_mask ^ crc_slide_byte(window_mask ^ crc,
-						work_buf[slide_offset + block_size], work_buf[slide_offset], window_table);
-				slide_offset++;
+				if (flag_anchor == 0){
+					temp_crc = crc;	// Save previous CRC-64 to compare later
+					crc = window_mask ^ crc_slide_byte(window_mask ^ crc,
+							work_buf[slide_offset + block_size], work_buf[slide_offset], window_table);
+					slide_offset++;
 
-				if (hash_counter >= CHECK_SLIDE_INTERVAL){	// Check freeze after sliding several bytes each.
-					// When hashing over than 8 times per 1 KB range.
-					if (slide_offset - hash_offset <= ((uint64_t)CHECK_SLIDE_INTERVAL << CHECK_SLIDE_RANGE)){
-						// When sliding over than time limit.
-						if (clock() - time_slide >= time_limit){
+					if (mismatch_counter >= check_limit){	// Check freeze by too many false candidates.
+						if ( (time_limit > 0) && (clock() - time_slide < time_limit) ){
+							check_limit = mismatch_counter + 1;	// Check time again at next mismatch.
+						} else {
 							if (par3_ctx->noise_level >= 1){
-								printf("Interrupt slide block by time out. offset = %"PRIu64" + %"PRIu64".\n", file_offset, slide_offset);
+								printf("Interrupt slide block by %s. offset = %"PRIu64" + %"PRIu64".\n",
+										(time_limit > 0) ? "time out" : "mismatch", file_offset, slide_offset);
 							}
-							flag_slide |= 1;
-							break;
+							flag_slide |= 1;	// Calculate CRC-64 after reading next block.
+							flag_anchor = 1;
 						}
 					}
-					hash_counter = 0;
-					hash_offset = slide_offset;
+				} else {
+					slide_offset++;
 				}
+				if (flag_anchor != 0){
+					// Jump to the next offset, which is aligned to found slices.
+					// Search cost depends on number of anchors, instead of block size.
+					slide_offset = next_anchor_offset(anchor_list, anchor_count, block_size, file_offset, slide_offset);
+					if ( (slide_offset >= block_size) || (file_offset + slide_offset + block_size > file_size) ){
+						if ( (flag_anchor == 2) && (crc_count == find_count) ){
+							// When no block was found at anchors, slide byte by byte.
+							flag_anchor = 0;
+							mismatch_counter = 0;
+							slide_offset = slide_start;
+							crc = slide_crc;
+							continue;
+						}
+						break;
+					}
+					crc = crc64(work_buf + slide_offset, block_size, 0);
+					continue;
+				}
+
 				if (crc == temp_crc){	// When CRC-64 is same after sliding 1 byte.
 					if (tail_size == 0)
 						blake3(work_buf + slide_offset - 1, block_size, buf_hash);
@@ -801,16 +973,15 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 				}
 			}
 
+			// When a block was found at anchors, the block range was resynchronized.
+			if (flag_anchor == 2)
+				flag_slide |= 7;	// Cancel slide of tails and calculate CRC-64 after reading next block.
+
 			// When one block was found while sliding search.
 			if (next_offset >= 0){
 				if (slice_list[next_slice].next == -1){	// There is only one slice for the found block.
-					slice_index = next_slice + 1;
-					if (slice_index < slice_count){	// There is next slice
-						if (slice_list[next_slice].chunk == slice_list[slice_index].chunk){	// Belong to same chunk
-							next_slice = slice_index;
-						} else {
-							next_offset = -2;
-						}
+					if (is_following_slice(slice_list, slice_count, next_slice)){	// There is next slice
+						next_slice++;
 					} else {
 						next_offset = -2;
 					}
@@ -823,15 +994,30 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 		// Compare current CRC-64 with chunk tails.
 		if ( ((flag_slide & 4) == 0) && (tail_count > 0) && (file_offset + slide_start + 40 <= file_size) ){
 			//printf("slide: offset = %"PRIu64" + %"PRIu64", tail crc = 0x%016"PRIx64"\n", file_offset, slide_start, crc40);
-			hash_counter = 0;
-			hash_offset = 0;
+			mismatch_counter = 0;
+			check_limit = (time_limit > 0) ? 1 : mismatch_limit;
 			time_slide = clock();	// Store starting time of slide search.
-			slide_offset = slide_start;
+			find_count = tail_count;
+			slide_crc = crc40;	// CRC-64 at slide_start to slide byte by byte later
+
+			// At first, check only offsets which are aligned to anchors.
+			flag_anchor = 0;
+			slide_offset = next_anchor_offset(anchor_list, anchor_count, block_size, file_offset, slide_start);
+			if ( (slide_offset < block_size) && (file_offset + slide_offset + 40 <= file_size) ){
+				flag_anchor = 2;
+				crc40 = crc64(work_buf + slide_offset, 40, 0);
+			} else {
+				slide_offset = slide_start;
+			}
 			while ( (slide_offset < block_size) && (file_offset + slide_offset + 40 <= file_size) ){
 				// Because CRC-64 for chunk tails is a range of the first 40-bytes, total data may be different.
 				tail_size = 0;
 				// find_index is the first index of the matching CRC-64. There may be multiple items.
-				find_index = cmp_list_search(crc40, tail_list, tail_count);
+				if (crc_filter[(crc40 & filter_mask) >> 3] & (1 << (crc40 & 7))){
+					find_index = cmp_list_search(crc40, tail_list, tail_count);
+				} else {
+					find_index = -1;
+				}
 				while (find_index >= 0){	// When CRC-64 is same.
 					slice_index = tail_list[find_index].index;	// index of slice
 					if (tail_size != slice_list[slice_index].size){
@@ -845,11 +1031,9 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 						} else if (file_offset + slide_offset + tail_size <= file_size){
 							blake3(work_buf + slide_offset, tail_size, buf_hash);
 
-							// Count number of hashing.
-							if (hash_counter == 0)
-								hash_offset = slide_offset;
-							hash_counter++;
-							//printf("slice[%"PRIu64"], hashing = %d, offset = %"PRIu64" + %"PRIu64".\n", slice_index, hash_counter, file_offset, slide_offset);
+							// Count number of hashing. It's canceled when the slice is found.
+							mismatch_counter++;
+							//printf("slice[%"PRIu64"], hashing = %d, offset = %"PRIu64" + %"PRIu64".\n", slice_index, mismatch_counter, file_offset, slide_offset);
 
 						} else {
 							// When chunk tail exceeds file data, hash value becomes zero.
@@ -863,16 +1047,19 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 							printf("tail block[%2"PRIu64"] : slice[%2"PRId64"] offset = %"PRIu64" + %"PRIu64", tail size = %"PRIu64", offset = %"PRIu64"\n",
 									block_index, slice_index, file_offset, slide_offset, tail_size, slice_list[slice_index].tail_offset);
 						}
-						if (slice_list[slice_index].find_name == NULL){	// When this slice was not found yet.
-							// Store filename & position of this slice for later reading.
-							slice_list[slice_index].find_name = filename;
-							slice_list[slice_index].find_offset = file_offset + slide_offset;
-							block_list[block_index].state |= 8;
+						// When this slice was not found yet, store filename & position of this slice for later reading.
+						if (set_found_slice(par3_ctx, slice_index, 8, filename, file_offset + slide_offset) != 0){
+							fclose(fp);
+							return RET_MEMORY_ERROR;
 						}
 						if (find_min > file_offset + slide_offset)
 							find_min = file_offset + slide_offset;
 						if (find_max < file_offset + slide_offset + tail_size)
 							find_max = file_offset + slide_offset + tail_size;
+						add_anchor(anchor_list, &anchor_count, (file_offset + slide_offset + tail_size) % block_size);
+
+						if (mismatch_counter > 0)
+							mismatch_counter--;
 
 						// When only one full size slice was found
 						if (next_offset >= 0){
@@ -896,25 +1083,45 @@ int check_damaged_file(PAR3_CTX *par3_ctx, char *filename,
 						break;
 				}
 
-				temp_crc = crc40;	// Save previous CRC-64 to compare later
-				crc40 = window_mask40 ^ crc_slide_byte(window_mask40 ^ crc40,
-						work_buf[slide_offset + 40], work_buf[slide_offset], window_table40);
-				slide_offset++;
+				if (flag_anchor == 0){
+					temp_crc = crc40;	// Save previous CRC-64 to compare later
+					crc40 = window_mask40 ^ crc_slide_byte(window_mask40 ^ crc40,
+							work_buf[slide_offset + 40], work_buf[slide_offset], window_table40);
+					slide_offset++;
 
-				if (hash_counter >= CHECK_SLIDE_INTERVAL){	// Check freeze after sliding several bytes each.
-					// When hashing over than 8 times in 8 KB range. (average >= 1 time / 1 KB)
-					if (slide_offset - hash_offset <= ((uint64_t)CHECK_SLIDE_INTERVAL << CHECK_SLIDE_RANGE)){
-						// When sliding over than time limit.
-						if (clock() - time_slide >= time_limit){
+					if (mismatch_counter >= check_limit){	// Check freeze by too many false candidates.
+						if ( (time_limit > 0) && (clock() - time_slide < time_limit) ){
+							check_limit = mismatch_counter + 1;	// Check time again at next mismatch.
+						} else {
 							if (par3_ctx->noise_level >= 1){
-								printf("Interrupt slide tail by time out. offset = %"PRIu64" + %"PRIu64".\n", file_offset, slide_offset);
+								printf("Interrupt slide tail by %s. offset = %"PRIu64" + %"PRIu64".\n",
+										(time_limit > 0) ? "time out" : "mismatch", file_offset, slide_offset);
 							}
-							flag_slide |= 2;
-							break;
+							flag_slide |= 2;	// Calculate CRC-64 after reading next block.
+							flag_anchor = 1;
 						}
 					}
-					hash_counter = 0;
-					hash_offset = slide_offset;
+				} else {
+					slide_offset++;
+				}
+				if (flag_anchor != 0){
+					// Jump to the next offset, which is aligned to found slices.
+					slide_offset = next_anchor_offset(anchor_list, anchor_count, block_size, file_offset, slide_offset);
+					if ( (slide_offset >= block_size) || (file_offset + slide_offset + 40 > file_size) ){
+						if ( (flag_anchor == 2) && (tail_count == find_count) ){
+							// When no tail was found at anchors, slide byte by byte.
+							flag_anchor = 0;
+							mismatch_counter = 0;
+							slide_offset = slide_start;
+							crc40 = slide_crc;
+							continue;
+						}
+						if (flag_anchor == 2)
+							flag_slide |= 2;	// Calculate CRC-64 after reading next block.
+						break;
+					}
+					crc40 = crc64(work_buf + slide_offset, 40, 0);
+					continue;
 				}
 				if (crc40 == temp_crc){	// When CRC-64 is same after sliding 1 byte.
 					// When offset is inside of uniform data.
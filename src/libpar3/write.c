@@ -9,8 +9,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "galois.h"
 #include "hash.h"
+#include "io_gather.h"
 #include "packet.h"
 #include "write.h"
 
@@ -147,37 +152,13 @@ number of blocks = 8192 ~ 16383 : number of copies = 14
 number of blocks = 16384 ~ 32767 : number of copies = 15
 number of blocks = 32768 ~ 65535 : number of copies = 16
 */
-static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_start, uint64_t each_count)
+// Create an Archive File, and write Creator Packet and first common packets.
+// Number of repeated common packets is returned in "packet_count_p".
+// When it fails, the file is closed.
+static int begin_data_file(PAR3_CTX *par3_ctx, PAR3_GATHER_CTX *gp, char *file_name, uint64_t each_count, size_t *packet_count_p)
 {
-	uint8_t *work_buf, *common_packet, packet_header[56];
-	uint32_t file_index, file_prev;
-	uint32_t cohort_count;
-	int64_t slice_index;
-	uint64_t num, file_offset;
-	uint64_t block_count, block_index, block_max;
-	size_t block_size, read_size, tail_offset;
-	size_t write_size, write_size2;
-	size_t packet_count, packet_to, packet_from;
-	size_t common_packet_size, packet_size, packet_offset;
-	PAR3_FILE_CTX *file_list;
-	PAR3_SLICE_CTX *slice_list;
-	PAR3_BLOCK_CTX *block_list;
-	FILE *fp_write, *fp_read;
-	blake3_hasher hasher;
-
-	block_size = par3_ctx->block_size;
-	work_buf = par3_ctx->work_buf;
-	file_list = par3_ctx->input_file_list;
-	slice_list = par3_ctx->slice_list;
-	block_list = par3_ctx->block_list;
-	common_packet = par3_ctx->common_packet;
-	common_packet_size = par3_ctx->common_packet_size;
-
-	// Set count for each cohort
-	if (par3_ctx->interleave > 0){
-		block_count = par3_ctx->block_count;
-		cohort_count = par3_ctx->interleave + 1;
-	}
+	uint64_t num;
+	size_t write_size, packet_count;
 
 	// How many repetition of common packet.
 	packet_count = 0;	// reduce 1, because put 1st copy at first.
@@ -191,9 +172,9 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 	//printf("each_count = %"PRIu64", repetition = %zu\n", each_count, packet_count);
 	packet_count *= par3_ctx->common_packet_count;
 	//printf("number of repeated packets = %zu\n", packet_count);
+	*packet_count_p = packet_count;
 
-	fp_write = fopen(file_name, "wb");
-	if (fp_write == NULL){
+	if (io_gather_open(gp, file_name, par3_ctx->write_direct) != 0){
 		perror("Failed to open Archive File");
 		return RET_FILE_IO_ERROR;
 	}
@@ -201,21 +182,177 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 	// Creator Packet
 	write_size = par3_ctx->creator_packet_size;
 	if (write_size > 0){
-		if (fwrite(par3_ctx->creator_packet, 1, write_size, fp_write) != write_size){
+		if (io_gather_add(gp, par3_ctx->creator_packet, write_size) != 0){
 			perror("Failed to write Creator Packet on Archive File");
-			fclose(fp_write);
+			io_gather_close(gp);
 			return RET_FILE_IO_ERROR;
 		}
 	}
 
 	// First common packets
-	write_size = common_packet_size;
-	if (fwrite(common_packet, 1, write_size, fp_write) != write_size){
+	write_size = par3_ctx->common_packet_size;
+	if (io_gather_add(gp, par3_ctx->common_packet, write_size) != 0){
 		perror("Failed to write first common packets on Archive File");
-		fclose(fp_write);
+		io_gather_close(gp);
 		return RET_FILE_IO_ERROR;
 	}
 
+	return 0;
+}
+
+// Write Data Packet of the input block, which data is stored in "buf".
+static int put_data_packet(PAR3_CTX *par3_ctx, PAR3_GATHER_CTX *gp, uint64_t block_index, uint8_t *buf)
+{
+	uint8_t packet_header[56];
+	size_t write_size;
+	blake3_hasher hasher;
+
+	// data size in the block
+	write_size = par3_ctx->block_list[block_index].size;
+
+	// packet header
+	make_packet_header(packet_header, 56 + write_size, par3_ctx->set_id, "PAR DAT\0", 0);
+
+	// The index of the input block
+	memcpy(packet_header + 48, &block_index, 8);
+
+	// Calculate checksum of packet here.
+	blake3_hasher_init(&hasher);
+	blake3_hasher_update(&hasher, packet_header + 24, 24 + 8);
+	blake3_hasher_update(&hasher, buf, write_size);
+	blake3_hasher_finalize(&hasher, packet_header + 8, 16);
+
+	// Write packet header and data on file.
+	if (io_gather_copy(gp, packet_header, 56) != 0){
+		perror("Failed to write Data Packet on Archive File");
+		return RET_FILE_IO_ERROR;
+	}
+	// Because buf is used for next block, data is written here.
+	if ( (io_gather_add(gp, buf, write_size) != 0) || (io_gather_flush(gp) != 0) ){
+		perror("Failed to write Data Packet on Archive File");
+		return RET_FILE_IO_ERROR;
+	}
+
+	return 0;
+}
+
+// Write repeated common packets after "step" of "each_count" Data Packets in the file.
+static int put_common_packet(PAR3_CTX *par3_ctx, PAR3_GATHER_CTX *gp, size_t packet_count,
+		uint64_t each_count, uint64_t step, size_t *packet_from_p, size_t *packet_offset_p)
+{
+	uint8_t *common_packet;
+	size_t write_size, write_size2;
+	size_t packet_to, packet_from;
+	size_t common_packet_size, packet_size, packet_offset;
+
+	common_packet = par3_ctx->common_packet;
+	common_packet_size = par3_ctx->common_packet_size;
+	packet_from = *packet_from_p;
+	packet_offset = *packet_offset_p;
+
+	// How many common packets to write here.
+	write_size = 0;
+	write_size2 = 0;
+	packet_to = packet_count * step / each_count;
+	//printf("write from %zu to %zu\n", packet_from, packet_to);
+	while (packet_to - packet_from > 0){
+		// Read packet size of each packet from packet_offset, and add them.
+		memcpy(&packet_size, common_packet + packet_offset + write_size + 24, 8);
+		write_size += packet_size;
+		packet_from++;
+		if (packet_offset + write_size >= common_packet_size)
+			break;
+	}
+	while (packet_to - packet_from > 0){
+		// Read packet size of each packet from the first, and add them.
+		memcpy(&packet_size, common_packet + write_size2 + 24, 8);
+		write_size2 += packet_size;
+		packet_from++;
+	}
+
+	// Write common packets
+	if (write_size > 0){
+		//printf("packet_offset = %zu, write_size = %zu, total = %zu\n", packet_offset, write_size, packet_offset + write_size);
+		if (io_gather_add(gp, common_packet + packet_offset, write_size) != 0){
+			perror("Failed to write repeated common packet on Archive File");
+			return RET_FILE_IO_ERROR;
+		}
+		// This offset doesn't exceed common_packet_size.
+		packet_offset += write_size;
+		if (packet_offset >= common_packet_size)
+			packet_offset -= common_packet_size;
+	}
+	if (write_size2 > 0){
+		//printf("write_size2 = %zu = packet_offset\n", write_size2);
+		if (io_gather_add(gp, common_packet, write_size2) != 0){
+			perror("Failed to write repeated common packet on Archive File");
+			return RET_FILE_IO_ERROR;
+		}
+		// Current offset is saved.
+		packet_offset = write_size2;
+	}
+
+	*packet_from_p = packet_from;
+	*packet_offset_p = packet_offset;
+	return 0;
+}
+
+// Write Comment Packet, and close the Archive File.
+static int end_data_file(PAR3_CTX *par3_ctx, PAR3_GATHER_CTX *gp)
+{
+	size_t write_size;
+
+	// Comment Packet
+	write_size = par3_ctx->comment_packet_size;
+	if (write_size > 0){
+		if (io_gather_add(gp, par3_ctx->comment_packet, write_size) != 0){
+			perror("Failed to write Comment Packet on Archive File");
+			io_gather_close(gp);
+			return RET_FILE_IO_ERROR;
+		}
+	}
+
+	if (io_gather_close(gp) != 0){
+		perror("Failed to close Archive File");
+		return RET_FILE_IO_ERROR;
+	}
+
+	return 0;
+}
+
+// This may run on worker thread, so work_buf is given for each thread.
+static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_start, uint64_t each_count, uint8_t *work_buf)
+{
+	int ret;
+	uint32_t file_index, file_prev;
+	uint32_t cohort_count;
+	int64_t slice_index;
+	uint64_t num, file_offset;
+	uint64_t block_count, block_index, block_max;
+	size_t block_size, read_size, tail_offset;
+	size_t write_size;
+	size_t packet_count, packet_from, packet_offset;
+	PAR3_FILE_CTX *file_list;
+	PAR3_SLICE_CTX *slice_list;
+	PAR3_BLOCK_CTX *block_list;
+	FILE *fp_read;
+	PAR3_GATHER_CTX gather;
+
+	block_size = par3_ctx->block_size;
+	file_list = par3_ctx->input_file_list;
+	slice_list = par3_ctx->slice_list;
+	block_list = par3_ctx->block_list;
+
+	// Set count for each cohort
+	if (par3_ctx->interleave > 0){
+		block_count = par3_ctx->block_count;
+		cohort_count = par3_ctx->interleave + 1;
+	}
+
+	ret = begin_data_file(par3_ctx, &gather, file_name, each_count, &packet_count);
+	if (ret != 0)
+		return ret;
+
 	// Data Packet and repeated common packets
 	file_prev = 0xFFFFFFFF;
 	fp_read = NULL;
@@ -237,12 +374,6 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 			// data size in the block
 			write_size = block_list[block_index].size;
 
-			// packet header
-			make_packet_header(packet_header, 56 + write_size, par3_ctx->set_id, "PAR DAT\0", 0);
-
-			// The index of the input block
-			memcpy(packet_header + 48, &block_index, 8);
-
 			// Read block data from file.
 			if (block_list[block_index].state & 1){	// including full size data
 				slice_index = block_list[block_index].slice;
@@ -253,7 +384,7 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 				}
 				if (slice_index == -1){	// When there is no valid slice.
 					printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-					fclose(fp_write);
+					io_gather_close(&gather);
 					if (fp_read != NULL)
 						fclose(fp_read);
 					return RET_LOGIC_ERROR;
@@ -272,7 +403,7 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 					fp_read = fopen(file_list[file_index].name, "rb");
 					if (fp_read == NULL){
 						perror("Failed to open input file");
-						fclose(fp_write);
+						io_gather_close(&gather);
 						return RET_FILE_IO_ERROR;
 					}
 					file_prev = file_index;
@@ -280,13 +411,13 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 				if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
 					perror("Failed to seek input file");
 					fclose(fp_read);
-					fclose(fp_write);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
 				if (fread(work_buf, 1, read_size, fp_read) != read_size){
 					perror("Failed to read full slice on input file");
 					fclose(fp_read);
-					fclose(fp_write);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
 
@@ -306,7 +437,7 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 					}
 					if (slice_index == -1){	// When there is no valid slice.
 						printf("Mapping information for block[%"PRIu64"] is wrong.\n", block_index);
-						fclose(fp_write);
+						io_gather_close(&gather);
 						if (fp_read != NULL)
 							fclose(fp_read);
 						return RET_LOGIC_ERROR;
@@ -324,7 +455,7 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 						fp_read = fopen(file_list[file_index].name, "rb");
 						if (fp_read == NULL){
 							perror("Failed to open input file");
-							fclose(fp_write);
+							io_gather_close(&gather);
 							return RET_FILE_IO_ERROR;
 						}
 						file_prev = file_index;
@@ -332,13 +463,13 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 					if (_fseeki64(fp_read, file_offset, SEEK_SET) != 0){
 						perror("Failed to seek input file");
 						fclose(fp_read);
-						fclose(fp_write);
+						io_gather_close(&gather);
 						return RET_FILE_IO_ERROR;
 					}
 					if (fread(work_buf + tail_offset, 1, read_size, fp_read) != read_size){
 						perror("Failed to read tail slice on input file");
 						fclose(fp_read);
-						fclose(fp_write);
+						io_gather_close(&gather);
 						return RET_FILE_IO_ERROR;
 					}
 					tail_offset += read_size;
@@ -357,160 +488,91 @@ static int write_data_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_
 				if (crc64(work_buf, write_size, 0) != block_list[block_index].crc){
 					printf("Checksum of block[%"PRIu64"] is different.\n", block_index);
 					fclose(fp_read);
-					fclose(fp_write);
+					io_gather_close(&gather);
 					return RET_LOGIC_ERROR;
 				}
 			}
 
-			// Calculate checksum of packet here.
-			blake3_hasher_init(&hasher);
-			blake3_hasher_update(&hasher, packet_header + 24, 24 + 8);
-			blake3_hasher_update(&hasher, work_buf, write_size);
-			blake3_hasher_finalize(&hasher, packet_header + 8, 16);
-
 			// Write packet header and data on file.
-			if (fwrite(packet_header, 1, 56, fp_write) != 56){
-				perror("Failed to write Data Packet on Archive File");
-				fclose(fp_write);
-				fclose(fp_read);
-				return RET_FILE_IO_ERROR;
-			}
-			if (fwrite(work_buf, 1, write_size, fp_write) != write_size){
-				perror("Failed to write Data Packet on Archive File");
-				fclose(fp_write);
+			ret = put_data_packet(par3_ctx, &gather, block_index, work_buf);
+			if (ret != 0){
+				io_gather_close(&gather);
 				fclose(fp_read);
-				return RET_FILE_IO_ERROR;
+				return ret;
 			}
 
 			block_index++;	// Goto next block
 		}
 
-		// How many common packets to write here.
-		write_size = 0;
-		write_size2 = 0;
-		packet_to = packet_count * (num - each_start + 1) / each_count;
-		//printf("write from %zu to %zu\n", packet_from, packet_to);
-		while (packet_to - packet_from > 0){
-			// Read packet size of each packet from packet_offset, and add them.
-			memcpy(&packet_size, common_packet + packet_offset + write_size + 24, 8);
-			write_size += packet_size;
-			packet_from++;
-			if (packet_offset + write_size >= common_packet_size)
-				break;
-		}
-		while (packet_to - packet_from > 0){
-			// Read packet size of each packet from the first, and add them.
-			memcpy(&packet_size, common_packet + write_size2 + 24, 8);
-			write_size2 += packet_size;
-			packet_from++;
-		}
-
-		// Write common packets
-		if (write_size > 0){
-			//printf("packet_offset = %zu, write_size = %zu, total = %zu\n", packet_offset, write_size, packet_offset + write_size);
-			if (fwrite(common_packet + packet_offset, 1, write_size, fp_write) != write_size){
-				perror("Failed to write repeated common packet on Archive File");
-				fclose(fp_write);
-				fclose(fp_read);
-				return RET_FILE_IO_ERROR;
-			}
-			// This offset doesn't exceed common_packet_size.
-			packet_offset += write_size;
-			if (packet_offset >= common_packet_size)
-				packet_offset -= common_packet_size;
-		}
-		if (write_size2 > 0){
-			//printf("write_size2 = %zu = packet_offset\n", write_size2);
-			if (fwrite(common_packet, 1, write_size2, fp_write) != write_size2){
-				perror("Failed to write repeated common packet on Archive File");
-				fclose(fp_write);
-				fclose(fp_read);
-				return RET_FILE_IO_ERROR;
-			}
-			// Current offset is saved.
-			packet_offset = write_size2;
-		}
-	}
-
-	// Comment Packet
-	write_size = par3_ctx->comment_packet_size;
-	if (write_size > 0){
-		if (fwrite(par3_ctx->comment_packet, 1, write_size, fp_write) != write_size){
-			perror("Failed to write Comment Packet on Archive File");
-			fclose(fp_write);
-			if (fp_read != NULL)
-				fclose(fp_read);
-			return RET_FILE_IO_ERROR;
+		// Write repeated common packets
+		ret = put_common_packet(par3_ctx, &gather, packet_count, each_count, num - each_start + 1, &packet_from, &packet_offset);
+		if (ret != 0){
+			io_gather_close(&gather);
+			fclose(fp_read);
+			return ret;
 		}
 	}
 
 	if (fp_read != NULL){
 		if (fclose(fp_read) != 0){
 			perror("Failed to close input file");
-			fclose(fp_write);
+			io_gather_close(&gather);
 			return RET_FILE_IO_ERROR;
 		}
 	}
-	if (fclose(fp_write) != 0){
-		perror("Failed to close Archive File");
-		return RET_FILE_IO_ERROR;
-	}
 
-	return 0;
+	return end_data_file(par3_ctx, &gather);
 }
 
-// Write PAR3 files with Data packets (input blocks)
-int write_archive_file(PAR3_CTX *par3_ctx, char *file_name)
+// Return number of worker threads to write PAR files.
+static int get_write_worker_count(PAR3_CTX *par3_ctx, uint32_t file_count, size_t buf_size)
 {
-	int digit_num1, digit_num2;
-	uint32_t file_count;
-	size_t len, region_size;
-	int64_t recovery_file_scheme;
-	uint64_t block_count, base_num;
-	uint64_t each_start, each_count, max_count;
+	int worker_count;
 
-	block_count = par3_ctx->block_count;
-	if (block_count == 0)
-		return 0;
-	recovery_file_scheme = par3_ctx->recovery_file_scheme;
-	if (recovery_file_scheme == -2)
-		recovery_file_scheme = par3_ctx->max_file_size;
-
-	// Allocate memory to read one input block and parity.
-	region_size = (par3_ctx->block_size + 4 + 3) & ~3;
-	par3_ctx->work_buf = malloc(region_size);
-	if (par3_ctx->work_buf == NULL){
-		perror("Failed to allocate memory for input data");
-		return RET_MEMORY_ERROR;
+#ifdef _OPENMP
+	if (par3_ctx->thread_count > 0){
+		worker_count = par3_ctx->thread_count;
+	} else {
+		worker_count = omp_get_max_threads();
 	}
-
-	// Remove the last ".par3" from base PAR3 filename.
-	strcpy(file_name, par3_ctx->par_filename);
-	len = strlen(file_name);
-	if (strcmp(file_name + len - 5, ".par3") == 0){
-		len -= 5;
-		file_name[len] = 0;
-		//printf("len = %zu, base name = %s\n", len, file_name);
+#else
+	worker_count = 1;	// Without OpenMP, files are written one by one.
+#endif
+	if ((uint32_t)worker_count > file_count)
+		worker_count = file_count;
+
+	// Each worker thread requires own buffer.
+	if ( (buf_size > 0) && (par3_ctx->memory_limit > 0) ){
+		while ( (worker_count > 1) && ((uint64_t)buf_size * worker_count > par3_ctx->memory_limit) )
+			worker_count--;
 	}
+	if (worker_count <= 1)
+		return 1;
 
-	// Set count for each cohort
-	if (par3_ctx->interleave > 0){
-		block_count = (block_count + par3_ctx->interleave) / (par3_ctx->interleave + 1);	// round up
-	}
+	return worker_count;
+}
 
-	// Calculate block count and digits max.
-	file_count = calculate_digit_max(par3_ctx, 56, block_count, 0, &base_num, &max_count, &digit_num1, &digit_num2);
-	if (len + 11 + digit_num1 + digit_num2 >= _MAX_PATH){	// .part#+#.par3
-		printf("PAR filename will be too long.\n");
-		return RET_FILE_IO_ERROR;
-	}
+// Make list of PAR files, and set range of blocks in each file.
+// Filenames are set as "base_name.part#+#.par3" or "base_name.vol#+#.par3" in name_buf.
+// Return number of PAR files, or 0 when failed to allocate memory.
+static uint32_t make_write_list(PAR3_CTX *par3_ctx, PAR3_WRITE_CTX **write_list_p, char **name_buf_p,
+		char *file_name, size_t len, char *name_type, int digit_num1, int digit_num2,
+		uint32_t file_count, uint64_t block_count, uint64_t each_start, uint64_t base_num, uint64_t max_count)
+{
+	char *name_buf;
+	uint32_t list_count, list_max;
+	int64_t recovery_file_scheme;
+	uint64_t each_count;
+	size_t name_size;
+	PAR3_WRITE_CTX *write_list, *tmp_p;
 
-	if (par3_ctx->noise_level >= 1){
-		show_sizing_scheme(par3_ctx, file_count, base_num, max_count);
-	}
+	recovery_file_scheme = par3_ctx->recovery_file_scheme;
+	if (recovery_file_scheme == -2)
+		recovery_file_scheme = par3_ctx->max_file_size;
 
-	// Write each PAR3 file.
-	each_start = 0;
+	list_count = 0;
+	list_max = 0;
+	write_list = NULL;
 	while (block_count > 0){
 		if (file_count > 0){
 			if (recovery_file_scheme == -1){	// Uniform
@@ -550,25 +612,312 @@ int write_archive_file(PAR3_CTX *par3_ctx, char *file_name)
 			}
 		}
 
-		sprintf(file_name + len, ".part%0*"PRIu64"+%0*"PRIu64".par3", digit_num1, each_start, digit_num2, each_count);
-		if (write_data_packet(par3_ctx, file_name, each_start, each_count) != 0){
-			return RET_FILE_IO_ERROR;
+		if (list_count >= list_max){
+			list_max += 64;
+			tmp_p = realloc(write_list, sizeof(PAR3_WRITE_CTX) * list_max);
+			if (tmp_p == NULL){
+				free(write_list);
+				return 0;
+			}
+			write_list = tmp_p;
 		}
-		if (par3_ctx->noise_level >= -1)
-			printf("Wrote archive file, %s\n", offset_file_name(file_name));
+		write_list[list_count].start = each_start;
+		write_list[list_count].count = each_count;
+		list_count++;
 
 		each_start += each_count;
 		block_count -= each_count;
 	}
 
+	// Set filename of each PAR file.
+	name_size = len + 12 + digit_num1 + digit_num2;	// .part#+#.par3 and null
+	name_buf = malloc(name_size * list_count);
+	if (name_buf == NULL){
+		free(write_list);
+		return 0;
+	}
+	for (file_count = 0; file_count < list_count; file_count++){
+		sprintf(file_name + len, "%s%0*"PRIu64"+%0*"PRIu64".par3", name_type,
+				digit_num1, write_list[file_count].start, digit_num2, write_list[file_count].count);
+		write_list[file_count].name = name_buf + name_size * file_count;
+		strcpy(write_list[file_count].name, file_name);
+		write_list[file_count].ret = 0;
+	}
+
+	*write_list_p = write_list;
+	*name_buf_p = name_buf;
+	return list_count;
+}
+
+// Make list of Archive Files, and set range of input blocks in each file.
+static int make_archive_list(PAR3_CTX *par3_ctx, char *file_name,
+		PAR3_WRITE_CTX **write_list_p, char **name_buf_p, uint32_t *file_count_p)
+{
+	int digit_num1, digit_num2;
+	uint32_t file_count;
+	size_t len;
+	uint64_t block_count, base_num, max_count;
+
+	block_count = par3_ctx->block_count;
+
+	// Remove the last ".par3" from base PAR3 filename.
+	strcpy(file_name, par3_ctx->par_filename);
+	len = strlen(file_name);
+	if (strcmp(file_name + len - 5, ".par3") == 0){
+		len -= 5;
+		file_name[len] = 0;
+		//printf("len = %zu, base name = %s\n", len, file_name);
+	}
+
+	// Set count for each cohort
+	if (par3_ctx->interleave > 0){
+		block_count = (block_count + par3_ctx->interleave) / (par3_ctx->interleave + 1);	// round up
+	}
+
+	// Calculate block count and digits max.
+	file_count = calculate_digit_max(par3_ctx, 56, block_count, 0, &base_num, &max_count, &digit_num1, &digit_num2);
+	if (len + 11 + digit_num1 + digit_num2 >= _MAX_PATH){	// .part#+#.par3
+		printf("PAR filename will be too long.\n");
+		return RET_FILE_IO_ERROR;
+	}
+
+	if (par3_ctx->noise_level >= 1){
+		show_sizing_scheme(par3_ctx, file_count, base_num, max_count);
+	}
+
+	file_count = make_write_list(par3_ctx, write_list_p, name_buf_p, file_name, len, ".part", digit_num1, digit_num2,
+			file_count, block_count, 0, base_num, max_count);
+	if (file_count == 0){
+		perror("Failed to allocate memory for PAR filename");
+		return RET_MEMORY_ERROR;
+	}
+
+	*file_count_p = file_count;
+	return 0;
+}
+
+// Write Archive Files in the list by reading input blocks.
+// The list and filenames are released.
+static int write_archive_list(PAR3_CTX *par3_ctx, PAR3_WRITE_CTX *write_list, char *name_buf, uint32_t file_count)
+{
+	int worker_count;
+	uint32_t num;
+	size_t region_size;
+
+	// Allocate memory to read one input block and parity for each worker thread.
+	region_size = (par3_ctx->block_size + 4 + 3) & ~3;
+	worker_count = get_write_worker_count(par3_ctx, file_count, region_size);
+	par3_ctx->work_buf = malloc(region_size * worker_count);
+	if (par3_ctx->work_buf == NULL){
+		perror("Failed to allocate memory for input data");
+		free(write_list);
+		free(name_buf);
+		return RET_MEMORY_ERROR;
+	}
+	if ( (worker_count > 1) && (par3_ctx->noise_level >= 2) ){
+		printf("Number of worker threads to write PAR files = %d\n", worker_count);
+	}
+
+	// Write each PAR3 file.
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+#endif
+	for (int i = 0; i < (int)file_count; i++){
+		uint8_t *work_buf = par3_ctx->work_buf;
+#ifdef _OPENMP
+		work_buf += region_size * omp_get_thread_num();
+#endif
+		write_list[i].ret = write_data_packet(par3_ctx, write_list[i].name, write_list[i].start, write_list[i].count, work_buf);
+	}
+
+	// Show results in order of PAR files.
+	for (num = 0; num < file_count; num++){
+		if (write_list[num].ret != 0)
+			break;
+		if (par3_ctx->noise_level >= -1)
+			printf("Wrote archive file, %s\n", offset_file_name(write_list[num].name));
+	}
+	free(write_list);
+	free(name_buf);
 	free(par3_ctx->work_buf);
 	par3_ctx->work_buf = NULL;
+	if (num < file_count)
+		return RET_FILE_IO_ERROR;
 
 	return 0;
 }
 
+// Write PAR3 files with Data packets (input blocks)
+int write_archive_file(PAR3_CTX *par3_ctx, char *file_name)
+{
+	char *name_buf;
+	int ret;
+	uint32_t file_count;
+	PAR3_WRITE_CTX *write_list;
+
+	if (par3_ctx->block_count == 0)
+		return 0;
+
+	ret = make_archive_list(par3_ctx, file_name, &write_list, &name_buf, &file_count);
+	if (ret != 0)
+		return ret;
+
+	return write_archive_list(par3_ctx, write_list, name_buf, file_count);
+}
+
+// State of writing Archive Files, while input blocks are read to create recovery blocks.
+typedef struct {
+	PAR3_WRITE_CTX *write_list;
+	char *name_buf;
+	uint32_t file_count;
+	uint32_t file_index;	// Archive File to write next Data Packet
+	uint64_t block_next;	// Index of next input block
+	uint64_t num;			// Index of group of Data Packets in the file
+	size_t packet_count, packet_from, packet_offset;
+	int file_open;
+	PAR3_GATHER_CTX gather;
+} PAR3_STREAM_CTX;
+
+// Prepare to write Archive Files with input blocks, which are read to create recovery blocks.
+// Then, input blocks are given by write_archive_block() in order.
+int open_archive_stream(PAR3_CTX *par3_ctx, char *file_name)
+{
+	int ret;
+	PAR3_STREAM_CTX *stream_p;
+
+	if (par3_ctx->block_count == 0)
+		return 0;
+
+	stream_p = calloc(1, sizeof(PAR3_STREAM_CTX));
+	if (stream_p == NULL){
+		perror("Failed to allocate memory for Archive Files");
+		return RET_MEMORY_ERROR;
+	}
+	ret = make_archive_list(par3_ctx, file_name, &(stream_p->write_list), &(stream_p->name_buf), &(stream_p->file_count));
+	if (ret != 0){
+		free(stream_p);
+		return ret;
+	}
+	par3_ctx->archive_stream = stream_p;
+
+	return 0;
+}
+
+// Write Data Packet of the input block, which data is stored in "buf".
+int write_archive_block(PAR3_CTX *par3_ctx, uint64_t block_index, uint8_t *buf)
+{
+	int ret;
+	uint64_t block_max;
+	PAR3_WRITE_CTX *write_p;
+	PAR3_STREAM_CTX *stream_p;
+
+	stream_p = par3_ctx->archive_stream;
+	if ( (block_index != stream_p->block_next) || (stream_p->file_index >= stream_p->file_count) ){
+		printf("Input block[%"PRIu64"] is out of order for Archive File.\n", block_index);
+		return RET_LOGIC_ERROR;
+	}
+	write_p = stream_p->write_list + stream_p->file_index;
+
+	if (stream_p->file_open == 0){
+		ret = begin_data_file(par3_ctx, &(stream_p->gather), write_p->name, write_p->count, &(stream_p->packet_count));
+		if (ret != 0)
+			return ret;
+		stream_p->file_open = 1;
+		stream_p->num = write_p->start;
+		stream_p->packet_from = 0;
+		stream_p->packet_offset = 0;
+	}
+
+	ret = put_data_packet(par3_ctx, &(stream_p->gather), block_index, buf);
+	if (ret != 0)
+		return ret;
+	stream_p->block_next++;
+
+	// After the last block in the group, repeated common packets follow.
+	if (par3_ctx->interleave == 0){
+		block_max = stream_p->num + 1;
+	} else {	// Write multiple blocks at interleaving
+		block_max = (stream_p->num + 1) * (par3_ctx->interleave + 1);
+		if (block_max > par3_ctx->block_count)
+			block_max = par3_ctx->block_count;
+	}
+	if (stream_p->block_next < block_max)
+		return 0;
+	ret = put_common_packet(par3_ctx, &(stream_p->gather), stream_p->packet_count, write_p->count,
+			stream_p->num - write_p->start + 1, &(stream_p->packet_from), &(stream_p->packet_offset));
+	if (ret != 0)
+		return ret;
+	stream_p->num++;
+
+	// After the last group, close the file.
+	if (stream_p->num == write_p->start + write_p->count){
+		stream_p->file_open = 0;
+		ret = end_data_file(par3_ctx, &(stream_p->gather));
+		if (ret != 0)
+			return ret;
+		stream_p->file_index++;
+	}
+
+	return 0;
+}
+
+// Release state of writing Archive Files, when creation failed.
+void release_archive_stream(PAR3_CTX *par3_ctx)
+{
+	PAR3_STREAM_CTX *stream_p;
+
+	stream_p = par3_ctx->archive_stream;
+	if (stream_p == NULL)
+		return;
+
+	if (stream_p->file_open)
+		io_gather_close(&(stream_p->gather));
+	free(stream_p->write_list);
+	free(stream_p->name_buf);
+	free(stream_p);
+	par3_ctx->archive_stream = NULL;
+}
+
+// Finish writing Archive Files.
+// When input blocks were not given while creating recovery blocks, read them here.
+int close_archive_stream(PAR3_CTX *par3_ctx)
+{
+	char *name_buf;
+	uint32_t num;
+	PAR3_WRITE_CTX *write_list;
+	PAR3_STREAM_CTX *stream_p;
+
+	stream_p = par3_ctx->archive_stream;
+	if (stream_p == NULL)
+		return 0;
+
+	if (stream_p->block_next == 0){
+		write_list = stream_p->write_list;
+		name_buf = stream_p->name_buf;
+		num = stream_p->file_count;
+		par3_ctx->archive_stream = NULL;
+		free(stream_p);	// The list is released in write_archive_list().
+		return write_archive_list(par3_ctx, write_list, name_buf, num);
+	}
+
+	if ( (stream_p->file_open) || (stream_p->file_index < stream_p->file_count) ){
+		printf("Some input blocks were not written on Archive File.\n");
+		release_archive_stream(par3_ctx);
+		return RET_LOGIC_ERROR;
+	}
+
+	// Show results in order of PAR files.
+	if (par3_ctx->noise_level >= -1){
+		for (num = 0; num < stream_p->file_count; num++)
+			printf("Wrote archive file, %s\n", offset_file_name(stream_p->write_list[num].name));
+	}
+	release_archive_stream(par3_ctx);
+
+	return 0;
+}
 
 // Recovery Data packet with dummy recovery block
+// This may run on worker thread.
 static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t each_start, uint64_t each_count)
 {
 	uint8_t *buf_p, *common_packet, packet_header[88];
@@ -582,7 +931,7 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 	size_t packet_count, packet_to, packet_from;
 	size_t common_packet_size, packet_size, packet_offset;
 	PAR3_POS_CTX *position_list;
-	FILE *fp;
+	PAR3_GATHER_CTX gather;
 	blake3_hasher hasher;
 
 	block_size = par3_ctx->block_size;
@@ -614,8 +963,7 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 	packet_count *= par3_ctx->common_packet_count;
 	//printf("number of repeated packets = %zu\n", packet_count);
 
-	fp = fopen(file_name, "wb");
-	if (fp == NULL){
+	if (io_gather_open(&gather, file_name, par3_ctx->write_direct) != 0){
 		perror("Failed to open Recovery File");
 		return RET_FILE_IO_ERROR;
 	}
@@ -623,18 +971,18 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 	// Creator Packet
 	write_size = par3_ctx->creator_packet_size;
 	if (write_size > 0){
-		if (fwrite(par3_ctx->creator_packet, 1, write_size, fp) != write_size){
+		if (io_gather_add(&gather, par3_ctx->creator_packet, write_size) != 0){
 			perror("Failed to write Creator Packet on Recovery File");
-			fclose(fp);
+			io_gather_close(&gather);
 			return RET_FILE_IO_ERROR;
 		}
 	}
 
 	// First common packets
 	write_size = common_packet_size;
-	if (fwrite(common_packet, 1, write_size, fp) != write_size){
+	if (io_gather_add(&gather, common_packet, write_size) != 0){
 		perror("Failed to write first common packets on Recovery File");
-		fclose(fp);
+		io_gather_close(&gather);
 		return RET_FILE_IO_ERROR;
 	}
 
@@ -676,7 +1024,7 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 				}
 				if (ret != 0){
 					printf("Parity of recovery block[%"PRIu64"] is different.\n", block_index);
-					fclose(fp);
+					io_gather_close(&gather);
 					return RET_LOGIC_ERROR;
 				}
 
@@ -687,14 +1035,15 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 				blake3_hasher_finalize(&hasher, packet_header + 8, 16);
 
 				// Write packet header and recovery data on file.
-				if (fwrite(packet_header, 1, 88, fp) != 88){
+				// Recovery block is written from block_data directly.
+				if (io_gather_copy(&gather, packet_header, 88) != 0){
 					perror("Failed to write Recovery Data Packet on Recovery File");
-					fclose(fp);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
-				if (fwrite(buf_p, 1, block_size, fp) != block_size){
+				if (io_gather_add(&gather, buf_p, block_size) != 0){
 					perror("Failed to write Recovery Data Packet on Recovery File");
-					fclose(fp);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
 				buf_p += region_size;
@@ -702,35 +1051,20 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 			// When there isn't enough memory to keep all blocks, zero fill the block area.
 			} else {
 				// Save position of each recovery block for later wariting.
-				position_list[block_index - first_num].name = par3_ctx->par_file_name + par3_ctx->par_file_name_len - strlen(file_name) - 1;
-				position_list[block_index - first_num].offset = _ftelli64(fp);
-				if (position_list[block_index - first_num].offset < 0){
-					perror("Failed to get current position of Recovery File");
-					fclose(fp);
-					return RET_FILE_IO_ERROR;
-				}
+				position_list[block_index - first_num].name = file_name;	// It's in the list of PAR filename.
+				position_list[block_index - first_num].offset = gather.size;
 				//printf("block[%"PRIu64"] offset = %"PRId64", %s\n", block_index, position_list[block_index - first_num].offset, position_list[block_index - first_num].name);
 
-				// Calculate CRC of packet data to check error, because state of BLAKE3 hash is too large.
-				position_list[block_index - first_num].crc = crc64(packet_header + 24, 64, 0);
-
 				// Write packet header and dummy data on file.
-				if (fwrite(packet_header, 1, 88, fp) != 88){
+				if (io_gather_copy(&gather, packet_header, 88) != 0){
 					perror("Failed to write Recovery Data Packet on Recovery File");
-					fclose(fp);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
-				// Write zero bytes as dummy
-				if (block_size > 1){
-					if (_fseeki64(fp, block_size - 1, SEEK_CUR) != 0){
-						perror("Failed to seek Recovery File");
-						fclose(fp);
-						return RET_FILE_IO_ERROR;
-					}
-				}
-				if (fwrite(packet_header + 8, 1, 1, fp) != 1){	// Write the last 1 byte of zero.
+				// Leave zero bytes as dummy
+				if (io_gather_skip(&gather, block_size) != 0){
 					perror("Failed to write Recovery Data Packet on Recovery File");
-					fclose(fp);
+					io_gather_close(&gather);
 					return RET_FILE_IO_ERROR;
 				}
 			}
@@ -761,9 +1095,9 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 		// Write common packets
 		if (write_size > 0){
 			//printf("packet_offset = %zu, write_size = %zu, total = %zu\n", packet_offset, write_size, packet_offset + write_size);
-			if (fwrite(common_packet + packet_offset, 1, write_size, fp) != write_size){
+			if (io_gather_add(&gather, common_packet + packet_offset, write_size) != 0){
 				perror("Failed to write repeated common packet on Recovery File");
-				fclose(fp);
+				io_gather_close(&gather);
 				return RET_FILE_IO_ERROR;
 			}
 			// This offset doesn't exceed common_packet_size.
@@ -773,9 +1107,9 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 		}
 		if (write_size2 > 0){
 			//printf("write_size2 = %zu = packet_offset\n", write_size2);
-			if (fwrite(common_packet, 1, write_size2, fp) != write_size2){
+			if (io_gather_add(&gather, common_packet, write_size2) != 0){
 				perror("Failed to write repeated common packet on Recovery File");
-				fclose(fp);
+				io_gather_close(&gather);
 				return RET_FILE_IO_ERROR;
 			}
 			// Current offset is saved.
@@ -786,14 +1120,14 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 	// Comment Packet
 	write_size = par3_ctx->comment_packet_size;
 	if (write_size > 0){
-		if (fwrite(par3_ctx->comment_packet, 1, write_size, fp) != write_size){
+		if (io_gather_add(&gather, par3_ctx->comment_packet, write_size) != 0){
 			perror("Failed to write Comment Packet on Recovery File");
-			fclose(fp);
+			io_gather_close(&gather);
 			return RET_FILE_IO_ERROR;
 		}
 	}
 
-	if (fclose(fp) != 0){
+	if (io_gather_close(&gather) != 0){
 		perror("Failed to close Recovery File");
 		return RET_FILE_IO_ERROR;
 	}
@@ -804,19 +1138,16 @@ static int write_recovery_packet(PAR3_CTX *par3_ctx, char *file_name, uint64_t e
 // Write PAR3 files with Recovery Data packets (recovery blocks are not written yet)
 int write_recovery_file(PAR3_CTX *par3_ctx, char *file_name)
 {
-	int digit_num1, digit_num2;
-	uint32_t file_count;
-	int64_t recovery_file_scheme;
-	uint64_t block_count, base_num, first_num;
-	uint64_t each_start, each_count, max_count;
-	size_t len;
+	char *name_buf, *namez;
+	int digit_num1, digit_num2, worker_count;
+	uint32_t file_count, num;
+	uint64_t block_count, base_num, first_num, max_count;
+	size_t len, namez_off;
+	PAR3_WRITE_CTX *write_list;
 
 	block_count = par3_ctx->recovery_block_count;
 	if (block_count == 0)
 		return 0;
-	recovery_file_scheme = par3_ctx->recovery_file_scheme;
-	if (recovery_file_scheme == -2)
-		recovery_file_scheme = par3_ctx->max_file_size;
 	first_num = par3_ctx->first_recovery_block;
 
 	// Remove the last ".par3" from base PAR3 filename.
@@ -854,64 +1185,55 @@ int write_recovery_file(PAR3_CTX *par3_ctx, char *file_name)
 		show_sizing_scheme(par3_ctx, file_count, base_num, max_count);
 	}
 
-	// Write each PAR3 file.
-	each_start = first_num;
-	while (block_count > 0){
-		if (file_count > 0){
-			if (recovery_file_scheme == -1){	// Uniform
-				each_count = max_count;
-				if (base_num > 0){
-					base_num--;
-					if (base_num == 0)
-						max_count--;
-				}
-
-			} else {	// Variable (base number * power of 2)
-				each_count = base_num;
-				base_num *= 2;
-				if (each_count > block_count)
-					each_count = block_count;
-			}
-
-		} else {
-			if (recovery_file_scheme == -1){	// Uniform
-				each_count = block_count;
-
-			} else if (recovery_file_scheme > 0){	// Limit size
-				each_count = base_num;
-				if (each_count > max_count){
-					each_count = max_count;
-				} else {
-					base_num *= 2;
-				}
-				if (each_count > block_count)
-					each_count = block_count;
-
-			} else {	// Power of 2
-				each_count = base_num;
-				base_num *= 2;
-				if (each_count > block_count)
-					each_count = block_count;
-			}
-		}
+	file_count = make_write_list(par3_ctx, &write_list, &name_buf, file_name, len, ".vol", digit_num1, digit_num2,
+			file_count, block_count, first_num, base_num, max_count);
+	if (file_count == 0){
+		perror("Failed to allocate memory for PAR filename");
+		return RET_MEMORY_ERROR;
+	}
 
-		sprintf(file_name + len, ".vol%0*"PRIu64"+%0*"PRIu64".par3", digit_num1, each_start, digit_num2, each_count);
-		if ((par3_ctx->ecc_method & 0x8000) == 0){
-			// When recovery blocks were not created yet, keep list of PAR filename.
-			if ( namez_add(&(par3_ctx->par_file_name), &(par3_ctx->par_file_name_len), &(par3_ctx->par_file_name_max), file_name) != 0){
+	if ((par3_ctx->ecc_method & 0x8000) == 0){
+		// When recovery blocks were not created yet, keep list of PAR filename.
+		namez_off = par3_ctx->par_file_name_len;
+		for (num = 0; num < file_count; num++){
+			if ( namez_add(&(par3_ctx->par_file_name), &(par3_ctx->par_file_name_len), &(par3_ctx->par_file_name_max), write_list[num].name) != 0){
 				perror("Failed to allocate memory for PAR filename");
+				free(write_list);
+				free(name_buf);
 				return RET_MEMORY_ERROR;
 			}
 		}
-		if (write_recovery_packet(par3_ctx, file_name, each_start, each_count) != 0){
-			return RET_FILE_IO_ERROR;
+		// Position of each recovery block refers the filename in the list.
+		namez = par3_ctx->par_file_name;
+		for (num = 0; num < file_count; num++){
+			write_list[num].name = namez + namez_off;
+			namez_off += strlen(namez + namez_off) + 1;
 		}
-		if (par3_ctx->noise_level >= -1)
-			printf("Wrote recovery file, %s\n", offset_file_name(file_name));
+	}
 
-		each_start += each_count;
-		block_count -= each_count;
+	// Each worker thread writes its own PAR files.
+	worker_count = get_write_worker_count(par3_ctx, file_count, 0);
+	if ( (worker_count > 1) && (par3_ctx->noise_level >= 2) ){
+		printf("Number of worker threads to write PAR files = %d\n", worker_count);
+	}
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+#endif
+	for (int i = 0; i < (int)file_count; i++){
+		write_list[i].ret = write_recovery_packet(par3_ctx, write_list[i].name, write_list[i].start, write_list[i].count);
+	}
+
+	// Show results in order of PAR files.
+	for (num = 0; num < file_count; num++){
+		if (write_list[num].ret != 0)
+			break;
+		if (par3_ctx->noise_level >= -1)
+			printf("Wrote recovery file, %s\n", offset_file_name(write_list[num].name));
 	}
+	free(write_list);
+	free(name_buf);
+	if (num < file_count)
+		return RET_FILE_IO_ERROR;
 
 	return 0;
 }
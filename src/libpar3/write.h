@@ -16,6 +16,12 @@ int write_index_file(PAR3_CTX *par3_ctx);
 
 int write_archive_file(PAR3_CTX *par3_ctx, char *file_name);
 
+// Write Archive Files with input blocks, which are read to create recovery blocks
+int open_archive_stream(PAR3_CTX *par3_ctx, char *file_name);
+int write_archive_block(PAR3_CTX *par3_ctx, uint64_t block_index, uint8_t *buf);
+int close_archive_stream(PAR3_CTX *par3_ctx);
+void release_archive_stream(PAR3_CTX *par3_ctx);
+
 int write_recovery_file(PAR3_CTX *par3_ctx, char *file_name);
 
 
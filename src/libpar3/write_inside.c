@@ -141,9 +141,6 @@ int insert_space_zip(PAR3_CTX *par3_ctx, int footer_size, int repeat_count)
 			}
 			//printf("block[%"PRIu64"] offset = %"PRId64", %s\n", block_index, position_list[block_index].offset, position_list[block_index].name);
 
-			// Calculate CRC of packet data to check error, because state of BLAKE3 hash is too large.
-			position_list[block_index].crc = crc64(packet_header + 24, 64, 0);
-
 			// Write packet header and dummy data on file.
 			if (fwrite(packet_header, 1, 88, fp) != 88){
 				perror("Failed to write Recovery Data Packet on Outside file");
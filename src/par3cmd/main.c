@@ -58,10 +58,15 @@ static void print_help(void)
 "  -v [-v]  : Be more verbose\n"
 "  -q [-q]  : Be more quiet (-q -q gives silence)\n"
 "  -m<n>    : Memory to use\n"
+"  -T<n>    : Number of threads to use\n"
+"  -Q<n>    : Number of reads in flight (1 = no asynchronous read)\n"
 "  --       : Treat all following arguments as filenames\n"
 "  -abs     : Enable absolute path\n"
 "Options: (verify or repair)\n"
 "  -S<n>    : Searching time limit (milli second)\n"
+"  -P       : Repair damaged files in place (with undo journal)\n"
+"  -F       : Read repaired files again to verify them fully\n"
+"  -O<file> : Repair only the file (can be repeated)\n"
 "Options: (create)\n"
 "  -b<n>    : Set the Block-Count\n"
 "  -s<n>    : Set the Block-Size (don't use both -b and -s)\n"
@@ -75,6 +80,8 @@ static void print_help(void)
 "  -n<n>    : Number of recovery files (don't use both -n and -l)\n"
 "  -R       : Recurse into subdirectories\n"
 "  -D       : Store Data packets\n"
+"  -I       : Write packet index file (<base>.par3idx)\n"
+"  -W       : Write PAR files without page cache (direct I/O)\n"
 "  -d<n>    : Enable deduplication of input blocks\n"
 "  -e<n>    : Set using Error Correction Codes\n"
 "  -i<n>    : Number of interleaving\n"
@@ -82,6 +89,8 @@ static void print_help(void)
 "  -ff      : Use FAT Permissions Packet\n"
 "  -lp<n>   : Limit repetition of packets in each file\n"
 "  -C<text> : Set comment\n"
+"  -H<path> : Use hash cache of input files\n"
+"  -K<n>    : Spot-check n blocks of each cached file\n"
 	);
 }
 
@@ -285,6 +294,24 @@ int main(int argc, char *argv[])
 					}
 				}
 
+			} else if ( (tmp_p[0] == 'T') && (tmp_p[1] >= '0') && (tmp_p[1] <= '9') ){	// Set the number of threads
+				if (par3_ctx->thread_count > 0){
+					printf("Cannot specify number of threads twice.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->thread_count = strtoul(tmp_p + 1, NULL, 10);
+				}
+
+			} else if ( (tmp_p[0] == 'Q') && (tmp_p[1] >= '0') && (tmp_p[1] <= '9') ){	// Set the number of reads in flight
+				if (par3_ctx->io_depth > 0){
+					printf("Cannot specify queue depth twice.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->io_depth = strtoul(tmp_p + 1, NULL, 10);
+				}
+
 			} else if ( (tmp_p[0] == 'S') && (tmp_p[1] >= '0') && (tmp_p[1] <= '9') ){	// Set searching time limit
 				if ( (command_operation != 'v') && (command_operation != 'r') ){
 					printf("Cannot specify searching time limit unless reparing or verifying.\n");
@@ -298,6 +325,37 @@ int main(int argc, char *argv[])
 					par3_ctx->search_limit = strtoul(tmp_p + 1, NULL, 10);
 				}
 
+			} else if (strcmp(tmp_p, "P") == 0){	// Repair damaged files in place
+				if (command_operation != 'r'){
+					printf("Cannot specify in-place repair unless repairing.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->repair_inplace = 1;
+				}
+
+			} else if (strcmp(tmp_p, "F") == 0){	// Read repaired files again at verification
+				if (command_operation != 'r'){
+					printf("Cannot specify full re-read unless repairing.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->repair_reread = 1;
+				}
+
+			} else if ( (tmp_p[0] == 'O') && (tmp_p[1] != 0) ){	// Repair only selected files
+				if (command_operation != 'r'){
+					printf("Cannot specify files to repair unless repairing.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					path_copy(file_name, tmp_p + 1, _MAX_PATH - 32);
+					if ( namez_add(&(par3_ctx->only_file_name), &(par3_ctx->only_file_name_len), &(par3_ctx->only_file_name_max), file_name) != 0){
+						ret = RET_MEMORY_ERROR;
+						goto prepare_return;
+					}
+				}
+
 			} else if ( (tmp_p[0] == 'B') && (tmp_p[1] != 0) ){	// Set the base-path manually
 				if (command_operation == 'l'){
 					printf("Cannot specify base-path for listing.\n");
@@ -522,6 +580,24 @@ int main(int argc, char *argv[])
 					command_option = 'R';
 				}
 
+			} else if (strcmp(tmp_p, "I") == 0){	// Write packet index file
+				if (command_operation != 'c'){
+					printf("Cannot specify packet index unless creating.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->packet_index = 'I';
+				}
+
+			} else if (strcmp(tmp_p, "W") == 0){	// Write PAR files without page cache
+				if ( (command_operation != 'c') && (command_operation != 'e') ){
+					printf("Cannot specify direct write unless creating.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->write_direct = 'W';
+				}
+
 			} else if (strcmp(tmp_p, "D") == 0){	// Store Data packets
 				if ( (command_operation != 'c') && (command_operation != 'e') ){
 					printf("Cannot specify Data packet unless creating.\n");
@@ -649,6 +725,38 @@ int main(int argc, char *argv[])
 					goto prepare_return;
 				}
 
+			} else if ( (tmp_p[0] == 'K') && (tmp_p[1] >= '0') && (tmp_p[1] <= '9') ){	// Spot-check of hash cache
+				if (command_operation != 'c'){
+					printf("Cannot specify hash cache unless creating.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else if (par3_ctx->hash_cache_check > 0){
+					printf("Cannot specify spot-check of hash cache twice.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					par3_ctx->hash_cache_check = strtoul(tmp_p + 1, NULL, 10);
+				}
+
+			} else if ( (tmp_p[0] == 'H') && (tmp_p[1] != 0) ){	// Set hash cache file
+				if (command_operation != 'c'){
+					printf("Cannot specify hash cache unless creating.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else if (par3_ctx->hash_cache_path[0] != 0){
+					printf("Cannot specify hash cache twice.\n");
+					ret = RET_INVALID_COMMAND;
+					goto prepare_return;
+				} else {
+					// Because current directory may change to base-path, use absolute path.
+					path_copy(file_name, tmp_p + 1, _MAX_PATH - 32);
+					if ( (file_name[0] == 0) || (get_absolute_path(par3_ctx->hash_cache_path, file_name, _MAX_PATH - 8) != 0) ){
+						printf("Failed to convert hash cache to absolute path\n");
+						ret = RET_INVALID_COMMAND;
+						goto prepare_return;
+					}
+				}
+
 			} else if ( (strcmp(tmp_p, "abs") == 0) || (strcmp(tmp_p, "ABS") == 0) ){	// Enable absolute path
 				if (par3_ctx->absolute_path != 0){
 					printf("Cannot enable absolute path twice.\n");
@@ -794,8 +902,12 @@ int main(int argc, char *argv[])
 				printf("memory_limit = %"PRIu64" Bytes\n", par3_ctx->memory_limit);
 			}
 		}
+		if (par3_ctx->thread_count != 0)
+			printf("thread_count = %u\n", par3_ctx->thread_count);
+		if (par3_ctx->io_depth != 0)
+			printf("io_depth = %u\n", par3_ctx->io_depth);
 		if (par3_ctx->search_limit != 0)
-			printf("search_limit = %d ms\n", par3_ctx->search_limit);
+			printf("search_limit = %u ms\n", par3_ctx->search_limit);
 		if (par3_ctx->block_count != 0)
 			printf("Specified block count = %"PRIu64"\n", par3_ctx->block_count);
 		if (par3_ctx->block_size != 0)
@@ -838,10 +950,22 @@ int main(int argc, char *argv[])
 			printf("recursive search = enable\n");
 		if (par3_ctx->absolute_path != 0)
 			printf("Absolute path = enable\n");
+		if (par3_ctx->repair_inplace != 0)
+			printf("In-place repair = enable\n");
+		if (par3_ctx->repair_reread != 0)
+			printf("Full re-read after repair = enable\n");
 		if (par3_ctx->data_packet != 0)
 			printf("Data packet = store\n");
+		if (par3_ctx->packet_index != 0)
+			printf("Packet index = write\n");
+		if (par3_ctx->write_direct != 0)
+			printf("Direct write = enable\n");
 		if (par3_ctx->repetition_limit != 0)
 			printf("Max packet repetition = %u\n", par3_ctx->repetition_limit);
+		if (par3_ctx->hash_cache_path[0] != 0)
+			printf("Hash cache = \"%s\"\n", par3_ctx->hash_cache_path);
+		if (par3_ctx->hash_cache_check != 0)
+			printf("Spot-check of hash cache = %u blocks\n", par3_ctx->hash_cache_check);
 		if (par3_ctx->base_path[0] != 0)
 			printf("Base path = \"%s\"\n", par3_ctx->base_path);
 		printf("PAR file = \"%s\"\n", par3_ctx->par_filename);
@@ -0,0 +1,342 @@
+#include "../platform.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Asynchronous reads are implemented with io_uring, using raw system calls so
+that no extra library is required. When the kernel headers are too old, or
+when io_uring is not permitted at run time (e.g. disabled by sysctl or by a
+seccomp filter), async_read_init() fails and callers fall back to stdio. */
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING_H 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#endif
+
+#if defined(HAVE_IO_URING_H) && defined(__NR_io_uring_setup) \
+    && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+
+/* One read request. `iov` is kept here, because the kernel may access it
+until the request completes. */
+struct async_request {
+    int fd;
+    int64_t offset;
+    struct iovec iov;
+};
+
+struct async_read {
+    int ring_fd;
+    unsigned depth;       /* max number of requests in flight */
+    unsigned batch;       /* submit requests after queueing this many */
+    unsigned pending;     /* queued in submission ring, not submitted yet */
+    unsigned in_flight;   /* submitted, not completed yet */
+    int error;            /* errno of the first failed request */
+
+    char *fixed_buf;      /* registered buffer, or NULL */
+    size_t fixed_size;
+
+    struct async_request *request_list;
+    unsigned *free_list;  /* stack of unused request slots */
+    unsigned free_count;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Puts a request into the submission ring. There must be a free slot. */
+static void queue_request(struct async_read *ar, unsigned slot)
+{
+    struct async_request *req = ar->request_list + slot;
+    struct io_uring_sqe *sqe;
+    unsigned tail, index;
+    char *buf = req->iov.iov_base;
+
+    tail = *ar->sq_tail;
+    index = tail & *ar->sq_mask;
+    sqe = ar->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = req->fd;
+    sqe->off = (uint64_t)req->offset;
+    sqe->user_data = slot;
+    if (ar->fixed_buf != NULL && buf >= ar->fixed_buf
+            && buf + req->iov.iov_len <= ar->fixed_buf + ar->fixed_size) {
+        /* Registered buffer avoids mapping pages on every request. */
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = (uint32_t)req->iov.iov_len;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+        sqe->len = 1;
+    }
+    ar->sq_array[index] = index;
+    __atomic_store_n(ar->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ar->pending++;
+}
+
+/* Handles finished requests. A short read is queued again for the rest. */
+static void reap_completion(struct async_read *ar)
+{
+    unsigned head, tail, slot;
+    struct io_uring_cqe *cqe;
+    struct async_request *req;
+
+    head = *ar->cq_head;
+    tail = __atomic_load_n(ar->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        cqe = ar->cqes + (head & *ar->cq_mask);
+        slot = (unsigned)cqe->user_data;
+        req = ar->request_list + slot;
+        ar->in_flight--;
+        if (cqe->res < 0) {
+            if (ar->error == 0) ar->error = -cqe->res;
+            ar->free_list[ar->free_count++] = slot;
+        } else if ((size_t)cqe->res < req->iov.iov_len) {
+            if (cqe->res == 0) {  /* unexpected end of file */
+                if (ar->error == 0) ar->error = EIO;
+                ar->free_list[ar->free_count++] = slot;
+            } else {
+                req->offset += cqe->res;
+                req->iov.iov_base = (char *)req->iov.iov_base + cqe->res;
+                req->iov.iov_len -= cqe->res;
+                queue_request(ar, slot);
+            }
+        } else {
+            ar->free_list[ar->free_count++] = slot;
+        }
+        head++;
+    }
+    __atomic_store_n(ar->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Submits queued requests, and waits until `min_complete` requests finish. */
+static int submit_and_wait(struct async_read *ar, unsigned min_complete)
+{
+    int ret;
+
+    for (;;) {
+        ret = sys_io_uring_enter(ar->ring_fd, ar->pending, min_complete,
+                min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (ar->error == 0) ar->error = errno;
+            return -1;
+        }
+        ar->pending -= (unsigned)ret;
+        ar->in_flight += (unsigned)ret;
+        reap_completion(ar);
+        if (ar->pending == 0) return 0;
+        min_complete = 0;  /* some requests were completed already */
+    }
+}
+
+struct async_read *async_read_init(unsigned queue_depth, void *buf, size_t buf_size)
+{
+    struct io_uring_params p;
+    struct async_read *ar;
+    unsigned i;
+    char *ptr;
+
+    if (queue_depth < 2) return NULL;
+    if (queue_depth > 4096) queue_depth = 4096;
+
+    ar = calloc(1, sizeof(struct async_read));
+    if (ar == NULL) return NULL;
+
+    memset(&p, 0, sizeof(p));
+    ar->ring_fd = (int)syscall(__NR_io_uring_setup, queue_depth, &p);
+    if (ar->ring_fd < 0) {
+        free(ar);
+        return NULL;
+    }
+    ar->depth = p.sq_entries;  /* may be rounded up to power of 2 */
+    if (ar->depth > queue_depth) ar->depth = queue_depth;
+    ar->batch = ar->depth / 4;
+    if (ar->batch == 0) ar->batch = 1;
+
+    ar->request_list = malloc(sizeof(struct async_request) * ar->depth);
+    ar->free_list = malloc(sizeof(unsigned) * ar->depth);
+    if (ar->request_list == NULL || ar->free_list == NULL) goto fail;
+    for (i = 0; i < ar->depth; i++) ar->free_list[i] = ar->depth - 1 - i;
+    ar->free_count = ar->depth;
+
+    /* Map submission ring, completion ring and submission entries. */
+    ar->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ar->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ar->cq_ring_size > ar->sq_ring_size) ar->sq_ring_size = ar->cq_ring_size;
+        ar->cq_ring_size = 0;
+    }
+    ar->sq_ring = mmap(NULL, ar->sq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ar->ring_fd, IORING_OFF_SQ_RING);
+    if (ar->sq_ring == MAP_FAILED) {
+        ar->sq_ring = NULL;
+        goto fail;
+    }
+    if (ar->cq_ring_size == 0) {
+        ar->cq_ring = ar->sq_ring;
+    } else {
+        ar->cq_ring = mmap(NULL, ar->cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ar->ring_fd, IORING_OFF_CQ_RING);
+        if (ar->cq_ring == MAP_FAILED) {
+            ar->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    ar->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ar->sqes = mmap(NULL, ar->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ar->ring_fd, IORING_OFF_SQES);
+    if (ar->sqes == MAP_FAILED) {
+        ar->sqes = NULL;
+        goto fail;
+    }
+
+    ptr = ar->sq_ring;
+    ar->sq_head = (unsigned *)(ptr + p.sq_off.head);
+    ar->sq_tail = (unsigned *)(ptr + p.sq_off.tail);
+    ar->sq_mask = (unsigned *)(ptr + p.sq_off.ring_mask);
+    ar->sq_array = (unsigned *)(ptr + p.sq_off.array);
+    ptr = ar->cq_ring;
+    ar->cq_head = (unsigned *)(ptr + p.cq_off.head);
+    ar->cq_tail = (unsigned *)(ptr + p.cq_off.tail);
+    ar->cq_mask = (unsigned *)(ptr + p.cq_off.ring_mask);
+    ar->cqes = (struct io_uring_cqe *)(ptr + p.cq_off.cqes);
+
+    /* Registering the buffer may fail by the limit of locked memory.
+       Then, requests use normal buffers. */
+    if (buf != NULL && buf_size > 0) {
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = buf_size;
+        if (syscall(__NR_io_uring_register, ar->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0) {
+            ar->fixed_buf = buf;
+            ar->fixed_size = buf_size;
+        }
+    }
+
+    return ar;
+
+fail:
+    async_read_close(ar);
+    return NULL;
+}
+
+int async_read_submit(struct async_read *ar, int fd, int64_t offset, void *buf, size_t size)
+{
+    unsigned slot;
+    struct async_request *req;
+
+    if (size == 0) return 0;
+
+    /* Wait for a free slot, when queue is full. */
+    while (ar->free_count == 0) {
+        if (submit_and_wait(ar, 1) != 0) return -1;
+    }
+
+    slot = ar->free_list[--ar->free_count];
+    req = ar->request_list + slot;
+    req->fd = fd;
+    req->offset = offset;
+    req->iov.iov_base = buf;
+    req->iov.iov_len = size;
+    queue_request(ar, slot);
+
+    if (ar->pending >= ar->batch) {
+        if (submit_and_wait(ar, 0) != 0) return -1;
+    }
+
+    return ar->error == 0 ? 0 : -1;
+}
+
+int async_read_wait(struct async_read *ar)
+{
+    int error;
+
+    while (ar->pending > 0 || ar->in_flight > 0) {
+        if (submit_and_wait(ar, ar->in_flight > 0 ? 1 : 0) != 0) break;
+    }
+
+    error = ar->error;
+    ar->error = 0;
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void async_read_close(struct async_read *ar)
+{
+    if (ar == NULL) return;
+
+    if (ar->sq_ring != NULL && (ar->pending > 0 || ar->in_flight > 0))
+        async_read_wait(ar);
+    if (ar->fixed_buf != NULL)
+        syscall(__NR_io_uring_register, ar->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    if (ar->sqes != NULL) munmap(ar->sqes, ar->sqes_size);
+    if (ar->cq_ring != NULL && ar->cq_ring != ar->sq_ring) munmap(ar->cq_ring, ar->cq_ring_size);
+    if (ar->sq_ring != NULL) munmap(ar->sq_ring, ar->sq_ring_size);
+    close(ar->ring_fd);
+    free(ar->request_list);
+    free(ar->free_list);
+    free(ar);
+}
+
+#else  /* io_uring is not available */
+
+struct async_read *async_read_init(unsigned queue_depth, void *buf, size_t buf_size)
+{
+    (void)queue_depth;
+    (void)buf;
+    (void)buf_size;
+    return NULL;
+}
+
+int async_read_submit(struct async_read *ar, int fd, int64_t offset, void *buf, size_t size)
+{
+    (void)ar;
+    (void)fd;
+    (void)offset;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+int async_read_wait(struct async_read *ar)
+{
+    (void)ar;
+    return -1;
+}
+
+void async_read_close(struct async_read *ar)
+{
+    (void)ar;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "../platform.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/fs.h>)
+#include <linux/fs.h>  /* FICLONERANGE */
+#endif
+#endif
+
+/* The largest size for one copy_file_range() call. */
+#define COPY_CHUNK_SIZE (1 << 30)
+
+int file_copy_range(int src_fd, int64_t src_offset, int dst_fd, int64_t dst_offset, uint64_t size)
+{
+    if (size == 0) return 0;
+
+#ifdef FICLONERANGE
+    {
+        /* Sharing extents works on XFS and Btrfs. It fails when offsets or
+           size are not aligned to the filesystem block, or when the files
+           are on different filesystems. Then, try to copy data next. */
+        struct file_clone_range range;
+        range.src_fd = src_fd;
+        range.src_offset = (uint64_t)src_offset;
+        range.src_length = size;
+        range.dest_offset = (uint64_t)dst_offset;
+        if (ioctl(dst_fd, FICLONERANGE, &range) == 0) return 0;
+    }
+#endif
+
+#ifdef __NR_copy_file_range
+    {
+        /* Raw system call is used, because old C libraries don't have
+           the wrapper function. */
+        loff_t in_offset = src_offset, out_offset = dst_offset;
+        long ret;
+        size_t len;
+
+        while (size > 0) {
+            len = size > COPY_CHUNK_SIZE ? COPY_CHUNK_SIZE : (size_t)size;
+            ret = syscall(__NR_copy_file_range, src_fd, &in_offset, dst_fd, &out_offset, len, 0);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (ret == 0) return -1;  /* unexpected end of source file */
+            size -= (uint64_t)ret;
+        }
+        return 0;
+    }
+#else
+    (void)src_fd;
+    (void)src_offset;
+    (void)dst_fd;
+    (void)dst_offset;
+    return -1;
+#endif
+}
@@ -0,0 +1,48 @@
+#include "../platform.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* The mapping starts at the page boundary before `offset`, so the returned
+address keeps the alignment of `offset` within a page. */
+
+static size_t page_size(void)
+{
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+}
+
+void *file_map(int fd, int64_t offset, size_t size)
+{
+    struct stat st;
+    size_t delta;
+    char *base;
+
+    if (size == 0 || offset < 0) return NULL;
+
+    /* Touching pages beyond the end of file would raise SIGBUS. */
+    if (fstat(fd, &st) != 0) return NULL;
+    if (offset > st.st_size || size > (uint64_t)(st.st_size - offset)) return NULL;
+
+    delta = (size_t)(offset & (int64_t)(page_size() - 1));
+    /* MAP_POPULATE isn't used, because it would copy every page of a
+       writable private mapping. Pages are shared with the page cache until
+       they are modified. */
+    base = mmap(NULL, size + delta, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, (off_t)(offset - (int64_t)delta));
+    if (base == MAP_FAILED) return NULL;
+    madvise(base, size + delta, MADV_WILLNEED);
+
+    return base + delta;
+}
+
+void file_unmap(void *addr, size_t size)
+{
+    size_t delta;
+
+    if (addr == NULL) return;
+    delta = (size_t)((uintptr_t)addr & (page_size() - 1));
+    munmap((char *)addr - delta, size + delta);
+}
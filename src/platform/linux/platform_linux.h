@@ -36,6 +36,7 @@ These must be defined before any header files are included! */
 #define _chdir      chdir
 #define _chmod      chmod
 #define _chsize_s   ftruncate
+#define _commit     fsync
 #define _ctime64    ctime
 #define _fileno     fileno
 #define _ftelli64   ftello
@@ -49,6 +50,10 @@ These must be defined before any header files are included! */
 #define __time64_t time_t
 #endif
 
+/* Sub-second part of file times in struct stat. */
+#define ST_MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#define ST_CTIME_NSEC(st) ((st)->st_ctim.tv_nsec)
+
 #define _mkdir(dirname) mkdir(dirname, S_IRUSR | S_IWUSR | S_IXUSR)
 
 /* Definitions related to _findfirst64(), _findnext64() and _findclose() follow.
@@ -0,0 +1,81 @@
+#include "../platform.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* O_DIRECT is defined only with _GNU_SOURCE, but glibc provides the value. */
+#if !defined(O_DIRECT) && defined(__O_DIRECT)
+#define O_DIRECT __O_DIRECT
+#endif
+
+/* The most buffers for one pwritev() call (IOV_MAX is at least 1024). */
+#define VECTOR_CHUNK 64
+
+int file_open_write(const char *path, int *direct)
+{
+    int fd;
+
+#ifdef O_DIRECT
+    if (*direct) {
+        /* Some file systems (e.g. tmpfs) refuse O_DIRECT with EINVAL. */
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+        if (fd >= 0) return fd;
+        if (errno != EINVAL) return -1;
+    }
+#endif
+
+    *direct = 0;
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+int file_write_vector(int fd, int64_t offset, const struct file_vec *vec, int count)
+{
+    struct iovec iov[VECTOR_CHUNK];
+    size_t done = 0;  /* bytes of vec[0] written already */
+    ssize_t ret;
+    int i, n;
+
+    for (;;) {
+        /* Skip buffers that were written completely. */
+        while (count > 0 && done >= vec[0].size) {
+            done -= vec[0].size;
+            vec++;
+            count--;
+        }
+        if (count <= 0) return 0;
+
+        n = count > VECTOR_CHUNK ? VECTOR_CHUNK : count;
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = (void *)vec[i].buf;
+            iov[i].iov_len = vec[i].size;
+        }
+        iov[0].iov_base = (char *)iov[0].iov_base + done;
+        iov[0].iov_len -= done;
+
+        ret = pwritev(fd, iov, n, (off_t)offset);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (ret == 0) {
+            errno = EIO;
+            return -1;
+        }
+        offset += ret;
+        done += (size_t)ret;
+    }
+}
+
+int file_close_write(int fd, int64_t size)
+{
+    int ret = 0;
+
+    if (ftruncate(fd, (off_t)size) != 0) ret = -1;
+    if (close(fd) != 0) ret = -1;
+    return ret;
+}
@@ -34,6 +34,71 @@ On failure, including when the result does not fit in `absolute_path`,
 a nonzero value is returned instead. */
 int get_absolute_path(char *absolute_path, const char *relative_path, size_t max);
 
+/* Batched asynchronous reads of file data.
+
+async_read_init() prepares up to `queue_depth` reads in flight. When `buf` is
+not NULL, the memory from `buf` to `buf + buf_size` may be registered to the
+kernel, so that reads into that region are faster. It returns NULL when
+asynchronous reads are not supported; then, callers should read by stdio.
+
+async_read_submit() queues a read of `size` bytes at `offset` in the file `fd`.
+The buffer must not be used and the file must not be closed, until
+async_read_wait() returns. It returns nonzero when a previous read failed.
+
+async_read_wait() waits for all queued reads, and returns nonzero (with errno
+set) when any of them failed. async_read_close() releases the resources. */
+struct async_read;
+struct async_read *async_read_init(unsigned queue_depth, void *buf, size_t buf_size);
+int async_read_submit(struct async_read *ar, int fd, int64_t offset, void *buf, size_t size);
+int async_read_wait(struct async_read *ar);
+void async_read_close(struct async_read *ar);
+
+/* Copies `size` bytes at `src_offset` in the file `src_fd` to `dst_offset` in
+the file `dst_fd`, without moving the data through user space. When the file
+system supports it, the copy shares extents with the source (reflink).
+
+Returns 0 on success. Returns nonzero when the range cannot be copied this way;
+then, callers should copy the data by stdio. Part of the range may have been
+written already in that case. Because the descriptors are used directly,
+callers must flush stdio buffers of `dst_fd` before calling. */
+int file_copy_range(int src_fd, int64_t src_offset, int dst_fd, int64_t dst_offset, uint64_t size);
+
+/* Maps `size` bytes at `offset` in the file `fd` into memory, so that file data
+is used from the page cache without copying it.
+
+The view is private: it may be modified, but changes are never written to the
+file. The whole range must be inside the file. Returns the address of the byte
+at `offset`, or NULL when the range cannot be mapped; then, callers should
+read the data by stdio. The view stays valid after the file is closed, until
+file_unmap() is called with the same address and size. */
+void *file_map(int fd, int64_t offset, size_t size);
+void file_unmap(void *addr, size_t size);
+
+/* Writes of file data gathered from multiple buffers.
+
+file_open_write() creates the file `path`, or truncates an existing one, for
+writing. It returns the file descriptor, or -1 (with errno set) on failure.
+When `*direct` is nonzero, it tries to write data without the page cache;
+then, the address and size of each buffer and the file offset of each write
+must be multiples of FILE_DIRECT_ALIGN. When the file system doesn't support
+it, the file is opened for normal writes, and `*direct` is set to 0.
+
+file_write_vector() writes `count` buffers in `vec` in order, starting at
+`offset` in the file `fd`. Returns 0 on success, or nonzero (with errno set)
+when the data cannot be written completely.
+
+file_close_write() sets the file length to `size` and closes the file. Bytes
+that were not written are read as zero. Returns nonzero (with errno set) on
+failure; the file is closed in either case. */
+#define FILE_DIRECT_ALIGN 4096
+struct file_vec {
+    const void *buf;
+    size_t size;
+};
+int file_open_write(const char *path, int *direct);
+int file_write_vector(int fd, int64_t offset, const struct file_vec *vec, int count);
+int file_close_write(int fd, int64_t size);
+
 #ifndef _WIN32  /* avoid conflicting definitions */
 
 /* Returns the length of a file identified by an open file descriptor. */
@@ -0,0 +1,38 @@
+#include "platform_windows.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../platform.h"
+
+// Asynchronous reads are not implemented on Windows yet.
+// Callers read files by stdio, when async_read_init() returns NULL.
+
+struct async_read *async_read_init(unsigned queue_depth, void *buf, size_t buf_size)
+{
+	(void)queue_depth;
+	(void)buf;
+	(void)buf_size;
+	return NULL;
+}
+
+int async_read_submit(struct async_read *ar, int fd, int64_t offset, void *buf, size_t size)
+{
+	(void)ar;
+	(void)fd;
+	(void)offset;
+	(void)buf;
+	(void)size;
+	return -1;
+}
+
+int async_read_wait(struct async_read *ar)
+{
+	(void)ar;
+	return -1;
+}
+
+void async_read_close(struct async_read *ar)
+{
+	(void)ar;
+}
@@ -0,0 +1,18 @@
+#include "platform_windows.h"
+
+#include <stdint.h>
+
+#include "../platform.h"
+
+// Copying file data inside the file system is not implemented on Windows yet.
+// Callers copy data by stdio, when file_copy_range() fails.
+
+int file_copy_range(int src_fd, int64_t src_offset, int dst_fd, int64_t dst_offset, uint64_t size)
+{
+	(void)src_fd;
+	(void)src_offset;
+	(void)dst_fd;
+	(void)dst_offset;
+	(void)size;
+	return -1;
+}
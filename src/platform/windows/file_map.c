@@ -0,0 +1,23 @@
+#include "platform_windows.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../platform.h"
+
+// Mapping file data is not implemented on Windows yet.
+// Callers read data by stdio, when file_map() returns NULL.
+
+void *file_map(int fd, int64_t offset, size_t size)
+{
+	(void)fd;
+	(void)offset;
+	(void)size;
+	return NULL;
+}
+
+void file_unmap(void *addr, size_t size)
+{
+	(void)addr;
+	(void)size;
+}
@@ -21,3 +21,7 @@ Do not include this file directly. Include "platform.h" instead. */
 // _S_IFREG = 0x8000
 #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
 #endif
+
+// struct _stat64 doesn't have sub-second part of file times.
+#define ST_MTIME_NSEC(st) 0
+#define ST_CTIME_NSEC(st) 0
@@ -0,0 +1,79 @@
+#include "platform_windows.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <windows.h>
+
+#include "../platform.h"
+
+// Each buffer is written by _write() after seeking to the offset.
+// Writes without the page cache use FILE_FLAG_NO_BUFFERING.
+// Because the file is binary mode, _write() passes the aligned buffer to WriteFile() as is.
+
+// The largest size for one _write() call.
+#define WRITE_CHUNK_SIZE (1 << 30)
+
+int file_open_write(const char *path, int *direct)
+{
+	HANDLE handle;
+	int fd;
+
+	if (*direct){
+		handle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL);
+		if (handle != INVALID_HANDLE_VALUE){
+			fd = _open_osfhandle((intptr_t)handle, _O_WRONLY | _O_BINARY);
+			if (fd >= 0)
+				return fd;
+			CloseHandle(handle);
+		}
+		// When it fails, the file is opened for normal writes.
+	}
+
+	*direct = 0;
+	return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+
+int file_write_vector(int fd, int64_t offset, const struct file_vec *vec, int count)
+{
+	const char *buf;
+	size_t size;
+	unsigned int len;
+	int ret;
+
+	if (_lseeki64(fd, offset, SEEK_SET) != offset)
+		return -1;
+
+	while (count > 0){
+		buf = vec->buf;
+		size = vec->size;
+		while (size > 0){
+			len = size > WRITE_CHUNK_SIZE ? WRITE_CHUNK_SIZE : (unsigned int)size;
+			ret = _write(fd, buf, len);
+			if (ret <= 0){
+				if (ret == 0)
+					errno = EIO;
+				return -1;
+			}
+			buf += ret;
+			size -= ret;
+		}
+		vec++;
+		count--;
+	}
+
+	return 0;
+}
+
+int file_close_write(int fd, int64_t size)
+{
+	int ret = 0;
+
+	if (_chsize_s(fd, size) != 0)
+		ret = -1;
+	if (_close(fd) != 0)
+		ret = -1;
+	return ret;
+}